@@ -1,5 +1,7 @@
 #version 420 core
 
+// SHADOWS defined for the variant writing depth for shadows
+
 in vec3 fragmentColor;
 in vec3 pointPos;
 in float zdepth;
@@ -15,7 +17,6 @@ layout (depth_greater) out float gl_FragDepth;
 
 uniform vec3 eyepos;
 uniform vec3 viewdir;
-uniform bool shadows;
 
 void main()
 {
@@ -33,17 +34,17 @@ void main()
   color = vec4(fragmentColor, alpha);
 
 
-  if (shadows)
-    gl_FragDepth = zdepth - zdepthR*dc;
-  else
-    gl_FragDepth = zdepth;
+#ifdef SHADOWS
+  gl_FragDepth = zdepth - zdepthR*dc;
+#else
+  gl_FragDepth = zdepth;
+#endif
 
 
 //  color = vec4(fragmentColor, 1);
 
-  if (shadows)
-    {
-      float d = dot((pointPos-eyepos), viewdir);
-      depth = vec3(d,zdepthR,gl_FragDepth);
-    }
+#ifdef SHADOWS
+  float d = dot((pointPos-eyepos), viewdir);
+  depth = vec3(d,zdepthR,gl_FragDepth);
+#endif
 }
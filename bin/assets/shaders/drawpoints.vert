@@ -1,7 +1,21 @@
 #version 420 core
 
+// variants are compiled with these defined as needed
+// ADAPTIVE_POINTSIZE : point size from octree level
+// APPLY_XFORM : transform points during manual registration
+// STEREO : both eyes in one pass, the instance picks the eye layer
+// POSITION_ONLY : no colour or tile per vertex, coloured by height,
+//                 only with fixed point size and no transform
+
+#ifdef STEREO
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
+#endif
+
 layout(location = 0) in vec3 vertexPosition;
+#ifndef POSITION_ONLY
 layout(location = 1) in vec4 vertexColor;
+#endif
 
 // Output data will be interpolated for each fragment.
 out vec3 fragmentColor;
@@ -9,8 +23,19 @@ out vec3 pointPos;
 out float zdepth;    
 out float zdepthR;    
 
+#ifdef STEREO
+// instance 0 draws the left eye, 1 the right eye
+layout(std140, binding = 1) uniform StereoEyes
+{
+  mat4 eyeMV[2];
+  mat4 eyeMVP[2];
+};
+#define MV eyeMV[gl_InstanceID]
+#define MVP eyeMVP[gl_InstanceID]
+#else
 uniform mat4 MV;
 uniform mat4 MVP;
+#endif
 
 uniform float pointSize;
 
@@ -18,6 +43,11 @@ uniform float scaleFactor;
 
 uniform sampler1D colorTex;
 
+#ifdef POSITION_ONLY
+uniform vec3 coordMin;
+uniform vec3 coordMax;
+#endif
+
 uniform vec3 eyepos;
 uniform vec3 viewDir;
 uniform int screenWidth;
@@ -25,9 +55,7 @@ uniform int screenWidth;
 uniform float projFactor;
 
 uniform sampler2DRect ommTex;
-uniform sampler2DRect visTex;
-
-uniform bool pointType;
+uniform usampler2DRect visTex;
 
 uniform float zFar;
 
@@ -37,81 +65,24 @@ uniform float maxPointSize;
 uniform float deadRadius;
 uniform vec3 deadPoint;
 
-uniform bool applyXform;
 uniform int xformTileId;
 uniform vec3 xformShift;
 uniform vec3 xformCen;
 uniform float xformScale;
 uniform vec4 xformRot;
 
-//-----------------------
-float numberOfOnes(float number, float index)
-{
-   float tmp = mod(number, pow(2.0, index + 1.0));
-   float numOnes = 0.0;
-   for (float i = 0.0; i < 8.0; i++)
-   {;
-      if (mod(tmp, 2.0) != 0.0)
-         numOnes++;
-      tmp = floor(tmp / 2.0);
-    };
-    return numOnes;
-};
-//-----------------------
+// octree walk starts at the node being drawn,
+// xyz node corner as fraction of tile box, w node level
+uniform vec4 nodeStart;
+uniform float nodeOffset; // texel of the node in visTex
 
 //-----------------------
-bool isBitSet(float number, float index)
-{
-  return mod(floor(number / pow(2.0, index)), 2.0) != 0.0;
-}
-//-----------------------
-
-//-----------------------
-float getLOD(float tile, vec3 omin, vec3 omax, vec3 opos)
-{
-
-  if (any(lessThan(opos, omin)) || any(greaterThan(opos, omax)))
-    return 10.0;
-
-  float depth = 0.0;
-  vec3 osize = omax-omin;
-  vec3 pos = opos-omin;
-  vec3 offset = vec3(0.0);
-  float ioffset = 0.0;
-
-  vec4 valueTop = texture2DRect(visTex, vec2(ioffset,tile)).rgba;
-
-  for(int i=0; i<20; i++) // assuming we do not have more than 20 levels
-  {
-    vec3 nsal = osize/pow(2.0, float(i)); // node size at this octree level
-    vec3 idx3d = (pos-offset)/nsal;       // which of the 8 octree node children
-
-//  if (any(lessThan(idx3d, vec3(0.0)) ||
-//                   greaterThan(idx3d, vec3(1.0))))
-//    return 10.0;    
-//  idx3d = clamp(idx3d, vec3(0.0), vec3(1.0));
-
-    idx3d = floor(idx3d+vec3(0.5));      // does the point lie in
-    float index = 4.0*idx3d.x + 2.0*idx3d.y + idx3d.z; // node position
-    vec4 value = texture2DRect(visTex, vec2(ioffset,tile)).rgba;
-    float mask = value.r*255.0;  // get visible child nodes
-    if (isBitSet(mask,index)) // visible node at this position
-    {
-      ioffset = ioffset + value.g * 255.0 + numberOfOnes(mask, index-1.0);
-      depth ++;
-    }
-    else // no mode visible child nodes at this position
-    {
-      if (value.a > 0.0)
-        depth = max(depth, value.b*255.0);
-      return depth;
-    }
-
-    offset = offset + (nsal*0.5) * idx3d;
-  }
-
- return depth;
-}
+// getLOD(tile, omin, omax, opos, start, startOffset) is spliced
+// in at the marker below from ShaderFactory::getLODShaderString
+// visTex is GL_RGBA8UI, texel per visible node holds
+// r : visible children mask, g : jump to first child,
+// b : max visible level, a : leaf bit and fill fraction
+//#getLOD
 //-----------------------
 
 vec3
@@ -129,7 +100,8 @@ void main()
 
    //----------------------------------
    // transform point during manual registration
-   if (applyXform && vertexColor.a >= xformTileId)
+#ifdef APPLY_XFORM
+   if (vertexColor.a >= xformTileId)
      {
        pointPos -= xformCen;
 
@@ -143,6 +115,7 @@ void main()
        //translate
        pointPos += xformShift;
      }
+#endif
    //----------------------------------
 
 
@@ -163,6 +136,9 @@ void main()
    //----------------------------------
 
    gl_Position =  MVP * vec4(pointPos,1);
+#ifdef STEREO
+   gl_Layer = gl_InstanceID;
+#endif
 
    zdepth = ((gl_DepthRange.diff * gl_Position.z/gl_Position.w) +
               gl_DepthRange.near + gl_DepthRange.far) / 2.0;
@@ -181,7 +157,7 @@ void main()
   //----------------------------------
    gl_PointSize = 1.0;
 
-   if (pointType) // adaptive pointsize
+#ifdef ADAPTIVE_POINTSIZE
      {
        float tile = vertexColor.a;
        vec4 omins = texture2DRect(ommTex, vec2(0.0,tile));
@@ -190,7 +166,8 @@ void main()
        vec3 omin = omins.rgb;
        vec3 omax = omaxs.rgb;
        
-       float lod = getLOD(tile, omin, omax, pointPos);
+       float lod = getLOD(int(tile), omin, omax, pointPos,
+			  nodeStart, int(nodeOffset));
        
        float r = spacing * scaleFactor;
        
@@ -214,10 +191,11 @@ void main()
        
        // -----------------------------------
      }
-   else // fixed pointsize
+#else // fixed pointsize
      {
       gl_PointSize = pointSize * scaleFactor;
      }
+#endif
 
 
    //----------------------------------
@@ -226,6 +204,13 @@ void main()
 
 
    //----------------------------------
+#ifdef POSITION_ONLY
+   float z = (vertexPosition.z-coordMin.z)/(coordMax.z-coordMin.z);
+   z = 0.5+sign(z-0.5)*sqrt(abs(z-0.5));
+   z = clamp(z, 0.0, 1.0);
+   fragmentColor = texture(colorTex, z).rgb;
+#else
    fragmentColor = vertexColor.rgb/vec3(255.0,255.0,255.0);
+#endif
    //----------------------------------
 }
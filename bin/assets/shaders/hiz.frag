@@ -0,0 +1,48 @@
+#version 420 core
+
+// Max depth pyramid for occlusion culling of octree nodes.
+// FIRST defined for the pass reading the points depth texture,
+// where texels without points are set far so they never occlude,
+// STEREO for reading its left eye layer.
+// Each pass halves the previous level keeping the farthest depth.
+
+// Ouput data
+layout(location=0) out float maxDepth;
+
+uniform ivec2 srcSize;
+
+#if defined(FIRST) && defined(STEREO)
+uniform sampler2DArray depthTex;
+
+float fetch(ivec2 p)
+{
+  return texelFetch(depthTex, ivec3(p, 0), 0).x;
+}
+#else
+uniform sampler2DRect depthTex;
+
+float fetch(ivec2 p)
+{
+  return texelFetch(depthTex, p).x;
+}
+#endif
+
+void main()
+{
+  ivec2 base = 2*ivec2(gl_FragCoord.xy);
+
+  maxDepth = 0.0;
+  for(int j=0; j<2; j++)
+    for(int i=0; i<2; i++)
+      {
+	ivec2 p = base + ivec2(i,j);
+	if (p.x < srcSize.x && p.y < srcSize.y)
+	  {
+	    float d = fetch(p);
+#ifdef FIRST
+	    if (d < 0.001) d = 1e30;
+#endif
+	    maxDepth = max(maxDepth, d);
+	  }
+      }
+}
@@ -0,0 +1,46 @@
+#version 410 core
+
+#ifdef BOX
+uniform sampler2D diffuse;
+uniform vec3 viewDir;
+in vec2 v2TexCoord;
+in vec3 v3Normal;
+in vec3 v3Color;
+#else
+uniform sampler2DArray diffuse;
+in vec3 v3TexCoord;
+in vec4 v4Scale;
+in vec3 v3MixColor;
+in float mixAmount;
+#endif
+
+out vec4 outputColor;
+
+void main()
+{
+#ifdef BOX
+  outputColor = texture(diffuse, v2TexCoord);
+
+  if (outputColor.a < 0.001)
+    discard;
+
+  if (length(v3Color) > 0)
+    outputColor.rgb = mix(outputColor.rgb,
+			  v3Color*outputColor.a,
+			  0.7);
+
+  float edge = abs(dot(v3Normal, viewDir));
+  outputColor.rgb += v3Color*edge;
+#else
+  outputColor = texture(diffuse, v3TexCoord);
+
+  if (outputColor.a < 0.001)
+    discard;
+
+  outputColor.rgb = mix(outputColor.rgb,
+			v3MixColor*outputColor.a,
+			mixAmount);
+
+  outputColor *= v4Scale;
+#endif
+}
@@ -0,0 +1,120 @@
+#version 410
+uniform mat4 MVP;
+uniform vec3 cpos;
+uniform vec3 rDir;
+uniform mat4 finalxform;
+uniform vec3 pinPoint;
+uniform vec3 frontR;
+uniform float deadRadius;
+uniform vec3 deadPoint;
+uniform int hitLabel;
+uniform vec2 viewport;
+
+// one instance per label
+layout(location = 0) in vec4 posProx;   // position, proximity
+layout(location = 1) in vec4 uvRect;    // place in the atlas
+layout(location = 2) in vec4 sizeKind;  // image size, atlas layer, tree label
+layout(location = 3) in vec4 boxMin;    // w is the label index
+layout(location = 4) in vec4 boxMax;
+layout(location = 5) in vec4 labelColor;
+
+#ifdef BOX
+layout(location = 6) in vec3 corner;
+layout(location = 7) in vec3 v3NormalIn;
+layout(location = 8) in vec2 v2TexCoordsIn;
+out vec2 v2TexCoord;
+out vec3 v3Normal;
+out vec3 v3Color;
+#else
+out vec3 v3TexCoord;
+out vec4 v4Scale;
+out vec3 v3MixColor;
+out float mixAmount;
+#endif
+
+// outside the clip volume, label is not drawn
+const vec4 hidden = vec4(2.0, 2.0, 2.0, 1.0);
+
+// Label::nearRay, the card is drawn instead
+bool nearRay(vec3 vp)
+{
+  vec4 fx = finalxform * vec4(vp, 1.0);
+  vec3 fxvp = fx.xyz/fx.w;
+  vec3 p = pinPoint + dot(fxvp - pinPoint, frontR)*frontR;
+  return (length(fxvp - p) <= 0.02);
+}
+
+// take slightly smaller radius
+bool inDeadZone(vec3 vp)
+{
+  return (deadRadius > 0.0 &&
+	  distance(vp.xy, deadPoint.xy) <= deadRadius-0.02);
+}
+
+void main()
+{
+  vec3 vp = posProx.xyz;
+  bool tree = (sizeKind.w > 0.5);
+  bool glow = (int(boxMin.w) == hitLabel);
+
+  gl_Position = hidden;
+
+#ifdef BOX
+  v2TexCoord = v2TexCoordsIn;
+  v3Normal = v3NormalIn;
+  v3Color = labelColor.rgb;
+  if (glow)
+    v3Color = 0.5*labelColor.rgb + 0.5*vec3(1.0, 0.3, 0.0);
+
+  if (!tree || nearRay(vp) || !inDeadZone(vp))
+    return;
+
+  gl_Position = MVP * vec4(mix(boxMin.xyz, boxMax.xyz, corner), 1.0);
+#else
+  vec2 c = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  v3TexCoord = vec3(uvRect.xy + c*uvRect.zw, sizeKind.z);
+  v4Scale = vec4(0.5, 0.5, 0.5, 1.0);
+  v3MixColor = vec3(0.0);
+  mixAmount = 0.0;
+
+  float dist = distance(cpos, vp);
+
+  if (tree)
+    {
+      // info icon only if we are close
+      if (nearRay(vp) || inDeadZone(vp) || dist*dist >= 1.0)
+	return;
+
+      float ptsz = (glow ? 40.0 : 20.0);
+      v4Scale = vec4(glow ? 1.0 : 0.8);
+      if (glow)
+	{
+	  v3MixColor = vec3(1.0, 0.3, 0.0);
+	  mixAmount = 0.8;
+	}
+
+      // ptsz/w pixels across, like the point sprite it replaces
+      gl_Position = MVP * vec4(vp, 1.0);
+      gl_Position.xy += vec2(2.0*c.x - 1.0, 1.0 - 2.0*c.y)*ptsz/viewport;
+      return;
+    }
+
+  float prox = posProx.w;
+  if (dist > prox)
+    return;
+
+  // fade out over the last fifth of the proximity
+  v4Scale *= 1.0 - smoothstep(0.8*prox, prox, dist);
+
+  // caption facing the viewer at constant angular size
+  vec3 nDir = normalize(cpos - vp);
+  vec3 uD = cross(nDir, rDir);
+  vec3 rD = cross(nDir, uD);
+
+  float projFactor = 0.045/tan(radians(55.0));
+  float frc = dist*0.01/(projFactor*max(sizeKind.x, sizeKind.y));
+
+  vec3 p = vp + (c.x - 0.5)*frc*sizeKind.x*rD - c.y*frc*sizeKind.y*uD;
+  gl_Position = MVP * vec4(p, 1.0);
+#endif
+}
@@ -0,0 +1,123 @@
+#version 420 core
+
+// Soft shadow and edge terms at 1/shadowScale resolution,
+// upsampled by the UPSAMPLE variant of shadow.frag.
+// DOWNSAMPLE defined for the pass reducing the depth texture,
+// STEREO for reading it from an eye layer of the stereo pass.
+
+// Ouput data
+layout(location=0) out vec4 color;
+
+uniform int shadowScale;
+
+#ifdef DOWNSAMPLE
+#ifdef STEREO
+uniform sampler2DArray depthTex;
+uniform int layer;
+
+vec4 fetch(vec2 p)
+{
+  return texture(depthTex, vec3(p/vec2(textureSize(depthTex, 0).xy), layer));
+}
+#else
+uniform sampler2DRect depthTex;
+
+vec4 fetch(vec2 p)
+{
+  return texture2DRect(depthTex, p);
+}
+#endif
+
+void main()
+{
+  // keep the closest covered sample of the block
+  vec2 base = floor(gl_FragCoord.xy)*float(shadowScale);
+
+  color = vec4(0.0);
+  for(int j=0; j<shadowScale; j++)
+    for(int i=0; i<shadowScale; i++)
+      {
+	vec4 d = fetch(base + vec2(i,j) + 0.5);
+	if (d.x > 0.001 && (color.x < 0.001 || d.x < color.x))
+	  color = d;
+      }
+}
+
+#else
+
+uniform sampler2DRect depthTex; // reduced depth
+
+uniform bool showedges;
+uniform bool softShadows;
+
+uniform float nearDist;
+uniform float farDist;
+
+const float cx[8] = float[](-1.0, 0.0, 1.0, 0.0, -1.0,-1.0, 1.0, 1.0);
+const float cy[8] = float[]( 0.0,-1.0, 0.0, 1.0, -1.0, 1.0,-1.0, 1.0);
+
+// r soft shadow, g edge shadow, 1 means not shadowed
+void main()
+{
+  vec2 spos = gl_FragCoord.xy;
+
+  color = vec4(1.0);
+
+  vec4 dtex = texture2DRect(depthTex, spos);
+  float depth = dtex.x;
+
+  if (depth < 0.001)
+    return;
+
+  float scale = float(shadowScale);
+
+  // same distance ranges as shadow.frag
+  float nearD1 = nearDist;
+  float farD1 = nearDist+(farDist-nearDist)*0.3;
+  float nearD2 = nearDist+(farDist-nearDist)*0.1;
+  float farD2 = nearDist+(farDist-nearDist)*0.5;
+  float dist = dtex.x;
+
+  if (farDist <= nearDist)
+    {
+      nearD1 = nearD2 = 0.0;
+      farD1 = farD2 = 1.0;
+      dist = 0.0;
+    }
+
+  // spiral radius is in full resolution pixels
+  if (softShadows && dist < farD1)
+   {
+     float stpfrc = smoothstep(nearD1, farD1, dist);
+     int nsteps = int(100.0*max(0.1, 1.0-stpfrc));
+
+     float sum = 0.0;
+     for(int i=0; i<nsteps; i++)
+       {
+	 float r = 1.0 + float(i)/4.0;
+	 vec2 pos = spos + vec2(r*cx[i%8],r*cy[i%8])/scale;
+	 float od = depth - texture2DRect(depthTex, pos).x;
+	 float ege = r*0.005;
+	 sum += step(ege, od);
+       }
+     sum /= float(nsteps);
+     color.r = pow(1.0-sum, 0.5);
+   }
+
+  if (showedges && dist < farD2)
+   {
+    float response = 0.0;
+    float shadow = 0.5*dtex.z*dtex.z;
+    float ldepth = log2(depth);
+    for(int i=0; i<8; i++)
+    {
+      vec2 pos = spos + vec2(cx[i],cy[i]);
+      float od = ldepth - log2(texture2DRect(depthTex, pos).x);
+      response += max(0.0, od-0.05);
+    }
+    response /= 8.0;
+    color.g = exp(-response*10*shadow);
+   }
+}
+
+#endif
@@ -4,9 +4,41 @@
 layout(location=0) out vec4 color;
 layout(depth_greater) out float gl_FragDepth;
 		      
+// STEREO defined for the variant reading one eye
+// from the 2 layer textures of the stereo pass
+#ifdef STEREO
+uniform sampler2DArray colorTex;
+uniform sampler2DArray depthTex;
+uniform int layer;
+
+vec4 fetch(sampler2DArray t, vec2 p)
+{
+  return texture(t, vec3(p/vec2(textureSize(t, 0).xy), layer));
+}
+
+vec4 fetchDepth(vec2 p)
+{
+  return texelFetch(depthTex, ivec3(ivec2(p), layer), 0);
+}
+#else
 uniform sampler2DRect colorTex;
 uniform sampler2DRect depthTex;
 
+vec4 fetch(sampler2DRect t, vec2 p)
+{
+  return texture2DRect(t, p);
+}
+
+vec4 fetchDepth(vec2 p)
+{
+  return texelFetch(depthTex, ivec2(p));
+}
+#endif
+
+// colour is filtered when the point passes were drawn at reduced
+// resolution, depth is taken from the nearest texel so splat
+// edges do not blend with their background or cleared texels
+
 uniform bool showedges;
 uniform bool softShadows;
 
@@ -17,12 +49,52 @@ uniform bool showsphere;
 
 uniform bool copyOnly;
 
+// fraction of the eye resolution the point passes were drawn
+// at, neighbours below are taken in the reduced texels
+uniform float renderScale;
+
+// UPSAMPLE defined for the variant taking the soft shadow and
+// edge terms from the reduced resolution occlusion pass
+#ifdef UPSAMPLE
+uniform sampler2DRect lowDepthTex;
+uniform sampler2DRect occlusionTex;
+uniform int shadowScale;
+
+// depth aware bilateral upsample of the shadow terms,
+// taps from the other side of a depth edge get no weight
+vec2 upsampleShadows(vec2 spos, float depth)
+{
+  float scale = float(shadowScale);
+  vec2 lpos = spos/scale - 0.5;
+  vec2 base = floor(lpos);
+  vec2 f = lpos - base;
+
+  vec2 sum = vec2(0.0);
+  float wsum = 0.0;
+  for(int j=0; j<2; j++)
+    for(int i=0; i<2; i++)
+      {
+	vec2 tpos = base + vec2(i,j) + 0.5;
+	float ld = texture2DRect(lowDepthTex, tpos).x;
+	float w = mix(1.0-f.x, f.x, float(i)) * mix(1.0-f.y, f.y, float(j));
+	w *= step(0.001, ld) * exp(-10.0*abs(ld-depth)/depth);
+	sum += w*texture2DRect(occlusionTex, tpos).xy;
+	wsum += w;
+      }
+
+  if (wsum < 0.0001) // no matching tap, take the nearest
+    return texture2DRect(occlusionTex, floor(spos/scale) + 0.5).xy;
+
+  return sum/wsum;
+}
+#endif
+
 void main()
 {
 
-  vec2 spos = gl_FragCoord.xy;
+  vec2 spos = gl_FragCoord.xy*renderScale;
 
-  color = texture2DRect(colorTex, spos.xy);
+  color = fetch(colorTex, spos.xy);
 
   if (color.a < 0.001)
     discard;
@@ -40,7 +112,7 @@ void main()
   //------------------------------
 
   
-  vec4 dtex = texture2DRect(depthTex, spos.xy);
+  vec4 dtex = fetchDepth(spos.xy);
   float depth = dtex.x;
   gl_FragDepth = dtex.z;
 
@@ -66,7 +138,7 @@ void main()
 	float stp = 1.0-step(2.0, dc);
 	vec2 pos = spos + vec2(i,j);
 	float frc = stp*1.0/dc;
-	col[idx] = frc*texture2DRect(colorTex, pos);
+	col[idx] = frc*fetch(colorTex, pos);
 	tdst += frc;
 	idx++;
       }
@@ -115,6 +187,11 @@ void main()
       dtex.x = 0.0;
     }
   
+#ifdef UPSAMPLE
+  vec2 occ = upsampleShadows(spos, depth);
+  if (softShadows && dtex.x < farD1)
+    color.rgb = mix(color.rgb*occ.x, color.rgb, smoothstep(nearD1, farD1, dtex.x));
+#else
   if (softShadows && dtex.x < farD1)
    {
      float stpfrc = smoothstep(nearD1, farD1, dtex.x);
@@ -131,7 +208,7 @@ void main()
        {
 	 r = 1.0 + float(i)/4.0;
 	 vec2 pos = spos + vec2(r*cx[int(mod(i,8))],r*cy[int(mod(i,8))]);
-	 float od = depth - texture2DRect(depthTex, pos).x;
+	 float od = depth - fetchDepth(pos).x;
 	 float ege = r*0.005;
 	 sum += step(ege, od);
 	 tele ++;
@@ -141,6 +218,7 @@ void main()
      sum = pow(sum, 0.5);
      color.rgb = mix(color.rgb*sum, color.rgb, stpfrc);
    }
+#endif
 
   float nearD2 = nearDist+(farDist-nearDist)*0.1;
   float farD2 = nearDist+(farDist-nearDist)*0.5;
@@ -150,6 +228,10 @@ void main()
       farD2 = 1.0;
       dtex.x = 0.0;
     }
+#ifdef UPSAMPLE
+  if (showedges && dtex.x < farD2)
+    color.rgb = mix(color.rgb*occ.y, color.rgb, smoothstep(nearD2, farD2, dtex.x));
+#else
   if (showedges && dtex.x < farD2)
    {
     float response = 0.0;
@@ -162,7 +244,7 @@ void main()
     {
       vec2 pos = spos + vec2(cx[i],cy[i]);
 
-      float od = depth - log2(texture2DRect(depthTex, pos).x);
+      float od = depth - log2(fetchDepth(pos).x);
       response += max(0.0, od-0.05);
 
       //vec4 p = texture2DRect(depthTex, pos);
@@ -178,4 +260,5 @@ void main()
     //float shadow = exp(-response*300);
     //color.rgb = mix(color.rgb*shadow, color.rgb, smoothstep(nearD2, farD2, dtex.x));
    }
+#endif
 }
@@ -0,0 +1,417 @@
+#include "loaderbench.h"
+#include "visibilitymap.h"
+
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QElapsedTimer>
+#include <QtMath>
+
+#include <algorithm>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+LoaderBench::LoaderBench()
+{
+  m_volume = 0;
+
+  m_screenWidth = 1920;
+  m_screenHeight = 1080;
+  m_timeStep = 0;
+  m_unloadUnused = false;
+  m_orbitPoses = 16;
+  m_lodCheckPoints = 0;
+
+  m_lodSelector.setMinNodePixelSize(100);
+}
+
+LoaderBench::~LoaderBench()
+{
+  if (m_volume)
+    delete m_volume;
+}
+
+bool
+LoaderBench::loadDataset(QString dirname)
+{
+  QDir dir(dirname);
+  if (!dir.exists())
+    {
+      m_error = "Directory not found : " + dirname;
+      return false;
+    }
+
+  // Volume::loadDir asks about timeseries in this case
+  QStringList subdir = dir.entryList(QDir::AllDirs | QDir::NoDotAndDotDot);
+  if (subdir.count() > 1 &&
+      !dir.exists("cloud.js") &&
+      !dir.exists("top.json"))
+    {
+      m_error = "Multiple subdirectories without cloud.js or top.json in " + dirname;
+      return false;
+    }
+
+  m_volume = new Volume();
+  if (!m_volume->loadDir(dirname))
+    {
+      m_error = "Cannot load " + dirname;
+      return false;
+    }
+
+  QList<PointCloud*> pointClouds = m_volume->pointClouds();
+  for(int d=0; d<pointClouds.count(); d++)
+    {
+      if (pointClouds[d]->time() == -1 ||
+	  pointClouds[d]->time() == m_timeStep)
+	{
+	  m_tiles += pointClouds[d]->tiles();
+	  m_allNodes += pointClouds[d]->allNodes();
+	}
+    }
+
+  if (m_tiles.count() == 0)
+    {
+      m_error = "No point cloud tiles found in " + dirname;
+      return false;
+    }
+
+  return true;
+}
+
+//--------------------------------------------
+// poses file :
+// { "poses" : [ { "position" : [x,y,z],
+//                 "rotation" : [x,y,z,w],
+//                 "fov" : degrees }, ... ] }
+//--------------------------------------------
+bool
+LoaderBench::loadPoses(QString flnm)
+{
+  QFile fl(flnm);
+  if (!fl.open(QIODevice::ReadOnly))
+    {
+      m_error = "Cannot open " + flnm;
+      return false;
+    }
+
+  QJsonDocument jsonDoc = QJsonDocument::fromJson(fl.readAll());
+  QJsonArray jsonPoses = jsonDoc.object()["poses"].toArray();
+
+  m_poses.clear();
+  for(int i=0; i<jsonPoses.count(); i++)
+    {
+      QJsonObject jsonPose = jsonPoses[i].toObject();
+      QJsonArray p = jsonPose["position"].toArray();
+      QJsonArray r = jsonPose["rotation"].toArray();
+      if (p.count() != 3 || r.count() != 4)
+	{
+	  m_error = QString("Pose %1 needs position and rotation").arg(i);
+	  return false;
+	}
+
+      BenchPose pose;
+      pose.position = Vec(p[0].toDouble(), p[1].toDouble(), p[2].toDouble());
+      pose.rotation = Quaternion(r[0].toDouble(), r[1].toDouble(),
+				 r[2].toDouble(), r[3].toDouble());
+      pose.fov = qDegreesToRadians(jsonPose["fov"].toDouble(45.0));
+      m_poses << pose;
+    }
+
+  if (m_poses.count() == 0)
+    {
+      m_error = "No poses in " + flnm;
+      return false;
+    }
+
+  return true;
+}
+
+//--------------------------------------------
+// circle around the dataset looking at its centre,
+// starting with the camera saved with the dataset if any
+//--------------------------------------------
+void
+LoaderBench::genOrbitPoses()
+{
+  m_poses.clear();
+
+  if (m_volume->validCamera())
+    {
+      BenchPose pose;
+      pose.position = m_volume->getCamPosition();
+      pose.rotation = m_volume->getCamOrientation();
+      pose.fov = M_PI/4;
+      m_poses << pose;
+    }
+
+  Vec bmin = m_tiles[0]->bmin();
+  Vec bmax = m_tiles[0]->bmax();
+  for(int i=1; i<m_tiles.count(); i++)
+    {
+      Vec tmin = m_tiles[i]->bmin();
+      Vec tmax = m_tiles[i]->bmax();
+      bmin = Vec(qMin(bmin.x, tmin.x), qMin(bmin.y, tmin.y), qMin(bmin.z, tmin.z));
+      bmax = Vec(qMax(bmax.x, tmax.x), qMax(bmax.y, tmax.y), qMax(bmax.z, tmax.z));
+    }
+  Vec cen = (bmin+bmax)/2;
+  float rad = (bmax-bmin).norm();
+
+  Camera cam;
+  for(int i=0; i<m_orbitPoses; i++)
+    {
+      float a = 2*M_PI*i/m_orbitPoses;
+      Vec pos = cen + rad*Vec(qCos(a)*0.85, qSin(a)*0.85, 0.5);
+      cam.setPosition(pos);
+      cam.setUpVector(Vec(0,0,1));
+      cam.lookAt(cen);
+
+      BenchPose pose;
+      pose.position = pos;
+      pose.rotation = cam.orientation();
+      pose.fov = M_PI/4;
+      m_poses << pose;
+    }
+}
+
+bool
+LoaderBench::run()
+{
+  if (m_poses.count() == 0)
+    genOrbitPoses();
+
+  Camera cam;
+  cam.setScreenWidthAndHeight(m_screenWidth, m_screenHeight);
+
+  QVector<double> decodeTimes; // milliseconds per node
+  QVector<double> readWaits;
+  QVector<double> selectTimes;
+  qint64 totalPoints = 0;
+  qint64 totalBytes = 0;
+  qint64 totalNodes = 0;
+
+  QElapsedTimer wallTimer;
+  QElapsedTimer timer;
+  qint64 loadTime = 0;
+
+  QJsonArray jsonPoses;
+
+  std::mt19937 rng(1);
+  qint64 lodMismatches = 0;
+
+  wallTimer.start();
+  for(int p=0; p<m_poses.count(); p++)
+    {
+      cam.setFieldOfView(m_poses[p].fov);
+      cam.setPosition(m_poses[p].position);
+      cam.setOrientation(m_poses[p].rotation);
+
+      QMatrix4x4 MV;
+      float m[16];
+      cam.getModelViewMatrix(m);
+      for(int i=0; i<16; i++)
+	MV.data()[i] = m[i];
+      MV = MV.transposed();
+
+      m_lodSelector.setProjFactor((0.5f*m_screenHeight)/qTan(m_poses[p].fov/2));
+
+      //-------------------------------
+      timer.start();
+      for(int i=0; i<m_allNodes.count(); i++)
+	{
+	  m_allNodes[i]->setActive(false);
+	  m_allNodes[i]->setPointLimit(-1);
+	}
+      QList<OctreeNode*> nodes = m_lodSelector.select(m_tiles, MV,
+						      m_poses[p].position);
+      selectTimes << timer.nsecsElapsed()*1e-6;
+      //-------------------------------
+
+      if (m_lodCheckPoints > 0)
+	lodMismatches += checkLOD(rng);
+
+      if (m_unloadUnused)
+	{
+	  for(int i=0; i<m_allNodes.count(); i++)
+	    if (!m_allNodes[i]->isActive() && m_allNodes[i]->dataLoaded())
+	      m_allNodes[i]->unloadData();
+	}
+
+      QList<OctreeNode*> loadNodes;
+      for(int i=0; i<nodes.count(); i++)
+	if (!nodes[i]->dataLoaded())
+	  loadNodes << nodes[i];
+
+      //-------------------------------
+      qint64 posePoints = 0;
+      qint64 poseBytes = 0;
+      timer.start();
+      m_nodeReader.submit(loadNodes);
+      for(int i=0; i<loadNodes.count(); i++)
+	{
+	  QElapsedTimer nodeTimer;
+	  nodeTimer.start();
+	  QByteArray fileData = m_nodeReader.take(loadNodes[i]);
+	  readWaits << nodeTimer.nsecsElapsed()*1e-6;
+
+	  nodeTimer.start();
+	  loadNodes[i]->loadData(fileData);
+	  decodeTimes << nodeTimer.nsecsElapsed()*1e-6;
+
+	  posePoints += loadNodes[i]->numpoints();
+	  poseBytes += fileData.size();
+	}
+      m_nodeReader.cancel();
+      qint64 poseTime = timer.nsecsElapsed();
+      loadTime += poseTime;
+      //-------------------------------
+
+      totalPoints += posePoints;
+      totalBytes += poseBytes;
+      totalNodes += loadNodes.count();
+
+      QJsonObject jsonPose;
+      jsonPose["selected_nodes"] = nodes.count();
+      jsonPose["selected_points"] = m_lodSelector.pointsSelected();
+      jsonPose["loaded_nodes"] = loadNodes.count();
+      jsonPose["loaded_points"] = posePoints;
+      jsonPose["load_ms"] = poseTime*1e-6;
+      jsonPoses << jsonPose;
+    }
+  double wallTime = wallTimer.nsecsElapsed()*1e-9;
+
+  double loadSecs = qMax(loadTime*1e-9, 1e-9);
+
+  m_results = QJsonObject();
+  m_results["poses"] = m_poses.count();
+  m_results["point_budget"] = m_lodSelector.pointBudget();
+  m_results["queue_depth"] = m_nodeReader.queueDepth();
+  m_results["nodes_loaded"] = totalNodes;
+  m_results["points_loaded"] = totalPoints;
+  m_results["bytes_read"] = totalBytes;
+  m_results["load_seconds"] = loadSecs;
+  m_results["wall_seconds"] = wallTime;
+  m_results["points_per_second"] = totalPoints/loadSecs;
+  m_results["bytes_per_second"] = totalBytes/loadSecs;
+
+  QJsonObject jsonDecode;
+  jsonDecode["p50"] = percentile(decodeTimes, 0.5);
+  jsonDecode["p90"] = percentile(decodeTimes, 0.9);
+  jsonDecode["p99"] = percentile(decodeTimes, 0.99);
+  m_results["decode_ms"] = jsonDecode;
+
+  QJsonObject jsonRead;
+  jsonRead["p50"] = percentile(readWaits, 0.5);
+  jsonRead["p90"] = percentile(readWaits, 0.9);
+  jsonRead["p99"] = percentile(readWaits, 0.99);
+  m_results["read_wait_ms"] = jsonRead;
+
+  QJsonObject jsonSelect;
+  jsonSelect["p50"] = percentile(selectTimes, 0.5);
+  jsonSelect["p90"] = percentile(selectTimes, 0.9);
+  jsonSelect["p99"] = percentile(selectTimes, 0.99);
+  m_results["select_ms"] = jsonSelect;
+
+  m_results["peak_rss_bytes"] = peakRSS();
+  m_results["per_pose"] = jsonPoses;
+
+  if (m_lodCheckPoints > 0)
+    {
+      m_results["lod_check_points"] = (qint64)m_lodCheckPoints*m_poses.count();
+      m_results["lod_mismatches"] = lodMismatches;
+      if (lodMismatches > 0)
+	{
+	  m_error = QString("LOD check failed for %1 points").arg(lodMismatches);
+	  return false;
+	}
+    }
+
+  return true;
+}
+
+//--------------------------------------------
+// compares the level decoded from the visibility rows, as
+// getLOD in drawpoints.vert does, with the level found from
+// the active nodes, for random points in the active tiles.
+// returns number of points where the two differ
+//--------------------------------------------
+qint64
+LoaderBench::checkLOD(std::mt19937 &rng)
+{
+  QList<PointCloud*> pointClouds = m_volume->pointClouds();
+
+  QList<OctreeNode*> tiles;
+  QList< QVector<uchar> > rows;
+  for(int d=0; d<pointClouds.count(); d++)
+    {
+      pointClouds[d]->updateVisibilityData();
+      QList<OctreeNode*> pt = pointClouds[d]->tiles();
+      const QVector< QVector<uchar> > &vData = pointClouds[d]->vData();
+      for(int i=0; i<pt.count(); i++)
+	if (pt[i]->isActive())
+	  {
+	    tiles << pt[i];
+	    rows << vData[i];
+	  }
+    }
+
+  if (tiles.count() == 0)
+    return 0;
+
+  std::uniform_int_distribution<int> pickTile(0, tiles.count()-1);
+  std::uniform_real_distribution<double> frac(0.0, 1.0);
+
+  qint64 mismatches = 0;
+  for(int i=0; i<m_lodCheckPoints; i++)
+    {
+      int t = pickTile(rng);
+      Vec bmin = tiles[t]->bmin();
+      Vec bmax = tiles[t]->bmax();
+      Vec pos = bmin + Vec(frac(rng)*(bmax.x-bmin.x),
+			   frac(rng)*(bmax.y-bmin.y),
+			   frac(rng)*(bmax.z-bmin.z));
+
+      float lodRow = VisibilityMap::rowLOD(rows[t], bmin, bmax, pos);
+      float lodNode = VisibilityMap::nodeLOD(tiles[t], pos);
+      if (qAbs(lodRow-lodNode) > 1e-4)
+	mismatches ++;
+    }
+
+  return mismatches;
+}
+
+double
+LoaderBench::percentile(QVector<double> &v, float p)
+{
+  if (v.count() == 0)
+    return 0;
+
+  std::sort(v.begin(), v.end());
+  int i = qBound(0, (int)qRound(p*(v.count()-1)), v.count()-1);
+  return v[i];
+}
+
+qint64
+LoaderBench::peakRSS()
+{
+#if defined(Q_OS_WIN)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.PeakWorkingSetSize;
+  return 0;
+#else
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0)
+    return 0;
+#if defined(Q_OS_MAC)
+  return ru.ru_maxrss; // bytes on mac
+#else
+  return (qint64)ru.ru_maxrss*1024; // kilobytes on linux
+#endif
+#endif
+}
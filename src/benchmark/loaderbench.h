@@ -0,0 +1,81 @@
+#ifndef LOADERBENCH_H
+#define LOADERBENCH_H
+
+#include <QGLViewer/camera.h>
+using namespace qglviewer;
+
+#include <QStringList>
+#include <QVector>
+#include <QJsonObject>
+
+#include <random>
+
+#include "volume.h"
+#include "lodselector.h"
+#include "nodereader.h"
+
+//--------------------------------------------
+// camera pose to run through the LOD selection
+//--------------------------------------------
+struct BenchPose
+{
+  Vec position;
+  Quaternion rotation;
+  float fov; // radians
+};
+
+//--------------------------------------------
+// Measures how fast nodes picked by the LOD selection
+// are read and decoded, without a GL context.
+// The dataset is opened with Volume::loadDir, each pose is
+// passed through LodSelector and the nodes not yet in memory
+// are read with NodeReader and decoded with OctreeNode::loadData,
+// same as the loader thread does before uploading to the gpu.
+//--------------------------------------------
+class LoaderBench
+{
+ public :
+  LoaderBench();
+  ~LoaderBench();
+
+  void setPointBudget(qint64 pb) { m_lodSelector.setPointBudget(pb); }
+  void setScreenSize(int w, int h) { m_screenWidth = w; m_screenHeight = h; }
+  void setQueueDepth(int q) { m_nodeReader.setQueueDepth(q); }
+  void setTimeStep(int t) { m_timeStep = t; }
+  void setUnloadUnused(bool b) { m_unloadUnused = b; }
+  void setOrbitPoses(int n) { m_orbitPoses = n; }
+  void setLODCheckPoints(int n) { m_lodCheckPoints = n; }
+
+  bool loadDataset(QString);
+  bool loadPoses(QString);
+
+  bool run();
+
+  QJsonObject results() { return m_results; }
+  QString errorString() { return m_error; }
+
+ protected :
+  Volume *m_volume;
+  LodSelector m_lodSelector;
+  NodeReader m_nodeReader;
+
+  int m_screenWidth, m_screenHeight;
+  int m_timeStep;
+  bool m_unloadUnused;
+  int m_orbitPoses;
+  int m_lodCheckPoints;
+
+  QList<BenchPose> m_poses;
+  QList<OctreeNode*> m_tiles;
+  QList<OctreeNode*> m_allNodes;
+
+  QJsonObject m_results;
+  QString m_error;
+
+  void genOrbitPoses();
+  qint64 checkLOD(std::mt19937&);
+  double percentile(QVector<double>&, float);
+  qint64 peakRSS();
+};
+
+#endif
@@ -0,0 +1,90 @@
+TEMPLATE = app
+TARGET = loaderbench
+DEPENDPATH += . ..
+
+# headless - loads datasets through the viewer's Volume code
+QT += opengl widgets core gui xml
+
+CONFIG += release console c++11
+CONFIG -= app_bundle
+DESTDIR = ..\..\bin
+
+INCLUDEPATH += .. \
+	c:\Qt\libQGLViewer-2.6.1 \
+ 	c:\cygwin64\home\acl900\drishtilib\glew-1.11.0\include \
+	..\LASzip
+
+QMAKE_LIBDIR += c:\Qt\libQGLViewer-2.6.1\lib \
+		c:\cygwin64\home\acl900\drishtilib\glew-1.11.0\lib\Release\x64 \
+	        ..\LASzip
+
+LIBS += QGLViewer2.lib glew32.lib LASzip.lib
+
+win32 {
+  LIBS += psapi.lib
+}
+
+unix:!macx {
+  # asynchronous node reads
+  packagesExist(liburing) {
+    DEFINES += USE_IO_URING
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liburing
+  }
+}
+
+
+FORMS += ../propertyeditor.ui
+
+HEADERS += loaderbench.h \
+	replaybench.h \
+	../volume.h \
+	../volumeloaderthread.h \
+	../triset.h \
+	../ply.h \
+	../pointcloud.h \
+	../octreenode.h \
+	../lodselector.h \
+	../nodereader.h \
+	../nodecache.h \
+	../memorystats.h \
+	../visibilitymap.h \
+	../hiztest.h \
+	../heightfield.h \
+	../label.h \
+	../labelrenderer.h \
+	../labelgrid.h \
+	../global.h \
+	../staticfunctions.h \
+	../shaderfactory.h \
+	../glewinitialisation.h \
+	../keyframe.h \
+	../keyframeinformation.h \
+	../propertyeditor.h
+
+SOURCES += main.cpp \
+	loaderbench.cpp \
+	replaybench.cpp \
+	../volume.cpp \
+	../volumeloaderthread.cpp \
+	../triset.cpp \
+	../ply.c \
+	../pointcloud.cpp \
+	../octreenode.cpp \
+	../lodselector.cpp \
+	../nodereader.cpp \
+	../nodecache.cpp \
+	../memorystats.cpp \
+	../visibilitymap.cpp \
+	../hiztest.cpp \
+	../heightfield.cpp \
+	../label.cpp \
+	../labelrenderer.cpp \
+	../labelgrid.cpp \
+	../global.cpp \
+	../staticfunctions.cpp \
+	../shaderfactory.cpp \
+	../glewinitialisation.cpp \
+	../keyframe.cpp \
+	../keyframeinformation.cpp \
+	../propertyeditor.cpp
@@ -0,0 +1,157 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QStatusBar>
+#include <QJsonDocument>
+#include <QFile>
+
+#include "global.h"
+#include "staticfunctions.h"
+#include "nodecache.h"
+#include "loaderbench.h"
+#include "replaybench.h"
+
+int main(int argv, char **args)
+{
+  // no window is ever shown, PointCloud still reports
+  // progress through the status bar and progress bar.
+  // replay needs a platform that can give an offscreen
+  // GL context, so leave the choice to the user there
+  bool replayMode = false;
+  for(int i=1; i<argv; i++)
+    if (QString(args[i]).startsWith("--replay"))
+      replayMode = true;
+  if (!replayMode && !qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+  QApplication app(argv, args);
+  QCoreApplication::setOrganizationName("NCI");
+  QCoreApplication::setApplicationName("loaderbench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Measure node loading throughput for a lasVR dataset");
+  parser.addHelpOption();
+  parser.addPositionalArgument("dataset", "Dataset directory");
+
+  QCommandLineOption posesOption(QStringList() << "p" << "poses",
+				 "JSON file with camera poses", "file");
+  QCommandLineOption orbitOption("orbit",
+				 "Number of orbit poses when no poses file is given",
+				 "n", "16");
+  QCommandLineOption budgetOption(QStringList() << "b" << "budget",
+				  "Point budget in millions", "n", "10");
+  QCommandLineOption sizeOption("size",
+				"Screen size used for the LOD selection",
+				"wxh", "1920x1080");
+  QCommandLineOption depthOption("queue-depth",
+				 "Number of node reads kept in flight", "n", "32");
+  QCommandLineOption timeOption("time", "Time step to load", "t", "0");
+  QCommandLineOption unloadOption("unload",
+				  "Unload nodes not selected for the current pose");
+  QCommandLineOption cacheOption("cache",
+				 "Use node cache in this directory", "dir");
+  QCommandLineOption outOption(QStringList() << "o" << "output",
+			       "Write results to file instead of stdout", "file");
+  QCommandLineOption replayOption("replay",
+				  "Replay keyframes file or VR pose log with GL drawing",
+				  "file");
+  QCommandLineOption fpsOption("fps", "Replay frame rate", "n", "60");
+  QCommandLineOption csvOption("csv",
+			       "Write per frame replay statistics to file instead of stdout",
+			       "file");
+  QCommandLineOption lodCheckOption("check-lod",
+				    "Check the visibility texture LOD against the octree for n random points per pose",
+				    "n");
+
+  parser.addOption(posesOption);
+  parser.addOption(orbitOption);
+  parser.addOption(budgetOption);
+  parser.addOption(sizeOption);
+  parser.addOption(depthOption);
+  parser.addOption(timeOption);
+  parser.addOption(unloadOption);
+  parser.addOption(cacheOption);
+  parser.addOption(outOption);
+  parser.addOption(replayOption);
+  parser.addOption(fpsOption);
+  parser.addOption(csvOption);
+  parser.addOption(lodCheckOption);
+
+  parser.process(app);
+
+  QTextStream err(stderr);
+
+  if (parser.positionalArguments().count() != 1)
+    {
+      err << parser.helpText();
+      return 1;
+    }
+
+  Global::setStatusBar(new QStatusBar());
+
+  // same colour gradient as Viewer::genColorMap,
+  // used for datasets without colour
+  Global::setColorMap(StaticFunctions::colorGradient());
+
+  if (parser.isSet(cacheOption))
+    NodeCache::setCacheDir(parser.value(cacheOption),
+			   (qint64)20*1024*1024*1024);
+
+  ReplayBench bench;
+  bench.setPointBudget(parser.value(budgetOption).toLongLong()*1000000);
+  bench.setQueueDepth(parser.value(depthOption).toInt());
+  bench.setTimeStep(parser.value(timeOption).toInt());
+  bench.setUnloadUnused(parser.isSet(unloadOption));
+  bench.setOrbitPoses(qMax(1, parser.value(orbitOption).toInt()));
+  bench.setFrameRate(parser.value(fpsOption).toInt());
+  if (parser.isSet(lodCheckOption))
+    bench.setLODCheckPoints(parser.value(lodCheckOption).toInt());
+
+  QStringList wh = parser.value(sizeOption).split("x");
+  if (wh.count() == 2)
+    bench.setScreenSize(wh[0].toInt(), wh[1].toInt());
+
+  if (!bench.loadDataset(parser.positionalArguments()[0]))
+    {
+      err << bench.errorString() << "\n";
+      return 1;
+    }
+
+  bool ok;
+  if (replayMode)
+    ok = (bench.loadPath(parser.value(replayOption)) &&
+	  bench.replay(parser.value(csvOption)));
+  else
+    ok = ((!parser.isSet(posesOption) ||
+	   bench.loadPoses(parser.value(posesOption))) &&
+	  bench.run());
+
+  if (!ok)
+    {
+      err << bench.errorString() << "\n";
+      return 1;
+    }
+
+  // replay summary goes to stderr when the csv is on stdout
+  if (replayMode && !parser.isSet(outOption) && !parser.isSet(csvOption))
+    {
+      err << QJsonDocument(bench.results()).toJson();
+      return 0;
+    }
+
+  QByteArray json = QJsonDocument(bench.results()).toJson();
+  if (parser.isSet(outOption))
+    {
+      QFile fl(parser.value(outOption));
+      if (!fl.open(QIODevice::WriteOnly))
+	{
+	  err << "Cannot write " << parser.value(outOption) << "\n";
+	  return 1;
+	}
+      fl.write(json);
+    }
+  else
+    QTextStream(stdout) << json;
+
+  return 0;
+}
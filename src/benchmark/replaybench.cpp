@@ -0,0 +1,602 @@
+#include "replaybench.h"
+#include "shaderfactory.h"
+#include "keyframe.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QElapsedTimer>
+#include <QtMath>
+
+ReplayBench::ReplayBench() : LoaderBench()
+{
+  m_fps = 60;
+  m_fov = M_PI/4;
+
+  m_surface = 0;
+  m_context = 0;
+
+  m_fbo = 0;
+  m_colorTex = 0;
+  m_depthRB = 0;
+  m_vertexArray = 0;
+  m_vertexBuffer[0] = m_vertexBuffer[1] = 0;
+  m_visibilityTex = 0;
+  m_program = 0;
+  m_mvpParm = -1;
+  m_queries[0] = m_queries[1] = 0;
+
+  m_dpv = 6;
+  m_currVBO = 0;
+  m_vboPoints = 0;
+}
+
+ReplayBench::~ReplayBench()
+{
+  cleanGL();
+}
+
+void
+ReplayBench::sceneBounds(Vec &bmin, Vec &bmax)
+{
+  QList<PointCloud*> pointClouds = m_volume->pointClouds();
+  bool first = true;
+  for(int d=0; d<pointClouds.count(); d++)
+    {
+      QList<OctreeNode*> tiles = pointClouds[d]->tiles();
+      for(int i=0; i<tiles.count(); i++)
+	{
+	  Vec tmin = tiles[i]->bmin();
+	  Vec tmax = tiles[i]->bmax();
+	  if (first)
+	    {
+	      bmin = tmin;
+	      bmax = tmax;
+	      first = false;
+	    }
+	  bmin = Vec(qMin(bmin.x, tmin.x), qMin(bmin.y, tmin.y), qMin(bmin.z, tmin.z));
+	  bmax = Vec(qMax(bmax.x, tmax.x), qMax(bmax.y, tmax.y), qMax(bmax.z, tmax.z));
+	}
+    }
+}
+
+//--------------------------------------------
+// keyframes file (JSON array written by KeyFrame::save)
+// or a head pose log (text written by VR::setPoseLog)
+//--------------------------------------------
+bool
+ReplayBench::loadPath(QString flnm)
+{
+  QFile fl(flnm);
+  if (!fl.open(QIODevice::ReadOnly))
+    {
+      m_error = "Cannot open " + flnm;
+      return false;
+    }
+  QByteArray data = fl.readAll();
+  fl.close();
+
+  m_frameMV.clear();
+  m_frameSelectMV.clear();
+  m_frameProj.clear();
+  m_framePos.clear();
+
+  QJsonParseError perr;
+  QJsonDocument jsonDoc = QJsonDocument::fromJson(data, &perr);
+  bool ok;
+  if (perr.error == QJsonParseError::NoError && jsonDoc.isArray())
+    ok = loadKeyFrames(jsonDoc.array());
+  else
+    ok = loadPoseLog(flnm);
+
+  if (ok && m_frameMV.count() == 0)
+    {
+      m_error = "No frames in " + flnm;
+      return false;
+    }
+
+  return ok;
+}
+
+bool
+ReplayBench::loadKeyFrames(QJsonArray jsonArray)
+{
+  KeyFrame keyFrame;
+  keyFrame.load(jsonArray);
+  keyFrame.updateKeyFrameInterpolator();
+
+  int nkf = keyFrame.numberOfKeyFrames();
+  if (nkf == 0)
+    return true;
+
+  Vec bmin, bmax;
+  sceneBounds(bmin, bmax);
+
+  // keyframes do not store the field of view, use the camera default
+  m_fov = M_PI/4;
+
+  Camera cam;
+  cam.setScreenWidthAndHeight(m_screenWidth, m_screenHeight);
+  cam.setSceneBoundingBox(bmin, bmax);
+  cam.setFieldOfView(m_fov);
+
+  Vec pos;
+  Quaternion rot;
+  QObject::connect(&keyFrame, &KeyFrame::updateLookFrom,
+		   [&](Vec p, Quaternion q, int) { pos = p; rot = q; });
+
+  // keyframe numbers are frame numbers at the playback rate
+  int minFrame = keyFrame.keyFrameInfo(0).frameNumber();
+  int maxFrame = keyFrame.keyFrameInfo(nkf-1).frameNumber();
+  for(int fno=minFrame; fno<=maxFrame; fno++)
+    {
+      keyFrame.playFrameNumber(fno);
+
+      cam.setPosition(pos);
+      cam.setOrientation(rot);
+
+      GLdouble m[16];
+      QMatrix4x4 MV, P;
+      cam.getModelViewMatrix(m);
+      for(int i=0; i<16; i++)
+	MV.data()[i] = m[i];
+      cam.getProjectionMatrix(m);
+      for(int i=0; i<16; i++)
+	P.data()[i] = m[i];
+
+      // the loader selects desktop views with the transpose
+      m_frameMV << MV;
+      m_frameSelectMV << MV.transposed();
+      m_frameProj << P;
+      m_framePos << pos;
+    }
+
+  return true;
+}
+
+//--------------------------------------------
+// each line : milliseconds, hmd position, modelview (row major)
+// poses are resampled at the replay frame rate
+//--------------------------------------------
+bool
+ReplayBench::loadPoseLog(QString flnm)
+{
+  QFile fl(flnm);
+  if (!fl.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+      m_error = "Cannot open " + flnm;
+      return false;
+    }
+
+  QList<qint64> times;
+  QList<Vec> pos;
+  QList<QMatrix4x4> mv;
+
+  QTextStream in(&fl);
+  while (!in.atEnd())
+    {
+      QStringList words = in.readLine().split(" ", QString::SkipEmptyParts);
+      if (words.count() != 20)
+	continue;
+
+      float m[16];
+      for(int i=0; i<16; i++)
+	m[i] = words[4+i].toFloat();
+
+      times << words[0].toLongLong();
+      pos << Vec(words[1].toFloat(), words[2].toFloat(), words[3].toFloat());
+      mv << QMatrix4x4(m);
+    }
+
+  if (times.count() == 0)
+    {
+      m_error = "Not a keyframes file or pose log : " + flnm;
+      return false;
+    }
+
+  Vec bmin, bmax;
+  sceneBounds(bmin, bmax);
+
+  // same fov as GLHiddenWidget uses for the headset
+  float fov = 110.0;
+  m_fov = qDegreesToRadians(fov);
+  float aspect = (float)m_screenWidth/(float)m_screenHeight;
+
+  int p = 0;
+  for(double t=times[0]; t<=times.last(); t+=1000.0/m_fps)
+    {
+      while (p < times.count()-1 && times[p+1] <= t)
+	p++;
+
+      // near and far from the scene bounds in eye space
+      float zfar = 0;
+      for (int c=0; c<8; c++)
+	{
+	  QVector4D v = mv[p] * QVector4D((c&4)?bmin.x:bmax.x,
+					  (c&2)?bmin.y:bmax.y,
+					  (c&1)?bmin.z:bmax.z, 1);
+	  zfar = qMax(zfar, -v.z());
+	}
+      zfar = qMax(zfar*1.1f, 1.0f);
+
+      QMatrix4x4 P;
+      P.perspective(fov, aspect, zfar*0.0001f, zfar);
+
+      // headset modelview goes to the selection as is
+      m_frameMV << mv[p];
+      m_frameSelectMV << mv[p];
+      m_frameProj << P;
+      m_framePos << pos[p];
+    }
+
+  return true;
+}
+
+bool
+ReplayBench::initGL()
+{
+  QSurfaceFormat format;
+  format.setVersion(3, 3);
+  format.setProfile(QSurfaceFormat::CompatibilityProfile);
+
+  m_context = new QOpenGLContext();
+  m_context->setFormat(format);
+  if (!m_context->create())
+    {
+      m_error = "Cannot create OpenGL context";
+      return false;
+    }
+
+  m_surface = new QOffscreenSurface();
+  m_surface->setFormat(m_context->format());
+  m_surface->create();
+  if (!m_context->makeCurrent(m_surface))
+    {
+      m_error = "Cannot make OpenGL context current";
+      return false;
+    }
+
+  if (!GlewInit::initialise())
+    {
+      m_error = "Cannot initialise glew";
+      return false;
+    }
+
+  //-------------------------------
+  glGenTextures(1, &m_colorTex);
+  glBindTexture(GL_TEXTURE_2D, m_colorTex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
+	       m_screenWidth, m_screenHeight, 0,
+	       GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+  glGenRenderbuffers(1, &m_depthRB);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_depthRB);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+			m_screenWidth, m_screenHeight);
+
+  glGenFramebuffers(1, &m_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			 GL_TEXTURE_2D, m_colorTex, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+			    GL_RENDERBUFFER, m_depthRB);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+      m_error = "Incomplete offscreen framebuffer";
+      return false;
+    }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  //-------------------------------
+
+  //-------------------------------
+  // vertex buffers large enough for the point budget
+  m_dpv = m_volume->dataPerVertex();
+  qint64 bpp = (m_dpv == 3 ? m_dpv*sizeof(float) : 20);
+
+  glGenVertexArrays(1, &m_vertexArray);
+  glGenBuffers(2, m_vertexBuffer);
+  for(int i=0; i<2; i++)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer[i]);
+      glBufferData(GL_ARRAY_BUFFER,
+		   m_lodSelector.pointBudget()*bpp,
+		   NULL,
+		   GL_STATIC_DRAW);
+    }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  //-------------------------------
+
+  glGenTextures(1, &m_visibilityTex);
+  glGenQueries(2, m_queries);
+
+  //-------------------------------
+  // plain points, only vertex fetch and rasterisation is measured
+  QString vertShader;
+  vertShader += "#version 330\n";
+  vertShader += "uniform mat4 MVP;\n";
+  vertShader += "layout(location = 0) in vec3 position;\n";
+  vertShader += "void main()\n";
+  vertShader += "{\n";
+  vertShader += "  gl_Position = MVP * vec4(position, 1.0);\n";
+  vertShader += "}\n";
+
+  QString fragShader;
+  fragShader += "#version 330\n";
+  fragShader += "out vec4 outputColor;\n";
+  fragShader += "void main()\n";
+  fragShader += "{\n";
+  fragShader += "  outputColor = vec4(1.0);\n";
+  fragShader += "}\n";
+
+  m_program = glCreateProgramObjectARB();
+  if (!ShaderFactory::loadShader(m_program, vertShader, fragShader))
+    {
+      m_error = "Cannot compile point shader";
+      return false;
+    }
+  m_mvpParm = glGetUniformLocationARB(m_program, "MVP");
+  //-------------------------------
+
+  m_currVBO = 0;
+  m_vboPoints = 0;
+  m_prevNodes.clear();
+
+  return true;
+}
+
+void
+ReplayBench::cleanGL()
+{
+  if (!m_context)
+    return;
+
+  m_context->makeCurrent(m_surface);
+
+  if (m_fbo) glDeleteFramebuffers(1, &m_fbo);
+  if (m_depthRB) glDeleteRenderbuffers(1, &m_depthRB);
+  if (m_colorTex) glDeleteTextures(1, &m_colorTex);
+  if (m_visibilityTex) glDeleteTextures(1, &m_visibilityTex);
+  m_visibilityMap.clear();
+  if (m_vertexBuffer[0]) glDeleteBuffers(2, m_vertexBuffer);
+  if (m_vertexArray) glDeleteVertexArrays(1, &m_vertexArray);
+  if (m_queries[0]) glDeleteQueries(2, m_queries);
+  if (m_program) glDeleteObjectARB(m_program);
+
+  m_context->doneCurrent();
+  delete m_context;
+  delete m_surface;
+  m_context = 0;
+  m_surface = 0;
+}
+
+//--------------------------------------------
+// same as GLHiddenWidget::createVisibilityTexture and uploadVisTex
+//--------------------------------------------
+void
+ReplayBench::createVisibilityTexture()
+{
+  QList<PointCloud*> pointClouds = m_volume->pointClouds();
+
+  for(int d=0; d<pointClouds.count(); d++)
+    pointClouds[d]->updateVisibilityData();
+
+  if (m_visibilityMap.update(pointClouds))
+    m_visibilityMap.upload(m_visibilityTex);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+//--------------------------------------------
+// nodes already in the previous buffer are copied across,
+// the rest are read, decoded and uploaded,
+// returns number of bytes uploaded
+//--------------------------------------------
+qint64
+ReplayBench::uploadNodes(QList<OctreeNode*> nodes, int &nodesUploaded)
+{
+  qint64 bpp = (m_dpv == 3 ? m_dpv*sizeof(float) : 20);
+
+  GLuint vbo1 = (m_currVBO+1)%2;
+  GLuint vbo2 = m_currVBO;
+
+  glBindBuffer(GL_COPY_READ_BUFFER, m_vertexBuffer[vbo1]);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_vertexBuffer[vbo2]);
+
+  QMap<int, QPair<qint64, qint64> > newLoad;
+  QList<OctreeNode*> loadNodes;
+  qint64 lpoints = 0;
+
+  for(int i=0; i<nodes.count(); i++)
+    {
+      int nodeId = nodes[i]->uid();
+      qint64 npts = nodes[i]->pointsToDraw();
+      if (m_prevNodes.contains(nodeId) &&
+	  m_prevNodes[nodeId].second >= npts)
+	{
+	  glCopyBufferSubData(GL_COPY_READ_BUFFER,
+			      GL_COPY_WRITE_BUFFER,
+			      bpp*m_prevNodes[nodeId].first,
+			      bpp*lpoints,
+			      bpp*npts);
+	  newLoad[nodeId] = qMakePair(lpoints, npts);
+	  lpoints += npts;
+	}
+      else
+	loadNodes << nodes[i];
+    }
+
+  qint64 bytes = 0;
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer[vbo2]);
+  m_nodeReader.submit(loadNodes);
+  for(int i=0; i<loadNodes.count(); i++)
+    {
+      loadNodes[i]->loadData(m_nodeReader.take(loadNodes[i]));
+      qint64 npts = loadNodes[i]->pointsToDraw();
+      if (npts > 0)
+	glBufferSubData(GL_ARRAY_BUFFER,
+			bpp*lpoints,
+			bpp*npts,
+			loadNodes[i]->coords());
+
+      newLoad[loadNodes[i]->uid()] = qMakePair(lpoints, npts);
+      lpoints += npts;
+      bytes += bpp*npts;
+    }
+  m_nodeReader.cancel();
+  glFinish();
+
+  nodesUploaded = loadNodes.count();
+
+  m_prevNodes = newLoad;
+  m_vboPoints = lpoints;
+  m_currVBO = (m_currVBO+1)%2;
+
+  return bytes;
+}
+
+void
+ReplayBench::drawPoints(QMatrix4x4 mvp, double &drawTime, qint64 &samples)
+{
+  // buffer written by the last upload
+  GLuint vbo = (m_currVBO+1)%2;
+  GLsizei stride = (m_dpv == 3 ? 0 : 20);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glViewport(0, 0, m_screenWidth, m_screenHeight);
+  glEnable(GL_DEPTH_TEST);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glUseProgramObjectARB(m_program);
+  glUniformMatrix4fv(m_mvpParm, 1, GL_FALSE, mvp.constData());
+
+  glBindVertexArray(m_vertexArray);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer[vbo]);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+
+  glBeginQuery(GL_TIME_ELAPSED, m_queries[0]);
+  glBeginQuery(GL_SAMPLES_PASSED, m_queries[1]);
+  glDrawArrays(GL_POINTS, 0, m_vboPoints);
+  glEndQuery(GL_SAMPLES_PASSED);
+  glEndQuery(GL_TIME_ELAPSED);
+
+  glDisableVertexAttribArray(0);
+  glBindVertexArray(0);
+  glUseProgramObjectARB(0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  GLuint64 elapsed = 0, passed = 0;
+  glGetQueryObjectui64v(m_queries[0], GL_QUERY_RESULT, &elapsed);
+  glGetQueryObjectui64v(m_queries[1], GL_QUERY_RESULT, &passed);
+
+  drawTime = elapsed*1e-6;
+  samples = passed;
+}
+
+//--------------------------------------------
+// csv goes to stdout when no file name is given
+//--------------------------------------------
+bool
+ReplayBench::replay(QString csvfile)
+{
+  if (m_frameMV.count() == 0)
+    {
+      m_error = "No camera path loaded";
+      return false;
+    }
+
+  if (!initGL())
+    return false;
+
+  QFile fl;
+  if (csvfile.isEmpty())
+    fl.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+  else
+    {
+      fl.setFileName(csvfile);
+      if (!fl.open(QIODevice::WriteOnly | QIODevice::Text))
+	{
+	  m_error = "Cannot write " + csvfile;
+	  return false;
+	}
+    }
+  QTextStream out(&fl);
+  out << "frame,select_ms,vistex_ms,nodes_requested,points_requested,"
+      << "nodes_uploaded,bytes_uploaded,upload_ms,draw_ms,"
+      << "points_drawn,samples_passed,frame_ms,late\n";
+
+  m_lodSelector.setProjFactor((0.5f*m_screenHeight)/qTan(m_fov/2));
+
+  double frameBudget = 1000.0/m_fps;
+  QVector<double> frameTimes;
+  int lateFrames = 0;
+  qint64 totalBytes = 0;
+
+  QElapsedTimer frameTimer, timer;
+  for(int f=0; f<m_frameMV.count(); f++)
+    {
+      frameTimer.start();
+
+      //-------------------------------
+      timer.start();
+      for(int i=0; i<m_allNodes.count(); i++)
+	{
+	  m_allNodes[i]->setActive(false);
+	  m_allNodes[i]->setPointLimit(-1);
+	}
+      QList<OctreeNode*> nodes = m_lodSelector.select(m_tiles,
+						      m_frameSelectMV[f],
+						      m_framePos[f]);
+      double selectTime = timer.nsecsElapsed()*1e-6;
+      //-------------------------------
+
+      timer.start();
+      createVisibilityTexture();
+      glFinish();
+      double vistexTime = timer.nsecsElapsed()*1e-6;
+
+      int nodesUploaded = 0;
+      timer.start();
+      qint64 bytes = uploadNodes(nodes, nodesUploaded);
+      double uploadTime = timer.nsecsElapsed()*1e-6;
+      totalBytes += bytes;
+
+      double drawTime = 0;
+      qint64 samples = 0;
+      drawPoints(m_frameProj[f]*m_frameMV[f], drawTime, samples);
+
+      double frameTime = frameTimer.nsecsElapsed()*1e-6;
+      bool late = (frameTime > frameBudget);
+      if (late) lateFrames++;
+      frameTimes << frameTime;
+
+      out << f << ","
+	  << selectTime << ","
+	  << vistexTime << ","
+	  << nodes.count() << ","
+	  << m_lodSelector.pointsSelected() << ","
+	  << nodesUploaded << ","
+	  << bytes << ","
+	  << uploadTime << ","
+	  << drawTime << ","
+	  << m_vboPoints << ","
+	  << samples << ","
+	  << frameTime << ","
+	  << (late ? 1 : 0) << "\n";
+    }
+  out.flush();
+
+  m_results = QJsonObject();
+  m_results["frames"] = m_frameMV.count();
+  m_results["fps"] = m_fps;
+  m_results["late_frames"] = lateFrames;
+  m_results["bytes_uploaded"] = totalBytes;
+  QJsonObject jsonFrame;
+  jsonFrame["p50"] = percentile(frameTimes, 0.5);
+  jsonFrame["p90"] = percentile(frameTimes, 0.9);
+  jsonFrame["p99"] = percentile(frameTimes, 0.99);
+  m_results["frame_ms"] = jsonFrame;
+  m_results["peak_rss_bytes"] = peakRSS();
+
+  return true;
+}
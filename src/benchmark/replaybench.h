@@ -0,0 +1,73 @@
+#ifndef REPLAYBENCH_H
+#define REPLAYBENCH_H
+
+#include "glewinitialisation.h"
+#include "loaderbench.h"
+#include "visibilitymap.h"
+
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QMatrix4x4>
+#include <QMap>
+#include <QPair>
+
+//--------------------------------------------
+// Plays a recorded camera path at a fixed frame rate and
+// writes per frame statistics as CSV.
+// The path is either a keyframes file saved from the keyframe
+// editor or a head pose log written by VR::setPoseLog.
+// Each frame runs the LOD selection, builds the visibility texture,
+// uploads new nodes into double buffered VBOs the way
+// GLHiddenWidget::loadPointsToVBO does and draws the points
+// into an offscreen framebuffer.
+//--------------------------------------------
+class ReplayBench : public LoaderBench
+{
+ public :
+  ReplayBench();
+  ~ReplayBench();
+
+  void setFrameRate(int f) { m_fps = qMax(1, f); }
+
+  bool loadPath(QString);
+
+  bool replay(QString);
+
+ private :
+  int m_fps;
+  float m_fov; // radians, used for the projection factor
+
+  QList<QMatrix4x4> m_frameMV;
+  QList<QMatrix4x4> m_frameSelectMV; // as GLHiddenWidget hands it to LodSelector
+  QList<QMatrix4x4> m_frameProj;
+  QList<Vec> m_framePos;
+
+  QOffscreenSurface *m_surface;
+  QOpenGLContext *m_context;
+
+  GLuint m_fbo, m_colorTex, m_depthRB;
+  GLuint m_vertexArray;
+  GLuint m_vertexBuffer[2];
+  GLuint m_visibilityTex;
+  VisibilityMap m_visibilityMap;
+  GLhandleARB m_program;
+  GLint m_mvpParm;
+  GLuint m_queries[2];
+
+  int m_dpv;
+  int m_currVBO;
+  qint64 m_vboPoints;
+  QMap<int, QPair<qint64, qint64> > m_prevNodes;
+
+  bool loadKeyFrames(QJsonArray);
+  bool loadPoseLog(QString);
+  void sceneBounds(Vec&, Vec&);
+
+  bool initGL();
+  void cleanGL();
+  void createVisibilityTexture();
+  qint64 uploadNodes(QList<OctreeNode*>, int&);
+  void drawPoints(QMatrix4x4, double&, qint64&);
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "budgetcontroller.h"
+
+#include <QtMath>
+
+// frames to wait after a change before judging the budget
+#define BUDGET_SETTLE_FRAMES 30
+
+// frames to wait for a load after a budget change, the
+// selection may not have changed at all
+#define BUDGET_LOAD_FRAMES 300
+
+// consecutive frames needed to lower or raise the budget
+#define BUDGET_OVER_FRAMES 5
+#define BUDGET_UNDER_FRAMES 45
+
+// band around the target in which the budget is kept
+#define BUDGET_OVER_FRACTION 1.05f
+#define BUDGET_UNDER_FRACTION 0.8f
+
+// smallest budget the controller goes down to
+#define BUDGET_MIN_POINTS 500000
+
+// render scale change per step
+#define BUDGET_SCALE_STEP 0.1f
+
+BudgetController::BudgetController()
+{
+  m_enabled = false;
+  m_targetMs = 1000.0f/60;
+  m_capacity = 0;
+  m_budget.store(0);
+
+  m_scaling = false;
+  m_minScale = 0.6f;
+  m_scale = 1.0f;
+
+  m_queries[0][0] = 0;
+  for(int i=0; i<4; i++)
+    m_pending[i] = false;
+  m_slot = 0;
+  m_inFrame = false;
+
+  m_waitLoad = false;
+  m_waitFrames = 0;
+
+  restart();
+}
+
+void
+BudgetController::restart()
+{
+  m_gpuMs = 0;
+  m_samples = 0;
+  m_overFrames = 0;
+  m_underFrames = 0;
+}
+
+void
+BudgetController::setEnabled(bool b)
+{
+  m_enabled = b;
+  m_budget.store(m_capacity);
+  m_waitLoad = false;
+  restart();
+}
+
+void
+BudgetController::setScaling(bool b, float minScale)
+{
+  m_scaling = b;
+  m_minScale = qBound(0.25f, minScale, 1.0f);
+  m_scale = 1.0f;
+  restart();
+}
+
+void
+BudgetController::setCapacity(qint64 c)
+{
+  m_capacity = c;
+  m_budget.store(c);
+  m_waitLoad = false;
+  restart();
+}
+
+void
+BudgetController::beginFrame()
+{
+  m_inFrame = false;
+
+  if (!m_enabled && !m_scaling)
+    return;
+
+  if (m_queries[0][0] == 0)
+    glGenQueries(8, &m_queries[0][0]);
+
+  // all slots still in flight, skip this frame
+  if (m_pending[m_slot])
+    return;
+
+  glQueryCounter(m_queries[m_slot][0], GL_TIMESTAMP);
+  m_inFrame = true;
+}
+
+void
+BudgetController::endFrame()
+{
+  if (!m_inFrame)
+    return;
+
+  glQueryCounter(m_queries[m_slot][1], GL_TIMESTAMP);
+  m_pending[m_slot] = true;
+  m_slot = (m_slot+1)%4;
+  m_inFrame = false;
+}
+
+bool
+BudgetController::update()
+{
+  if (!m_enabled && !m_scaling)
+    return false;
+
+  bool changed = false;
+
+  // oldest first, stop at the first one not done
+  for(int i=0; i<4; i++)
+    {
+      int s = (m_slot+i)%4;
+      if (!m_pending[s])
+	continue;
+
+      GLuint available = 0;
+      glGetQueryObjectuiv(m_queries[s][1],
+			  GL_QUERY_RESULT_AVAILABLE,
+			  &available);
+      if (!available)
+	break;
+
+      GLuint64 t0, t1;
+      glGetQueryObjectui64v(m_queries[s][0], GL_QUERY_RESULT, &t0);
+      glGetQueryObjectui64v(m_queries[s][1], GL_QUERY_RESULT, &t1);
+      m_pending[s] = false;
+
+      changed |= addSample((t1-t0)*1e-6);
+    }
+
+  return changed;
+}
+
+void
+BudgetController::nodesLoaded()
+{
+  if (!m_waitLoad)
+    return;
+
+  // settle frames count from here
+  m_waitLoad = false;
+  restart();
+}
+
+bool
+BudgetController::addSample(float ms)
+{
+  // frames drawn with the old nodes say nothing of the new budget
+  if (m_waitLoad)
+    {
+      m_waitFrames++;
+      if (m_waitFrames < BUDGET_LOAD_FRAMES)
+	return false;
+      m_waitLoad = false;
+      restart();
+    }
+
+  m_gpuMs = (m_samples == 0 ? ms : 0.9f*m_gpuMs + 0.1f*ms);
+  m_samples++;
+
+  if (m_samples < BUDGET_SETTLE_FRAMES)
+    return false;
+
+  if (m_gpuMs > m_targetMs*BUDGET_OVER_FRACTION)
+    {
+      m_overFrames++;
+      m_underFrames = 0;
+    }
+  else if (m_gpuMs < m_targetMs*BUDGET_UNDER_FRACTION)
+    {
+      m_underFrames++;
+      m_overFrames = 0;
+    }
+  else
+    {
+      m_overFrames = 0;
+      m_underFrames = 0;
+    }
+
+  // resolution goes down first and comes back up first
+  if (m_overFrames >= BUDGET_OVER_FRAMES)
+    {
+      if (m_scaling && m_scale > m_minScale)
+	{
+	  m_scale = qMax(m_minScale, m_scale - BUDGET_SCALE_STEP);
+	  restart();
+	  return false;
+	}
+
+      // cut roughly in proportion to the overshoot
+      if (m_enabled)
+	return changeBudget(qMax(0.6f, 0.95f*m_targetMs/m_gpuMs));
+    }
+  else if (m_underFrames >= BUDGET_UNDER_FRAMES)
+    {
+      if (m_scaling && m_scale < 1.0f)
+	{
+	  m_scale = qMin(1.0f, m_scale + BUDGET_SCALE_STEP);
+	  restart();
+	  return false;
+	}
+
+      if (m_enabled)
+	return changeBudget(1.1f);
+    }
+
+  return false;
+}
+
+bool
+BudgetController::changeBudget(float frc)
+{
+  qint64 budget = m_budget.load();
+  qint64 newBudget = budget*frc;
+
+  newBudget = qBound(qMin(m_capacity, (qint64)BUDGET_MIN_POINTS),
+		     newBudget,
+		     m_capacity);
+
+  if (qAbs(newBudget - budget) < budget/50)
+    {
+      m_overFrames = m_underFrames = 0;
+      return false;
+    }
+
+  m_budget.store(newBudget);
+
+  // judge the new budget on its own frames, once they are loaded
+  m_waitLoad = true;
+  m_waitFrames = 0;
+  restart();
+
+  return true;
+}
@@ -0,0 +1,93 @@
+#ifndef BUDGETCONTROLLER_H
+#define BUDGETCONTROLLER_H
+
+#include <GL/glew.h>
+
+#include <QAtomicInteger>
+
+//--------------------------------------------
+// Adapts the number of points selected for drawing, and in VR
+// the resolution of the point passes, so that frames hold a
+// target GPU time.
+// GPU time of a frame comes from GL_TIMESTAMP queries around
+// its rendering, picked up a few frames later so the queries
+// never stall the pipeline.
+// Frames over the target cut the budget in proportion, frames
+// well under it raise the budget in small steps, and nothing
+// changes in the band between. After a budget change the
+// controller ignores frames till the viewer reports a complete
+// load, or a timeout when the selection did not change, and then
+// waits a few more frames before judging again so the level of
+// detail does not oscillate.
+// The render scale is the first lever as it takes effect on
+// the next frame without reloading nodes: it is lowered before
+// the budget is cut and restored before the budget is raised.
+// The budget never exceeds the size of the point buffers, so
+// changing it does not reallocate them.
+//--------------------------------------------
+class BudgetController
+{
+ public :
+  BudgetController();
+
+  void setEnabled(bool);
+  bool enabled() { return m_enabled; }
+
+  // scale the point passes down to minScale of full resolution
+  void setScaling(bool, float);
+  bool scaling() { return m_scaling; }
+
+  void setTarget(float ms) { m_targetMs = ms; }
+  float target() { return m_targetMs; }
+
+  // points the buffers hold, the budget starts from there
+  void setCapacity(qint64);
+
+  // read by the loader thread as well
+  qint64 budget() { return m_budget.load(); }
+
+  // fraction of full resolution for the point passes
+  float renderScale() { return m_scale; }
+
+  // smoothed gpu frame time in ms
+  float gpuTime() { return m_gpuMs; }
+
+  // bracket the gpu work of a frame, GUI thread only
+  void beginFrame();
+  void endFrame();
+
+  // picks up finished queries, returns true when
+  // the budget changed and nodes need reselecting
+  bool update();
+
+  // all selected nodes are in the point buffers
+  void nodesLoaded();
+
+ private :
+  bool m_enabled;
+  float m_targetMs;
+  qint64 m_capacity;
+  QAtomicInteger<qint64> m_budget;
+
+  bool m_scaling;
+  float m_minScale;
+  float m_scale;
+
+  GLuint m_queries[4][2];
+  bool m_pending[4];
+  int m_slot;
+  bool m_inFrame;
+
+  float m_gpuMs;
+  int m_samples;   // since the last change
+  bool m_waitLoad; // budget changed, new nodes not loaded yet
+  int m_waitFrames;
+  int m_overFrames;
+  int m_underFrames;
+
+  void restart();
+  bool addSample(float);
+  bool changeBudget(float);
+};
+
+#endif
@@ -0,0 +1,24 @@
+TEMPLATE = app
+TARGET = lasconvert
+DEPENDPATH += . ..
+
+# headless - Qt core only
+QT += core concurrent
+QT -= gui
+
+CONFIG += release console c++11
+CONFIG -= app_bundle
+DESTDIR = ..\..\bin
+
+INCLUDEPATH += .. \
+	..\LASzip
+
+QMAKE_LIBDIR += ..\LASzip
+
+LIBS += LASzip.lib
+
+
+HEADERS += octreeconverter.h
+
+SOURCES += main.cpp \
+	octreeconverter.cpp
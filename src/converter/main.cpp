@@ -0,0 +1,70 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+#include "octreeconverter.h"
+
+int main(int argv, char **args)
+{
+  QCoreApplication app(argv, args);
+  QCoreApplication::setOrganizationName("NCI");
+  QCoreApplication::setApplicationName("lasconvert");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Convert LAS/LAZ files into an octree for lasVR");
+  parser.addHelpOption();
+  parser.addPositionalArgument("input", "LAS/LAZ files or directories containing them");
+
+  QCommandLineOption outOption(QStringList() << "o" << "output",
+			       "Output directory", "dir");
+  QCommandLineOption lazOption("laz", "Write LAZ nodes instead of BIN");
+  QCommandLineOption shuffleOption("shuffle",
+				   "Store points within each node in random order");
+  QCommandLineOption threadOption(QStringList() << "t" << "threads",
+				  "Number of threads", "n");
+  QCommandLineOption memOption(QStringList() << "m" << "memory",
+			       "Memory limit in MB", "mb", "4096");
+  QCommandLineOption spacingOption("spacing",
+				   "Point spacing at root level", "s");
+  QCommandLineOption scaleOption("scale",
+				 "Coordinate precision", "s", "0.001");
+
+  parser.addOption(outOption);
+  parser.addOption(lazOption);
+  parser.addOption(shuffleOption);
+  parser.addOption(threadOption);
+  parser.addOption(memOption);
+  parser.addOption(spacingOption);
+  parser.addOption(scaleOption);
+
+  parser.process(app);
+
+  QTextStream err(stderr);
+
+  if (parser.positionalArguments().count() == 0 ||
+      !parser.isSet(outOption))
+    {
+      err << parser.helpText();
+      return 1;
+    }
+
+  OctreeConverter converter;
+  converter.setInputFiles(parser.positionalArguments());
+  converter.setOutputDir(parser.value(outOption));
+  converter.setLAZOutput(parser.isSet(lazOption));
+  converter.setShuffle(parser.isSet(shuffleOption));
+  if (parser.isSet(threadOption))
+    converter.setThreads(parser.value(threadOption).toInt());
+  converter.setMemoryLimit(parser.value(memOption).toLongLong()*1024*1024);
+  if (parser.isSet(spacingOption))
+    converter.setSpacing(parser.value(spacingOption).toDouble());
+  converter.setScale(parser.value(scaleOption).toDouble());
+
+  if (!converter.convert())
+    {
+      err << converter.errorString() << "\n";
+      return 1;
+    }
+
+  return 0;
+}
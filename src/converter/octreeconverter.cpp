@@ -0,0 +1,950 @@
+#include "octreeconverter.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QtConcurrent>
+#include <QtMath>
+
+#include <random>
+#include <algorithm>
+
+#include "laszip_dll.h"
+
+#define CONV_GRID_LEVELS 7
+#define CONV_GRID (1 << CONV_GRID_LEVELS)
+#define CONV_MAX_LEVEL 20
+
+static void
+message(QString mesg)
+{
+  QTextStream out(stdout);
+  out << mesg << "\n";
+  out.flush();
+}
+
+// breadth first, the order PointCloud::saveOctreeNodeToJson writes
+static bool
+levelOrder(const QString &a, const QString &b)
+{
+  if (a.count() != b.count())
+    return a.count() < b.count();
+  return a < b;
+}
+
+OctreeConverter::OctreeConverter()
+{
+  m_files.clear();
+  m_outDir.clear();
+  m_lazOutput = false;
+  m_shuffle = false;
+  m_memoryLimit = (qint64)4*1024*1024*1024;
+  m_spacing = 0; // computed from bounding box
+  m_scale = 0.001;
+  m_leafPoints = 20000;
+
+  m_totalPoints = 0;
+  m_colorPresent = false;
+  m_chunkLimit = 0;
+
+  setThreads(QThread::idealThreadCount());
+}
+
+void
+OctreeConverter::setThreads(int n)
+{
+  m_threads = qMax(1, n);
+  QThreadPool::globalInstance()->setMaxThreadCount(m_threads);
+}
+
+void
+OctreeConverter::setInputFiles(QStringList flist)
+{
+  m_files.clear();
+
+  for(int i=0; i<flist.count(); i++)
+    {
+      QFileInfo finfo(flist[i]);
+      if (finfo.isDir())
+	{
+	  QDirIterator dirIter(flist[i],
+			       QStringList() << "*.las" << "*.laz",
+			       QDir::Files | QDir::Readable,
+			       QDirIterator::Subdirectories);
+	  while(dirIter.hasNext())
+	    m_files << dirIter.next();
+	}
+      else
+	m_files << finfo.absoluteFilePath();
+    }
+}
+
+bool
+OctreeConverter::convert()
+{
+  if (m_files.count() == 0)
+    {
+      m_error = "No LAS/LAZ files to convert";
+      return false;
+    }
+
+  if (m_outDir.isEmpty())
+    {
+      m_error = "No output directory specified";
+      return false;
+    }
+
+  m_tmpDir = QDir(m_outDir).absoluteFilePath("tmp");
+  if (!QDir().mkpath(QDir(m_outDir).absoluteFilePath("data/r")) ||
+      !QDir().mkpath(m_tmpDir))
+    {
+      m_error = "Cannot create directories in "+m_outDir;
+      return false;
+    }
+
+  m_nodes.clear();
+  m_pendingRoots.clear();
+
+  //-----------------------
+  if (!readHeaders())
+    return false;
+
+  message(QString("%1 points in %2 files").arg(m_totalPoints).arg(m_files.count()));
+  //-----------------------
+
+  QList<int> fileIdx;
+  for(int i=0; i<m_files.count(); i++)
+    fileIdx << i;
+
+  //-----------------------
+  // counting pass
+  m_counts.fill(0, CONV_GRID*CONV_GRID*CONV_GRID);
+  m_color16.fill(false, m_files.count());
+  QtConcurrent::blockingMap(fileIdx, [this](int &i) { countFile(i); });
+
+  createChunks();
+  m_counts.clear();
+  m_counts.squeeze();
+
+  message(QString("%1 chunks of at most %2 points").	\
+	  arg(m_chunks.count()).arg(m_chunkLimit));
+  //-----------------------
+
+
+  //-----------------------
+  // distribution pass
+  QtConcurrent::blockingMap(fileIdx, [this](int &i) { distributeFile(i); });
+  m_cellChunk.clear();
+  m_cellChunk.squeeze();
+
+  message("Points distributed");
+  //-----------------------
+
+
+  //-----------------------
+  // chunks to subtrees
+  QList<int> chunkIdx;
+  for(int i=0; i<m_chunks.count(); i++)
+    chunkIdx << i;
+  QtConcurrent::blockingMap(chunkIdx, [this](int &i) { buildChunk(i); });
+
+  message("Chunks done");
+  //-----------------------
+
+
+  //-----------------------
+  // levels above the chunks, deepest first
+  int maxLen = 0;
+  for(int i=0; i<m_pendingRoots.count(); i++)
+    maxLen = qMax(maxLen, m_pendingRoots[i].count());
+
+  for(int l=maxLen-1; l>=0; l--)
+    {
+      QSet<QString> upper;
+      for(int i=0; i<m_pendingRoots.count(); i++)
+	{
+	  if (m_pendingRoots[i].count() > l)
+	    upper << m_pendingRoots[i].left(l);
+	}
+
+      QList<QString> levelNodes = upper.toList();
+      QtConcurrent::blockingMap(levelNodes, [this](QString &ls) { buildUpperNode(ls); });
+    }
+  //-----------------------
+
+
+  if (!writeMetadata())
+    return false;
+
+  QDir(m_tmpDir).removeRecursively();
+
+  message(QString("%1 nodes written to %2").arg(m_nodes.count()).arg(m_outDir));
+
+  return true;
+}
+
+bool
+OctreeConverter::readHeaders()
+{
+  m_totalPoints = 0;
+  m_colorPresent = false;
+
+  for(int i=0; i<m_files.count(); i++)
+    {
+      laszip_POINTER laszip_reader;
+      laszip_create(&laszip_reader);
+
+      laszip_BOOL is_compressed = m_files[i].endsWith(".laz", Qt::CaseInsensitive);
+      if (laszip_open_reader(laszip_reader, QFile::encodeName(m_files[i]).data(), &is_compressed))
+	{
+	  m_error = "Error opening file "+m_files[i];
+	  laszip_destroy(laszip_reader);
+	  return false;
+	}
+
+      laszip_header* header;
+      laszip_get_header_pointer(laszip_reader, &header);
+
+      laszip_I64 npts = (header->number_of_point_records ? header->number_of_point_records : header->extended_number_of_point_records);
+
+      ConvVec hmin(header->min_x, header->min_y, header->min_z);
+      ConvVec hmax(header->max_x, header->max_y, header->max_z);
+      if (i == 0)
+	{
+	  m_tightMin = hmin;
+	  m_tightMax = hmax;
+	}
+      else
+	{
+	  m_tightMin = ConvVec(qMin(m_tightMin.x, hmin.x),
+			   qMin(m_tightMin.y, hmin.y),
+			   qMin(m_tightMin.z, hmin.z));
+	  m_tightMax = ConvVec(qMax(m_tightMax.x, hmax.x),
+			   qMax(m_tightMax.y, hmax.y),
+			   qMax(m_tightMax.z, hmax.z));
+	}
+
+      // point formats carrying rgb
+      int fmt = header->point_data_format;
+      if (fmt == 2 || fmt == 3 || fmt == 5 ||
+	  fmt == 7 || fmt == 8 || fmt == 10)
+	m_colorPresent = true;
+
+      m_totalPoints += npts;
+
+      laszip_close_reader(laszip_reader);
+      laszip_destroy(laszip_reader);
+    }
+
+  if (m_totalPoints == 0)
+    {
+      m_error = "No points found";
+      return false;
+    }
+
+  //-----------------------
+  // octree is a cube starting at the tight minimum
+  ConvVec ext = m_tightMax - m_tightMin;
+  double size = qMax(ext.x, qMax(ext.y, ext.z));
+  if (size <= 0)
+    size = 1;
+  m_bmin = m_tightMin;
+  m_bmax = m_bmin + ConvVec(size, size, size);
+
+  if (m_spacing <= 0)
+    m_spacing = (m_bmax-m_bmin).norm()/250;
+
+  // coordinates relative to the octree minimum need to fit in 31 bits
+  while (size/m_scale > 2.0e9)
+    m_scale *= 10;
+  //-----------------------
+
+  //-----------------------
+  // about 64 bytes per point are needed while building a chunk
+  m_chunkLimit = qMax((qint64)1000000, m_memoryLimit/(m_threads*64));
+  //-----------------------
+
+  return true;
+}
+
+int
+OctreeConverter::gridCell(double x, double y, double z)
+{
+  double size = m_bmax.x - m_bmin.x;
+  int ix = qBound(0, (int)(CONV_GRID*(x-m_bmin.x)/size), CONV_GRID-1);
+  int iy = qBound(0, (int)(CONV_GRID*(y-m_bmin.y)/size), CONV_GRID-1);
+  int iz = qBound(0, (int)(CONV_GRID*(z-m_bmin.z)/size), CONV_GRID-1);
+
+  return (ix*CONV_GRID + iy)*CONV_GRID + iz;
+}
+
+//--------------------------------------------
+// each file is counted into its own histogram
+// which is then added to the global one
+//--------------------------------------------
+void
+OctreeConverter::countFile(int fidx)
+{
+  laszip_POINTER laszip_reader;
+  laszip_create(&laszip_reader);
+
+  laszip_BOOL is_compressed = m_files[fidx].endsWith(".laz", Qt::CaseInsensitive);
+  if (laszip_open_reader(laszip_reader, QFile::encodeName(m_files[fidx]).data(), &is_compressed))
+    {
+      laszip_destroy(laszip_reader);
+      return;
+    }
+
+  laszip_header* header;
+  laszip_get_header_pointer(laszip_reader, &header);
+  laszip_I64 npts = (header->number_of_point_records ? header->number_of_point_records : header->extended_number_of_point_records);
+
+  laszip_point* point;
+  laszip_get_point_pointer(laszip_reader, &point);
+
+  QVector<quint32> counts(CONV_GRID*CONV_GRID*CONV_GRID, 0);
+  bool color16 = false;
+  for(qint64 i=0; i<npts; i++)
+    {
+      laszip_read_point(laszip_reader);
+
+      double x = point->X*header->x_scale_factor + header->x_offset;
+      double y = point->Y*header->y_scale_factor + header->y_offset;
+      double z = point->Z*header->z_scale_factor + header->z_offset;
+
+      counts[gridCell(x,y,z)]++;
+
+      // many writers store 8 bit colour despite the spec,
+      // one value above 255 means the file is 16 bit
+      if (point->rgb[0] > 255 ||
+	  point->rgb[1] > 255 ||
+	  point->rgb[2] > 255)
+	color16 = true;
+    }
+
+  laszip_close_reader(laszip_reader);
+  laszip_destroy(laszip_reader);
+
+  QMutexLocker lock(&m_mutex);
+  for(int i=0; i<counts.count(); i++)
+    m_counts[i] += counts[i];
+  m_color16[fidx] = color16;
+}
+
+//--------------------------------------------
+// sum the counts up a pyramid and go down from the top
+// till the cells fit in the chunk limit
+//--------------------------------------------
+void
+OctreeConverter::createChunks()
+{
+  QList< QVector<qint64> > pyramid;
+  for(int l=0; l<=CONV_GRID_LEVELS; l++)
+    pyramid << QVector<qint64>();
+
+  pyramid[CONV_GRID_LEVELS].resize(m_counts.count());
+  for(int i=0; i<m_counts.count(); i++)
+    pyramid[CONV_GRID_LEVELS][i] = m_counts[i];
+
+  for(int l=CONV_GRID_LEVELS-1; l>=0; l--)
+    {
+      int n = 1 << l;
+      pyramid[l].fill(0, n*n*n);
+      for(int ix=0; ix<n; ix++)
+      for(int iy=0; iy<n; iy++)
+      for(int iz=0; iz<n; iz++)
+	{
+	  qint64 sum = 0;
+	  for(int k=0; k<8; k++)
+	    {
+	      int cx = 2*ix + (k>3 ? 1 : 0);
+	      int cy = 2*iy + (k%4>1 ? 1 : 0);
+	      int cz = 2*iz + (k%2);
+	      sum += pyramid[l+1][(cx*2*n + cy)*2*n + cz];
+	    }
+	  pyramid[l][(ix*n + iy)*n + iz] = sum;
+	}
+    }
+
+  m_chunks.clear();
+  addChunks(pyramid, 0, 0, 0, 0);
+
+  // finest grid cell -> chunk
+  m_cellChunk.fill(-1, CONV_GRID*CONV_GRID*CONV_GRID);
+  for(int c=0; c<m_chunks.count(); c++)
+    {
+      int shift = CONV_GRID_LEVELS - m_chunks[c].level;
+      int w = 1 << shift;
+      int x0 = m_chunks[c].ix << shift;
+      int y0 = m_chunks[c].iy << shift;
+      int z0 = m_chunks[c].iz << shift;
+      for(int ix=x0; ix<x0+w; ix++)
+      for(int iy=y0; iy<y0+w; iy++)
+      for(int iz=z0; iz<z0+w; iz++)
+	m_cellChunk[(ix*CONV_GRID + iy)*CONV_GRID + iz] = c;
+    }
+}
+
+void
+OctreeConverter::addChunks(QList< QVector<qint64> > &pyramid,
+			   int l, int ix, int iy, int iz)
+{
+  int n = 1 << l;
+  qint64 npts = pyramid[l][(ix*n + iy)*n + iz];
+  if (npts == 0)
+    return;
+
+  // a single finest cell above the limit becomes a chunk anyway
+  if (npts <= m_chunkLimit || l == CONV_GRID_LEVELS)
+    {
+      ConvChunk chunk;
+      chunk.level = l;
+      chunk.ix = ix;
+      chunk.iy = iy;
+      chunk.iz = iz;
+      chunk.numpoints = npts;
+
+      // same child numbering as PointCloud::loadOctreeNodeFromJson
+      chunk.levelString.clear();
+      for(int d=0; d<l; d++)
+	{
+	  int s = l-1-d;
+	  int k = 4*((ix>>s)&1) + 2*((iy>>s)&1) + ((iz>>s)&1);
+	  chunk.levelString += QString::number(k);
+	}
+
+      m_chunks << chunk;
+      return;
+    }
+
+  for(int k=0; k<8; k++)
+    addChunks(pyramid, l+1,
+	      2*ix + (k>3 ? 1 : 0),
+	      2*iy + (k%4>1 ? 1 : 0),
+	      2*iz + (k%2));
+}
+
+void
+OctreeConverter::appendChunk(int c, QByteArray &buf)
+{
+  QMutexLocker lock(&m_mutex);
+
+  QFile fl(chunkFile(c));
+  fl.open(QFile::WriteOnly | QFile::Append);
+  fl.write(buf);
+  fl.close();
+
+  buf.clear();
+}
+
+void
+OctreeConverter::distributeFile(int fidx)
+{
+  laszip_POINTER laszip_reader;
+  laszip_create(&laszip_reader);
+
+  laszip_BOOL is_compressed = m_files[fidx].endsWith(".laz", Qt::CaseInsensitive);
+  if (laszip_open_reader(laszip_reader, QFile::encodeName(m_files[fidx]).data(), &is_compressed))
+    {
+      laszip_destroy(laszip_reader);
+      return;
+    }
+
+  laszip_header* header;
+  laszip_get_header_pointer(laszip_reader, &header);
+  laszip_I64 npts = (header->number_of_point_records ? header->number_of_point_records : header->extended_number_of_point_records);
+
+  laszip_point* point;
+  laszip_get_point_pointer(laszip_reader, &point);
+
+  // colour is held as 16 bit whatever the file had
+  int colorScale = (m_color16[fidx] ? 1 : 257);
+
+  // per chunk buffers - a quarter of the memory limit is
+  // shared by all threads for distribution
+  int nchunks = m_chunks.count();
+  qint64 flushSize = m_memoryLimit/(4*m_threads*nchunks);
+  flushSize = qBound((qint64)16*1024, flushSize, (qint64)1024*1024);
+  QVector<QByteArray> buffers(nchunks);
+
+  for(qint64 i=0; i<npts; i++)
+    {
+      laszip_read_point(laszip_reader);
+
+      double x = point->X*header->x_scale_factor + header->x_offset;
+      double y = point->Y*header->y_scale_factor + header->y_offset;
+      double z = point->Z*header->z_scale_factor + header->z_offset;
+
+      ConvPoint cp;
+      cp.x = qRound64((x-m_bmin.x)/m_scale);
+      cp.y = qRound64((y-m_bmin.y)/m_scale);
+      cp.z = qRound64((z-m_bmin.z)/m_scale);
+      cp.rgb[0] = point->rgb[0]*colorScale;
+      cp.rgb[1] = point->rgb[1]*colorScale;
+      cp.rgb[2] = point->rgb[2]*colorScale;
+      cp.cls = point->classification;
+      cp.pad = 0;
+
+      int c = m_cellChunk[gridCell(x,y,z)];
+      buffers[c].append((char*)&cp, sizeof(ConvPoint));
+      if (buffers[c].size() >= flushSize)
+	appendChunk(c, buffers[c]);
+    }
+
+  for(int c=0; c<nchunks; c++)
+    {
+      if (buffers[c].size() > 0)
+	appendChunk(c, buffers[c]);
+    }
+
+  laszip_close_reader(laszip_reader);
+  laszip_destroy(laszip_reader);
+}
+
+void
+OctreeConverter::buildChunk(int c)
+{
+  QVector<ConvPoint> pts = readRaw(chunkFile(c));
+  QFile::remove(chunkFile(c));
+
+  // random order so that the first point landing in
+  // a sampling cell is a random pick
+  std::mt19937 rng(c+1);
+  std::shuffle(pts.begin(), pts.end(), rng);
+
+  buildNode(m_chunks[c].levelString, pts, true);
+}
+
+void
+OctreeConverter::nodeBox(QString ls, ConvVec &bmin, ConvVec &bmax)
+{
+  // same subdivision as PointCloud::loadOctreeNodeFromJson
+  bmin = m_bmin;
+  ConvVec bsize = m_bmax-m_bmin;
+  for(int vl=0; vl<ls.count(); vl++)
+    {
+      int d = ls[vl].digitValue();
+      bsize /= 2;
+      if (d%2 > 0) bmin.z += bsize.z;
+      if (d%4 > 1) bmin.y += bsize.y;
+      if (d   > 3) bmin.x += bsize.x;
+    }
+  bmax = bmin + bsize;
+}
+
+//--------------------------------------------
+// first point in each cell of size spacing is kept,
+// points are expected in random order
+//--------------------------------------------
+QVector<bool>
+OctreeConverter::sample(QString ls, const QVector<ConvPoint> &pts)
+{
+  ConvVec bmin, bmax;
+  nodeBox(ls, bmin, bmax);
+  double spacing = nodeSpacing(ls);
+  qint64 n = qCeil((bmax.x-bmin.x)/spacing) + 1;
+
+  QVector<bool> keep(pts.count(), false);
+  QSet<qint64> occupied;
+  for(int i=0; i<pts.count(); i++)
+    {
+      qint64 cx = qBound((qint64)0, (qint64)((m_bmin.x + pts[i].x*m_scale - bmin.x)/spacing), n-1);
+      qint64 cy = qBound((qint64)0, (qint64)((m_bmin.y + pts[i].y*m_scale - bmin.y)/spacing), n-1);
+      qint64 cz = qBound((qint64)0, (qint64)((m_bmin.z + pts[i].z*m_scale - bmin.z)/spacing), n-1);
+      qint64 key = (cx*n + cy)*n + cz;
+      if (!occupied.contains(key))
+	{
+	  occupied << key;
+	  keep[i] = true;
+	}
+    }
+
+  return keep;
+}
+
+void
+OctreeConverter::buildNode(QString ls, QVector<ConvPoint> &pts, bool chunkRoot)
+{
+  int level = ls.count();
+
+  QVector<ConvPoint> nodePts;
+  QVector<ConvPoint> childPts[8];
+
+  if (pts.count() <= m_leafPoints || level >= CONV_MAX_LEVEL)
+    {
+      // leaf - keeps everything
+      nodePts = pts;
+      pts.clear();
+    }
+  else
+    {
+      QVector<bool> keep = sample(ls, pts);
+
+      ConvVec bmin, bmax;
+      nodeBox(ls, bmin, bmax);
+      ConvVec bmid = (bmin+bmax)*0.5 - m_bmin;
+      double midx = bmid.x/m_scale;
+      double midy = bmid.y/m_scale;
+      double midz = bmid.z/m_scale;
+
+      // counting sort of the remaining points into the children
+      QVector<uchar> child(pts.count());
+      int count[8] = {0,0,0,0,0,0,0,0};
+      int nkeep = 0;
+      for(int i=0; i<pts.count(); i++)
+	{
+	  if (keep[i])
+	    {
+	      nkeep++;
+	      continue;
+	    }
+	  int k = (pts[i].x >= midx ? 4 : 0) +
+	          (pts[i].y >= midy ? 2 : 0) +
+	          (pts[i].z >= midz ? 1 : 0);
+	  child[i] = k;
+	  count[k]++;
+	}
+
+      nodePts.reserve(nkeep);
+      for(int k=0; k<8; k++)
+	childPts[k].reserve(count[k]);
+
+      for(int i=0; i<pts.count(); i++)
+	{
+	  if (keep[i])
+	    nodePts << pts[i];
+	  else
+	    childPts[child[i]] << pts[i];
+	}
+
+      pts.clear();
+      pts.squeeze();
+    }
+
+  if (chunkRoot && level > 0)
+    {
+      // sampled again when building the levels above
+      writeRaw(rawFile(ls), nodePts);
+      QMutexLocker lock(&m_mutex);
+      m_pendingRoots << ls;
+    }
+  else
+    writeNode(ls, nodePts);
+
+  nodePts.clear();
+  nodePts.squeeze();
+
+  for(int k=0; k<8; k++)
+    {
+      if (childPts[k].count() > 0)
+	buildNode(ls + QString::number(k), childPts[k], false);
+    }
+}
+
+//--------------------------------------------
+// node above the chunks - takes its sample from the points
+// of its children, children are final after this
+//--------------------------------------------
+void
+OctreeConverter::buildUpperNode(QString ls)
+{
+  QVector<ConvPoint> pts;
+  QVector<uchar> owner;
+  for(int k=0; k<8; k++)
+    {
+      QString cls = ls + QString::number(k);
+      if (!QFile::exists(rawFile(cls)))
+	continue;
+
+      QVector<ConvPoint> cpts = readRaw(rawFile(cls));
+      pts += cpts;
+      owner += QVector<uchar>(cpts.count(), k);
+    }
+
+  // shuffle points along with their owners
+  std::mt19937 rng(qHash(ls)+1);
+  for(int i=pts.count()-1; i>0; i--)
+    {
+      int j = std::uniform_int_distribution<int>(0, i)(rng);
+      qSwap(pts[i], pts[j]);
+      qSwap(owner[i], owner[j]);
+    }
+
+  QVector<bool> keep = sample(ls, pts);
+
+  QVector<ConvPoint> nodePts;
+  QVector<ConvPoint> childPts[8];
+  for(int i=0; i<pts.count(); i++)
+    {
+      if (keep[i])
+	nodePts << pts[i];
+      else
+	childPts[owner[i]] << pts[i];
+    }
+  pts.clear();
+
+  for(int k=0; k<8; k++)
+    {
+      QString cls = ls + QString::number(k);
+      if (!QFile::exists(rawFile(cls)))
+	continue;
+
+      writeNode(cls, childPts[k]);
+      QFile::remove(rawFile(cls));
+    }
+
+  if (ls.isEmpty())
+    writeNode(ls, nodePts);
+  else
+    writeRaw(rawFile(ls), nodePts);
+}
+
+void
+OctreeConverter::writeRaw(QString flnm, const QVector<ConvPoint> &pts)
+{
+  QFile fl(flnm);
+  fl.open(QFile::WriteOnly);
+  fl.write((char*)pts.constData(), pts.count()*sizeof(ConvPoint));
+  fl.close();
+}
+
+QVector<ConvPoint>
+OctreeConverter::readRaw(QString flnm)
+{
+  QFile fl(flnm);
+  fl.open(QFile::ReadOnly);
+  QVector<ConvPoint> pts(fl.size()/sizeof(ConvPoint));
+  fl.read((char*)pts.data(), pts.count()*sizeof(ConvPoint));
+  fl.close();
+
+  return pts;
+}
+
+//--------------------------------------------
+// node coordinates are stored relative to the node minimum
+// in units of the cloud.js scale, as read by OctreeNode
+//--------------------------------------------
+void
+OctreeConverter::writeNode(QString ls, QVector<ConvPoint> &pts)
+{
+  if (m_shuffle)
+    {
+      std::mt19937 rng(qHash(ls)+7);
+      std::shuffle(pts.begin(), pts.end(), rng);
+    }
+
+  ConvVec bmin, bmax;
+  nodeBox(ls, bmin, bmax);
+  double ox = (bmin.x-m_bmin.x)/m_scale;
+  double oy = (bmin.y-m_bmin.y)/m_scale;
+  double oz = (bmin.z-m_bmin.z)/m_scale;
+
+  QString flnm = QDir(m_outDir).absoluteFilePath(QString("data/r/r%1.%2").\
+						 arg(ls).\
+						 arg(m_lazOutput ? "laz" : "bin"));
+
+  if (!m_lazOutput)
+    {
+      // POSITION_CARTESIAN, COLOR_PACKED
+      QByteArray data(16*pts.count(), 0);
+      for(int i=0; i<pts.count(); i++)
+	{
+	  int *crd = (int*)(data.data() + 16*i);
+	  uchar *rgb = (uchar*)(data.data() + 16*i + 12);
+	  crd[0] = qRound64(pts[i].x - ox);
+	  crd[1] = qRound64(pts[i].y - oy);
+	  crd[2] = qRound64(pts[i].z - oz);
+	  for(int c=0; c<3; c++)
+	    rgb[c] = pts[i].rgb[c] >> 8;
+	  rgb[3] = 255;
+	}
+
+      QFile fl(flnm);
+      fl.open(QFile::WriteOnly);
+      fl.write(data);
+      fl.close();
+    }
+  else
+    {
+      laszip_POINTER laszip_writer;
+      laszip_create(&laszip_writer);
+
+      laszip_header* header;
+      laszip_get_header_pointer(laszip_writer, &header);
+
+      header->point_data_format = (m_colorPresent ? 2 : 0);
+      header->point_data_record_length = (m_colorPresent ? 26 : 20);
+      header->number_of_point_records = pts.count();
+      header->x_scale_factor = m_scale;
+      header->y_scale_factor = m_scale;
+      header->z_scale_factor = m_scale;
+      header->x_offset = bmin.x;
+      header->y_offset = bmin.y;
+      header->z_offset = bmin.z;
+      header->min_x = bmin.x;
+      header->min_y = bmin.y;
+      header->min_z = bmin.z;
+      header->max_x = bmax.x;
+      header->max_y = bmax.y;
+      header->max_z = bmax.z;
+
+      if (laszip_open_writer(laszip_writer, QFile::encodeName(flnm).data(), 1))
+	{
+	  message("Error writing "+flnm);
+	  laszip_destroy(laszip_writer);
+	  return;
+	}
+
+      laszip_point* point;
+      laszip_get_point_pointer(laszip_writer, &point);
+
+      for(int i=0; i<pts.count(); i++)
+	{
+	  point->X = qRound64(pts[i].x - ox);
+	  point->Y = qRound64(pts[i].y - oy);
+	  point->Z = qRound64(pts[i].z - oz);
+	  point->rgb[0] = pts[i].rgb[0];
+	  point->rgb[1] = pts[i].rgb[1];
+	  point->rgb[2] = pts[i].rgb[2];
+	  point->classification = pts[i].cls;
+	  laszip_write_point(laszip_writer);
+	}
+
+      laszip_close_writer(laszip_writer);
+      laszip_destroy(laszip_writer);
+    }
+
+  QMutexLocker lock(&m_mutex);
+  m_nodes[ls] = pts.count();
+}
+
+bool
+OctreeConverter::writeMetadata()
+{
+  QDir outdir(m_outDir);
+
+  //-----------------------
+  // octree.json as PointCloud::saveOctreeNodeToJson writes it,
+  // done here so the converter does not pull in the viewer
+  QMap<QString, int> levelsBelow;
+  QStringList keys = m_nodes.keys();
+  for(int i=0; i<keys.count(); i++)
+    {
+      QString ls = keys[i];
+      for(int p=0; p<=ls.count(); p++)
+	{
+	  QString pls = ls.left(p);
+	  levelsBelow[pls] = qMax(levelsBelow.value(pls, 0), ls.count()-p);
+	}
+    }
+
+  QStringList levels = levelsBelow.keys();
+  std::sort(levels.begin(), levels.end(), levelOrder);
+
+  QJsonArray jsonOctreeData;
+  for(int i=0; i<levels.count(); i++)
+    {
+      QString ls = levels[i];
+
+      QJsonObject jsonInfo;
+      if (m_nodes.contains(ls))
+	jsonInfo["filename"] = QString("data/r/r%1.%2").\
+	                         arg(ls).\
+	                         arg(m_lazOutput ? "laz" : "bin");
+      else
+	jsonInfo["filename"] = "";
+      jsonInfo["numpoints"] = m_nodes.value(ls, 0);
+      jsonInfo["levelsbelow"] = levelsBelow[ls];
+      jsonInfo["level"] = ls;
+
+      QJsonObject jsonOctreeNode;
+      jsonOctreeNode["node"] = jsonInfo;
+      jsonOctreeData << jsonOctreeNode;
+    }
+
+  QFile octreeFile(outdir.absoluteFilePath("octree.json"));
+  if (!octreeFile.open(QIODevice::WriteOnly))
+    {
+      m_error = "Cannot write "+octreeFile.fileName();
+      return false;
+    }
+  octreeFile.write(QJsonDocument(jsonOctreeData).toJson());
+  octreeFile.close();
+  //-----------------------
+
+
+  //-----------------------
+  QJsonObject jsonCloud;
+  jsonCloud["version"] = "1.7";
+  jsonCloud["octreeDir"] = "data";
+  jsonCloud["points"] = m_totalPoints;
+
+  QJsonObject jsonBox;
+  jsonBox["lx"] = m_bmin.x;
+  jsonBox["ly"] = m_bmin.y;
+  jsonBox["lz"] = m_bmin.z;
+  jsonBox["ux"] = m_bmax.x;
+  jsonBox["uy"] = m_bmax.y;
+  jsonBox["uz"] = m_bmax.z;
+  jsonCloud["boundingBox"] = jsonBox;
+
+  QJsonObject jsonTightBox;
+  jsonTightBox["lx"] = m_tightMin.x;
+  jsonTightBox["ly"] = m_tightMin.y;
+  jsonTightBox["lz"] = m_tightMin.z;
+  jsonTightBox["ux"] = m_tightMax.x;
+  jsonTightBox["uy"] = m_tightMax.y;
+  jsonTightBox["uz"] = m_tightMax.z;
+  jsonCloud["tightBoundingBox"] = jsonTightBox;
+
+  if (m_lazOutput)
+    jsonCloud["pointAttributes"] = "LAZ";
+  else
+    {
+      QJsonArray jsonAttrib;
+      jsonAttrib << "POSITION_CARTESIAN" << "COLOR_PACKED";
+      jsonCloud["pointAttributes"] = jsonAttrib;
+    }
+
+  jsonCloud["spacing"] = m_spacing;
+  jsonCloud["scale"] = m_scale;
+  jsonCloud["hierarchyStepSize"] = CONV_MAX_LEVEL;
+  jsonCloud["shuffled"] = m_shuffle;
+
+  QFile cloudFile(outdir.absoluteFilePath("cloud.js"));
+  if (!cloudFile.open(QIODevice::WriteOnly))
+    {
+      m_error = "Cannot write "+cloudFile.fileName();
+      return false;
+    }
+  cloudFile.write(QJsonDocument(jsonCloud).toJson());
+  cloudFile.close();
+  //-----------------------
+
+
+  //-----------------------
+  // no rgb in the input - let the viewer color by height
+  if (!m_colorPresent)
+    {
+      QJsonObject jsonMod;
+      QJsonObject jsonInfo;
+      jsonInfo["color"] = false;
+      jsonMod["mod"] = jsonInfo;
+
+      QFile modFile(outdir.absoluteFilePath("mod.json"));
+      modFile.open(QIODevice::WriteOnly);
+      modFile.write(QJsonDocument(jsonMod).toJson());
+      modFile.close();
+    }
+  //-----------------------
+
+  return true;
+}
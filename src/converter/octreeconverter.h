@@ -0,0 +1,137 @@
+#ifndef OCTREECONVERTER_H
+#define OCTREECONVERTER_H
+
+#include <QStringList>
+#include <QVector>
+#include <QMap>
+#include <QMutex>
+#include <QtMath>
+
+//--------------------------------------------
+// double precision point, all the converter needs of
+// QGLViewer's Vec without pulling in the GL headers
+//--------------------------------------------
+struct ConvVec
+{
+  double x, y, z;
+
+  ConvVec() : x(0), y(0), z(0) {}
+  ConvVec(double px, double py, double pz) : x(px), y(py), z(pz) {}
+
+  ConvVec operator+(const ConvVec &v) const { return ConvVec(x+v.x, y+v.y, z+v.z); }
+  ConvVec operator-(const ConvVec &v) const { return ConvVec(x-v.x, y-v.y, z-v.z); }
+  ConvVec operator*(double f) const { return ConvVec(x*f, y*f, z*f); }
+  ConvVec& operator/=(double f) { x/=f; y/=f; z/=f; return *this; }
+
+  double norm() const { return qSqrt(x*x + y*y + z*z); }
+};
+
+//--------------------------------------------
+// point as held during conversion,
+// coordinates are relative to the octree minimum
+// in units of the output scale, colour is 16 bit
+//--------------------------------------------
+struct ConvPoint
+{
+  qint32 x, y, z;
+  quint16 rgb[3];
+  uchar cls;
+  uchar pad;
+};
+
+//--------------------------------------------
+// one partition of the input produced by the counting pass,
+// each chunk is a subtree of the final octree and is built
+// independently of the others
+//--------------------------------------------
+struct ConvChunk
+{
+  int level;
+  int ix, iy, iz;
+  qint64 numpoints;
+  QString levelString;
+};
+
+//--------------------------------------------
+// Builds a lasVR octree (cloud.js, octree.json and BIN/LAZ
+// node files) from raw LAS/LAZ files.
+// 1. headers give the bounding box
+// 2. points are counted on a 128^3 grid and the grid is split
+//    into chunks that fit in the memory limit
+// 3. points are distributed into per chunk temporary files
+// 4. chunks are turned into subtrees in parallel
+// 5. levels above the chunks are sampled from the chunk roots
+//--------------------------------------------
+class OctreeConverter
+{
+ public :
+  OctreeConverter();
+
+  void setInputFiles(QStringList);
+  void setOutputDir(QString d) { m_outDir = d; }
+  void setLAZOutput(bool b) { m_lazOutput = b; }
+  void setShuffle(bool b) { m_shuffle = b; }
+  void setThreads(int);
+  void setMemoryLimit(qint64 m) { m_memoryLimit = m; }
+  void setSpacing(double s) { m_spacing = s; }
+  void setScale(double s) { m_scale = s; }
+  void setLeafPoints(int n) { m_leafPoints = n; }
+
+  bool convert();
+
+  QString errorString() { return m_error; }
+
+ private :
+  QStringList m_files;
+  QString m_outDir;
+  QString m_tmpDir;
+  bool m_lazOutput;
+  bool m_shuffle;
+  int m_threads;
+  qint64 m_memoryLimit;
+  double m_spacing;
+  double m_scale;
+  int m_leafPoints;
+
+  QString m_error;
+
+  ConvVec m_bmin, m_bmax;
+  ConvVec m_tightMin, m_tightMax;
+  qint64 m_totalPoints;
+  bool m_colorPresent;
+
+  qint64 m_chunkLimit;
+  QVector<quint32> m_counts;
+  QVector<bool> m_color16; // per file, colour depth seen while counting
+  QVector<qint32> m_cellChunk;
+  QList<ConvChunk> m_chunks;
+
+  QMutex m_mutex;
+  QMap<QString, qint64> m_nodes; // level string -> number of points
+  QStringList m_pendingRoots; // chunk roots still to be sampled upwards
+
+  bool readHeaders();
+  void countFile(int);
+  void createChunks();
+  void addChunks(QList< QVector<qint64> >&, int, int, int, int);
+  void distributeFile(int);
+  void buildChunk(int);
+  void buildNode(QString, QVector<ConvPoint>&, bool);
+  void buildUpperNode(QString);
+  bool writeMetadata();
+
+  void nodeBox(QString, ConvVec&, ConvVec&);
+  double nodeSpacing(QString ls) { return m_spacing/(1 << ls.count()); }
+  QVector<bool> sample(QString, const QVector<ConvPoint>&);
+
+  void writeNode(QString, QVector<ConvPoint>&);
+  void writeRaw(QString, const QVector<ConvPoint>&);
+  QVector<ConvPoint> readRaw(QString);
+  QString rawFile(QString ls) { return m_tmpDir + "/node_r" + ls + ".raw"; }
+  QString chunkFile(int i) { return m_tmpDir + QString("/chunk_%1.raw").arg(i); }
+  void appendChunk(int, QByteArray&);
+
+  int gridCell(double, double, double);
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "frametimer.h"
+
+#include <QMutexLocker>
+#include <QDateTime>
+
+#include <algorithm>
+
+// samples kept per stage for the rolling percentiles
+#define FRAMETIMER_WINDOW 300
+// seconds between log lines
+#define FRAMETIMER_LOG_INTERVAL 5
+
+bool FrameTimer::m_enabled = false;
+QMutex FrameTimer::m_mutex;
+QVector<double> FrameTimer::m_samples[FrameTimer::NumStages];
+int FrameTimer::m_next[FrameTimer::NumStages];
+double FrameTimer::m_frameCpu[FrameTimer::NumStages];
+bool FrameTimer::m_frameCpuSet[FrameTimer::NumStages];
+GLuint FrameTimer::m_queries[FrameTimer::NumStages][4];
+bool FrameTimer::m_pending[FrameTimer::NumStages][4];
+int FrameTimer::m_slot[FrameTimer::NumStages];
+int FrameTimer::m_activeStage = -1;
+QFile FrameTimer::m_logFile;
+QElapsedTimer FrameTimer::m_logTimer;
+
+QString
+FrameTimer::stageName(int s)
+{
+  switch (s)
+    {
+    case SelectNodes : return "select";
+    case VisibilityTexture : return "vistex";
+    case LoadVBO : return "loadvbo";
+    case Labels : return "labels";
+    case Map : return "map";
+    case DepthPass : return "gpu depth";
+    case ShadowPass : return "gpu shadow";
+    case Trisets : return "gpu trisets";
+    case LabelsGpu : return "gpu labels";
+    case HiZ : return "gpu hiz";
+    }
+  return "";
+}
+
+void
+FrameTimer::setEnabled(bool b)
+{
+  QMutexLocker lock(&m_mutex);
+
+  m_enabled = b;
+  for(int s=0; s<NumStages; s++)
+    {
+      m_samples[s].clear();
+      m_next[s] = 0;
+      m_frameCpu[s] = 0;
+      m_frameCpuSet[s] = false;
+    }
+}
+
+void
+FrameTimer::setLogFile(QString flnm)
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (m_logFile.isOpen())
+    m_logFile.close();
+
+  if (flnm.isEmpty())
+    return;
+
+  m_logFile.setFileName(flnm);
+  if (m_logFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    m_logTimer.start();
+}
+
+void
+FrameTimer::addCpuTime(Stage s, double ms)
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_enabled)
+    return;
+
+  m_frameCpu[s] += ms;
+  m_frameCpuSet[s] = true;
+}
+
+void
+FrameTimer::addSample(int s, double ms)
+{
+  if (m_samples[s].count() < FRAMETIMER_WINDOW)
+    m_samples[s] << ms;
+  else
+    m_samples[s][m_next[s]] = ms;
+  m_next[s] = (m_next[s]+1)%FRAMETIMER_WINDOW;
+}
+
+//--------------------------------------------
+// GL_TIME_ELAPSED queries cannot be nested,
+// a stage started while another is running is not timed
+//--------------------------------------------
+void
+FrameTimer::beginGpu(Stage s)
+{
+  if (!m_enabled || m_activeStage >= 0)
+    return;
+
+  if (m_queries[s][0] == 0)
+    {
+      glGenQueries(4, m_queries[s]);
+      for(int i=0; i<4; i++)
+	m_pending[s][i] = false;
+      m_slot[s] = 0;
+    }
+
+  // all queries for this stage still in flight
+  int slot = m_slot[s];
+  if (m_pending[s][slot])
+    return;
+
+  glBeginQuery(GL_TIME_ELAPSED, m_queries[s][slot]);
+  m_activeStage = s;
+}
+
+void
+FrameTimer::endGpu(Stage s)
+{
+  if (m_activeStage != s)
+    return;
+
+  glEndQuery(GL_TIME_ELAPSED);
+  m_pending[s][m_slot[s]] = true;
+  m_slot[s] = (m_slot[s]+1)%4;
+  m_activeStage = -1;
+}
+
+void
+FrameTimer::endFrame()
+{
+  if (!m_enabled)
+    return;
+
+  QMutexLocker lock(&m_mutex);
+
+  for(int s=0; s<NumStages; s++)
+    {
+      if (m_frameCpuSet[s])
+	addSample(s, m_frameCpu[s]);
+      m_frameCpu[s] = 0;
+      m_frameCpuSet[s] = false;
+
+      // collect finished gpu queries without waiting
+      if (m_queries[s][0] == 0)
+	continue;
+
+      double gpu = 0;
+      bool found = false;
+      for(int i=0; i<4; i++)
+	{
+	  if (!m_pending[s][i])
+	    continue;
+
+	  GLint available = 0;
+	  glGetQueryObjectiv(m_queries[s][i], GL_QUERY_RESULT_AVAILABLE, &available);
+	  if (available)
+	    {
+	      GLuint64 ns = 0;
+	      glGetQueryObjectui64v(m_queries[s][i], GL_QUERY_RESULT, &ns);
+	      gpu += ns*1e-6;
+	      found = true;
+	      m_pending[s][i] = false;
+	    }
+	}
+      if (found)
+	addSample(s, gpu);
+    }
+
+  if (m_logFile.isOpen() &&
+      m_logTimer.elapsed() > FRAMETIMER_LOG_INTERVAL*1000)
+    {
+      writeLog();
+      m_logTimer.restart();
+    }
+}
+
+double
+FrameTimer::percentile(int s, float p)
+{
+  if (m_samples[s].count() == 0)
+    return 0;
+
+  QVector<double> v = m_samples[s];
+  std::sort(v.begin(), v.end());
+  int i = qBound(0, (int)qRound(p*(v.count()-1)), v.count()-1);
+  return v[i];
+}
+
+//--------------------------------------------
+// one line per stage : name p50 p95 p99 in milliseconds
+//--------------------------------------------
+QStringList
+FrameTimer::summary()
+{
+  QMutexLocker lock(&m_mutex);
+
+  QStringList lines;
+  for(int s=0; s<NumStages; s++)
+    {
+      if (m_samples[s].count() == 0)
+	continue;
+
+      lines << QString("%1 : %2  %3  %4 ms").\
+	arg(stageName(s), -12).\
+	arg(percentile(s, 0.5), 0, 'f', 2).\
+	arg(percentile(s, 0.95), 0, 'f', 2).\
+	arg(percentile(s, 0.99), 0, 'f', 2);
+    }
+
+  return lines;
+}
+
+void
+FrameTimer::writeLog()
+{
+  QString line = QDateTime::currentDateTime().toString(Qt::ISODate);
+  for(int s=0; s<NumStages; s++)
+    {
+      if (m_samples[s].count() == 0)
+	continue;
+
+      line += QString("  %1 %2/%3/%4").\
+	arg(stageName(s).replace(" ", "_")).\
+	arg(percentile(s, 0.5), 0, 'f', 2).\
+	arg(percentile(s, 0.95), 0, 'f', 2).\
+	arg(percentile(s, 0.99), 0, 'f', 2);
+    }
+  line += "\n";
+
+  m_logFile.write(line.toLatin1());
+  m_logFile.flush();
+}
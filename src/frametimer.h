@@ -0,0 +1,99 @@
+#ifndef FRAMETIMER_H
+#define FRAMETIMER_H
+
+#include <GL/glew.h>
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QFile>
+
+//--------------------------------------------
+// Per stage frame timings.
+// CPU stages are timed with FrameTimerScope and may be
+// reported from any thread.
+// GPU stages are bracketed with beginGpu/endGpu using
+// GL_TIME_ELAPSED queries on the GUI thread. Results are
+// picked up a few frames later in endFrame so the
+// queries never stall the pipeline.
+// Each stage keeps a rolling window of samples, percentiles
+// are shown in the info overlay and written to the log file.
+//--------------------------------------------
+class FrameTimer
+{
+ public :
+  enum Stage
+  {
+    SelectNodes = 0,    // cpu
+    VisibilityTexture,
+    LoadVBO,
+    Labels,
+    Map,
+    DepthPass,          // gpu
+    ShadowPass,
+    Trisets,
+    LabelsGpu,
+    HiZ,
+    NumStages
+  };
+
+  static void setEnabled(bool);
+  static bool enabled() { return m_enabled; }
+
+  static void setLogFile(QString);
+  static bool logging() { return m_logFile.isOpen(); }
+
+  static void addCpuTime(Stage, double);
+
+  static void beginGpu(Stage);
+  static void endGpu(Stage);
+
+  static void endFrame();
+
+  static QStringList summary();
+
+ private :
+  static bool m_enabled;
+
+  static QMutex m_mutex;
+  static QVector<double> m_samples[NumStages];
+  static int m_next[NumStages];
+
+  static double m_frameCpu[NumStages];
+  static bool m_frameCpuSet[NumStages];
+
+  static GLuint m_queries[NumStages][4];
+  static bool m_pending[NumStages][4];
+  static int m_slot[NumStages];
+  static int m_activeStage;
+
+  static QFile m_logFile;
+  static QElapsedTimer m_logTimer;
+
+  static void addSample(int, double);
+  static double percentile(int, float);
+  static QString stageName(int);
+  static void writeLog();
+};
+
+//--------------------------------------------
+// times the enclosing block as a CPU stage
+//--------------------------------------------
+class FrameTimerScope
+{
+ public :
+  FrameTimerScope(FrameTimer::Stage s) { m_stage = s; m_timer.start(); }
+  ~FrameTimerScope()
+  {
+    if (FrameTimer::enabled())
+      FrameTimer::addCpuTime(m_stage, m_timer.nsecsElapsed()*1e-6);
+  }
+
+ private :
+  FrameTimer::Stage m_stage;
+  QElapsedTimer m_timer;
+};
+
+#endif
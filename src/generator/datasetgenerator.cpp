@@ -0,0 +1,792 @@
+#include "datasetgenerator.h"
+#include "octreenode.h"
+#include "pointcloud.h"
+
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QtConcurrent>
+#include <QtMath>
+
+#include "laszip_dll.h"
+
+// terrain amplitude and feature size in metres
+#define GEN_TERRAIN_HEIGHT 15.0
+#define GEN_TERRAIN_SCALE 250.0
+#define GEN_TERRAIN_OCTAVES 4
+// cell size of the tree lookup grid
+#define GEN_TREE_CELL 10.0
+#define GEN_MAX_TREE_HEIGHT 30.0
+// surface samples per side when sizing a node
+#define GEN_COVERAGE_SAMPLES 9
+
+static void
+message(QString mesg)
+{
+  QTextStream out(stdout);
+  out << mesg << "\n";
+  out.flush();
+}
+
+static int
+setLevelsBelow(OctreeNode *node)
+{
+  int lb = 0;
+  for(int k=0; k<8; k++)
+    {
+      OctreeNode *cnode = node->getChild(k);
+      if (cnode)
+	lb = qMax(lb, setLevelsBelow(cnode)+1);
+    }
+  node->setLevelsBelow(lb);
+
+  return lb;
+}
+
+DatasetGenerator::DatasetGenerator()
+{
+  m_outDir.clear();
+  m_lazOutput = false;
+  m_totalPoints = 10000000;
+  m_tiles = 1;
+  m_depth = 6;
+  m_tileSize = 200;
+  m_treeDensity = 150;
+  m_nodeSpread = 0.5;
+  m_timeSteps = 1;
+  m_labels = 0;
+  m_seed = 1;
+  m_scale = 0.001;
+
+  m_step = 0;
+
+  setThreads(QThread::idealThreadCount());
+}
+
+void
+DatasetGenerator::setThreads(int n)
+{
+  m_threads = qMax(1, n);
+  QThreadPool::globalInstance()->setMaxThreadCount(m_threads);
+}
+
+bool
+DatasetGenerator::generate()
+{
+  if (m_outDir.isEmpty())
+    {
+      m_error = "No output directory specified";
+      return false;
+    }
+
+  if (!QDir().mkpath(m_outDir))
+    {
+      m_error = "Cannot create "+m_outDir;
+      return false;
+    }
+
+  if (!writeTopJson())
+    return false;
+
+  for(int t=0; t<m_timeSteps; t++)
+    {
+      m_step = t;
+
+      QString stepDir = QDir(m_outDir).absoluteFilePath(QString("t%1").arg(t, 3, 10, QChar('0')));
+
+      QList<GenTree> stepTrees;
+      for(int i=0; i<m_tiles; i++)
+	{
+	  if (!genTile(t, i))
+	    return false;
+
+	  stepTrees += m_trees;
+	}
+
+      if (m_labels > 0)
+	{
+	  m_trees = stepTrees;
+	  if (!writeLabels(stepDir))
+	    return false;
+	}
+    }
+
+  return true;
+}
+
+//--------------------------------------------
+// tiles are laid out on a grid, all share the same
+// terrain function so their edges match
+//--------------------------------------------
+bool
+DatasetGenerator::genTile(int step, int tile)
+{
+  int tx = qCeil(qSqrt((double)m_tiles));
+  int ix = tile%tx;
+  int iy = tile/tx;
+
+  m_bmin = Vec(ix*m_tileSize, iy*m_tileSize, -GEN_TERRAIN_HEIGHT-1);
+  m_bmax = m_bmin + Vec(m_tileSize, m_tileSize, m_tileSize);
+  m_tightMin = Vec(m_bmax.x, m_bmax.y, m_bmax.z);
+  m_tightMax = Vec(m_bmin.x, m_bmin.y, m_bmin.z);
+
+  m_tileDir = QDir(m_outDir).absoluteFilePath(QString("t%1/tile_%2").\
+					      arg(step, 3, 10, QChar('0')).\
+					      arg(tile, 3, 10, QChar('0')));
+  if (!QDir().mkpath(QDir(m_tileDir).absoluteFilePath("data/r")))
+    {
+      m_error = "Cannot create directories in "+m_tileDir;
+      return false;
+    }
+
+  genTrees(tile);
+  genNodeList();
+
+  //-----------------------
+  // spread the tile points over the nodes
+  qint64 tilePoints = m_totalPoints/m_tiles;
+  double sumW = 0;
+  for(int i=0; i<m_nodes.count(); i++)
+    sumW += m_nodes[i].weight;
+  for(int i=0; i<m_nodes.count(); i++)
+    m_nodes[i].numpoints = qRound64(tilePoints*m_nodes[i].weight/qMax(sumW, 1e-6));
+  //-----------------------
+
+  QList<int> nodeIdx;
+  for(int i=0; i<m_nodes.count(); i++)
+    nodeIdx << i;
+  QtConcurrent::blockingMap(nodeIdx, [this](int &i) { genNode(i); });
+
+  if (!writeMetadata())
+    return false;
+
+  qint64 npts = 0;
+  for(int i=0; i<m_nodes.count(); i++)
+    npts += m_nodes[i].numpoints;
+  message(QString("%1 : %2 points in %3 nodes, %4 trees").\
+	  arg(m_tileDir).arg(npts).arg(m_nodes.count()).arg(m_trees.count()));
+
+  return true;
+}
+
+//--------------------------------------------
+// procedural terrain - a few octaves of value noise
+//--------------------------------------------
+double
+DatasetGenerator::lattice(int x, int y, int o)
+{
+  quint32 h = (quint32)x*374761393u + (quint32)y*668265263u +
+              (quint32)o*2246822519u + (quint32)m_seed*3266489917u;
+  h = (h ^ (h >> 13))*1274126177u;
+  h = h ^ (h >> 16);
+
+  return (h & 0xffffff)/16777216.0;
+}
+
+double
+DatasetGenerator::valueNoise(double x, double y, int o)
+{
+  int xi = qFloor(x);
+  int yi = qFloor(y);
+  double fx = x - xi;
+  double fy = y - yi;
+  fx = fx*fx*(3-2*fx);
+  fy = fy*fy*(3-2*fy);
+
+  double v00 = lattice(xi, yi, o);
+  double v10 = lattice(xi+1, yi, o);
+  double v01 = lattice(xi, yi+1, o);
+  double v11 = lattice(xi+1, yi+1, o);
+
+  return (v00*(1-fx) + v10*fx)*(1-fy) + (v01*(1-fx) + v11*fx)*fy;
+}
+
+double
+DatasetGenerator::terrain(double x, double y)
+{
+  double h = 0;
+  double amp = 1;
+  double sum = 0;
+  double f = 1.0/GEN_TERRAIN_SCALE;
+  for(int o=0; o<GEN_TERRAIN_OCTAVES; o++)
+    {
+      h += amp*(2*valueNoise(x*f, y*f, o)-1);
+      sum += amp;
+      amp *= 0.5;
+      f *= 2;
+    }
+
+  return GEN_TERRAIN_HEIGHT*h/sum;
+}
+//--------------------------------------------
+
+
+//--------------------------------------------
+// trees do not depend on the time step apart
+// from growing a little with every step
+//--------------------------------------------
+void
+DatasetGenerator::genTrees(int tile)
+{
+  m_trees.clear();
+  m_treeGrid.clear();
+
+  std::mt19937 rng(m_seed*7919 + tile*104729);
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+
+  double maxHt = qBound(1.0,
+			m_tileSize - 2*GEN_TERRAIN_HEIGHT - 2,
+			GEN_MAX_TREE_HEIGHT);
+  double growth = 0.6 + 0.4*(m_step+1)/m_timeSteps;
+
+  int ntrees = m_treeDensity*m_tileSize*m_tileSize/10000;
+  for(int i=0; i<ntrees; i++)
+    {
+      GenTree tree;
+      tree.x = m_bmin.x + uni(rng)*m_tileSize;
+      tree.y = m_bmin.y + uni(rng)*m_tileSize;
+      tree.ground = terrain(tree.x, tree.y);
+      tree.height = maxHt*(0.3 + 0.7*uni(rng))*growth;
+      tree.radius = tree.height*(0.15 + 0.15*uni(rng));
+      tree.crownHt = tree.height*(0.25 + 0.15*uni(rng));
+      tree.rgb[0] = 30 + 50*uni(rng);
+      tree.rgb[1] = 90 + 80*uni(rng);
+      tree.rgb[2] = 20 + 40*uni(rng);
+
+      int gx = (tree.x-m_bmin.x)/GEN_TREE_CELL;
+      int gy = (tree.y-m_bmin.y)/GEN_TREE_CELL;
+      m_treeGrid[(qint64)gx*100000+gy] << m_trees.count();
+
+      m_trees << tree;
+    }
+}
+
+QList<int>
+DatasetGenerator::treesNear(double x0, double y0, double x1, double y1)
+{
+  // crowns reach at most this far from the trunk
+  double reach = 0.3*GEN_MAX_TREE_HEIGHT;
+
+  int gx0 = qMax(0, qFloor((x0-reach-m_bmin.x)/GEN_TREE_CELL));
+  int gy0 = qMax(0, qFloor((y0-reach-m_bmin.y)/GEN_TREE_CELL));
+  int gx1 = qFloor((x1+reach-m_bmin.x)/GEN_TREE_CELL);
+  int gy1 = qFloor((y1+reach-m_bmin.y)/GEN_TREE_CELL);
+
+  QList<int> trees;
+  for(int gx=gx0; gx<=gx1; gx++)
+    for(int gy=gy0; gy<=gy1; gy++)
+      {
+	QList<int> cell = m_treeGrid.value((qint64)gx*100000+gy);
+	for(int i=0; i<cell.count(); i++)
+	  {
+	    const GenTree &t = m_trees.at(cell[i]);
+	    if (t.x+t.radius >= x0 && t.x-t.radius <= x1 &&
+		t.y+t.radius >= y0 && t.y-t.radius <= y1)
+	      trees << cell[i];
+	  }
+      }
+
+  return trees;
+}
+
+//--------------------------------------------
+// ground height at x,y, also returns the tree whose crown
+// covers x,y (or -1) and the crown half thickness there
+//--------------------------------------------
+double
+DatasetGenerator::surfaceAt(double x, double y,
+			    const QList<int> &trees,
+			    int &tree, double &crown)
+{
+  tree = -1;
+  crown = -1;
+  for(int i=0; i<trees.count(); i++)
+    {
+      const GenTree &t = m_trees.at(trees.at(i));
+      double d2 = (x-t.x)*(x-t.x) + (y-t.y)*(y-t.y);
+      if (d2 < t.radius*t.radius)
+	{
+	  double c = t.crownHt*qSqrt(1-d2/(t.radius*t.radius));
+	  if (c > crown)
+	    {
+	      crown = c;
+	      tree = trees.at(i);
+	    }
+	}
+    }
+
+  return terrain(x, y);
+}
+//--------------------------------------------
+
+
+void
+DatasetGenerator::nodeBox(QString ls, Vec &bmin, Vec &bmax)
+{
+  // same subdivision as PointCloud::loadOctreeNodeFromJson
+  bmin = m_bmin;
+  Vec bsize = m_bmax-m_bmin;
+  for(int vl=0; vl<ls.count(); vl++)
+    {
+      int d = ls[vl].digitValue();
+      bsize /= 2;
+      if (d%2 > 0) bmin.z += bsize.z;
+      if (d%4 > 1) bmin.y += bsize.y;
+      if (d   > 3) bmin.x += bsize.x;
+    }
+  bmax = bmin + bsize;
+}
+
+//--------------------------------------------
+// fraction of the node footprint where ground or a
+// crown lies within the node, 0 means the node is empty
+//--------------------------------------------
+double
+DatasetGenerator::coverage(QString ls)
+{
+  Vec bmin, bmax;
+  nodeBox(ls, bmin, bmax);
+
+  QList<int> trees = treesNear(bmin.x, bmin.y, bmax.x, bmax.y);
+
+  int ns = GEN_COVERAGE_SAMPLES;
+  int hits = 0;
+  for(int i=0; i<ns; i++)
+    for(int j=0; j<ns; j++)
+      {
+	double x = bmin.x + (i+0.5)*(bmax.x-bmin.x)/ns;
+	double y = bmin.y + (j+0.5)*(bmax.y-bmin.y)/ns;
+
+	int tree;
+	double crown;
+	double g = surfaceAt(x, y, trees, tree, crown);
+	if (g >= bmin.z && g < bmax.z)
+	  hits++;
+
+	if (tree >= 0)
+	  {
+	    const GenTree &t = m_trees.at(tree);
+	    double zc = t.ground + t.height - t.crownHt;
+	    if (zc+crown >= bmin.z && zc-crown < bmax.z)
+	      hits++;
+	  }
+      }
+
+  return (double)hits/(ns*ns);
+}
+
+//--------------------------------------------
+// walk down from the root keeping nodes the surface passes through,
+// weight is the coverage times a log-normal factor seeded by the node
+//--------------------------------------------
+void
+DatasetGenerator::genNodeList()
+{
+  m_nodes.clear();
+
+  QStringList level;
+  level << "";
+  while (level.count() > 0)
+    {
+      QVector<double> cov(level.count());
+      double *covPtr = cov.data();
+      QList<int> levelIdx;
+      for(int i=0; i<level.count(); i++)
+	levelIdx << i;
+      QtConcurrent::blockingMap(levelIdx, [this, &level, covPtr](int &i)
+				{ covPtr[i] = coverage(level.at(i)); });
+
+      QStringList nextLevel;
+      for(int i=0; i<level.count(); i++)
+	{
+	  if (cov[i] <= 0)
+	    continue;
+
+	  std::mt19937 rng(qHash(level[i]) ^ (quint32)(m_seed*31337));
+	  std::normal_distribution<double> normal(0.0, 1.0);
+
+	  GenNode node;
+	  node.levelString = level[i];
+	  node.weight = cov[i]*qExp(m_nodeSpread*normal(rng) -
+				    0.5*m_nodeSpread*m_nodeSpread);
+	  node.numpoints = 0;
+	  m_nodes << node;
+
+	  if (level[i].count() < m_depth)
+	    {
+	      for(int k=0; k<8; k++)
+		nextLevel << level[i] + QString::number(k);
+	    }
+	}
+
+      level = nextLevel;
+    }
+}
+
+void
+DatasetGenerator::samplePoint(std::mt19937 &rng,
+			      Vec bmin, Vec bmax,
+			      const QList<int> &trees,
+			      Vec &pt, uchar *rgb, uchar &cls)
+{
+  std::uniform_real_distribution<double> uni(0.0, 1.0);
+
+  double x = bmin.x + uni(rng)*(bmax.x-bmin.x);
+  double y = bmin.y + uni(rng)*(bmax.y-bmin.y);
+
+  int tree;
+  double crown;
+  double g = surfaceAt(x, y, trees, tree, crown);
+
+  if (tree >= 0 && uni(rng) < 0.85)
+    {
+      // mostly on the upper crown surface, some inside
+      const GenTree &t = m_trees.at(tree);
+      double zc = t.ground + t.height - t.crownHt;
+      double u = (uni(rng) < 0.7 ? 1-0.15*uni(rng) : 2*uni(rng)-1);
+      pt = Vec(x, y, zc + crown*u);
+
+      double shade = 0.7 + 0.3*(u+1)*0.5;
+      rgb[0] = t.rgb[0]*shade;
+      rgb[1] = t.rgb[1]*shade;
+      rgb[2] = t.rgb[2]*shade;
+      cls = 5; // high vegetation
+    }
+  else
+    {
+      pt = Vec(x, y, g + 0.03*(uni(rng)-0.5));
+
+      // greener in the valleys, browner on the hills
+      double h = (g + GEN_TERRAIN_HEIGHT)/(2*GEN_TERRAIN_HEIGHT);
+      double n = 0.85 + 0.3*uni(rng);
+      rgb[0] = qBound(0.0, (90 + 70*h)*n, 255.0);
+      rgb[1] = qBound(0.0, (110 + 20*h)*n, 255.0);
+      rgb[2] = qBound(0.0, (60 + 30*h)*n, 255.0);
+      cls = 2; // ground
+    }
+}
+
+//--------------------------------------------
+// points are drawn in random order so the
+// nodes are written as shuffled
+//--------------------------------------------
+void
+DatasetGenerator::genNode(int idx)
+{
+  QString ls = m_nodes.at(idx).levelString;
+  qint64 target = m_nodes.at(idx).numpoints;
+
+  Vec bmin, bmax;
+  nodeBox(ls, bmin, bmax);
+
+  std::mt19937 rng(qHash(ls) ^
+		   (quint32)(m_seed*7919 + m_step*1299709) ^
+		   (quint32)(m_bmin.x*131 + m_bmin.y*137));
+
+  QList<int> trees = treesNear(bmin.x, bmin.y, bmax.x, bmax.y);
+
+  QVector<Vec> pts;
+  QVector<uchar> rgb;
+  QVector<uchar> cls;
+  pts.reserve(target);
+  rgb.reserve(3*target);
+  cls.reserve(target);
+
+  Vec tmin = bmax;
+  Vec tmax = bmin;
+
+  qint64 attempts = 0;
+  qint64 maxAttempts = 50*target + 1000;
+  while (pts.count() < target && attempts < maxAttempts)
+    {
+      attempts++;
+
+      Vec p;
+      uchar c[3];
+      uchar cl;
+      samplePoint(rng, bmin, bmax, trees, p, c, cl);
+
+      if (p.z < bmin.z || p.z >= bmax.z)
+	continue;
+
+      pts << p;
+      rgb << c[0] << c[1] << c[2];
+      cls << cl;
+
+      tmin = Vec(qMin(tmin.x, p.x), qMin(tmin.y, p.y), qMin(tmin.z, p.z));
+      tmax = Vec(qMax(tmax.x, p.x), qMax(tmax.y, p.y), qMax(tmax.z, p.z));
+    }
+
+  if (pts.count() > 0)
+    writeNode(ls, pts, rgb, cls);
+
+  QMutexLocker lock(&m_mutex);
+  m_nodes[idx].numpoints = pts.count();
+  if (pts.count() > 0)
+    {
+      m_tightMin = Vec(qMin(m_tightMin.x, tmin.x),
+		       qMin(m_tightMin.y, tmin.y),
+		       qMin(m_tightMin.z, tmin.z));
+      m_tightMax = Vec(qMax(m_tightMax.x, tmax.x),
+		       qMax(m_tightMax.y, tmax.y),
+		       qMax(m_tightMax.z, tmax.z));
+    }
+}
+
+//--------------------------------------------
+// same node encoding as lasconvert
+//--------------------------------------------
+void
+DatasetGenerator::writeNode(QString ls,
+			    QVector<Vec> &pts,
+			    QVector<uchar> &rgb,
+			    QVector<uchar> &cls)
+{
+  Vec bmin, bmax;
+  nodeBox(ls, bmin, bmax);
+
+  QString flnm = QDir(m_tileDir).absoluteFilePath(QString("data/r/r%1.%2").\
+						  arg(ls).\
+						  arg(m_lazOutput ? "laz" : "bin"));
+
+  if (!m_lazOutput)
+    {
+      // POSITION_CARTESIAN, COLOR_PACKED
+      QByteArray data(16*pts.count(), 0);
+      for(int i=0; i<pts.count(); i++)
+	{
+	  int *crd = (int*)(data.data() + 16*i);
+	  uchar *c = (uchar*)(data.data() + 16*i + 12);
+	  crd[0] = qRound64((pts[i].x - bmin.x)/m_scale);
+	  crd[1] = qRound64((pts[i].y - bmin.y)/m_scale);
+	  crd[2] = qRound64((pts[i].z - bmin.z)/m_scale);
+	  c[0] = rgb[3*i+0];
+	  c[1] = rgb[3*i+1];
+	  c[2] = rgb[3*i+2];
+	  c[3] = 255;
+	}
+
+      QFile fl(flnm);
+      fl.open(QFile::WriteOnly);
+      fl.write(data);
+      fl.close();
+      return;
+    }
+
+  laszip_POINTER laszip_writer;
+  laszip_create(&laszip_writer);
+
+  laszip_header* header;
+  laszip_get_header_pointer(laszip_writer, &header);
+
+  header->point_data_format = 2;
+  header->point_data_record_length = 26;
+  header->number_of_point_records = pts.count();
+  header->x_scale_factor = m_scale;
+  header->y_scale_factor = m_scale;
+  header->z_scale_factor = m_scale;
+  header->x_offset = bmin.x;
+  header->y_offset = bmin.y;
+  header->z_offset = bmin.z;
+  header->min_x = bmin.x;
+  header->min_y = bmin.y;
+  header->min_z = bmin.z;
+  header->max_x = bmax.x;
+  header->max_y = bmax.y;
+  header->max_z = bmax.z;
+
+  if (laszip_open_writer(laszip_writer, QFile::encodeName(flnm).data(), 1))
+    {
+      message("Error writing "+flnm);
+      laszip_destroy(laszip_writer);
+      return;
+    }
+
+  laszip_point* point;
+  laszip_get_point_pointer(laszip_writer, &point);
+
+  for(int i=0; i<pts.count(); i++)
+    {
+      point->X = qRound64((pts[i].x - bmin.x)/m_scale);
+      point->Y = qRound64((pts[i].y - bmin.y)/m_scale);
+      point->Z = qRound64((pts[i].z - bmin.z)/m_scale);
+      point->rgb[0] = rgb[3*i+0]*256;
+      point->rgb[1] = rgb[3*i+1]*256;
+      point->rgb[2] = rgb[3*i+2]*256;
+      point->classification = cls[i];
+      laszip_write_point(laszip_writer);
+    }
+
+  laszip_close_writer(laszip_writer);
+  laszip_destroy(laszip_writer);
+}
+
+bool
+DatasetGenerator::writeMetadata()
+{
+  QDir outdir(m_tileDir);
+
+  //-----------------------
+  // octree.json through the same code the viewer uses
+  QList<OctreeNode*> allNodes;
+  OctreeNode *oNode = new OctreeNode();
+  allNodes << oNode;
+
+  qint64 totalPoints = 0;
+  qint64 rootPoints = 0;
+  for(int i=0; i<m_nodes.count(); i++)
+    {
+      if (m_nodes[i].numpoints == 0)
+	continue;
+
+      QString ls = m_nodes[i].levelString;
+      OctreeNode *tnode = oNode;
+      for(int vl=0; vl<ls.count(); vl++)
+	{
+	  int k = ls[vl].digitValue();
+	  if (!tnode->getChild(k))
+	    allNodes << tnode->childAt(k);
+	  tnode = tnode->getChild(k);
+	}
+
+      QString flnm = outdir.absoluteFilePath(QString("data/r/r%1.%2").\
+					     arg(ls).\
+					     arg(m_lazOutput ? "laz" : "bin"));
+      tnode->setFileName(flnm);
+      tnode->setNumPoints(m_nodes[i].numpoints);
+      tnode->setLevelString(ls);
+
+      totalPoints += m_nodes[i].numpoints;
+      if (ls.isEmpty())
+	rootPoints = m_nodes[i].numpoints;
+    }
+  setLevelsBelow(oNode);
+
+  PointCloud::saveOctreeNodeToJson(m_tileDir, oNode);
+
+  for(int i=0; i<allNodes.count(); i++)
+    delete allNodes[i];
+  //-----------------------
+
+
+  //-----------------------
+  QJsonObject jsonCloud;
+  jsonCloud["version"] = "1.7";
+  jsonCloud["octreeDir"] = "data";
+  jsonCloud["points"] = totalPoints;
+
+  QJsonObject jsonBox;
+  jsonBox["lx"] = m_bmin.x;
+  jsonBox["ly"] = m_bmin.y;
+  jsonBox["lz"] = m_bmin.z;
+  jsonBox["ux"] = m_bmax.x;
+  jsonBox["uy"] = m_bmax.y;
+  jsonBox["uz"] = m_bmax.z;
+  jsonCloud["boundingBox"] = jsonBox;
+
+  QJsonObject jsonTightBox;
+  jsonTightBox["lx"] = m_tightMin.x;
+  jsonTightBox["ly"] = m_tightMin.y;
+  jsonTightBox["lz"] = m_tightMin.z;
+  jsonTightBox["ux"] = m_tightMax.x;
+  jsonTightBox["uy"] = m_tightMax.y;
+  jsonTightBox["uz"] = m_tightMax.z;
+  jsonCloud["tightBoundingBox"] = jsonTightBox;
+
+  if (m_lazOutput)
+    jsonCloud["pointAttributes"] = "LAZ";
+  else
+    {
+      QJsonArray jsonAttrib;
+      jsonAttrib << "POSITION_CARTESIAN" << "COLOR_PACKED";
+      jsonCloud["pointAttributes"] = jsonAttrib;
+    }
+
+  // root points spread over the tile footprint
+  jsonCloud["spacing"] = m_tileSize/qSqrt((double)qMax(rootPoints, (qint64)1));
+  jsonCloud["scale"] = m_scale;
+  jsonCloud["hierarchyStepSize"] = m_depth;
+  jsonCloud["shuffled"] = true;
+
+  QFile cloudFile(outdir.absoluteFilePath("cloud.js"));
+  if (!cloudFile.open(QIODevice::WriteOnly))
+    {
+      m_error = "Cannot write "+cloudFile.fileName();
+      return false;
+    }
+  cloudFile.write(QJsonDocument(jsonCloud).toJson());
+  cloudFile.close();
+  //-----------------------
+
+  return true;
+}
+
+//--------------------------------------------
+// columns as read by PointCloud::loadLabelsCSV,
+// positions in centimetres
+//--------------------------------------------
+bool
+DatasetGenerator::writeLabels(QString stepDir)
+{
+  QFile fl(QDir(stepDir).absoluteFilePath("labels.csv"));
+  if (!fl.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+      m_error = "Cannot write "+fl.fileName();
+      return false;
+    }
+
+  QTextStream out(&fl);
+  out << "id,tile,x,y,ground,height,area,z,points,r,g,b\n";
+
+  int stride = qMax(1, m_trees.count()/m_labels);
+  int nl = 0;
+  for(int i=0; i<m_trees.count() && nl<m_labels; i+=stride, nl++)
+    {
+      GenTree &t = m_trees[i];
+      double area = M_PI*t.radius*t.radius;
+      out << i << ","
+	  << 0 << ","
+	  << qRound(t.x*100) << ","
+	  << qRound(t.y*100) << ","
+	  << qRound(t.ground*100) << ","
+	  << QString::number(t.height, 'f', 2) << ","
+	  << QString::number(area, 'f', 2) << ","
+	  << qRound((t.ground+t.height)*100) << ","
+	  << qRound(area*50) << ","
+	  << (int)t.rgb[0] << ","
+	  << (int)t.rgb[1] << ","
+	  << (int)t.rgb[2] << "\n";
+    }
+
+  fl.close();
+
+  message(QString("%1 labels written to %2").arg(nl).arg(fl.fileName()));
+
+  return true;
+}
+
+bool
+DatasetGenerator::writeTopJson()
+{
+  QJsonObject jsonInfo;
+  jsonInfo["timeseries"] = (m_timeSteps > 1);
+
+  QJsonObject jsonTop;
+  jsonTop["top"] = jsonInfo;
+
+  QFile fl(QDir(m_outDir).absoluteFilePath("top.json"));
+  if (!fl.open(QIODevice::WriteOnly))
+    {
+      m_error = "Cannot write "+fl.fileName();
+      return false;
+    }
+  fl.write(QJsonDocument(jsonTop).toJson());
+  fl.close();
+
+  return true;
+}
@@ -0,0 +1,121 @@
+#ifndef DATASETGENERATOR_H
+#define DATASETGENERATOR_H
+
+#include <QGLViewer/vec.h>
+using namespace qglviewer;
+
+#include <QStringList>
+#include <QVector>
+#include <QMap>
+#include <QMutex>
+
+#include <random>
+
+//--------------------------------------------
+// tree-like cluster of points standing on the terrain,
+// the crown is an ellipsoid above a bare trunk
+//--------------------------------------------
+struct GenTree
+{
+  double x, y;
+  double ground;
+  double height;
+  double radius;  // crown radius
+  double crownHt; // vertical crown semi axis
+  uchar rgb[3];
+};
+
+//--------------------------------------------
+// node of the octree being generated
+//--------------------------------------------
+struct GenNode
+{
+  QString levelString;
+  double weight;     // share of the tile points
+  qint64 numpoints;  // target, then actual after generation
+};
+
+//--------------------------------------------
+// Writes a synthetic lasVR dataset for benchmarking:
+// top.json, one directory per time step (with labels.csv)
+// holding a grid of tiles, each tile a Potree octree
+// (cloud.js, octree.json and BIN or LAZ node files).
+// Points are sampled from a procedural terrain with trees on it.
+// The node structure is built first from the surface height
+// range inside every node, the requested number of points is then
+// spread over the nodes by their surface coverage times a
+// log-normal factor, and each node is generated independently
+// from its own seed so the output does not depend on threading.
+//--------------------------------------------
+class DatasetGenerator
+{
+ public :
+  DatasetGenerator();
+
+  void setOutputDir(QString d) { m_outDir = d; }
+  void setLAZOutput(bool b) { m_lazOutput = b; }
+  void setTotalPoints(qint64 n) { m_totalPoints = n; }
+  void setTiles(int n) { m_tiles = qMax(1, n); }
+  void setDepth(int d) { m_depth = qBound(0, d, 20); }
+  void setTileSize(double s) { m_tileSize = s; }
+  void setTreeDensity(double d) { m_treeDensity = d; }
+  void setNodeSpread(double s) { m_nodeSpread = s; }
+  void setTimeSteps(int t) { m_timeSteps = qMax(1, t); }
+  void setLabels(int n) { m_labels = n; }
+  void setSeed(int s) { m_seed = s; }
+  void setScale(double s) { m_scale = s; }
+  void setThreads(int);
+
+  bool generate();
+
+  QString errorString() { return m_error; }
+
+ private :
+  QString m_outDir;
+  bool m_lazOutput;
+  qint64 m_totalPoints;
+  int m_tiles;
+  int m_depth;
+  double m_tileSize;
+  double m_treeDensity; // trees per hectare
+  double m_nodeSpread;  // sigma of the log-normal node size factor
+  int m_timeSteps;
+  int m_labels;
+  int m_seed;
+  double m_scale;
+  int m_threads;
+
+  QString m_error;
+
+  // current tile
+  int m_step;
+  QString m_tileDir;
+  Vec m_bmin, m_bmax;
+  Vec m_tightMin, m_tightMax;
+  QList<GenTree> m_trees;
+  QMap<qint64, QList<int> > m_treeGrid;
+  QList<GenNode> m_nodes;
+  QMutex m_mutex;
+
+  double terrain(double, double);
+  double valueNoise(double, double, int);
+  double lattice(int, int, int);
+
+  void genTrees(int);
+  QList<int> treesNear(double, double, double, double);
+  double surfaceAt(double, double, const QList<int>&, int&, double&);
+
+  void nodeBox(QString, Vec&, Vec&);
+  double coverage(QString);
+  void genNodeList();
+  void genNode(int);
+  void samplePoint(std::mt19937&, Vec, Vec, const QList<int>&, Vec&, uchar*, uchar&);
+  void writeNode(QString, QVector<Vec>&, QVector<uchar>&, QVector<uchar>&);
+
+  bool genTile(int, int);
+  bool writeMetadata();
+  bool writeLabels(QString);
+  bool writeTopJson();
+};
+
+#endif
@@ -0,0 +1,49 @@
+TEMPLATE = app
+TARGET = lasgenerate
+DEPENDPATH += . ..
+
+# headless - writes datasets through the same octree code as the viewer
+QT += opengl widgets core gui xml concurrent
+
+CONFIG += release console c++11
+CONFIG -= app_bundle
+DESTDIR = ..\..\bin
+
+INCLUDEPATH += .. \
+	c:\Qt\libQGLViewer-2.6.1 \
+ 	c:\cygwin64\home\acl900\drishtilib\glew-1.11.0\include \
+	..\LASzip
+
+QMAKE_LIBDIR += c:\Qt\libQGLViewer-2.6.1\lib \
+		c:\cygwin64\home\acl900\drishtilib\glew-1.11.0\lib\Release\x64 \
+	        ..\LASzip
+
+LIBS += QGLViewer2.lib glew32.lib LASzip.lib
+
+
+HEADERS += datasetgenerator.h \
+	../octreenode.h \
+	../nodecache.h \
+	../memorystats.h \
+	../heightfield.h \
+	../pointcloud.h \
+	../label.h \
+	../labelrenderer.h \
+	../labelgrid.h \
+	../global.h \
+	../staticfunctions.h \
+	../shaderfactory.h
+
+SOURCES += main.cpp \
+	datasetgenerator.cpp \
+	../octreenode.cpp \
+	../nodecache.cpp \
+	../memorystats.cpp \
+	../heightfield.cpp \
+	../pointcloud.cpp \
+	../label.cpp \
+	../labelrenderer.cpp \
+	../labelgrid.cpp \
+	../global.cpp \
+	../staticfunctions.cpp \
+	../shaderfactory.cpp
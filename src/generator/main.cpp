@@ -0,0 +1,98 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+#include "datasetgenerator.h"
+
+// accepts plain numbers or K, M, B suffixes - 100M, 1B
+static qint64
+pointCount(QString str)
+{
+  str = str.trimmed().toUpper();
+  qint64 mult = 1;
+  if (str.endsWith("K")) mult = 1000;
+  if (str.endsWith("M")) mult = 1000000;
+  if (str.endsWith("B") || str.endsWith("G")) mult = 1000000000;
+  if (mult > 1)
+    str.chop(1);
+
+  return qRound64(str.toDouble()*mult);
+}
+
+int main(int argv, char **args)
+{
+  QCoreApplication app(argv, args);
+  QCoreApplication::setOrganizationName("NCI");
+  QCoreApplication::setApplicationName("lasgenerate");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Generate a synthetic lasVR dataset of terrain and trees");
+  parser.addHelpOption();
+
+  QCommandLineOption outOption(QStringList() << "o" << "output",
+			       "Output directory", "dir");
+  QCommandLineOption pointsOption(QStringList() << "n" << "points",
+				  "Points per time step, K/M/B suffixes allowed", "n", "10M");
+  QCommandLineOption tilesOption("tiles", "Number of tiles", "n", "1");
+  QCommandLineOption depthOption("depth", "Octree levels below the root", "n", "6");
+  QCommandLineOption tileSizeOption("tile-size", "Tile edge in metres", "m", "200");
+  QCommandLineOption treesOption("trees", "Trees per hectare", "n", "150");
+  QCommandLineOption spreadOption("node-spread",
+				  "Spread of node sizes, 0 gives even nodes", "s", "0.5");
+  QCommandLineOption stepsOption("timesteps", "Number of time steps", "n", "1");
+  QCommandLineOption labelsOption("labels", "Tree labels per time step in labels.csv", "n", "0");
+  QCommandLineOption lazOption("laz", "Write LAZ nodes instead of BIN");
+  QCommandLineOption seedOption("seed", "Random seed", "n", "1");
+  QCommandLineOption threadOption(QStringList() << "t" << "threads",
+				  "Number of threads", "n");
+  QCommandLineOption scaleOption("scale",
+				 "Coordinate precision", "s", "0.001");
+
+  parser.addOption(outOption);
+  parser.addOption(pointsOption);
+  parser.addOption(tilesOption);
+  parser.addOption(depthOption);
+  parser.addOption(tileSizeOption);
+  parser.addOption(treesOption);
+  parser.addOption(spreadOption);
+  parser.addOption(stepsOption);
+  parser.addOption(labelsOption);
+  parser.addOption(lazOption);
+  parser.addOption(seedOption);
+  parser.addOption(threadOption);
+  parser.addOption(scaleOption);
+
+  parser.process(app);
+
+  QTextStream err(stderr);
+
+  if (!parser.isSet(outOption))
+    {
+      err << parser.helpText();
+      return 1;
+    }
+
+  DatasetGenerator generator;
+  generator.setOutputDir(parser.value(outOption));
+  generator.setTotalPoints(pointCount(parser.value(pointsOption)));
+  generator.setTiles(parser.value(tilesOption).toInt());
+  generator.setDepth(parser.value(depthOption).toInt());
+  generator.setTileSize(qMax(50.0, parser.value(tileSizeOption).toDouble()));
+  generator.setTreeDensity(parser.value(treesOption).toDouble());
+  generator.setNodeSpread(parser.value(spreadOption).toDouble());
+  generator.setTimeSteps(parser.value(stepsOption).toInt());
+  generator.setLabels(parser.value(labelsOption).toInt());
+  generator.setLAZOutput(parser.isSet(lazOption));
+  generator.setSeed(parser.value(seedOption).toInt());
+  if (parser.isSet(threadOption))
+    generator.setThreads(parser.value(threadOption).toInt());
+  generator.setScale(parser.value(scaleOption).toDouble());
+
+  if (!generator.generate())
+    {
+      err << generator.errorString() << "\n";
+      return 1;
+    }
+
+  return 0;
+}
@@ -1,6 +1,9 @@
 #include "glhiddenwidget.h"
 #include "staticfunctions.h"
 #include "global.h"
+#include "frametimer.h"
+#include "tracer.h"
+#include "heightfield.h"
 
 #include <QMessageBox>
 #include <QApplication>
@@ -26,8 +29,10 @@ GLHiddenWidget::GLHiddenWidget(QGLFormat format,
   m_vertexBuffer[0] = 0;
   m_vertexBuffer[1] = 0;
 
+  m_mapBuffer = 0;
+  m_mapTime = -1;
+
   m_visibilityTex = 0;
-  m_visibilityMap = 0;
 
   // emit vboLoaded every time m_pointBlockSize points are uploaded to gpu
   m_pointsDrawn = 0;
@@ -70,10 +75,18 @@ GLHiddenWidget::setVBOs(GLuint vb0, GLuint vb1)
   m_firstLoad = true;
 }
 
+void
+GLHiddenWidget::setMapVBO(GLuint vb)
+{
+  m_mapBuffer = vb;
+  m_mapTime = -1;
+}
+
 void
 GLHiddenWidget::setVisTex(GLuint vt) 
 {
   m_visibilityTex = vt;
+  m_visibilityMap.clear();
 }
 
 void
@@ -86,6 +99,8 @@ GLHiddenWidget::setVolume(Volume *v)
   m_pointClouds = m_volume->pointClouds();
   m_trisets = m_volume->trisets();
 
+  m_mapTime = -1;
+
   int ht;
   if (m_viewer->vrMode() && m_vr->vrEnabled())
     {
@@ -139,22 +154,7 @@ void GLHiddenWidget::resizeEvent(QResizeEvent *event)
 void
 GLHiddenWidget::uploadVisTex()
 {
-  GLuint target = GL_TEXTURE_RECTANGLE;
-  glActiveTexture(GL_TEXTURE3);
-  glBindTexture(target, m_visibilityTex);
-  glTexParameterf(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); 
-  glTexParameterf(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); 
-  glTexParameterf(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexImage2D(target,
-	       0,
-	       GL_RGBA8,
-	       m_maxwd/4, m_ntiles,
-	       0,
-	       GL_RGBA,
-	       GL_UNSIGNED_BYTE,
-	       m_visibilityMap); 
+  m_visibilityMap.upload(m_visibilityTex);
 
   m_newVisTex = false;
 }
@@ -162,6 +162,9 @@ GLHiddenWidget::uploadVisTex()
 void
 GLHiddenWidget::createVisibilityTexture()
 {
+  TRACE_SCOPE("createVisibilityTexture");
+  FrameTimerScope frameTimer(FrameTimer::VisibilityTexture);
+
   if (m_pointClouds.count() == 0)
     return;
   
@@ -169,32 +172,9 @@ GLHiddenWidget::createVisibilityTexture()
   for(int d=0; d<m_pointClouds.count(); d++)
     m_pointClouds[d]->updateVisibilityData();
   
-  QList< QList<uchar> > m_vData;
-  m_vData.clear();
-
-  for(int d=0; d<m_pointClouds.count(); d++)
-    m_vData += m_pointClouds[d]->vData();
-
-
-  m_ntiles = m_vData.count();
-  m_maxwd = 0;
-  for(int i=0; i<m_ntiles; i++)
-    m_maxwd = qMax(m_maxwd, m_vData[i].count());
-  
-
-  if (m_visibilityMap) delete [] m_visibilityMap;
-  m_visibilityMap = new uchar[m_maxwd*m_ntiles];
-  memset(m_visibilityMap, 0, m_maxwd*m_ntiles);
-    
-  for(int i=0; i<m_ntiles; i++)
-    {
-      QList<uchar> vS = m_vData[i];
-      
-      for(int k=0; k<vS.count(); k++)
-	m_visibilityMap[i*m_maxwd + k] = vS[k];
-    }
-
-  m_newVisTex = true;
+  // upload waits till the next vboLoaded
+  if (m_visibilityMap.update(m_pointClouds))
+    m_newVisTex = true;
 }
 
 void
@@ -209,6 +189,8 @@ GLHiddenWidget::switchVolume()
   m_pointClouds = m_volume->pointClouds();
   m_trisets = m_volume->trisets();
 
+  m_mapTime = -1;
+
   int ht;
   if (m_viewer->vrMode() && m_vr->vrEnabled())
     {
@@ -241,6 +223,9 @@ GLHiddenWidget::stopLoading()
 void
 GLHiddenWidget::removeEditedNodes()
 {
+  // edited points have moved, the map buffer too
+  m_mapTime = -1;
+
   if (m_prevNodes.count() > 0)
     {
       QMap<int, QPair<qint64, qint64> > newLoad;
@@ -259,6 +244,9 @@ GLHiddenWidget::removeEditedNodes()
 void
 GLHiddenWidget::loadPointsToVBO()
 {
+  FrameTimerScope frameTimer(FrameTimer::LoadVBO);
+  TRACE_SCOPE("uploadNodes");
+
   if (m_currVBO < 0) return;
   if (m_vertexBuffer[0] <= 0) return;
 
@@ -292,18 +280,23 @@ GLHiddenWidget::loadPointsToVBO()
   //-------------------------------
   if (m_prevNodes.count() > 0)
     {
+      bool sameSizes = true;
       for(int i=0; i<currload.count(); i++)
 	{
 	  int nodeId = currload[i]->uid();
-	  if (!m_prevNodes.contains(nodeId)) // save it to load next
+	  // also reload partially drawn nodes that now need more points
+	  if (!m_prevNodes.contains(nodeId) ||
+	      m_prevNodes[nodeId].second < currload[i]->pointsToDraw()) // save it to load next
 	    loadNodes << currload[i];
+	  else if (m_prevNodes[nodeId].second != currload[i]->pointsToDraw())
+	    sameSizes = false;
 	}
 
       // no nodes to load,
       // check if we need to unload some nodes
       if (loadNodes.count() == 0)
 	{
-	  if (m_prevNodes.count() == currload.count())
+	  if (m_prevNodes.count() == currload.count() && sameSizes)
 	    {
 	      if (Global::playFrames())
 		emit vboLoadedAll(m_currVBO, -1);
@@ -332,6 +325,15 @@ GLHiddenWidget::loadPointsToVBO()
 
   QMap<int, QPair<qint64, qint64> > newLoad;
 
+  // node ranges describe the buffer being filled now
+  m_rangeNodes.clear();
+  m_nodeRanges.clear();
+
+  // ground heights come from the decoded points, except
+  // while editing when they are not yet transformed
+  bool addHeights = !m_viewer->editMode();
+  int heightGen = HeightField::generation();
+
 
   //-------------------------------
   for(int i=0; i<currload.count(); i++)
@@ -339,6 +341,7 @@ GLHiddenWidget::loadPointsToVBO()
       if (m_volume->newLoad() && !m_firstLoad)
 	{
 	  glFinish();
+	  sendNodeRanges();
 	  emit vboLoaded(m_currVBO, lpoints);
 	  m_currVBO = (m_currVBO+1)%2;
 	  m_prevNodes = newLoad;
@@ -350,11 +353,13 @@ GLHiddenWidget::loadPointsToVBO()
 	}
 
       int nodeId = currload[i]->uid();
-      if (m_prevNodes.contains(nodeId))
+      if (m_prevNodes.contains(nodeId) &&
+	  m_prevNodes[nodeId].second >= currload[i]->pointsToDraw())
 	{
 	  QPair<qint64, qint64> qp = m_prevNodes[nodeId];
 	  qint64 start = qp.first;
-	  qint64 npts = qp.second;
+	  // partially drawn nodes keep only the leading points
+	  qint64 npts = currload[i]->pointsToDraw();
 
 	  if (m_dpv == 3)
 	    glCopyBufferSubData(GL_COPY_READ_BUFFER,
@@ -381,6 +386,12 @@ GLHiddenWidget::loadPointsToVBO()
 	  newLoad[nodeId] = qp;
 	  //-----------------
 
+	  addNodeRange(currload[i], lpoints, npts);
+
+	  // already decoded, heights may have been cleared since
+	  if (addHeights)
+	    HeightField::addNode(heightGen, currload[i]);
+
 	  lpoints += npts;
 	}
     }
@@ -392,6 +403,7 @@ GLHiddenWidget::loadPointsToVBO()
   if (lpoints > 0)
     {
       glFinish();
+      sendNodeRanges();
       emit vboLoaded(m_currVBO, lpoints);
 
       if (m_newVisTex)
@@ -407,6 +419,10 @@ GLHiddenWidget::loadPointsToVBO()
       
   glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer[m_currVBO]);
 
+  // start reading node files ahead of the decode below,
+  // loadNodes are already in priority order
+  m_nodeReader.submit(loadNodes);
+
   // load data for remaining OctreeNodes
   for(int i=0; i<loadNodes.count(); i++)
     {
@@ -415,8 +431,19 @@ GLHiddenWidget::loadPointsToVBO()
 	  break;
 	}
 
-      loadNodes[i]->loadData();
-      qint64 npts = loadNodes[i]->numpoints();
+      TRACE_SCOPE("loadNode");
+      TRACE_ARG("uid", loadNodes[i]->uid());
+
+      QByteArray nodeData = m_nodeReader.take(loadNodes[i]);
+      TRACE_ARG("bytes_read", nodeData.size());
+
+      loadNodes[i]->loadData(nodeData);
+      if (addHeights)
+	HeightField::addNode(heightGen, loadNodes[i]);
+
+      qint64 npts = loadNodes[i]->pointsToDraw();
+      TRACE_ARG("points", npts);
+      TRACE_ARG("bytes_uploaded", npts*(m_dpv == 3 ? 12 : 20));
       
       if (npts > 0)
 	{
@@ -447,12 +474,15 @@ GLHiddenWidget::loadPointsToVBO()
 	}
       //-----------------
 
+      addNodeRange(loadNodes[i], lpoints, npts);
+
       lpoints += npts;
       
       blkpts += npts;
       if (blkpts > blk*m_pointBlockSize)
 	{
 	  glFinish();
+	  sendNodeRanges();
 	  emit vboLoaded(m_currVBO, lpoints);
 	  blk ++;
 
@@ -462,10 +492,17 @@ GLHiddenWidget::loadPointsToVBO()
 	}
     }
 
+  // drop reads left over when loading was interrupted
+  m_nodeReader.cancel();
+
+  TRACE_ARG("nodes", loadNodes.count());
+  TRACE_ARG("points", lpoints);
+
   if (m_newVisTex)
     uploadVisTex();
 
   glFinish();
+  sendNodeRanges();
   emit vboLoadedAll(m_currVBO, lpoints);
 
   m_firstLoad = false;
@@ -478,6 +515,33 @@ GLHiddenWidget::loadPointsToVBO()
 }
 
 
+void
+GLHiddenWidget::addNodeRange(OctreeNode *node, qint64 start, qint64 npts)
+{
+  if (npts <= 0)
+    return;
+
+  NodeRange range;
+  range.start = start;
+  range.npts = npts;
+  range.node = node;
+  m_rangeNodes << node;
+  m_nodeRanges << range;
+}
+
+//--------------------------------------------
+// visibility info is read just before the viewer is told,
+// it then matches the visibility texture uploaded with it
+//--------------------------------------------
+void
+GLHiddenWidget::sendNodeRanges()
+{
+  for(int i=0; i<m_rangeNodes.count(); i++)
+    m_nodeRanges[i].setWalkStart(m_rangeNodes[i]);
+
+  m_viewer->setNodeRanges(m_currVBO, m_nodeRanges);
+}
+
 //--------------------------------------------
 // generate list of nodes to upload
 //--------------------------------------------
@@ -516,11 +580,108 @@ GLHiddenWidget::updateView()
   createVisibilityTexture();
 
   loadPointsToVBO();  
+
+  loadMapVBO();
+}
+
+//--------------------------------------------
+// The VR map is drawn from the coarse levels of every tile of
+// the time step, whatever the view selected. Whole levels are
+// taken shallowest first while they fit in MAP_POINT_BUDGET, so
+// the map covers all of the data at the same level of detail.
+// Runs after the view load so the points shown come first.
+//--------------------------------------------
+void
+GLHiddenWidget::loadMapVBO()
+{
+  if (!m_mapBuffer ||
+      m_mapTime == m_currTime ||
+      !m_viewer->vrMode() ||
+      !m_vr->vrEnabled() ||
+      m_pointClouds.count() == 0 ||
+      !m_pointClouds[0]->showMap())
+    return;
+
+  if (m_volume->newLoad())
+    return;
+
+  TRACE_SCOPE("loadMapVBO");
+
+  QList<OctreeNode*> mapNodes;
+  qint64 mapPoints = 0;
+  QList<OctreeNode*> level = m_tiles;
+  for(int l=0; l<=MAP_MAX_LEVEL && level.count() > 0; l++)
+    {
+      qint64 lpts = 0;
+      QList<OctreeNode*> below;
+      for(int i=0; i<level.count(); i++)
+	{
+	  lpts += level[i]->numpoints();
+	  for(int k=0; k<8; k++)
+	    if (level[i]->getChild(k))
+	      below << level[i]->getChild(k);
+	}
+
+      if (mapPoints + lpts > MAP_POINT_BUDGET)
+	break;
+
+      mapNodes += level;
+      mapPoints += lpts;
+      level = below;
+    }
+
+  // nodes the view load did not decode
+  QList<OctreeNode*> readNodes;
+  for(int i=0; i<mapNodes.count(); i++)
+    if (!mapNodes[i]->dataLoaded())
+      readNodes << mapNodes[i];
+  m_nodeReader.submit(readNodes);
+
+  // partly overwritten until the load completes
+  m_mapTime = -1;
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_mapBuffer);
+
+  int bpp = (m_dpv == 3 ? 12 : 20);
+  qint64 lpoints = 0;
+  for(int i=0; i<mapNodes.count(); i++)
+    {
+      // moved on to another step, start over with that one
+      if (m_volume->newLoad())
+	{
+	  m_nodeReader.cancel();
+	  return;
+	}
+
+      OctreeNode *node = mapNodes[i];
+      if (!node->dataLoaded())
+	node->loadData(m_nodeReader.take(node));
+
+      qint64 npts = qMin(node->numpoints(), (qint64)MAP_POINT_BUDGET-lpoints);
+      if (npts > 0 && node->coords())
+	{
+	  glBufferSubData(GL_ARRAY_BUFFER,
+			  bpp*lpoints,
+			  bpp*npts,
+			  node->coords());
+	  lpoints += npts;
+	}
+    }
+
+  m_nodeReader.cancel();
+
+  glFinish();
+
+  m_mapTime = m_currTime;
+  emit mapVBOLoaded(m_currTime, lpoints);
 }
 
 void
 GLHiddenWidget::genDrawNodeList()
 {
+  TRACE_SCOPE("genDrawNodeList");
+  FrameTimerScope frameTimer(FrameTimer::SelectNodes);
+
   if (m_pointClouds.count() == 0)
     return;
   
@@ -547,42 +708,34 @@ GLHiddenWidget::genDrawNodeList()
     {
       QList<OctreeNode*> allNodes = m_pointClouds[d]->allNodes();
       for(int od=0; od<allNodes.count(); od++)
-	allNodes[od]->setActive(false);
+	{
+	  allNodes[od]->setActive(false);
+	  allNodes[od]->setPointLimit(-1);
+	}
     }
 
 
-  genPriorityQueue(cpos);
-
-
   //-------------------------------
-  // sort based on projection size
-  m_pointsDrawn = 0;
-  m_newNodes.clear();
-  QList<float> keys = m_priorityQueue.keys();
-
-  bool bufferFull = false;
-  for(int k=keys.count()-1; k>=0 && !bufferFull; k--)
+  QMatrix4x4 MV;
+  if (m_viewer->vrMode() && m_vr->vrEnabled())
     {
-      QList<OctreeNode*> values = m_priorityQueue.values(keys[k]);
-      for(int v=0; v<values.count() && !bufferFull; v++)
-	{
-	  if (m_pointsDrawn + values[v]->numpoints() < m_pointBudget)
-	    {
-	      m_pointsDrawn += values[v]->numpoints();
-	      m_newNodes << values[v];
-	    }
-	  else
-	    bufferFull = true;
-	}
+      MV = m_vr->modelView();
     }
-  for(int d=0; d<m_pointClouds.count(); d++)
+  else
     {
-      QList<OctreeNode*> allNodes = m_pointClouds[d]->allNodes();
-      for(int od=0; od<allNodes.count(); od++)
-	allNodes[od]->setActive(false);
+      float m[16];
+      m_viewer->camera()->getModelViewMatrix(m);
+      for(int i=0; i<16; i++)
+	MV.data()[i] = m[i];
+      MV = MV.transposed();
     }
-  for(int i=0; i<m_newNodes.count(); i++)
-    m_newNodes[i]->setActive(true);
+
+  m_lodSelector.setPointBudget(qMin(m_pointBudget, m_viewer->drawBudget()));
+  m_lodSelector.setMinNodePixelSize(m_minNodePixelSize);
+  m_lodSelector.setProjFactor(m_projFactor);
+  m_lodSelector.setOcclusionTest(m_viewer->occlusionTest());
+  m_newNodes = m_lodSelector.select(m_orderedTiles, MV, cpos);
+  m_pointsDrawn = m_lodSelector.pointsSelected();
   //-------------------------------
 
 
@@ -614,128 +767,6 @@ GLHiddenWidget::genDrawNodeList()
   m_viewer->setNearFar(nearDist, farDist);
 }
 
-void
-GLHiddenWidget::genPriorityQueue(Vec cpos)
-{
-  QMatrix4x4 MV;
-
-  if (m_viewer->vrMode() && m_vr->vrEnabled())
-    {
-      MV = m_vr->modelView();
-    }
-  else
-    {
-      float m[16];
-      m_viewer->camera()->getModelViewMatrix(m);
-      for(int i=0; i<16; i++)
-	MV.data()[i] = m[i];
-      MV = MV.transposed();
-    }
-
-  m_pointsDrawn = 0;
-  m_priorityQueue.clear();
-
-  QList<OctreeNode*> onl0;
-
-  // consider all top-level tile nodes first
-  for(int d=0; d<m_orderedTiles.count(); d++)
-    {
-      OctreeNode *node = m_orderedTiles[d];
-      
-      Vec bmin = node->bmin();
-      Vec bmax = node->bmax(); 
-
-      QVector4D bminV = MV * QVector4D(bmin.x, bmin.y, bmin.z, 1);
-      QVector4D bmaxV = MV * QVector4D(bmax.x, bmax.y, bmax.z, 1);
-      bmin = Vec(bminV.x(), bminV.y(), bminV.z());
-      bmax = Vec(bmaxV.x(), bmaxV.y(), bmaxV.z());
-
-
-      Vec bcen = (bmax+bmin)/2;
-      //float dtoc = (cpos-bcen).norm();
-      //float blen = (bmax-bcen).norm();
-      
-      float screenProjectedSize = 100000;
-      //if (dtoc > blen)
-      screenProjectedSize = StaticFunctions::projectionSize(cpos,
-							    bmin, bmax,
-							    m_projFactor);
-      bool ignoreChildren = (screenProjectedSize < m_minNodePixelSize);
-      
-      if (!ignoreChildren)
-	onl0 << node;
-      
-      if (!node->isActive())
-	{
-	  m_priorityQueue.insert(screenProjectedSize, node);
-	  
-	  //if (dtoc <= blen)
-	  //  m_priorityQueue.insert(100000, node);
-	  //else
-	  //  m_priorityQueue.insert(1.0/slope*blen/qSqrt(dtoc*dtoc-blen*blen), node);
-	  
-	  node->setActive(true);
-	}
-    }
-
-  // now consider the nodes within each tile
-  while (onl0.count() > 0)
-    {
-      bool done = false;
-      QList<OctreeNode*> onl1;
-      onl1.clear();
-      for(int i=0; i<onl0.count() && !done; i++)
-	{
-	  OctreeNode *node = onl0[i];
-	  for (int k=0; k<8 && !done; k++)
-	    {
-	      OctreeNode *cnode = node->getChild(k);
-	      if (cnode)
-		{     
-		  Vec bmin = cnode->bmin();
-		  Vec bmax = cnode->bmax();			  
-
-		  QVector4D bminV = MV * QVector4D(bmin.x, bmin.y, bmin.z, 1);
-		  QVector4D bmaxV = MV * QVector4D(bmax.x, bmax.y, bmax.z, 1);
-		  bmin = Vec(bminV.x(), bminV.y(), bminV.z());
-		  bmax = Vec(bmaxV.x(), bmaxV.y(), bmaxV.z());
-
-		  Vec bcen = (bmax+bmin)/2;
-		  //float dtoc = (cpos-bcen).norm();
-		  //float blen = (bmax-bcen).norm();
-		  
-		  float screenProjectedSize = 100000;
-		  //if (dtoc > blen)
-		  screenProjectedSize = StaticFunctions::projectionSize(cpos,
-									bmin, bmax,
-									m_projFactor);
-		  bool ignoreChildren = (screenProjectedSize < m_minNodePixelSize);
-		  
-		  if (!ignoreChildren)
-		    onl1 << cnode;
-		  
-		  if (!cnode->isActive())
-		    {
-		      m_priorityQueue.insert(screenProjectedSize, node);
-		      
-		      //if (dtoc <= blen)
-		      //  m_priorityQueue.insert(100000, node);
-		      //else
-		      //  m_priorityQueue.insert(1.0/slope*blen/qSqrt(dtoc*dtoc-blen*blen), node);
-		      
-		      cnode->setActive(true);
-		    }
-		} // valid child
-	    } // loop over child nodes
-	} // loop over onl0
-      
-      if (!done)
-	onl0 = onl1;
-      else
-	break;
-    }
-}
-
 void
 GLHiddenWidget::orderTiles(Vec cpos)
 {
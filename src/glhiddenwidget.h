@@ -6,6 +6,9 @@
 #include "viewer.h"
 #include "vr.h"
 #include "volumefactory.h"
+#include "nodereader.h"
+#include "lodselector.h"
+#include "visibilitymap.h"
 
 #include <QGLWidget>
 #include <QMutex>
@@ -34,6 +37,7 @@ class GLHiddenWidget : public QGLWidget
   public slots:
     void switchVolume();
     void setVBOs(GLuint, GLuint);  
+    void setMapVBO(GLuint);
     void setVisTex(GLuint);
     void loadPointsToVBO();
     void stopLoading();
@@ -43,6 +47,7 @@ class GLHiddenWidget : public QGLWidget
  signals :
     void vboLoaded(int, qint64);
     void vboLoadedAll(int, qint64);
+    void mapVBOLoaded(int, qint64);
     void message(QString);
 
     void meshLoadedAll();
@@ -71,12 +76,20 @@ class GLHiddenWidget : public QGLWidget
     int m_currVBO;
     GLuint m_vertexBuffer[2];
 
+    // coarse levels of all tiles for the VR map,
+    // filled once per time step after the view load
+    GLuint m_mapBuffer;
+    int m_mapTime;
+
     QMutex m_mutex;
     bool m_loading;
     bool m_stopLoading;
 
     QMap<int, QPair<qint64, qint64> > m_prevNodes;
 
+    NodeReader m_nodeReader;
+    LodSelector m_lodSelector;
+
     int m_currTime;
     float m_fov, m_slope, m_projFactor;
 
@@ -88,12 +101,11 @@ class GLHiddenWidget : public QGLWidget
     QList<OctreeNode*> m_tiles;
     QList<OctreeNode*> m_orderedTiles;
     QList<OctreeNode*> m_newNodes;
-    QMultiMap<float, OctreeNode*> m_priorityQueue;
 
     bool m_firstLoad;
 
     GLuint m_visibilityTex;
-    uchar *m_visibilityMap;
+    VisibilityMap m_visibilityMap;
 
     qint64 m_pointsDrawn;
     qint64 m_pointBudget;
@@ -101,13 +113,19 @@ class GLHiddenWidget : public QGLWidget
     bool m_newVisTex;
 
     void genDrawNodeList();
-    void genPriorityQueue(Vec);
     void orderTiles(Vec);
     void createVisibilityTexture();
 
-    int m_ntiles, m_maxwd;
     void uploadVisTex();
 
+    void loadMapVBO();
+
+    // points of each node in the buffer being filled
+    QVector<OctreeNode*> m_rangeNodes;
+    QVector<NodeRange> m_nodeRanges;
+    void addNodeRange(OctreeNode*, qint64, qint64);
+    void sendNodeRanges();
+
 };
 
 #endif
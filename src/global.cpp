@@ -1,4 +1,5 @@
 #include "global.h"
+#include "heightfield.h"
 
 bool Global::m_playFrames = false;
 bool Global::playFrames() { return m_playFrames; }
@@ -180,10 +181,21 @@ float* Global::m_depthBuffer = 0;
 void Global::setDepthBuffer(float *db) { m_depthBuffer = db; }
 
 
+//--------------------------------------------
+// ground from the height field where it has points,
+// otherwise from the map depth buffer
+//--------------------------------------------
 Vec
 Global::stickToGround(Vec pt)
 {
+  float z;
+  if (HeightField::height(pt.x, pt.y, z))
+    return Vec(pt.x, pt.y, z);
+
   Vec ptGround = pt;
+  if (!m_depthBuffer)
+    return ptGround;
+
   Vec ptProjected = menuCamProjectedCoordinatesOf(pt);
   int x = ptProjected.x;
   int y = ptProjected.y;
@@ -200,7 +212,14 @@ Global::stickToGround(Vec pt)
 QVector3D
 Global::stickToGround(QVector3D pt)
 {
+  float z;
+  if (HeightField::height(pt.x(), pt.y(), z))
+    return QVector3D(pt.x(), pt.y(), z);
+
   QVector3D ptGround = pt;
+  if (!m_depthBuffer)
+    return ptGround;
+
   QVector3D ptProjected = menuCamProjectedCoordinatesOf(pt);
   int x = ptProjected.x();
   int y = ptProjected.y();
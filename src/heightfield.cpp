@@ -0,0 +1,376 @@
+#include "heightfield.h"
+#include "memorystats.h"
+
+#include <QtMath>
+#include <QHash>
+#include <float.h>
+#include <algorithm>
+
+// cells along the longer side of level 0
+#define HEIGHTFIELD_SIZE 2048
+
+// step past a cell boundary, in level 0 cells
+#define HEIGHTFIELD_EPS 0.001f
+
+// no points in the cell
+#define HEIGHTFIELD_EMPTY -FLT_MAX
+
+QReadWriteLock HeightField::m_lock;
+int HeightField::m_generation = 0;
+Vec HeightField::m_bmin;
+float HeightField::m_cellSize = 1;
+int HeightField::m_wd = 0;
+int HeightField::m_ht = 0;
+QList< QVector<float> > HeightField::m_levels;
+QList< QVector<int> > HeightField::m_rowGen;
+QList<int> HeightField::m_levelWd;
+QList<int> HeightField::m_levelHt;
+bool HeightField::m_empty = true;
+QSet<int> HeightField::m_nodes;
+
+void
+HeightField::setBounds(Vec bmin, Vec bmax)
+{
+  QWriteLocker lock(&m_lock);
+
+  m_generation++;
+  m_nodes.clear();
+  m_levels.clear();
+  m_rowGen.clear();
+  m_levelWd.clear();
+  m_levelHt.clear();
+  m_empty = true;
+  m_wd = m_ht = 0;
+  MemoryStats::set(MemoryStats::HeightData, 0);
+
+  float ext = qMax(bmax.x-bmin.x, bmax.y-bmin.y);
+  if (ext <= 0)
+    return;
+
+  m_bmin = bmin;
+  m_cellSize = ext/HEIGHTFIELD_SIZE;
+  m_wd = qBound(1, (int)qCeil((bmax.x-bmin.x)/m_cellSize), HEIGHTFIELD_SIZE);
+  m_ht = qBound(1, (int)qCeil((bmax.y-bmin.y)/m_cellSize), HEIGHTFIELD_SIZE);
+
+  qint64 bytes = 0;
+  int wd = m_wd;
+  int ht = m_ht;
+  while (1)
+    {
+      m_levels << QVector<float>(wd*ht, HEIGHTFIELD_EMPTY);
+      m_rowGen << QVector<int>(ht, m_generation);
+      m_levelWd << wd;
+      m_levelHt << ht;
+      bytes += wd*ht*sizeof(float) + ht*sizeof(int);
+
+      if (wd == 1 && ht == 1)
+	break;
+
+      wd = (wd+1)/2;
+      ht = (ht+1)/2;
+    }
+
+  MemoryStats::set(MemoryStats::HeightData, bytes);
+}
+
+void
+HeightField::release()
+{
+  setBounds(Vec(0,0,0), Vec(0,0,0));
+}
+
+//--------------------------------------------
+// rows written before this generation read as empty
+// and are refilled by addNode when it first touches them
+//--------------------------------------------
+void
+HeightField::clear()
+{
+  QWriteLocker lock(&m_lock);
+
+  m_generation++;
+  m_nodes.clear();
+  m_empty = true;
+}
+
+int
+HeightField::generation()
+{
+  QReadLocker lock(&m_lock);
+  return m_generation;
+}
+
+bool
+HeightField::valid()
+{
+  QReadLocker lock(&m_lock);
+  return !m_empty;
+}
+
+//--------------------------------------------
+// node points are in the frame used for drawing,
+// nodes already added since the last clear are skipped.
+// The points are reduced to a maximum per cell first and
+// only those are merged under the write lock.
+//--------------------------------------------
+void
+HeightField::addNode(int gen, OctreeNode *node)
+{
+  if (!node->dataLoaded() ||
+      !node->coords() ||
+      node->numpoints() <= 0)
+    return;
+
+  Vec bmin;
+  float cellSize;
+  int wd, ht;
+  {
+    QReadLocker lock(&m_lock);
+
+    if (gen != m_generation ||
+	m_levels.count() == 0 ||
+	m_nodes.contains(node->uid()))
+      return;
+
+    bmin = m_bmin;
+    cellSize = m_cellSize;
+    wd = m_wd;
+    ht = m_ht;
+  }
+
+  QHash<int, float> cellMax;
+  int stride = (node->dataPerVertex() == 3 ? 12 : 20);
+  uchar *coord = node->coords();
+  qint64 npts = node->numpoints();
+  for(qint64 np=0; np<npts; np++)
+    {
+      float *v = (float*)(coord + stride*np);
+      float fx = (v[0]-bmin.x)/cellSize;
+      float fy = (v[1]-bmin.y)/cellSize;
+      if (fx < 0 || fx >= wd ||
+	  fy < 0 || fy >= ht)
+	continue;
+
+      int idx = (int)fy*wd + (int)fx;
+      QHash<int, float>::iterator it = cellMax.find(idx);
+      if (it == cellMax.end())
+	cellMax.insert(idx, v[2]);
+      else if (v[2] > it.value())
+	it.value() = v[2];
+    }
+
+  if (cellMax.count() == 0)
+    return;
+
+  QWriteLocker lock(&m_lock);
+
+  // a clear or new bounds while the points were gathered
+  if (gen != m_generation ||
+      m_nodes.contains(node->uid()))
+    return;
+
+  m_nodes << node->uid();
+
+  int nlevels = m_levels.count();
+  QHash<int, float>::const_iterator it;
+  for(it = cellMax.constBegin(); it != cellMax.constEnd(); ++it)
+    {
+      int cx = it.key() % m_wd;
+      int cy = it.key() / m_wd;
+      float z = it.value();
+
+      // heights only grow, stop once a level is already higher
+      for(int l=0; l<nlevels; l++)
+	{
+	  int row = cy >> l;
+	  int lwd = m_levelWd[l];
+	  float *level = m_levels[l].data();
+	  int &rgen = m_rowGen[l][row];
+	  if (rgen != m_generation)
+	    {
+	      std::fill(level + row*lwd, level + (row+1)*lwd, HEIGHTFIELD_EMPTY);
+	      rgen = m_generation;
+	    }
+
+	  float &h = level[row*lwd + (cx>>l)];
+	  if (z <= h)
+	    break;
+	  h = z;
+	}
+    }
+  m_empty = false;
+}
+
+//--------------------------------------------
+// maximum height in the cell at level l that holds
+// level 0 cell cx,cy, empty when nothing landed there
+//--------------------------------------------
+float
+HeightField::cellHeight(int l, int cx, int cy)
+{
+  int row = cy >> l;
+  if (m_rowGen.at(l).at(row) != m_generation)
+    return HEIGHTFIELD_EMPTY;
+
+  return m_levels.at(l).at(row*m_levelWd[l] + (cx>>l));
+}
+
+//--------------------------------------------
+// level 0 cell, or the highest of its direct
+// neighbours to bridge gaps between sparse points
+//--------------------------------------------
+float
+HeightField::groundHeight(int cx, int cy)
+{
+  float h = cellHeight(0, cx, cy);
+  if (h > HEIGHTFIELD_EMPTY)
+    return h;
+
+  int nx[4] = { cx-1, cx+1, cx, cx };
+  int ny[4] = { cy, cy, cy-1, cy+1 };
+  for(int i=0; i<4; i++)
+    {
+      if (nx[i] < 0 || nx[i] >= m_wd ||
+	  ny[i] < 0 || ny[i] >= m_ht)
+	continue;
+      h = qMax(h, cellHeight(0, nx[i], ny[i]));
+    }
+
+  return h;
+}
+
+bool
+HeightField::height(float x, float y, float &z)
+{
+  QReadLocker lock(&m_lock);
+
+  if (m_empty)
+    return false;
+
+  float fx = (x-m_bmin.x)/m_cellSize;
+  float fy = (y-m_bmin.y)/m_cellSize;
+  if (fx < 0 || fx >= m_wd ||
+      fy < 0 || fy >= m_ht)
+    return false;
+
+  float h = groundHeight(fx, fy);
+  if (h <= HEIGHTFIELD_EMPTY)
+    return false;
+
+  z = h;
+  return true;
+}
+
+//--------------------------------------------
+// clip ray o + t*d against [0,n) on one axis
+//--------------------------------------------
+static bool
+clipRay(float o, float d, int n, float &t0, float &t1)
+{
+  if (qAbs(d) < 1e-8)
+    return (o >= 0 && o < n);
+
+  float ta = (0 - o)/d;
+  float tb = (n - o)/d;
+  t0 = qMax(t0, qMin(ta, tb));
+  t1 = qMin(t1, qMax(ta, tb));
+
+  return (t0 <= t1);
+}
+
+//--------------------------------------------
+// walks the ray through the levels, a cell is only
+// entered when the ray dips below its maximum height
+// and is left for the coarser level after it,
+// empty cells are passed over
+//--------------------------------------------
+bool
+HeightField::intersect(Vec orig, Vec dir, Vec &hit)
+{
+  QReadLocker lock(&m_lock);
+
+  if (m_empty)
+    return false;
+
+  // xy in level 0 cells, z as it is
+  float ox = (orig.x-m_bmin.x)/m_cellSize;
+  float oy = (orig.y-m_bmin.y)/m_cellSize;
+  float oz = orig.z;
+  float dx = dir.x/m_cellSize;
+  float dy = dir.y/m_cellSize;
+  float dz = dir.z;
+
+  float len = qSqrt(dx*dx + dy*dy);
+  if (len < 1e-6)
+    {
+      // pointing straight up or down
+      if (dz >= 0 ||
+	  ox < 0 || ox >= m_wd ||
+	  oy < 0 || oy >= m_ht)
+	return false;
+
+      float h = groundHeight(ox, oy);
+      if (h <= HEIGHTFIELD_EMPTY || h > oz)
+	return false;
+
+      hit = Vec(orig.x, orig.y, h);
+      return true;
+    }
+
+  // t counts level 0 cells travelled in xy
+  dx /= len;
+  dy /= len;
+  dz /= len;
+
+  float t0 = 0;
+  float t1 = FLT_MAX;
+  if (!clipRay(ox, dx, m_wd, t0, t1) ||
+      !clipRay(oy, dy, m_ht, t0, t1))
+    return false;
+
+  int top = m_levels.count()-1;
+  int l = top;
+  float t = t0;
+  while (t < t1)
+    {
+      float px = ox + (t+HEIGHTFIELD_EPS)*dx;
+      float py = oy + (t+HEIGHTFIELD_EPS)*dy;
+      int cx = qBound(0, (int)px, m_wd-1) >> l;
+      int cy = qBound(0, (int)py, m_ht-1) >> l;
+
+      // where the ray leaves this cell
+      int size = 1 << l;
+      float ex = FLT_MAX;
+      float ey = FLT_MAX;
+      if (dx > 0) ex = ((cx+1)*size - ox)/dx;
+      if (dx < 0) ex = (cx*size - ox)/dx;
+      if (dy > 0) ey = ((cy+1)*size - oy)/dy;
+      if (dy < 0) ey = (cy*size - oy)/dy;
+      float te = qMin(t1, qMin(ex, ey));
+
+      float h = cellHeight(l, cx << l, cy << l);
+      float zin = oz + t*dz;
+      float zout = oz + te*dz;
+
+      if (h > HEIGHTFIELD_EMPTY &&
+	  qMin(zin, zout) <= h)
+	{
+	  if (l > 0)
+	    {
+	      l--;
+	      continue;
+	    }
+
+	  float th = (zin <= h ? t : t + (zin-h)/(-dz));
+	  hit = Vec(m_bmin.x + (ox + th*dx)*m_cellSize,
+		    m_bmin.y + (oy + th*dy)*m_cellSize,
+		    oz + th*dz);
+	  return true;
+	}
+
+      t = qMax(te, t + HEIGHTFIELD_EPS);
+      l = qMin(l+1, top);
+    }
+
+  return false;
+}
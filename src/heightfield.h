@@ -0,0 +1,66 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include "octreenode.h"
+
+#include <QVector>
+#include <QSet>
+#include <QReadWriteLock>
+
+//--------------------------------------------
+// Highest point per xy cell over the dataset, built up from the
+// nodes as the loader decodes them and used in VR for keeping
+// the head above ground, teleport hits and grounding labels.
+// Level 0 has HEIGHTFIELD_SIZE cells along the longer side, each
+// level above holds the maximum of 2x2 cells below.
+// Cells without points are unknown, callers fall back to the
+// depth buffer there, a lookup may borrow a direct neighbour.
+// Heights are in the same frame as the decoded points and are
+// dropped with clear() whenever those change, e.g. time step.
+// clear() only bumps the generation, each row carries the
+// generation it was last written in and is reset on first use.
+//--------------------------------------------
+class HeightField
+{
+ public :
+  // GUI thread, starts over with the xy extent of the data
+  static void setBounds(Vec, Vec);
+  static void release();
+
+  // cheap enough to call every frame, rows are reset lazily
+  static void clear();
+
+  // taken by the loader before a load, nodes added with
+  // a generation from before the last clear() are ignored
+  static int generation();
+  static void addNode(int, OctreeNode*);
+
+  static bool valid();
+
+  // ground height at x,y, false when nothing is known there
+  static bool height(float, float, float&);
+
+  // first point where the ray from origin along dir
+  // meets the ground
+  static bool intersect(Vec, Vec, Vec&);
+
+ private :
+  static QReadWriteLock m_lock;
+  static int m_generation;
+
+  static Vec m_bmin;
+  static float m_cellSize;
+  static int m_wd, m_ht;
+
+  static QList< QVector<float> > m_levels;
+  static QList< QVector<int> > m_rowGen;
+  static QList<int> m_levelWd, m_levelHt;
+  static bool m_empty;
+
+  static QSet<int> m_nodes;
+
+  static float cellHeight(int, int, int);
+  static float groundHeight(int, int);
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include "hizmap.h"
+#include "shaderfactory.h"
+
+// width of the level read back to the cpu
+#define HIZMAP_READBACK_WIDTH 128
+
+HiZMap::HiZMap()
+{
+  m_enabled = true;
+  m_discard = false;
+
+  m_frameWd = m_frameHt = 0;
+
+  m_fbo = 0;
+
+  for(int s=0; s<3; s++)
+    m_shaders[s] = 0;
+  m_shadersTried = false;
+
+  m_pbo[0] = m_pbo[1] = 0;
+  m_fence[0] = m_fence[1] = 0;
+  m_slot = 0;
+}
+
+void
+HiZMap::clear()
+{
+  QMutexLocker lock(&m_mutex);
+  m_test = HiZTest();
+
+  // fences are deleted on the next build, with a context current
+  m_discard = true;
+}
+
+HiZTest
+HiZMap::test()
+{
+  QMutexLocker lock(&m_mutex);
+  return m_test;
+}
+
+void
+HiZMap::createShaders()
+{
+  m_shadersTried = true;
+
+  for(int s=0; s<3; s++)
+    {
+      QStringList defines;
+      if (s < 2) defines << "FIRST";
+      if (s == 1) defines << "STEREO";
+
+      m_shaders[s] = glCreateProgramObjectARB();
+      if (! ShaderFactory::loadShadersFromFile(m_shaders[s],
+					       "assets/shaders/hiz.vert",
+					       "assets/shaders/hiz.frag",
+					       defines))
+	{
+	  glDeleteObjectARB(m_shaders[s]);
+	  m_shaders[s] = 0;
+	  continue;
+	}
+
+      m_parms[s][0] = glGetUniformLocation(m_shaders[s], "depthTex");
+      m_parms[s][1] = glGetUniformLocation(m_shaders[s], "srcSize");
+    }
+}
+
+void
+HiZMap::dropReadbacks()
+{
+  for(int i=0; i<2; i++)
+    {
+      if (m_fence[i]) glDeleteSync(m_fence[i]);
+      m_fence[i] = 0;
+    }
+}
+
+void
+HiZMap::resize(int wd, int ht)
+{
+  dropReadbacks();
+
+  if (m_levelTex.count() > 0)
+    glDeleteTextures(m_levelTex.count(), m_levelTex.data());
+  m_levelTex.clear();
+  m_levelWd.clear();
+  m_levelHt.clear();
+
+  m_frameWd = wd;
+  m_frameHt = ht;
+
+  int lwd = wd;
+  int lht = ht;
+  do
+    {
+      lwd = (lwd+1)/2;
+      lht = (lht+1)/2;
+      m_levelWd << lwd;
+      m_levelHt << lht;
+    }
+  while (lwd > HIZMAP_READBACK_WIDTH);
+
+  m_levelTex.resize(m_levelWd.count());
+  glGenTextures(m_levelTex.count(), m_levelTex.data());
+  for(int l=0; l<m_levelTex.count(); l++)
+    {
+      glBindTexture(GL_TEXTURE_RECTANGLE, m_levelTex[l]);
+      glTexImage2D(GL_TEXTURE_RECTANGLE,
+		   0,
+		   GL_R32F,
+		   m_levelWd[l], m_levelHt[l],
+		   0,
+		   GL_RED,
+		   GL_FLOAT,
+		   0);
+      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    }
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+  if (!m_fbo)
+    glGenFramebuffers(1, &m_fbo);
+
+  if (!m_pbo[0])
+    glGenBuffers(2, m_pbo);
+  int last = m_levelTex.count()-1;
+  for(int i=0; i<2; i++)
+    {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo[i]);
+      glBufferData(GL_PIXEL_PACK_BUFFER,
+		   m_levelWd[last]*m_levelHt[last]*sizeof(float),
+		   0,
+		   GL_STREAM_READ);
+    }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void
+HiZMap::collect(int slot)
+{
+  if (!m_fence[slot])
+    return;
+
+  // do not wait, a late readback is dropped
+  // when its slot is reused
+  GLenum status = glClientWaitSync(m_fence[slot], 0, 0);
+  if (status != GL_ALREADY_SIGNALED &&
+      status != GL_CONDITION_SATISFIED)
+    return;
+
+  glDeleteSync(m_fence[slot]);
+  m_fence[slot] = 0;
+
+  int last = m_levelTex.count()-1;
+  int lwd = m_levelWd[last];
+  int lht = m_levelHt[last];
+
+  QVector<float> depth(lwd*lht);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo[slot]);
+  float *ptr = (float*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (ptr)
+    {
+      memcpy(depth.data(), ptr, lwd*lht*sizeof(float));
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (!ptr)
+    return;
+
+  HiZTest test;
+  test.set(depth, lwd, lht,
+	   1 << (last+1), m_frameWd, m_frameHt,
+	   m_viewProj[slot], m_eyepos[slot], m_viewDir[slot]);
+
+  QMutexLocker lock(&m_mutex);
+  m_test = test;
+}
+
+void
+HiZMap::build(GLuint depthTex, bool stereo, int wd, int ht,
+	      QMatrix4x4 viewProj, Vec eyepos, Vec viewDir)
+{
+  if (!m_enabled || wd <= 0 || ht <= 0)
+    return;
+
+  if (!m_shadersTried)
+    createShaders();
+
+  int first = (stereo ? 1 : 0);
+  if (!m_shaders[first] || !m_shaders[2])
+    return;
+
+  if (m_discard)
+    {
+      dropReadbacks();
+      m_discard = false;
+    }
+
+  if (wd != m_frameWd || ht != m_frameHt)
+    resize(wd, ht);
+
+  // readback issued on the previous build
+  int slot = m_slot;
+  collect(1-slot);
+
+  //--------------------
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  GLint drawFbo, readFbo;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFbo);
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFbo);
+  GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+  GLboolean blend = glIsEnabled(GL_BLEND);
+  GLint vertexArray;
+  glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &vertexArray);
+
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glDisableVertexAttribArray(0);
+  //--------------------
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+  glActiveTexture(GL_TEXTURE6);
+  for(int l=0; l<m_levelTex.count(); l++)
+    {
+      glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
+			     GL_COLOR_ATTACHMENT0,
+			     GL_TEXTURE_RECTANGLE,
+			     m_levelTex[l],
+			     0);
+      glViewport(0, 0, m_levelWd[l], m_levelHt[l]);
+
+      int s = (l == 0 ? first : 2);
+      if (l == 0)
+	glBindTexture(stereo ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_RECTANGLE, depthTex);
+      else
+	glBindTexture(GL_TEXTURE_RECTANGLE, m_levelTex[l-1]);
+
+      glUseProgram(m_shaders[s]);
+      glUniform1i(m_parms[s][0], 6); // source level
+      if (l == 0)
+	glUniform2i(m_parms[s][1], wd, ht);
+      else
+	glUniform2i(m_parms[s][1], m_levelWd[l-1], m_levelHt[l-1]);
+
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+  if (stereo)
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+  //--------------------
+  // queue the readback of the coarsest level
+  int last = m_levelTex.count()-1;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo[slot]);
+  glReadPixels(0, 0, m_levelWd[last], m_levelHt[last],
+	       GL_RED, GL_FLOAT, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (m_fence[slot]) glDeleteSync(m_fence[slot]);
+  m_fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  m_viewProj[slot] = viewProj;
+  m_eyepos[slot] = eyepos;
+  m_viewDir[slot] = viewDir;
+  m_slot = 1-slot;
+  //--------------------
+
+  glUseProgram(0);
+  glActiveTexture(GL_TEXTURE0);
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  if (depthTest) glEnable(GL_DEPTH_TEST);
+  if (blend) glEnable(GL_BLEND);
+  if (vertexArray) glEnableVertexAttribArray(0);
+}
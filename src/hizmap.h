@@ -0,0 +1,72 @@
+#ifndef HIZMAP_H
+#define HIZMAP_H
+
+#include <GL/glew.h>
+
+#include "hiztest.h"
+
+#include <QMutex>
+
+//--------------------------------------------
+// Max depth pyramid built from the points depth pass, used to
+// skip refining octree nodes hidden behind nearer points.
+// Each pass halves the previous level down to at most
+// HIZMAP_READBACK_WIDTH texels across. That level is read into a
+// pixel buffer and only mapped on the next build once its fence
+// has passed, so node selection works from the frame before and
+// the renderer never waits on the readback.
+//--------------------------------------------
+class HiZMap
+{
+ public :
+  HiZMap();
+
+  void setEnabled(bool b) { m_enabled = b; }
+  bool enabled() { return m_enabled; }
+
+  // depth texture is GL_TEXTURE_RECTANGLE, or the
+  // GL_TEXTURE_2D_ARRAY of the stereo pass of which
+  // the left eye layer is used, x holds the distance
+  // along viewDir from eyepos
+  void build(GLuint, bool, int, int,
+	     QMatrix4x4, Vec, Vec);
+
+  // drop the pyramid and any readback in flight,
+  // e.g. when the time step changes
+  void clear();
+
+  // latest pyramid, invalid if there is none yet
+  HiZTest test();
+
+ private :
+  bool m_enabled;
+  bool m_discard;
+
+  int m_frameWd, m_frameHt;
+
+  GLuint m_fbo;
+  QVector<GLuint> m_levelTex;
+  QVector<int> m_levelWd, m_levelHt;
+
+  // first level, first level from stereo layer, reduce
+  GLhandleARB m_shaders[3];
+  GLint m_parms[3][2];
+  bool m_shadersTried;
+
+  // readback slots used in turn
+  GLuint m_pbo[2];
+  GLsync m_fence[2];
+  QMatrix4x4 m_viewProj[2];
+  Vec m_eyepos[2], m_viewDir[2];
+  int m_slot;
+
+  QMutex m_mutex;
+  HiZTest m_test;
+
+  void createShaders();
+  void resize(int, int);
+  void dropReadbacks();
+  void collect(int);
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "hiztest.h"
+
+// relative depth margin for splat size and half float depth
+#define HIZTEST_DEPTH_MARGIN 0.02f
+
+HiZTest::HiZTest()
+{
+  m_scale = 1;
+  m_frameWd = m_frameHt = 0;
+}
+
+void
+HiZTest::set(QVector<float> depth, int wd, int ht,
+	     int scale, int frameWd, int frameHt,
+	     QMatrix4x4 viewProj, Vec eyepos, Vec viewDir)
+{
+  m_levels.clear();
+  m_wd.clear();
+  m_ht.clear();
+
+  if (wd <= 0 || ht <= 0 || depth.count() < wd*ht)
+    return;
+
+  m_scale = scale;
+  m_frameWd = frameWd;
+  m_frameHt = frameHt;
+  m_viewProj = viewProj;
+  m_eyepos = eyepos;
+  m_viewDir = viewDir;
+
+  m_levels << depth;
+  m_wd << wd;
+  m_ht << ht;
+
+  // rest of the pyramid, texel i of a level covers 2i and 2i+1 below
+  while (wd > 1 || ht > 1)
+    {
+      int nwd = (wd+1)/2;
+      int nht = (ht+1)/2;
+
+      QVector<float> src = m_levels.last();
+      QVector<float> dst(nwd*nht, 0.0f);
+      for(int y=0; y<ht; y++)
+	for(int x=0; x<wd; x++)
+	  {
+	    float &d = dst[(y/2)*nwd + x/2];
+	    d = qMax(d, src[y*wd + x]);
+	  }
+
+      m_levels << dst;
+      m_wd << nwd;
+      m_ht << nht;
+      wd = nwd;
+      ht = nht;
+    }
+}
+
+bool
+HiZTest::occluded(Vec bmin, Vec bmax) const
+{
+  if (m_levels.count() == 0)
+    return false;
+
+  float nearest = 0;
+  float x0 = 1, x1 = -1, y0 = 1, y1 = -1;
+  for (int c=0; c<8; c++)
+    {
+      Vec pos((c&4)?bmin.x:bmax.x, (c&2)?bmin.y:bmax.y, (c&1)?bmin.z:bmax.z);
+
+      float z = (pos - m_eyepos)*m_viewDir;
+      nearest = (c == 0 ? z : qMin(nearest, z));
+
+      QVector4D clip = m_viewProj * QVector4D(pos.x, pos.y, pos.z, 1);
+      if (clip.w() <= 0.0001f) // box reaches behind the eye
+	return false;
+
+      float x = clip.x()/clip.w();
+      float y = clip.y()/clip.w();
+      x0 = qMin(x0, x);
+      x1 = qMax(x1, x);
+      y0 = qMin(y0, y);
+      y1 = qMax(y1, y);
+    }
+
+  if (nearest <= 0)
+    return false;
+
+  // nothing is known about the parts outside the frame
+  if (x0 < -1 || x1 > 1 || y0 < -1 || y1 > 1)
+    return false;
+
+  // covered texels of the finest level
+  float sx = 0.5f*m_frameWd/m_scale;
+  float sy = 0.5f*m_frameHt/m_scale;
+  int tx0 = qBound(0, (int)((x0+1)*sx), m_wd[0]-1);
+  int tx1 = qBound(0, (int)((x1+1)*sx), m_wd[0]-1);
+  int ty0 = qBound(0, (int)((y0+1)*sy), m_ht[0]-1);
+  int ty1 = qBound(0, (int)((y1+1)*sy), m_ht[0]-1);
+
+  // coarser levels until the box covers at most 2x2 texels
+  int l = 0;
+  while (l < m_levels.count()-1 &&
+	 (tx1-tx0 > 1 || ty1-ty0 > 1))
+    {
+      tx0 >>= 1; tx1 >>= 1;
+      ty0 >>= 1; ty1 >>= 1;
+      l++;
+    }
+
+  const QVector<float> &level = m_levels[l];
+  float limit = nearest/(1.0f + HIZTEST_DEPTH_MARGIN);
+  for(int y=ty0; y<=ty1; y++)
+    for(int x=tx0; x<=tx1; x++)
+      if (level[y*m_wd[l] + x] >= limit)
+	return false;
+
+  return true;
+}
@@ -0,0 +1,46 @@
+#ifndef HIZTEST_H
+#define HIZTEST_H
+
+#include <QGLViewer/vec.h>
+using namespace qglviewer;
+
+#include <QVector>
+#include <QMatrix4x4>
+
+//--------------------------------------------
+// Conservative occlusion test of node boxes against a max depth
+// pyramid from an earlier frame.
+// Depth is the distance along the view direction as written by
+// the points depth pass, texels without points hold a huge value
+// so they never occlude. A box is occluded when every texel it
+// covers has all its points nearer than the nearest box corner.
+// Copies are cheap as the levels are implicitly shared.
+// Does not touch GL.
+//--------------------------------------------
+class HiZTest
+{
+ public :
+  HiZTest();
+
+  // finest level with each texel covering scale x scale pixels
+  // of the wd x ht frame rendered with viewProj from eyepos
+  void set(QVector<float>, int, int,
+	   int, int, int,
+	   QMatrix4x4, Vec, Vec);
+
+  bool valid() const { return m_levels.count() > 0; }
+
+  bool occluded(Vec, Vec) const;
+
+ private :
+  QVector<QVector<float>> m_levels;
+  QVector<int> m_wd, m_ht;
+
+  float m_scale;
+  int m_frameWd, m_frameHt;
+
+  QMatrix4x4 m_viewProj;
+  Vec m_eyepos, m_viewDir;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include "shaderfactory.h"
 #include "staticfunctions.h"
 #include "label.h"
+#include "memorystats.h"
 
 #include <QtMath>
 #include <QMessageBox>
@@ -18,8 +19,10 @@ Label::Label()
   m_treeInfo.clear();
 
   m_vertData = 0;
-  m_boxData = 0;
+  m_boxMin = m_boxMax = Vec(0,0,0);
   m_texWd = m_texHt = 0;
+  m_texBytes = 0;
+  m_glTexture = 0;
 
   m_hitDur = 0;
 }
@@ -44,6 +47,19 @@ Label::~Label()
       m_glVertArray = 0;
       m_glVertBuffer = 0;
     }
+
+  if (m_glTexture)
+    glDeleteTextures(1, &m_glTexture);
+  m_glTexture = 0;
+  MemoryStats::add(MemoryStats::LabelTextures, -m_texBytes);
+  m_texBytes = 0;
+}
+
+void
+Label::accountTexture()
+{
+  MemoryStats::add(MemoryStats::LabelTextures, 4*m_texWd*m_texHt - m_texBytes);
+  m_texBytes = 4*m_texWd*m_texHt;
 }
 
 void
@@ -51,9 +67,32 @@ Label::setTreeInfo(QList<float> ti)
 {
   m_treeInfo = ti;
 
-  m_hitC = 0.5*m_color + 0.5*Vec(1,0.3,0);
+  // card is made again when next needed
+  if (m_glTexture)
+    glDeleteTextures(1, &m_glTexture);
+  m_glTexture = 0;
+  m_texWd = m_texHt = 0;
+  accountTexture();
+
+  createBox();
+}
+
+QImage
+Label::image()
+{
+  if (m_treeInfo.count() > 0)
+    return cardImage();
+
+  QFont font = QFont("Helvetica", m_fontSize);
   QColor color(m_color.z*255,m_color.y*255,m_color.x*255);
-  
+  return StaticFunctions::renderText(m_caption,
+				     font,
+				     Qt::black, color);
+}
+
+QImage
+Label::cardImage()
+{
   int ht = 0;
   int wd = 0;
   QList<QImage> img;
@@ -80,22 +119,35 @@ Label::setTreeInfo(QList<float> ti)
       ht = ht + textimg.height();
     }
 
-  m_texWd = wd+5;
-  m_texHt = ht+5;
+  wd += 5;
+  ht += 5;
 
-  QImage image = QImage(m_texWd, m_texHt, QImage::Format_ARGB32);
+  QImage image = QImage(wd, ht, QImage::Format_ARGB32);
   image.fill(Qt::black);
   QPainter p(&image);
   p.setPen(QPen(Qt::gray, 2, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-  p.drawRoundedRect(1, 1, m_texWd-2, m_texHt-2, 5, 5);
+  p.drawRoundedRect(1, 1, wd-2, ht-2, 5, 5);
   int cht = 3;
   for (int i=0; i<img.count(); i++)
     {
-      int cwd = (m_texWd - img[i].width())/2;
+      int cwd = (wd - img[i].width())/2;
       p.drawImage(cwd, cht, img[i].rgbSwapped());
       cht += img[i].height();
     }
 
+  return image;
+}
+
+GLuint
+Label::glTexture()
+{
+  if (m_glTexture)
+    return m_glTexture;
+
+  QImage image = Label::image();
+  m_texWd = image.width();
+  m_texHt = image.height();
+
   glGenTextures(1, &m_glTexture);
   glActiveTexture(GL_TEXTURE4);
   glBindTexture(GL_TEXTURE_2D, m_glTexture);
@@ -112,14 +164,18 @@ Label::setTreeInfo(QList<float> ti)
 	       GL_RGBA,
 	       GL_UNSIGNED_BYTE,
 	       image.bits());
+  accountTexture();
   
   glDisable(GL_TEXTURE_2D);
+
+  return m_glTexture;
 }
 
 void
 Label::setGlobalMinMax(Vec gmin, Vec gmax)
 {
   m_position -= gmin;
+  createBox();
 }
 
 void
@@ -192,6 +248,9 @@ Label::checkHit(QMatrix4x4 matR,
   //if (deadRadius <= 0)
   //return -100000;
 
+  if (m_treeInfo.count() == 0)
+    return -100000;
+
   Vec vp2d(m_position.x, m_position.y, 0);
   Vec dp2d(deadPoint.x(), deadPoint.y(), 0);
   
@@ -199,8 +258,8 @@ Label::checkHit(QMatrix4x4 matR,
     return -100000;
 
   
-  QVector3D bmin = QVector3D(m_boxData[0],m_boxData[1],m_boxData[2]);
-  QVector3D bmax = QVector3D(m_boxData[48],m_boxData[49],m_boxData[50]);
+  QVector3D bmin = QVector3D(m_boxMin.x, m_boxMin.y, m_boxMin.z);
+  QVector3D bmax = QVector3D(m_boxMax.x, m_boxMax.y, m_boxMax.z);
 
   QVector3D centerR = QVector3D(matR * QVector4D(0,0,0,1));
   QVector3D cenR = finalxformInv.map(centerR);
@@ -228,7 +287,7 @@ Label::genVertData()
   glGenBuffers( 1, &m_glVertBuffer );
   glBindBuffer( GL_ARRAY_BUFFER, m_glVertBuffer );
   glBufferData( GL_ARRAY_BUFFER,
-		sizeof(float)*8*30,
+		sizeof(float)*8*4,
 		NULL,
 		GL_STATIC_DRAW );
       
@@ -262,142 +321,53 @@ Label::genVertData()
   glGenBuffers(1, &m_glIndexBuffer);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_glIndexBuffer);
   
-  if (m_treeInfo.count() > 0) // draw box
-    {
-      if (!m_boxData)
-	createBox();
-      
-      glBindVertexArray(m_glVertArray);
-      glBindBuffer( GL_ARRAY_BUFFER, m_glVertBuffer);
-      glBufferSubData(GL_ARRAY_BUFFER,
-		      0,
-		      sizeof(float)*8*24,
-		      &m_boxData[0]);
-      
-      uchar indexData[36];
-      //	  for(int i=0; i<24; i++)
-      //	    indexData[i] = i;
-      
-      for(int i=0; i<6; i++)
-	{
-	  indexData[6*i+0] = 4*i+0;
-	  indexData[6*i+1] = 4*i+1;
-	  indexData[6*i+2] = 4*i+2;
-	  indexData[6*i+3] = 4*i+0;
-	  indexData[6*i+4] = 4*i+2;
-	  indexData[6*i+5] = 4*i+3;
-	}
-      
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		   sizeof(uchar)*36,
-		   &indexData[0],
-		   GL_STATIC_DRAW);
-    }
-  else
-    {
-      uchar indexData[6];
-      indexData[0] = 0;
-      indexData[1] = 1;
-      indexData[2] = 2;
-      indexData[3] = 0;
-      indexData[4] = 2;
-      indexData[5] = 3;
+  uchar indexData[6];
+  indexData[0] = 0;
+  indexData[1] = 1;
+  indexData[2] = 2;
+  indexData[3] = 0;
+  indexData[4] = 2;
+  indexData[5] = 3;
       
-      glBufferData( GL_ELEMENT_ARRAY_BUFFER,
-		    sizeof(uchar) * 2 * 3,
-		    &indexData[0],
-		    GL_STATIC_DRAW );
-    }
+  glBufferData( GL_ELEMENT_ARRAY_BUFFER,
+		sizeof(uchar) * 2 * 3,
+		&indexData[0],
+		GL_STATIC_DRAW );
   
   glBindVertexArray( 0 );
+}
   
+//--------------------------------------------
+// same test as the labels shader uses to leave
+// the label out of its icon and box passes
+//--------------------------------------------
+bool
+Label::nearRay(QVector3D pinPoint,
+	       QVector3D frontR,
+	       QMatrix4x4 finalxform)
+{
+  if (m_treeInfo.count() == 0)
+    return false;
   
+  QVector3D vp = QVector3D(m_position.x, m_position.y, m_position.z);
+  QVector3D fxvp = finalxform.map(vp);
   
-  int fsize = m_fontSize;
-  if (!m_glTexture)
-    {
-      QFont font = QFont("Helvetica", fsize);
-      QColor color(m_color.z*255,m_color.y*255,m_color.x*255); 
-      QImage tmpTex = StaticFunctions::renderText(m_caption,
-						  font,
-						  Qt::black, color);      
-      m_texWd = tmpTex.width();
-      m_texHt = tmpTex.height();
-      
-      glGenTextures(1, &m_glTexture);
-      glActiveTexture(GL_TEXTURE4);
-      glBindTexture(GL_TEXTURE_2D, m_glTexture);
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); 
-      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); 
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexImage2D(GL_TEXTURE_2D,
-		   0,
-		   4,
-		   m_texWd,
-		   m_texHt,
-		   0,
-		   GL_RGBA,
-		   GL_UNSIGNED_BYTE,
-		   tmpTex.bits());
-      
-      glDisable(GL_TEXTURE_2D);
-    }  
+  return (fxvp.distanceToLine(pinPoint, frontR) <= 0.02);
 }
 
 void
-Label::drawLabel(QVector3D cpos,
-		 QVector3D vDir,
-		 QVector3D uDir,
-		 QVector3D rDir,
-		 QMatrix4x4 mvp,
-		 QMatrix4x4 matR,
-		 QMatrix4x4 finalxform,
-		 QMatrix4x4 finalxformInv,
-		 float deadRadius,
-		 QVector3D deadPoint,
-		 bool glow)
+Label::drawCard(QVector3D cpos,
+		QVector3D vDir,
+		QVector3D rDir,
+		QMatrix4x4 mvp)
 {
   if (!m_vertData)
     genVertData();
   
+  GLuint texId = glTexture();
 
   QVector3D vp = QVector3D(m_position.x, m_position.y, m_position.z);
 
-  if (m_treeInfo.count() > 0)
-    {
-      QVector3D centerR = QVector3D(matR * QVector4D(0,0,0,1));
-      QVector3D frontR;
-      frontR = QVector3D(matR * QVector4D(0,0,-0.1,1)) - centerR;
-      QVector3D pinPoint = centerR + frontR;
-      QVector3D fxvp = finalxform.map(vp);
-
-      if (fxvp.distanceToLine(pinPoint, frontR) > 0.02)
-	{
-	  Vec vp2d(vp.x(), vp.y(), 0);
-	  Vec dp2d(deadPoint.x(), deadPoint.y(), 0);
-	  
-	  if (deadRadius <= 0 ||
-	      (vp2d-dp2d).norm() > deadRadius-0.02) // take slightly smaller radius
-	    {
-	      // show icon only if we are close
-	      if ((cpos-vp).lengthSquared() < 1)
-		showTreeInfoPosition(mvp, glow);
-	    }
-	  else
-	    drawBox(mvp, vDir, glow, true);
-	  
-	  return;
-	}
-    }
-  else if ((cpos-vp).length() > m_proximity)
-    return;
-
-
-  //glDepthMask(GL_FALSE); // disable writing to depth buffer
-  //glDisable(GL_DEPTH_TEST);
-
-
   QVector3D nDir = (cpos-vp).normalized();
   QVector3D uD = QVector3D::crossProduct(nDir, rDir);
   uD.normalized();
@@ -457,12 +427,9 @@ Label::drawLabel(QVector3D cpos,
   m_vertData[30] = 1.0;
   m_vertData[31] = 0.0;
 
-//  glEnable(GL_BLEND);
-//  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
 
   glActiveTexture(GL_TEXTURE4);
-  glBindTexture(GL_TEXTURE_2D, m_glTexture);
+  glBindTexture(GL_TEXTURE_2D, texId);
   glEnable(GL_TEXTURE_2D);
 
   glBindVertexArray(m_glVertArray);
@@ -471,31 +438,6 @@ Label::drawLabel(QVector3D cpos,
 		  0,
 		  sizeof(float)*8*4,
 		  &m_vertData[0]);
-
-  // Identify the components in the vertex buffer
-  glEnableVertexAttribArray( 0 );
-  glVertexAttribPointer( 0, //attribute 0
-			 3, // size
-			 GL_FLOAT, // type
-			 GL_FALSE, // normalized
-			 sizeof(float)*8, // stride
-			 (void *)0 ); // starting offset
-  
-  glEnableVertexAttribArray( 1 );
-  glVertexAttribPointer( 1,
-			 3,
-			 GL_FLOAT,
-			 GL_FALSE,
-			 sizeof(float)*8,
-			 (char *)NULL + sizeof(float)*3 );
-  
-  glEnableVertexAttribArray( 2 );
-  glVertexAttribPointer( 2,
-			 2,
-			 GL_FLOAT,
-			 GL_FALSE, 
-			 sizeof(float)*8,
-			 (char *)NULL + sizeof(float)*6 );
   
   glUseProgram(ShaderFactory::rcShader());
   GLint *rcShaderParm = ShaderFactory::rcShaderParm();
@@ -515,19 +457,6 @@ Label::drawLabel(QVector3D cpos,
   glDisable(GL_TEXTURE_2D);
 
   glUseProgram( 0 );
-
-//  glDisable(GL_BLEND);
-  //glDepthMask(GL_TRUE); // enable writing to depth buffer
-  //glEnable(GL_DEPTH_TEST);
-
-//  if (!m_linkData.isEmpty())
-//    {
-//      float prox = (cpos-pos).length()/m_proximity;      
-//      Vec col = Vec(1.0-prox*0.5, prox, prox*0.5);
-//      col *= 255;
-//      QColor bcol(col.x, col.y, col.z);
-//      StaticFunctions::renderText(x, y+2*fsize, "^", font, bcol, color);
-//    }
 }
 
 bool
@@ -553,101 +482,12 @@ Label::checkLink(Camera *cam, QPoint pos)
   return false;
 }
 
-void
-Label::showTreeInfoPosition(QMatrix4x4 mvp, bool glow)
-{
-  glDepthMask(GL_FALSE); // disable writing to depth buffer
-
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-  m_vertData[0] = m_position.x;
-  m_vertData[1] = m_position.y;
-  m_vertData[2] = m_position.z;
-  m_vertData[3] = 0;
-  m_vertData[4] = 0;
-  m_vertData[5] = 0;
-  m_vertData[6] = 0;
-  m_vertData[7] = 0;
-
-  glEnable(GL_PROGRAM_POINT_SIZE );
-  glEnable(GL_POINT_SPRITE);
-  glActiveTexture(GL_TEXTURE4);
-  glBindTexture(GL_TEXTURE_2D, Global::infoSpriteTexture());
-  glEnable(GL_TEXTURE_2D);
-
-  glBindVertexArray(m_glVertArray);
-  glBindBuffer( GL_ARRAY_BUFFER, m_glVertBuffer);
-  glBufferSubData(GL_ARRAY_BUFFER,
-		  0,
-		  sizeof(float)*8,
-		  &m_vertData[0]);
-
-  // Identify the components in the vertex buffer
-  glEnableVertexAttribArray( 0 );
-  glVertexAttribPointer( 0, //attribute 0
-			 3, // size
-			 GL_FLOAT, // type
-			 GL_FALSE, // normalized
-			 sizeof(float)*8, // stride
-			 (void *)0 ); // starting offset
-  
-  glEnableVertexAttribArray( 1 );
-  glVertexAttribPointer( 1,
-			 3,
-			 GL_FLOAT,
-			 GL_FALSE,
-			 sizeof(float)*8,
-			 (char *)NULL + sizeof(float)*3 );
-  
-  glEnableVertexAttribArray( 2 );
-  glVertexAttribPointer( 2,
-			 2,
-			 GL_FLOAT,
-			 GL_FALSE, 
-			 sizeof(float)*8,
-			 (char *)NULL + sizeof(float)*6 );
-
-  glUseProgram(ShaderFactory::rcShader());
-  GLint *rcShaderParm = ShaderFactory::rcShaderParm();
-  glUniformMatrix4fv(rcShaderParm[0], 1, GL_FALSE, mvp.data() );  
-  glUniform1i(rcShaderParm[1], 4); // texture
-
-  glUniform3f(rcShaderParm[3], 0, 0, 0); // view direction
-  glUniform1i(rcShaderParm[5], 3); // point sprite
-
-  if (!glow)
-    {
-      glUniform3f(rcShaderParm[2], 0, 0, 0); // color
-      glUniform1f(rcShaderParm[4], 0.8); // opacity modulator
-      glUniform1f(rcShaderParm[6], 20); // pointsize
-      glUniform1f(rcShaderParm[7], 0); // mix color
-    }
-  else
-    {
-      glUniform3f(rcShaderParm[2], 1, 0.3, 0.0); // mix color
-      glUniform1f(rcShaderParm[4], 1); // opacity modulator
-      glUniform1f(rcShaderParm[6], 40); // pointsize
-      glUniform1f(rcShaderParm[7], 0.8); // mix color
-    }
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_glIndexBuffer);  
-  glDrawArrays(GL_POINTS, 0, 1);  
-  glBindVertexArray(0);
-
-  glDisable(GL_PROGRAM_POINT_SIZE );
-  glDisable(GL_POINT_SPRITE);
-  glDisable(GL_TEXTURE_2D);
-
-  glUseProgram( 0 );
-
-  glDisable(GL_BLEND);
-  glDepthMask(GL_TRUE); // enable writing to depth buffer
-}
-
 void
 Label::createBox()
 {
+  if (m_treeInfo.count() < 2)
+    return;
+
   // use area parameter for side length of box
   float sz = qSqrt(m_treeInfo[1])/2;
   //float sz = qSqrt(m_treeInfo[1]);
@@ -659,174 +499,6 @@ Label::createBox()
   bmin *= 0.01;
   bmax *= 0.01;
 
-  bmin += m_position;
-  bmax += m_position;
- 
-  if (!m_boxData)
-    m_boxData = new float[24*8];
-
-  QList<Vec> box; 
-  box << Vec(bmin.x, bmin.y, bmin.z);
-  box << Vec(bmax.x, bmin.y, bmin.z);
-  box << Vec(bmax.x, bmax.y, bmin.z);
-  box << Vec(bmin.x, bmax.y, bmin.z);
-
-  box << Vec(bmin.x, bmin.y, bmax.z);
-  box << Vec(bmax.x, bmin.y, bmax.z);
-  box << Vec(bmax.x, bmax.y, bmax.z);
-  box << Vec(bmin.x, bmax.y, bmax.z);
-
-  box << Vec(bmin.x, bmax.y, bmin.z);
-  box << Vec(bmax.x, bmax.y, bmin.z);
-  box << Vec(bmax.x, bmax.y, bmax.z);
-  box << Vec(bmin.x, bmax.y, bmax.z);
-
-  box << Vec(bmin.x, bmin.y, bmin.z);
-  box << Vec(bmax.x, bmin.y, bmin.z);
-  box << Vec(bmax.x, bmin.y, bmax.z);
-  box << Vec(bmin.x, bmin.y, bmax.z);  
-
-  box << Vec(bmin.x, bmin.y, bmin.z);
-  box << Vec(bmin.x, bmax.y, bmin.z);
-  box << Vec(bmin.x, bmax.y, bmax.z);
-  box << Vec(bmin.x, bmin.y, bmax.z);  
-
-  box << Vec(bmax.x, bmin.y, bmin.z);
-  box << Vec(bmax.x, bmax.y, bmin.z);
-  box << Vec(bmax.x, bmax.y, bmax.z);
-  box << Vec(bmax.x, bmin.y, bmax.z);  
-
-  QList<Vec> boxN; 
-  boxN << Vec(0,0,-1);
-  boxN << Vec(0,0,-1);
-  boxN << Vec(0,0,-1);
-  boxN << Vec(0,0,-1);
-
-  boxN << Vec(0,0,1);
-  boxN << Vec(0,0,1);
-  boxN << Vec(0,0,1);
-  boxN << Vec(0,0,1);
-
-  boxN << Vec(0,1,0);
-  boxN << Vec(0,1,0);
-  boxN << Vec(0,1,0);
-  boxN << Vec(0,1,0);
-
-  boxN << Vec(0,-1,0);
-  boxN << Vec(0,-1,0);
-  boxN << Vec(0,-1,0);
-  boxN << Vec(0,-1,0);
-
-  boxN << Vec(-1,0,0);
-  boxN << Vec(-1,0,0);
-  boxN << Vec(-1,0,0);
-  boxN << Vec(-1,0,0);
-
-  boxN << Vec(1,0,0);
-  boxN << Vec(1,0,0);
-  boxN << Vec(1,0,0);
-  boxN << Vec(1,0,0);
-  
-  float texC[] = {1,0, 0,0, 0,1, 1,1};
-  for(int i=0; i<24; i++)
-    {
-      m_boxData[8*i+0] = box[i].x;
-      m_boxData[8*i+1] = box[i].y;
-      m_boxData[8*i+2] = box[i].z;
-      m_boxData[8*i+3] = boxN[i].x;
-      m_boxData[8*i+4] = boxN[i].y;
-      m_boxData[8*i+5] = boxN[i].z;
-      m_boxData[8*i+6] = texC[2*(i%4)+0];
-      m_boxData[8*i+7] = texC[2*(i%4)+1];
-    }
-}
-
-void
-Label::drawBox(QMatrix4x4 mvp, QVector3D vDir,
-	       bool glow, bool box)
-{
-  glActiveTexture(GL_TEXTURE4);
-  if (box)
-    glBindTexture(GL_TEXTURE_2D, Global::boxSpriteTexture());
-  else
-    glBindTexture(GL_TEXTURE_2D, Global::circleSpriteTexture());
-  glEnable(GL_TEXTURE_2D);
-
-
-  glBindBuffer( GL_ARRAY_BUFFER, m_glVertBuffer);
-  glBufferSubData(GL_ARRAY_BUFFER,
-		  0,
-		  sizeof(float)*8*24,
-		  &m_boxData[0]);
-
-  glEnable(GL_TEXTURE_2D);
-
-
-  glBindVertexArray(m_glVertArray);
-  glBindBuffer( GL_ARRAY_BUFFER, m_glVertBuffer);
-
-  // Identify the components in the vertex buffer
-  glEnableVertexAttribArray( 0 );
-  glVertexAttribPointer( 0, //attribute 0
-			 3, // size
-			 GL_FLOAT, // type
-			 GL_FALSE, // normalized
-			 sizeof(float)*8, // stride
-			 (void *)0 ); // starting offset
-  
-  glEnableVertexAttribArray( 1 );
-  glVertexAttribPointer( 1,
-			 3,
-			 GL_FLOAT,
-			 GL_FALSE,
-			 sizeof(float)*8,
-			 (char *)NULL + sizeof(float)*3 );
-  
-  glEnableVertexAttribArray( 2 );
-  glVertexAttribPointer( 2,
-			 2,
-			 GL_FLOAT,
-			 GL_FALSE, 
-			 sizeof(float)*8,
-			 (char *)NULL + sizeof(float)*6 );
-
-  glColor3f(0.5, 0.6, 1.0);
-
-  glUseProgram(ShaderFactory::rcShader());
-  GLint *rcShaderParm = ShaderFactory::rcShaderParm();
-  glUniformMatrix4fv(rcShaderParm[0], 1, GL_FALSE, mvp.data() );  
-  glUniform1i(rcShaderParm[1], 4); // texture
-
-  if (glow)
-    glUniform3f(rcShaderParm[2], m_hitC.x, m_hitC.y, m_hitC.z); // mix color
-  else
-    glUniform3f(rcShaderParm[2], m_color.x, m_color.y, m_color.z); // mix color
-
-  if (box)
-    glUniform3f(rcShaderParm[3], vDir.x(), vDir.y(), vDir.z()); // view direction
-  else
-    glUniform3f(rcShaderParm[3], 0,0,0); // view direction
-
-  glUniform1f(rcShaderParm[4], 1.0); // opacity modulator
-  glUniform1i(rcShaderParm[5], 5); // apply texture
-  glUniform1f(rcShaderParm[6], 10); // pointsize
-
-  if (box)
-    glUniform1f(rcShaderParm[7], 0.7); // mix color
-  else
-    glUniform1f(rcShaderParm[7], 1); // mix color
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_glIndexBuffer);  
-  //glDrawElements(GL_QUADS, 24, GL_UNSIGNED_BYTE, 0);  
-  
-  if (box)
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);  
-  else // draw only bottom square
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);  
-
-  glBindVertexArray(0);
-
-  glUseProgram( 0 );
-
-  glDisable(GL_TEXTURE_2D);
+  m_boxMin = bmin + m_position;
+  m_boxMax = bmax + m_position;
 }
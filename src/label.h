@@ -7,6 +7,7 @@ using namespace qglviewer;
 
 #include <QMatrix4x4>
 #include <QVector3D>
+#include <QImage>
 
 class Label
 {
@@ -22,14 +23,23 @@ class Label
   void setLink(QString lnk) { m_linkData = lnk; }
 
   void setTreeInfo(QList<float>);
+  bool treeLabel() { return m_treeInfo.count() > 0; }
+
+  Vec position() { return m_position; }
+  float proximity() { return m_proximity; }
+  Vec color() { return m_color; }
+  Vec boxMin() { return m_boxMin; }
+  Vec boxMax() { return m_boxMax; }
+
+  // caption, or the information card for tree labels
+  QImage image();
 
   void drawLabel(Camera*);
-  void drawLabel(QVector3D,
-		 QVector3D, QVector3D, QVector3D,
-		 QMatrix4x4, QMatrix4x4,
-		 QMatrix4x4, QMatrix4x4,
-		 float, QVector3D,
-		 bool);
+
+  // information card of a tree label, drawn while
+  // the controller ray passes close to the label
+  bool nearRay(QVector3D, QVector3D, QMatrix4x4);
+  void drawCard(QVector3D, QVector3D, QVector3D, QMatrix4x4);
 
   bool checkLink(Camera*, QPoint);
   QString linkData() { return m_linkData; }
@@ -40,7 +50,9 @@ class Label
   float checkHit(QMatrix4x4, QMatrix4x4,
 		float, QVector3D);
 
-  GLuint glTexture() { return m_glTexture; }
+  // created on first use, labels are otherwise
+  // drawn from the atlas of LabelRenderer
+  GLuint glTexture();
   QSize textureSize() { return QSize(m_texWd, m_texHt); }
 
  private :
@@ -55,6 +67,7 @@ class Label
   QString m_linkData;
 
   int m_texWd, m_texHt;
+  qint64 m_texBytes;
 
   GLuint m_glTexture;
   GLuint m_glVertBuffer;
@@ -62,17 +75,16 @@ class Label
   GLuint m_glVertArray;
 
   float *m_vertData;
-  float *m_boxData;
+  Vec m_boxMin, m_boxMax;
 
   int m_hitDur;
-  Vec m_hitC;
 
   void genVertData();
+  void accountTexture();
 
-  void showTreeInfoPosition(QMatrix4x4, bool);
+  QImage cardImage();
 
   void createBox();
-  void drawBox(QMatrix4x4, QVector3D, bool, bool);
 };
 
 #endif
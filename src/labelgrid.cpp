@@ -0,0 +1,197 @@
+#include "labelgrid.h"
+
+#include <QtMath>
+
+// average labels per cell
+#define LABELGRID_PER_CELL 4
+
+// cells along either side at most
+#define LABELGRID_MAX_SIZE 1024
+
+LabelGrid::LabelGrid()
+{
+  clear();
+}
+
+void
+LabelGrid::clear()
+{
+  m_bmin = Vec(0,0,0);
+  m_cellSize = 1;
+  m_wd = m_ht = 0;
+  m_cellStart.clear();
+  m_items.clear();
+  m_pos.clear();
+  m_maxProximity = 0;
+}
+
+void
+LabelGrid::build(QList<Label*> labels)
+{
+  clear();
+
+  int nlabels = labels.count();
+  if (nlabels == 0)
+    return;
+
+  m_pos.resize(nlabels);
+  Vec bmin, bmax;
+  for(int i=0; i<nlabels; i++)
+    {
+      Vec p = labels[i]->position();
+      m_pos[i] = p;
+
+      if (i == 0)
+	bmin = bmax = p;
+      else
+	{
+	  bmin = Vec(qMin(bmin.x, p.x), qMin(bmin.y, p.y), qMin(bmin.z, p.z));
+	  bmax = Vec(qMax(bmax.x, p.x), qMax(bmax.y, p.y), qMax(bmax.z, p.z));
+	}
+
+      if (!labels[i]->treeLabel())
+	m_maxProximity = qMax(m_maxProximity, labels[i]->proximity());
+    }
+
+  float xext = bmax.x-bmin.x;
+  float yext = bmax.y-bmin.y;
+  float ext = qMax(xext, yext);
+
+  // square cells, about LABELGRID_PER_CELL labels each
+  // if they were spread evenly
+  float area = qMax(xext*yext, ext*ext/LABELGRID_MAX_SIZE);
+  m_cellSize = qSqrt(area*LABELGRID_PER_CELL/nlabels);
+  m_cellSize = qMax(m_cellSize, ext/LABELGRID_MAX_SIZE);
+  if (m_cellSize <= 0)
+    m_cellSize = 1;
+
+  m_bmin = bmin;
+  m_wd = qBound(1, (int)(xext/m_cellSize)+1, LABELGRID_MAX_SIZE);
+  m_ht = qBound(1, (int)(yext/m_cellSize)+1, LABELGRID_MAX_SIZE);
+
+  // counting sort of the labels on their cell
+  QVector<int> cell(nlabels);
+  m_cellStart.fill(0, m_wd*m_ht+1);
+  for(int i=0; i<nlabels; i++)
+    {
+      int cx = qBound(0, (int)((m_pos[i].x-m_bmin.x)/m_cellSize), m_wd-1);
+      int cy = qBound(0, (int)((m_pos[i].y-m_bmin.y)/m_cellSize), m_ht-1);
+      cell[i] = cy*m_wd + cx;
+      m_cellStart[cell[i]+1]++;
+    }
+
+  for(int c=0; c<m_wd*m_ht; c++)
+    m_cellStart[c+1] += m_cellStart[c];
+
+  QVector<int> fill = m_cellStart;
+  m_items.resize(nlabels);
+  for(int i=0; i<nlabels; i++)
+    m_items[fill[cell[i]]++] = i;
+}
+
+//--------------------------------------------
+// cells overlapped by the xy rectangle,
+// false when it lies outside the grid
+//--------------------------------------------
+bool
+LabelGrid::cellRange(float xmin, float ymin, float xmax, float ymax,
+		     int &cx0, int &cy0, int &cx1, int &cy1)
+{
+  if (m_wd == 0)
+    return false;
+
+  float fx0 = (xmin-m_bmin.x)/m_cellSize;
+  float fy0 = (ymin-m_bmin.y)/m_cellSize;
+  float fx1 = (xmax-m_bmin.x)/m_cellSize;
+  float fy1 = (ymax-m_bmin.y)/m_cellSize;
+
+  if (fx1 < 0 || fy1 < 0 || fx0 >= m_wd || fy0 >= m_ht)
+    return false;
+
+  cx0 = qMax(0, (int)fx0);
+  cy0 = qMax(0, (int)fy0);
+  cx1 = qMin(m_wd-1, (int)fx1);
+  cy1 = qMin(m_ht-1, (int)fy1);
+
+  return true;
+}
+
+QList<int>
+LabelGrid::sphere(Vec p, float r)
+{
+  QList<int> found;
+
+  int cx0, cy0, cx1, cy1;
+  if (r < 0 ||
+      !cellRange(p.x-r, p.y-r, p.x+r, p.y+r, cx0, cy0, cx1, cy1))
+    return found;
+
+  float r2 = r*r;
+  for(int cy=cy0; cy<=cy1; cy++)
+    for(int cx=cx0; cx<=cx1; cx++)
+      {
+	int c = cy*m_wd + cx;
+	for(int k=m_cellStart[c]; k<m_cellStart[c+1]; k++)
+	  {
+	    int i = m_items[k];
+	    if ((m_pos[i]-p).squaredNorm() <= r2)
+	      found << i;
+	  }
+      }
+
+  return found;
+}
+
+QList<int>
+LabelGrid::disk(Vec p, float r)
+{
+  QList<int> found;
+
+  int cx0, cy0, cx1, cy1;
+  if (r < 0 ||
+      !cellRange(p.x-r, p.y-r, p.x+r, p.y+r, cx0, cy0, cx1, cy1))
+    return found;
+
+  for(int cy=cy0; cy<=cy1; cy++)
+    for(int cx=cx0; cx<=cx1; cx++)
+      {
+	int c = cy*m_wd + cx;
+	for(int k=m_cellStart[c]; k<m_cellStart[c+1]; k++)
+	  {
+	    int i = m_items[k];
+	    Vec d = m_pos[i]-p;
+	    d.z = 0;
+	    if (d.norm() <= r)
+	      found << i;
+	  }
+      }
+
+  return found;
+}
+
+QList<int>
+LabelGrid::box(Vec bmin, Vec bmax)
+{
+  QList<int> found;
+
+  int cx0, cy0, cx1, cy1;
+  if (!cellRange(bmin.x, bmin.y, bmax.x, bmax.y, cx0, cy0, cx1, cy1))
+    return found;
+
+  for(int cy=cy0; cy<=cy1; cy++)
+    for(int cx=cx0; cx<=cx1; cx++)
+      {
+	int c = cy*m_wd + cx;
+	for(int k=m_cellStart[c]; k<m_cellStart[c+1]; k++)
+	  {
+	    int i = m_items[k];
+	    Vec p = m_pos[i];
+	    if (p.x >= bmin.x && p.x <= bmax.x &&
+		p.y >= bmin.y && p.y <= bmax.y &&
+		p.z >= bmin.z && p.z <= bmax.z)
+	      found << i;
+	  }
+      }
+
+  return found;
+}
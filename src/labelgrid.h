@@ -0,0 +1,53 @@
+#ifndef LABELGRID_H
+#define LABELGRID_H
+
+#include "label.h"
+
+#include <QList>
+#include <QVector>
+
+//--------------------------------------------
+// Uniform xy grid over the label positions of a point cloud,
+// labels stand on the ground so one cell column is enough.
+// Cells hold about LABELGRID_PER_CELL labels on average.
+// Queries return the indices of labels in the cells overlapped
+// by the query with the exact test done here, so the per frame
+// cost follows the labels around the viewer and not the total.
+// Rebuilt whenever labels are loaded or moved.
+//--------------------------------------------
+class LabelGrid
+{
+ public :
+  LabelGrid();
+
+  void clear();
+  void build(QList<Label*>);
+
+  // largest proximity over labels with captions
+  float maxProximity() { return m_maxProximity; }
+
+  // positions within radius of a point
+  QList<int> sphere(Vec, float);
+
+  // positions within radius of a point in xy
+  QList<int> disk(Vec, float);
+
+  // positions inside a box
+  QList<int> box(Vec, Vec);
+
+ private :
+  Vec m_bmin;
+  float m_cellSize;
+  int m_wd, m_ht;
+
+  QVector<int> m_cellStart;  // wd*ht+1 offsets into m_items
+  QVector<int> m_items;      // label indices in cell order
+  QVector<Vec> m_pos;
+
+  float m_maxProximity;
+
+  bool cellRange(float, float, float, float,
+		 int&, int&, int&, int&);
+};
+
+#endif
@@ -0,0 +1,595 @@
+#include "labelrenderer.h"
+#include "shaderfactory.h"
+#include "memorystats.h"
+#include "global.h"
+
+#include <QPainter>
+#include <QtMath>
+
+// width of the atlas layers, images are packed in shelves
+#define LABELATLAS_SIZE 2048
+
+// empty texels around each image against filtering bleed
+#define LABELATLAS_PAD 2
+
+// floats per label instance
+#define LABELRENDERER_FLOATS 24
+
+//--------------------------------------------
+// places an image on the current shelf, or starts a new
+// shelf or layer when it does not fit
+//--------------------------------------------
+static void
+atlasPlace(QList<QImage> &pages,
+	   int &x, int &y, int &shelfHt,
+	   QImage img,
+	   QRect &rect, int &layer)
+{
+  int maxSize = LABELATLAS_SIZE - LABELATLAS_PAD;
+  if (img.width() > maxSize || img.height() > maxSize)
+    img = img.scaled(maxSize, maxSize,
+		     Qt::KeepAspectRatio,
+		     Qt::SmoothTransformation);
+
+  int wd = img.width() + LABELATLAS_PAD;
+  int ht = img.height() + LABELATLAS_PAD;
+
+  if (x + wd > LABELATLAS_SIZE)
+    {
+      x = 0;
+      y += shelfHt;
+      shelfHt = 0;
+    }
+
+  if (pages.count() == 0 || y + ht > LABELATLAS_SIZE)
+    {
+      QImage page(LABELATLAS_SIZE, LABELATLAS_SIZE, QImage::Format_ARGB32);
+      page.fill(Qt::transparent);
+      pages << page;
+      x = y = shelfHt = 0;
+    }
+
+  QPainter p(&pages.last());
+  p.setCompositionMode(QPainter::CompositionMode_Source);
+  p.drawImage(x, y, img);
+
+  rect = QRect(x, y, img.width(), img.height());
+  layer = pages.count()-1;
+
+  x += wd;
+  shelfHt = qMax(shelfHt, ht);
+}
+
+//--------------------------------------------
+// in front of the viewer and at most half a viewport
+// outside of it, enough for captions and boxes
+//--------------------------------------------
+static bool
+inFrustum(QMatrix4x4 &mvp, Vec p)
+{
+  QVector4D c = mvp * QVector4D(p.x, p.y, p.z, 1);
+  float m = 1.5*c.w();
+  return (c.w() > 0 &&
+	  qAbs(c.x()) <= m &&
+	  qAbs(c.y()) <= m);
+}
+
+LabelRenderer::LabelRenderer()
+{
+  m_labels.clear();
+  m_newLabels = false;
+  m_movedLabels = false;
+  m_treeLabels = false;
+
+  m_iconLayer = 0;
+
+  m_atlas = 0;
+  m_atlasHt = LABELATLAS_SIZE;
+  m_atlasLayers = 0;
+  m_atlasBytes = 0;
+
+  m_instanceBuffer = 0;
+  m_cubeBuffer = 0;
+  m_quadVAO = m_boxVAO = 0;
+
+  m_shadersTried = false;
+  m_shaders[0] = m_shaders[1] = 0;
+}
+
+LabelRenderer::~LabelRenderer()
+{
+  release();
+}
+
+void
+LabelRenderer::release()
+{
+  if (m_atlas)
+    glDeleteTextures(1, &m_atlas);
+  m_atlas = 0;
+  MemoryStats::add(MemoryStats::LabelTextures, -m_atlasBytes);
+  m_atlasBytes = 0;
+  m_atlasLayers = 0;
+
+  if (m_quadVAO)
+    {
+      glDeleteVertexArrays(1, &m_quadVAO);
+      glDeleteVertexArrays(1, &m_boxVAO);
+      glDeleteBuffers(1, &m_instanceBuffer);
+      glDeleteBuffers(1, &m_cubeBuffer);
+    }
+  m_quadVAO = m_boxVAO = 0;
+  m_instanceBuffer = m_cubeBuffer = 0;
+
+  for(int s=0; s<2; s++)
+    {
+      if (m_shaders[s])
+	glDeleteObjectARB(m_shaders[s]);
+      m_shaders[s] = 0;
+    }
+  m_shadersTried = false;
+
+  // everything is made again on the next draw
+  m_newLabels = (m_labels.count() > 0);
+}
+
+void
+LabelRenderer::setLabels(QList<Label*> labels)
+{
+  m_labels = labels;
+  m_newLabels = true;
+
+  m_treeLabels = false;
+  for(int i=0; i<m_labels.count(); i++)
+    m_treeLabels |= m_labels[i]->treeLabel();
+}
+
+void
+LabelRenderer::updatePositions()
+{
+  m_movedLabels = true;
+}
+
+void
+LabelRenderer::createShaders()
+{
+  m_shadersTried = true;
+
+  for(int s=0; s<2; s++)
+    {
+      QStringList defines;
+      if (s == 1) defines << "BOX";
+
+      m_shaders[s] = glCreateProgramObjectARB();
+      if (! ShaderFactory::loadShadersFromFile(m_shaders[s],
+					       "assets/shaders/labels.vert",
+					       "assets/shaders/labels.frag",
+					       defines))
+	{
+	  glDeleteObjectARB(m_shaders[s]);
+	  m_shaders[s] = 0;
+	  continue;
+	}
+
+      m_parms[s][0] = glGetUniformLocation(m_shaders[s], "MVP");
+      m_parms[s][1] = glGetUniformLocation(m_shaders[s], "cpos");
+      m_parms[s][2] = glGetUniformLocation(m_shaders[s], "rDir");
+      m_parms[s][3] = glGetUniformLocation(m_shaders[s], "finalxform");
+      m_parms[s][4] = glGetUniformLocation(m_shaders[s], "pinPoint");
+      m_parms[s][5] = glGetUniformLocation(m_shaders[s], "frontR");
+      m_parms[s][6] = glGetUniformLocation(m_shaders[s], "deadRadius");
+      m_parms[s][7] = glGetUniformLocation(m_shaders[s], "deadPoint");
+      m_parms[s][8] = glGetUniformLocation(m_shaders[s], "hitLabel");
+      m_parms[s][9] = glGetUniformLocation(m_shaders[s], "viewport");
+      m_parms[s][10] = glGetUniformLocation(m_shaders[s], "diffuse");
+      m_parms[s][11] = glGetUniformLocation(m_shaders[s], "viewDir");
+    }
+}
+
+//--------------------------------------------
+// instance attributes 0-5 for both passes, the box pass
+// also takes a unit cube with normals and texcoords
+//--------------------------------------------
+void
+LabelRenderer::createBuffers()
+{
+  glGenBuffers(1, &m_instanceBuffer);
+  glGenBuffers(1, &m_cubeBuffer);
+
+  // corners of the faces, 0 for box min and 1 for box max
+  float corner[] = { 0,0,0, 1,0,0, 1,1,0, 0,1,0,
+		     0,0,1, 1,0,1, 1,1,1, 0,1,1,
+		     0,1,0, 1,1,0, 1,1,1, 0,1,1,
+		     0,0,0, 1,0,0, 1,0,1, 0,0,1,
+		     0,0,0, 0,1,0, 0,1,1, 0,0,1,
+		     1,0,0, 1,1,0, 1,1,1, 1,0,1 };
+  float normal[] = { 0,0,-1,  0,0,1,
+		     0,1,0,   0,-1,0,
+		     -1,0,0,  1,0,0 };
+  float texC[] = {1,0, 0,0, 0,1, 1,1};
+  int tri[] = {0,1,2, 0,2,3};
+
+  float cube[36*8];
+  for(int f=0; f<6; f++)
+    for(int t=0; t<6; t++)
+      {
+	int c = 4*f + tri[t];
+	float *v = cube + 8*(6*f+t);
+	v[0] = corner[3*c+0];
+	v[1] = corner[3*c+1];
+	v[2] = corner[3*c+2];
+	v[3] = normal[3*f+0];
+	v[4] = normal[3*f+1];
+	v[5] = normal[3*f+2];
+	v[6] = texC[2*tri[t]+0];
+	v[7] = texC[2*tri[t]+1];
+      }
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_cubeBuffer);
+  glBufferData(GL_ARRAY_BUFFER,
+	       sizeof(float)*36*8,
+	       &cube[0],
+	       GL_STATIC_DRAW);
+
+  int stride = sizeof(float)*LABELRENDERER_FLOATS;
+
+  glGenVertexArrays(1, &m_quadVAO);
+  glGenVertexArrays(1, &m_boxVAO);
+  for(int v=0; v<2; v++)
+    {
+      glBindVertexArray(v == 0 ? m_quadVAO : m_boxVAO);
+
+      glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+      for(int a=0; a<6; a++)
+	{
+	  glEnableVertexAttribArray(a);
+	  glVertexAttribPointer(a,
+				4,
+				GL_FLOAT,
+				GL_FALSE,
+				stride,
+				(char *)NULL + sizeof(float)*4*a);
+	  glVertexAttribDivisor(a, 1);
+	}
+
+      if (v == 1)
+	{
+	  glBindBuffer(GL_ARRAY_BUFFER, m_cubeBuffer);
+	  glEnableVertexAttribArray(6);
+	  glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE,
+				sizeof(float)*8,
+				(void *)0);
+	  glEnableVertexAttribArray(7);
+	  glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE,
+				sizeof(float)*8,
+				(char *)NULL + sizeof(float)*3);
+	  glEnableVertexAttribArray(8);
+	  glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE,
+				sizeof(float)*8,
+				(char *)NULL + sizeof(float)*6);
+	}
+    }
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//--------------------------------------------
+// captions of plain labels and the info icon shown for
+// tree labels, tree cards are not part of the atlas
+//--------------------------------------------
+void
+LabelRenderer::buildAtlas()
+{
+  int nlabels = m_labels.count();
+  m_rect.fill(QRect(), nlabels);
+  m_layer.fill(0, nlabels);
+
+  QList<QImage> pages;
+  int x = 0;
+  int y = 0;
+  int shelfHt = 0;
+
+  // uploaded as bgra like Global::infoSpriteTexture
+  QImage info = QImage(":/images/info.png").convertToFormat(QImage::Format_ARGB32);
+  atlasPlace(pages, x, y, shelfHt,
+	     info.rgbSwapped(),
+	     m_iconRect, m_iconLayer);
+
+  for(int i=0; i<nlabels; i++)
+    {
+      if (m_labels[i]->treeLabel())
+	continue;
+
+      QImage img = m_labels[i]->image();
+      if (img.isNull())
+	continue;
+
+      atlasPlace(pages, x, y, shelfHt,
+		 img.convertToFormat(QImage::Format_ARGB32),
+		 m_rect[i], m_layer[i]);
+    }
+
+  // a single layer is only as high as needed
+  m_atlasLayers = pages.count();
+  m_atlasHt = (m_atlasLayers == 1 ? y + shelfHt : LABELATLAS_SIZE);
+
+  if (m_atlas)
+    glDeleteTextures(1, &m_atlas);
+  glGenTextures(1, &m_atlas);
+
+  glActiveTexture(GL_TEXTURE4);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlas);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY,
+	       0,
+	       GL_RGBA8,
+	       LABELATLAS_SIZE, m_atlasHt, m_atlasLayers,
+	       0,
+	       GL_RGBA,
+	       GL_UNSIGNED_BYTE,
+	       0);
+  for(int l=0; l<m_atlasLayers; l++)
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+		    0,
+		    0, 0, l,
+		    LABELATLAS_SIZE, m_atlasHt, 1,
+		    GL_RGBA,
+		    GL_UNSIGNED_BYTE,
+		    pages[l].bits());
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  qint64 bytes = (qint64)4*LABELATLAS_SIZE*m_atlasHt*m_atlasLayers;
+  MemoryStats::add(MemoryStats::LabelTextures, bytes - m_atlasBytes);
+  m_atlasBytes = bytes;
+}
+
+void
+LabelRenderer::buildInstances()
+{
+  int nlabels = m_labels.count();
+  m_instanceData.resize(LABELRENDERER_FLOATS*nlabels);
+
+  float aw = LABELATLAS_SIZE;
+  float ah = m_atlasHt;
+  for(int i=0; i<nlabels; i++)
+    {
+      Label *lbl = m_labels[i];
+      bool tree = lbl->treeLabel();
+      QRect r = (tree ? m_iconRect : m_rect[i]);
+      int layer = (tree ? m_iconLayer : m_layer[i]);
+
+      Vec pos = lbl->position();
+      Vec bmin = lbl->boxMin();
+      Vec bmax = lbl->boxMax();
+      Vec col = lbl->color();
+
+      float *f = m_instanceData.data() + LABELRENDERER_FLOATS*i;
+      f[0] = pos.x;
+      f[1] = pos.y;
+      f[2] = pos.z;
+      f[3] = lbl->proximity();
+
+      f[4] = r.x()/aw;
+      f[5] = r.y()/ah;
+      f[6] = r.width()/aw;
+      f[7] = r.height()/ah;
+
+      f[8] = r.width();
+      f[9] = r.height();
+      f[10] = layer;
+      f[11] = (tree ? 1 : 0);
+
+      f[12] = bmin.x;
+      f[13] = bmin.y;
+      f[14] = bmin.z;
+      f[15] = i; // compared with the hit label
+
+      f[16] = bmax.x;
+      f[17] = bmax.y;
+      f[18] = bmax.z;
+      f[19] = 0;
+
+      f[20] = col.x;
+      f[21] = col.y;
+      f[22] = col.z;
+      f[23] = 0;
+    }
+}
+
+//--------------------------------------------
+// instances of the listed labels for the next draw
+//--------------------------------------------
+int
+LabelRenderer::uploadInstances(QList<int> list)
+{
+  QVector<float> data(LABELRENDERER_FLOATS*list.count());
+  for(int i=0; i<list.count(); i++)
+    memcpy(data.data() + LABELRENDERER_FLOATS*i,
+	   m_instanceData.constData() + LABELRENDERER_FLOATS*list[i],
+	   sizeof(float)*LABELRENDERER_FLOATS);
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER,
+	       sizeof(float)*data.count(),
+	       data.constData(),
+	       GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  return list.count();
+}
+
+void
+LabelRenderer::draw(LabelGrid *grid,
+		    QVector3D cpos,
+		    QVector3D vDir,
+		    QVector3D rDir,
+		    QMatrix4x4 mvp,
+		    QMatrix4x4 matR,
+		    QMatrix4x4 finalxform,
+		    QMatrix4x4 finalxformInv,
+		    float deadRadius,
+		    QVector3D deadPoint,
+		    int hitLabel)
+{
+  int nlabels = m_labels.count();
+  if (nlabels == 0)
+    return;
+
+  if (!m_shadersTried)
+    createShaders();
+
+  if (!m_shaders[0] || !m_shaders[1])
+    return;
+
+  if (!m_quadVAO)
+    createBuffers();
+
+  if (m_newLabels)
+    {
+      buildAtlas();
+      m_newLabels = false;
+      m_movedLabels = true;
+    }
+
+  if (m_movedLabels)
+    {
+      buildInstances();
+      m_movedLabels = false;
+    }
+
+  // controller ray as Label::nearRay sees it
+  QVector3D centerR = QVector3D(matR * QVector4D(0,0,0,1));
+  QVector3D frontR = QVector3D(matR * QVector4D(0,0,-0.1,1)) - centerR;
+  QVector3D pinPoint = centerR + frontR;
+
+  //--------------------
+  // captions within their proximity and icons within unit
+  // distance, boxes of tree labels in the dead zone
+  Vec cp = Vec(cpos.x(), cpos.y(), cpos.z());
+  float radius = grid->maxProximity();
+  if (m_treeLabels)
+    radius = qMax(radius, 1.0f);
+
+  QList<int> quads;
+  QList<int> nearby = grid->sphere(cp, radius);
+  for(int n=0; n<nearby.count(); n++)
+    {
+      Label *lbl = m_labels[nearby[n]];
+      float dist = (lbl->position()-cp).norm();
+      if (lbl->treeLabel() ? dist >= 1 : dist > lbl->proximity())
+	continue;
+
+      if (inFrustum(mvp, lbl->position()))
+	quads << nearby[n];
+    }
+
+  QList<int> boxes;
+  if (m_treeLabels && deadRadius > 0)
+    {
+      Vec dp = Vec(deadPoint.x(), deadPoint.y(), deadPoint.z());
+      QList<int> zone = grid->disk(dp, deadRadius-0.02);
+      for(int n=0; n<zone.count(); n++)
+	{
+	  Label *lbl = m_labels[zone[n]];
+	  if (lbl->treeLabel() &&
+	      (inFrustum(mvp, lbl->boxMin()) ||
+	       inFrustum(mvp, lbl->boxMax())))
+	    boxes << zone[n];
+	}
+    }
+
+  // a label is near the ray when within about 0.02 of the pin
+  // point, 0.02*sqrt(1+1/(1-|frontR|^2)^2) to be exact. Taken back
+  // to the label frame, a bad fit for a projective final
+  // transform so every label is tried then.
+  QList<int> cards;
+  if (m_treeLabels)
+    {
+      float along = qAbs(1 - frontR.lengthSquared());
+      bool affine = (finalxform.row(3) == QVector4D(0,0,0,1));
+      if (affine && along > 0.1)
+	{
+	  float r = 0.02*qSqrt(1 + 1/(along*along));
+	  QVector3D pin = finalxformInv.map(pinPoint);
+	  float rd = 0;
+	  for(int k=0; k<3; k++)
+	    {
+	      QVector3D off(0,0,0);
+	      off[k] = r;
+	      rd = qMax(rd, (finalxformInv.map(pinPoint+off) - pin).length());
+	    }
+	  cards = grid->sphere(Vec(pin.x(), pin.y(), pin.z()), rd);
+	}
+      else
+	{
+	  for(int i=0; i<nlabels; i++)
+	    cards << i;
+	}
+    }
+  //--------------------
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  for(int s=0; s<2; s++)
+    {
+      glUseProgram(m_shaders[s]);
+      glUniformMatrix4fv(m_parms[s][0], 1, GL_FALSE, mvp.data());
+      glUniform3f(m_parms[s][1], cpos.x(), cpos.y(), cpos.z());
+      glUniform3f(m_parms[s][2], rDir.x(), rDir.y(), rDir.z());
+      glUniformMatrix4fv(m_parms[s][3], 1, GL_FALSE, finalxform.data());
+      glUniform3f(m_parms[s][4], pinPoint.x(), pinPoint.y(), pinPoint.z());
+      glUniform3f(m_parms[s][5], frontR.x(), frontR.y(), frontR.z());
+      glUniform1f(m_parms[s][6], deadRadius);
+      glUniform3f(m_parms[s][7], deadPoint.x(), deadPoint.y(), deadPoint.z());
+      glUniform1i(m_parms[s][8], hitLabel);
+      glUniform2f(m_parms[s][9], viewport[2], viewport[3]);
+      glUniform1i(m_parms[s][10], 4); // texture
+      glUniform3f(m_parms[s][11], vDir.x(), vDir.y(), vDir.z());
+    }
+
+  glActiveTexture(GL_TEXTURE4);
+
+  // boxes of tree labels inside the dead zone
+  if (boxes.count() > 0)
+    {
+      int ninst = uploadInstances(boxes);
+      glUseProgram(m_shaders[1]);
+      glBindTexture(GL_TEXTURE_2D, Global::boxSpriteTexture());
+      glBindVertexArray(m_boxVAO);
+      glDrawArraysInstanced(GL_TRIANGLES, 0, 36, ninst);
+    }
+
+  // captions and info icons
+  glDepthMask(GL_FALSE); // disable writing to depth buffer
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+  if (quads.count() > 0)
+    {
+      int ninst = uploadInstances(quads);
+      glUseProgram(m_shaders[0]);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlas);
+      glBindVertexArray(m_quadVAO);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ninst);
+    }
+
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glUseProgram(0);
+
+  glDisable(GL_BLEND);
+  glDepthMask(GL_TRUE); // enable writing to depth buffer
+
+  // cards along the controller ray
+  for(int n=0; n<cards.count(); n++)
+    {
+      Label *lbl = m_labels[cards[n]];
+      if (lbl->nearRay(pinPoint, frontR, finalxform))
+	lbl->drawCard(cpos, vDir, rDir, mvp);
+    }
+}
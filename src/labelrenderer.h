@@ -0,0 +1,81 @@
+#ifndef LABELRENDERER_H
+#define LABELRENDERER_H
+
+#include <GL/glew.h>
+
+#include "labelgrid.h"
+
+#include <QList>
+#include <QVector>
+#include <QRect>
+
+//--------------------------------------------
+// Draws all labels of a point cloud with a couple of instanced
+// draw calls in place of one set of GL objects and draws per label.
+// Captions and the info icon are packed into the layers of one
+// texture array, each label is one instance carrying its position,
+// atlas rectangle, box and color.
+// Labels near the viewer or in the dead zone are found through the
+// LabelGrid of the point cloud and culled against the view, only
+// their instances are sent for the eye being drawn.
+// Proximity fading, dead zone and icon/box selection are done in
+// the vertex shader, hidden labels collapse to nothing.
+// Only the information cards shown along the controller ray are
+// still drawn one by one, there are seldom more than a few.
+//--------------------------------------------
+class LabelRenderer
+{
+ public :
+  LabelRenderer();
+  ~LabelRenderer();
+
+  void release();
+
+  // labels added or removed, atlas is rebuilt
+  void setLabels(QList<Label*>);
+
+  // labels moved, e.g. grounded
+  void updatePositions();
+
+  void draw(LabelGrid*,
+	    QVector3D,
+	    QVector3D, QVector3D,
+	    QMatrix4x4, QMatrix4x4,
+	    QMatrix4x4, QMatrix4x4,
+	    float, QVector3D,
+	    int);
+
+ private :
+  QList<Label*> m_labels;
+  bool m_newLabels;
+  bool m_movedLabels;
+  bool m_treeLabels;
+
+  // per label place in the atlas
+  QVector<QRect> m_rect;
+  QVector<int> m_layer;
+  QRect m_iconRect;
+  int m_iconLayer;
+
+  GLuint m_atlas;
+  int m_atlasHt;
+  int m_atlasLayers;
+  qint64 m_atlasBytes;
+
+  QVector<float> m_instanceData;
+  GLuint m_instanceBuffer;
+  GLuint m_cubeBuffer;
+  GLuint m_quadVAO, m_boxVAO;
+
+  bool m_shadersTried;
+  GLhandleARB m_shaders[2];
+  GLint m_parms[2][12];
+
+  void createShaders();
+  void createBuffers();
+  void buildAtlas();
+  void buildInstances();
+  int uploadInstances(QList<int>);
+};
+
+#endif
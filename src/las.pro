@@ -26,6 +26,20 @@ win32 {
   LIBS += glmedia.lib
 }
 
+# trace event markers, build with qmake CONFIG+=trace
+trace {
+  DEFINES += USE_TRACE
+}
+
+unix:!macx {
+  # asynchronous node reads
+  packagesExist(liburing) {
+    DEFINES += USE_IO_URING
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liburing
+  }
+}
+
 LIBS += QGLViewer2.lib glew32.lib LASzip.lib openvr_api.lib 
 
 FORMS += vrmain.ui \
@@ -48,11 +62,26 @@ HEADERS += vrmain.h \
 	mymanipulatedframe.h \
 	octreenode.h \
 	glhiddenwidget.h \
+	nodereader.h \
+	nodecache.h \
+	lodselector.h \
+	frametimer.h \
+	tracer.h \
+	memorystats.h \
+	visibilitymap.h \
+	hiztest.h \
+	hizmap.h \
+	budgetcontroller.h \
+	heightfield.h \
+	pointpicker.h \
+	mapcache.h \
 	loaderthread.h \
 	volumeloaderthread.h \
 	pointcloud.h \
 	staticfunctions.h \
 	label.h \
+	labelrenderer.h \
+	labelgrid.h \
 	vr.h \
 	cglrendermodel.h \
 	vrmenu.h \
@@ -82,11 +111,26 @@ SOURCES += main.cpp \
 	mymanipulatedframe.cpp \
 	octreenode.cpp \
 	glhiddenwidget.cpp \
+	nodereader.cpp \
+	nodecache.cpp \
+	lodselector.cpp \
+	frametimer.cpp \
+	tracer.cpp \
+	memorystats.cpp \
+	visibilitymap.cpp \
+	hiztest.cpp \
+	hizmap.cpp \
+	budgetcontroller.cpp \
+	heightfield.cpp \
+	pointpicker.cpp \
+	mapcache.cpp \
 	loaderthread.cpp \
 	volumeloaderthread.cpp \
 	pointcloud.cpp \
 	staticfunctions.cpp \
 	label.cpp \
+	labelrenderer.cpp \
+	labelgrid.cpp \
 	vr.cpp \
 	cglrendermodel.cpp \
 	vrmenu.cpp \
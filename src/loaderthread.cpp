@@ -1,4 +1,5 @@
 #include "loaderthread.h"
+#include "tracer.h"
 #include <QMessageBox>
 
 void
@@ -11,6 +12,8 @@ LoaderThread::start(QGLFormat format, QWidget *parent, QGLWidget *sw)
 	  this, SIGNAL(vboLoaded(int, qint64)));
   connect(m_gl, SIGNAL(vboLoadedAll(int, qint64)),
 	  this, SIGNAL(vboLoadedAll(int, qint64)));
+  connect(m_gl, SIGNAL(mapVBOLoaded(int, qint64)),
+	  this, SIGNAL(mapVBOLoaded(int, qint64)));
   connect(m_gl, SIGNAL(message(QString)),
 	  this, SIGNAL(message(QString)));
 
@@ -27,6 +30,8 @@ LoaderThread::stopLoading()
 void
 LoaderThread::loadPointsToVBO()
 {
+  TRACE_SCOPE("loadPointsToVBO");
+
   m_gl->makeCurrent();
   m_gl->loadPointsToVBO();
   m_gl->doneCurrent();
@@ -35,6 +40,8 @@ LoaderThread::loadPointsToVBO()
 void
 LoaderThread::updateView()
 {
+  TRACE_SCOPE("updateView");
+
   m_gl->makeCurrent();
   m_gl->updateView();
   m_gl->doneCurrent();
@@ -21,6 +21,7 @@ class LoaderThread : public QObject
  signals :
    void vboLoaded(int, qint64);
    void vboLoadedAll(int, qint64);
+   void mapVBOLoaded(int, qint64);
    void message(QString);
        
    void meshLoadedAll();
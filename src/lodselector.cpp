@@ -0,0 +1,133 @@
+#include "lodselector.h"
+#include "staticfunctions.h"
+
+LodSelector::LodSelector()
+{
+  m_pointBudget = 10000000;
+  m_minNodePixelSize = 100;
+  m_projFactor = 1.0;
+  m_pointsSelected = 0;
+}
+
+float
+LodSelector::projectedSize(OctreeNode *node, QMatrix4x4 &MV, Vec cpos)
+{
+  Vec bmin = node->bmin();
+  Vec bmax = node->bmax();
+
+  QVector4D bminV = MV * QVector4D(bmin.x, bmin.y, bmin.z, 1);
+  QVector4D bmaxV = MV * QVector4D(bmax.x, bmax.y, bmax.z, 1);
+  bmin = Vec(bminV.x(), bminV.y(), bminV.z());
+  bmax = Vec(bmaxV.x(), bmaxV.y(), bmaxV.z());
+
+  return StaticFunctions::projectionSize(cpos,
+					 bmin, bmax,
+					 m_projFactor);
+}
+
+QList<OctreeNode*>
+LodSelector::select(QList<OctreeNode*> tiles, QMatrix4x4 MV, Vec cpos)
+{
+  genPriorityQueue(tiles, MV, cpos);
+
+  //-------------------------------
+  // take nodes with largest projection size first
+  m_pointsSelected = 0;
+  QList<OctreeNode*> nodes;
+  QList<float> keys = m_priorityQueue.keys();
+
+  bool bufferFull = false;
+  for(int k=keys.count()-1; k>=0 && !bufferFull; k--)
+    {
+      QList<OctreeNode*> values = m_priorityQueue.values(keys[k]);
+      for(int v=0; v<values.count() && !bufferFull; v++)
+	{
+	  if (m_pointsSelected + values[v]->numpoints() < m_pointBudget)
+	    {
+	      m_pointsSelected += values[v]->numpoints();
+	      nodes << values[v];
+	    }
+	  else
+	    {
+	      // points in shuffled nodes are in random order,
+	      // draw only as many as fit in the remaining budget
+	      qint64 remaining = m_pointBudget - m_pointsSelected;
+	      if (values[v]->shuffled() && remaining > 0)
+		{
+		  values[v]->setPointLimit(remaining);
+		  m_pointsSelected += remaining;
+		  nodes << values[v];
+		}
+	      bufferFull = true;
+	    }
+	}
+    }
+
+  // only the selected nodes stay active
+  QList<OctreeNode*> queued = m_priorityQueue.values();
+  for(int i=0; i<queued.count(); i++)
+    queued[i]->setActive(false);
+  for(int i=0; i<nodes.count(); i++)
+    nodes[i]->setActive(true);
+  //-------------------------------
+
+  return nodes;
+}
+
+void
+LodSelector::genPriorityQueue(QList<OctreeNode*> tiles, QMatrix4x4 MV, Vec cpos)
+{
+  m_priorityQueue.clear();
+
+  QList<OctreeNode*> onl0;
+
+  // consider all top-level tile nodes first
+  for(int d=0; d<tiles.count(); d++)
+    {
+      OctreeNode *node = tiles[d];
+
+      float screenProjectedSize = projectedSize(node, MV, cpos);
+
+      if (screenProjectedSize >= m_minNodePixelSize &&
+	  !m_occlusionTest.occluded(node->tightOctreeMin(),
+				    node->tightOctreeMax()))
+	onl0 << node;
+
+      if (!node->isActive())
+	{
+	  m_priorityQueue.insert(screenProjectedSize, node);
+	  node->setActive(true);
+	}
+    }
+
+  // now consider the nodes within each tile
+  while (onl0.count() > 0)
+    {
+      QList<OctreeNode*> onl1;
+      for(int i=0; i<onl0.count(); i++)
+	{
+	  OctreeNode *node = onl0[i];
+	  for (int k=0; k<8; k++)
+	    {
+	      OctreeNode *cnode = node->getChild(k);
+	      if (cnode)
+		{
+		  float screenProjectedSize = projectedSize(cnode, MV, cpos);
+
+		  if (screenProjectedSize >= m_minNodePixelSize &&
+		      !m_occlusionTest.occluded(cnode->tightOctreeMin(),
+						cnode->tightOctreeMax()))
+		    onl1 << cnode;
+
+		  if (!cnode->isActive())
+		    {
+		      m_priorityQueue.insert(screenProjectedSize, cnode);
+		      cnode->setActive(true);
+		    }
+		} // valid child
+	    } // loop over child nodes
+	} // loop over onl0
+
+      onl0 = onl1;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef LODSELECTOR_H
+#define LODSELECTOR_H
+
+#include "octreenode.h"
+#include "hiztest.h"
+
+#include <QList>
+#include <QMultiMap>
+#include <QMatrix4x4>
+
+//--------------------------------------------
+// Picks the octree nodes to draw for a given modelview.
+// Nodes are ranked on their projected screen size and taken
+// largest first until the point budget is used up.
+// Nodes failing the occlusion test are kept but not refined.
+// Does not touch GL so it can also be driven without a context.
+//--------------------------------------------
+class LodSelector
+{
+ public :
+  LodSelector();
+
+  void setPointBudget(qint64 pb) { m_pointBudget = pb; }
+  void setMinNodePixelSize(int s) { m_minNodePixelSize = s; }
+  void setProjFactor(float p) { m_projFactor = p; }
+  void setOcclusionTest(HiZTest t) { m_occlusionTest = t; }
+
+  qint64 pointBudget() { return m_pointBudget; }
+  float projFactor() { return m_projFactor; }
+
+  // active flag and point limit of all nodes
+  // need to be cleared before calling select
+  QList<OctreeNode*> select(QList<OctreeNode*>, QMatrix4x4, Vec);
+
+  qint64 pointsSelected() { return m_pointsSelected; }
+
+ private :
+  qint64 m_pointBudget;
+  int m_minNodePixelSize;
+  float m_projFactor;
+  HiZTest m_occlusionTest;
+
+  qint64 m_pointsSelected;
+  QMultiMap<float, OctreeNode*> m_priorityQueue;
+
+  void genPriorityQueue(QList<OctreeNode*>, QMatrix4x4, Vec);
+  float projectedSize(OctreeNode*, QMatrix4x4&, Vec);
+};
+
+#endif
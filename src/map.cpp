@@ -2,6 +2,7 @@
 #include "map.h"
 #include "shaderfactory.h"
 #include "staticfunctions.h"
+#include "memorystats.h"
 
 #include <QFont>
 #include <QColor>
@@ -15,6 +16,7 @@ Map::Map() : QObject()
   m_glVertArray = 0;
   m_vertData = 0;
   m_VBpoints = 0;
+  m_texBytes = 0;
 
   m_bc = 0;
 
@@ -32,6 +34,8 @@ Map::Map() : QObject()
 
 Map::~Map()
 {
+  MemoryStats::add(MemoryStats::MapImage, -m_texBytes);
+
   if(m_vertData)
     {
       delete [] m_vertData;
@@ -57,20 +61,39 @@ Map::setTeleports(QList<QVector3D> tp)
 void
 Map::setImage(QImage img)
 {
-  m_texWd = img.width();
-  m_texHt = img.height();
-  
-  if (!m_glTexture)
-    glGenTextures(1, &m_glTexture);
+  setTexture(composeImage(img));
+}
+
+//--------------------------------------------
+// no GL here, may run off the render thread
+//--------------------------------------------
+QImage
+Map::composeImage(QImage img)
+{
+  int wd = img.width();
+  int ht = img.height();
 
-  m_image = QImage(m_texWd, m_texHt, QImage::Format_ARGB32);
-  QPainter p(&m_image);
+  QImage image(wd, ht, QImage::Format_ARGB32);
+  QPainter p(&image);
   p.setBrush(QColor(0,0,0,180));
   p.setPen(QPen(Qt::yellow, 5, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-  //p.drawRoundedRect(1, 1, m_texWd-2, m_texHt-2, 50, 50);
-  p.drawEllipse(1, 1, m_texWd-2, m_texHt-2);
+  //p.drawRoundedRect(1, 1, wd-2, ht-2, 50, 50);
+  p.drawEllipse(1, 1, wd-2, ht-2);
   p.drawImage(0, 0, img.rgbSwapped());
+  p.end();
+
+  return image;
+}
 
+void
+Map::setTexture(QImage image)
+{
+  m_image = image;
+  m_texWd = m_image.width();
+  m_texHt = m_image.height();
+  
+  if (!m_glTexture)
+    glGenTextures(1, &m_glTexture);
 
   glActiveTexture(GL_TEXTURE4);
   glBindTexture(GL_TEXTURE_2D, m_glTexture);
@@ -88,6 +111,12 @@ Map::setImage(QImage img)
 	       GL_UNSIGNED_BYTE,
 	       m_image.bits());
 
+  // texture plus the image kept for drawing, replaces
+  // whatever this map counted before
+  qint64 texBytes = 8*(qint64)m_texWd*m_texHt;
+  MemoryStats::add(MemoryStats::MapImage, texBytes - m_texBytes);
+  m_texBytes = texBytes;
+
   glDisable(GL_TEXTURE_2D);
 }
 
@@ -227,6 +256,10 @@ Map::genVertData()
 		   GL_RGBA,
 		   GL_UNSIGNED_BYTE,
 		   tmpTex.bits());
+
+      qint64 texBytes = 4*(qint64)m_texWd*m_texHt;
+      MemoryStats::add(MemoryStats::MapImage, texBytes - m_texBytes);
+      m_texBytes = texBytes;
       
       glDisable(GL_TEXTURE_2D);
     }
@@ -23,6 +23,11 @@ class Map : public QObject
 
   void setImage(QImage);
 
+  // setImage in two halves, the map image composed with the
+  // menu backdrop and the texture upload of the result
+  static QImage composeImage(QImage);
+  void setTexture(QImage);
+
   void setCurrPos(QVector3D v, QVector3D vd)
   {
     m_currPos = v;
@@ -57,6 +62,7 @@ class Map : public QObject
   GLuint m_glIndexBuffer;
   GLuint m_glVertArray;
   int m_texHt, m_texWd;
+  qint64 m_texBytes; // counted under MemoryStats::MapImage
   float *m_vertData;
 
   QVector3D m_currPos;
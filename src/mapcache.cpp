@@ -0,0 +1,339 @@
+#include "mapcache.h"
+#include "memorystats.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QMutexLocker>
+
+// maps held in memory
+#define MAPCACHE_MAX_BYTES ((qint64)1024*1024*1024)
+
+// map files of other keys kept on disk
+#define MAPCACHE_MAX_DISK_BYTES ((qint64)4*1024*1024*1024)
+
+// file header, "MAP1" followed by width and height
+#define MAPCACHE_MAGIC 0x3150414d
+
+//--------------------------------------------
+// rgba rows top down, then the float depth as VR keeps it,
+// written aside and renamed later so readers never see half a file
+//--------------------------------------------
+static bool
+writeMapFile(QString tmpflnm, QImage image, QVector<float> depth)
+{
+  QDir().mkpath(QFileInfo(tmpflnm).absolutePath());
+
+  QFile fout(tmpflnm);
+  if (!fout.open(QFile::WriteOnly))
+    return false;
+
+  qint32 hdr[3];
+  hdr[0] = MAPCACHE_MAGIC;
+  hdr[1] = image.width();
+  hdr[2] = image.height();
+  fout.write((char*)hdr, sizeof(hdr));
+  for(int y=0; y<image.height(); y++)
+    fout.write((char*)image.constScanLine(y), image.width()*4);
+  fout.write((char*)depth.constData(), depth.count()*sizeof(float));
+  bool ok = (fout.error() == QFile::NoError);
+  fout.close();
+
+  if (!ok)
+    QFile::remove(tmpflnm);
+
+  return ok;
+}
+
+static bool
+readMapFile(QString flnm, QImage &image, QVector<float> &depth)
+{
+  QFile fin(flnm);
+  if (!fin.open(QFile::ReadOnly))
+    return false;
+
+  qint32 hdr[3];
+  if (fin.read((char*)hdr, sizeof(hdr)) != sizeof(hdr) ||
+      hdr[0] != MAPCACHE_MAGIC ||
+      hdr[1] <= 0 || hdr[2] <= 0)
+    return false;
+
+  int wd = hdr[1];
+  int ht = hdr[2];
+  qint64 npix = (qint64)wd*ht;
+  if (fin.size() != (qint64)sizeof(hdr) + npix*8)
+    return false;
+
+  image = QImage(wd, ht, QImage::Format_RGBA8888_Premultiplied);
+  for(int y=0; y<ht; y++)
+    fin.read((char*)image.scanLine(y), wd*4);
+
+  depth.resize(npix);
+  fin.read((char*)depth.data(), npix*sizeof(float));
+
+  return (fin.error() == QFile::NoError);
+}
+
+//--------------------------------------------
+// one disk read or write on the cache thread
+//--------------------------------------------
+class MapCacheTask : public QRunnable
+{
+ public :
+  MapCache *cache;
+  bool write;
+  int step, generation;
+  QString flnm;
+  QImage image;
+  QVector<float> depth;
+
+  void run()
+  {
+    // source changed since this was queued
+    if (!cache->current(generation))
+      return;
+
+    if (write)
+      {
+	QString tmpflnm = flnm + ".tmp";
+	if (writeMapFile(tmpflnm, image, depth))
+	  cache->writeDone(generation, tmpflnm, flnm);
+	return;
+      }
+
+    QImage img;
+    QVector<float> dep;
+    if (!readMapFile(flnm, img, dep))
+      {
+	img = QImage();
+	dep.clear();
+      }
+    cache->readDone(generation, step, img, dep);
+  }
+};
+
+MapCache::MapCache()
+{
+  m_pool.setMaxThreadCount(1);
+  m_generation = 0;
+  m_bytes = 0;
+}
+
+MapCache::~MapCache()
+{
+  clear();
+  m_pool.waitForDone();
+}
+
+void
+MapCache::setSource(QString dir, QString key)
+{
+  clear();
+
+  QMutexLocker lock(&m_mutex);
+  m_dir = (dir.isEmpty() ? QString() : QDir(dir).absoluteFilePath("mapcache"));
+  m_key = key;
+  prune();
+}
+
+void
+MapCache::setKey(QString key)
+{
+  clear();
+
+  QMutexLocker lock(&m_mutex);
+  m_key = key;
+  prune();
+}
+
+//--------------------------------------------
+// mutex held, maps drawn for earlier keys stay on disk in
+// case the data or map camera goes back, the oldest written
+// are removed once they add up to MAPCACHE_MAX_DISK_BYTES
+//--------------------------------------------
+void
+MapCache::prune()
+{
+  if (m_dir.isEmpty())
+    return;
+
+  QDir dir(m_dir);
+  QFileInfoList files = dir.entryInfoList(QStringList() << "map*_*.bin",
+					  QDir::Files,
+					  QDir::Time); // newest first
+  QString current = QString("_%1.bin").arg(m_key);
+  qint64 bytes = 0;
+  for(int i=0; i<files.count(); i++)
+    {
+      if (files[i].fileName().endsWith(current))
+	continue;
+
+      bytes += files[i].size();
+      if (bytes > MAPCACHE_MAX_DISK_BYTES)
+	dir.remove(files[i].fileName());
+    }
+}
+
+void
+MapCache::clear(bool removeFiles)
+{
+  QMutexLocker lock(&m_mutex);
+
+  m_generation++;
+  m_images.clear();
+  m_depths.clear();
+  m_used.clear();
+  m_reading.clear();
+  m_bytes = 0;
+  MemoryStats::set(MemoryStats::MapCacheData, 0);
+
+  if (removeFiles && !m_dir.isEmpty())
+    {
+      QDir dir(m_dir);
+      QStringList files = dir.entryList(QStringList() << QString("map*_%1.bin").arg(m_key),
+					QDir::Files);
+      for(int i=0; i<files.count(); i++)
+	dir.remove(files[i]);
+    }
+}
+
+QString
+MapCache::fileName(int step)
+{
+  return QDir(m_dir).absoluteFilePath(QString("map%1_%2.bin").arg(step).arg(m_key));
+}
+
+bool
+MapCache::current(int gen)
+{
+  QMutexLocker lock(&m_mutex);
+  return (gen == m_generation);
+}
+
+bool
+MapCache::get(int step, QImage &image, QVector<float> &depth)
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_images.contains(step))
+    return false;
+
+  m_used.removeAll(step);
+  m_used << step;
+
+  image = m_images[step];
+  depth = m_depths[step];
+
+  return true;
+}
+
+//--------------------------------------------
+// mutex held, makes room by dropping the
+// least recently used maps
+//--------------------------------------------
+void
+MapCache::insert(int step, QImage image, QVector<float> depth)
+{
+  if (m_images.contains(step))
+    m_bytes -= (qint64)m_images[step].byteCount() + m_depths[step].count()*sizeof(float);
+
+  m_images[step] = image;
+  m_depths[step] = depth;
+  m_bytes += (qint64)image.byteCount() + depth.count()*sizeof(float);
+
+  m_used.removeAll(step);
+  m_used << step;
+
+  while (m_bytes > MAPCACHE_MAX_BYTES && m_used.count() > 1)
+    {
+      int old = m_used.takeFirst();
+      m_bytes -= (qint64)m_images[old].byteCount() + m_depths[old].count()*sizeof(float);
+      m_images.remove(old);
+      m_depths.remove(old);
+    }
+
+  MemoryStats::set(MemoryStats::MapCacheData, m_bytes);
+}
+
+void
+MapCache::put(int step, QImage image, QVector<float> depth)
+{
+  QMutexLocker lock(&m_mutex);
+
+  insert(step, image, depth);
+
+  if (m_dir.isEmpty())
+    return;
+
+  MapCacheTask *task = new MapCacheTask;
+  task->cache = this;
+  task->write = true;
+  task->step = step;
+  task->generation = m_generation;
+  task->flnm = fileName(step);
+  task->image = image;
+  task->depth = depth;
+  m_pool.start(task);
+}
+
+void
+MapCache::prefetch(int step)
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (m_dir.isEmpty() ||
+      m_images.contains(step) ||
+      m_reading.contains(step))
+    return;
+
+  QString flnm = fileName(step);
+  if (!QFile::exists(flnm))
+    return;
+
+  m_reading << step;
+
+  MapCacheTask *task = new MapCacheTask;
+  task->cache = this;
+  task->write = false;
+  task->step = step;
+  task->generation = m_generation;
+  task->flnm = flnm;
+  m_pool.start(task);
+}
+
+//--------------------------------------------
+// the generation is checked again under the mutex, a clear
+// since the write started must not have its files come back
+//--------------------------------------------
+void
+MapCache::writeDone(int gen, QString tmpflnm, QString flnm)
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (gen == m_generation)
+    {
+      QFile::remove(flnm);
+      if (QFile::rename(tmpflnm, flnm))
+	return;
+    }
+
+  QFile::remove(tmpflnm);
+}
+
+void
+MapCache::readDone(int gen, int step, QImage image, QVector<float> depth)
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (gen != m_generation)
+    return;
+
+  m_reading.remove(step);
+
+  // drawn meanwhile, that one is newer
+  if (image.isNull() || m_images.contains(step))
+    return;
+
+  insert(step, image, depth);
+}
@@ -0,0 +1,68 @@
+#ifndef MAPCACHE_H
+#define MAPCACHE_H
+
+#include <QImage>
+#include <QVector>
+#include <QMap>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+
+//--------------------------------------------
+// Top-down VR map colour and depth per time step, so stepping
+// through a time series swaps in a map drawn before instead of
+// drawing and reading back a new one.
+// Maps are held in memory up to MAPCACHE_MAX_BYTES, least
+// recently used dropped first, and written to a mapcache
+// directory next to the dataset. Files are named after the time
+// step and a key for the data and map camera they were drawn for,
+// files of other keys are capped at MAPCACHE_MAX_DISK_BYTES.
+// Disk reads and writes run on a single background thread,
+// prefetch() pulls upcoming steps into memory ahead of playback.
+//--------------------------------------------
+class MapCache
+{
+ public :
+  MapCache();
+  ~MapCache();
+
+  // directory of the dataset and key of the maps, drops
+  // what is held, an empty directory keeps maps in memory only
+  void setSource(QString, QString);
+
+  // new key for the same directory once the data changed
+  void setKey(QString);
+
+  // drops all maps, files too when asked
+  void clear(bool removeFiles=false);
+
+  bool get(int, QImage&, QVector<float>&);
+  void put(int, QImage, QVector<float>);
+
+  // reads a step from disk in the background if not held
+  void prefetch(int);
+
+ private :
+  friend class MapCacheTask;
+
+  QMutex m_mutex;
+  QThreadPool m_pool;
+  int m_generation;
+
+  QString m_dir, m_key;
+
+  QMap<int, QImage> m_images;
+  QMap<int, QVector<float> > m_depths;
+  QList<int> m_used;    // least recently used first
+  QSet<int> m_reading;
+  qint64 m_bytes;
+
+  QString fileName(int);
+  bool current(int);
+  void prune();
+  void insert(int, QImage, QVector<float>);
+  void writeDone(int, QString, QString);
+  void readDone(int, int, QImage, QVector<float>);
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "memorystats.h"
+
+#include <QDateTime>
+
+// seconds between log lines
+#define MEMORYSTATS_LOG_INTERVAL 10
+
+QAtomicInteger<qint64> MemoryStats::m_bytes[MemoryStats::NumCategories];
+QFile MemoryStats::m_logFile;
+QElapsedTimer MemoryStats::m_logTimer;
+
+QString
+MemoryStats::categoryName(int c)
+{
+  switch (c)
+    {
+    case NodeData : return "nodes";
+    case PointVBO : return "point vbo";
+    case FrameBuffers : return "fbo";
+    case TrisetData : return "mesh";
+    case TrisetVBO : return "mesh vbo";
+    case LabelTextures : return "labels";
+    case MapImage : return "map";
+    case VRBuffers : return "vr fbo";
+    case HeightData : return "heights";
+    case MapCacheData : return "map cache";
+    }
+  return "";
+}
+
+QString
+MemoryStats::toMB(qint64 b)
+{
+  return QString::number(b/(1024.0*1024.0), 'f', 1);
+}
+
+qint64
+MemoryStats::cpuBytes()
+{
+  return (bytes(NodeData) + bytes(TrisetData) +
+	  bytes(HeightData) + bytes(MapCacheData));
+}
+
+qint64
+MemoryStats::gpuBytes()
+{
+  qint64 total = 0;
+  for(int c=0; c<NumCategories; c++)
+    total += bytes((Category)c);
+
+  return total - cpuBytes();
+}
+
+//--------------------------------------------
+// cpu and gpu totals followed by each category, in MB
+//--------------------------------------------
+QString
+MemoryStats::summary()
+{
+  QString mesg = QString("Memory MB : cpu %1  gpu %2  (").\
+    arg(toMB(cpuBytes())).\
+    arg(toMB(gpuBytes()));
+  for(int c=0; c<NumCategories; c++)
+    {
+      if (c > 0) mesg += "  ";
+      mesg += QString("%1 %2").\
+	arg(categoryName(c)).\
+	arg(toMB(bytes((Category)c)));
+    }
+  mesg += ")";
+
+  return mesg;
+}
+
+void
+MemoryStats::setLogFile(QString flnm)
+{
+  if (m_logFile.isOpen())
+    m_logFile.close();
+
+  if (flnm.isEmpty())
+    return;
+
+  m_logFile.setFileName(flnm);
+  if (m_logFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    m_logTimer.start();
+}
+
+//--------------------------------------------
+// called from the viewer once a second
+//--------------------------------------------
+void
+MemoryStats::logIfDue()
+{
+  if (!m_logFile.isOpen() ||
+      m_logTimer.elapsed() < MEMORYSTATS_LOG_INTERVAL*1000)
+    return;
+
+  m_logTimer.restart();
+
+  QString line = QDateTime::currentDateTime().toString(Qt::ISODate);
+  line += QString("  cpu %1  gpu %2").\
+    arg(cpuBytes()).\
+    arg(gpuBytes());
+  for(int c=0; c<NumCategories; c++)
+    line += QString("  %1 %2").\
+      arg(categoryName(c).replace(" ", "_")).\
+      arg(bytes((Category)c));
+  line += "\n";
+
+  m_logFile.write(line.toLatin1());
+  m_logFile.flush();
+}
@@ -0,0 +1,56 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <QString>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QFile>
+
+//--------------------------------------------
+// Bytes held by the big allocations, cpu and gpu side.
+// Objects with many instances (nodes, trisets, labels) add and
+// subtract their own share, single owners (point VBOs, frame
+// buffers) set the whole amount.
+// Updated from the loader threads as well as the GUI thread.
+//--------------------------------------------
+class MemoryStats
+{
+ public :
+  enum Category
+  {
+    NodeData = 0,  // decoded node points in OctreeNode
+    PointVBO,      // the two point buffers
+    FrameBuffers,  // depth/shadow buffers in Viewer
+    TrisetData,    // triset vertex data held on the cpu
+    TrisetVBO,
+    LabelTextures,
+    MapImage,      // map texture and image
+    VRBuffers,     // eye and map frame buffers
+    HeightData,    // ground heights in HeightField
+    MapCacheData,  // per time step maps in MapCache
+    NumCategories
+  };
+
+  static void add(Category c, qint64 b) { m_bytes[c].fetchAndAddRelaxed(b); }
+  static void set(Category c, qint64 b) { m_bytes[c].store(b); }
+  static qint64 bytes(Category c) { return m_bytes[c].load(); }
+
+  static qint64 cpuBytes();
+  static qint64 gpuBytes();
+
+  static QString summary();
+
+  static void setLogFile(QString);
+  static void logIfDue();
+
+ private :
+  static QAtomicInteger<qint64> m_bytes[NumCategories];
+
+  static QFile m_logFile;
+  static QElapsedTimer m_logTimer;
+
+  static QString categoryName(int);
+  static QString toMB(qint64);
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "nodecache.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QMutexLocker>
+
+// entry file : magic, version, bytes per point, number of points, data
+#define NODECACHE_MAGIC 0x434e564c // "LVNC"
+#define NODECACHE_VERSION 1
+#define NODECACHE_HEADER 24
+
+QString NodeCache::m_cacheDir;
+qint64 NodeCache::m_maxSize = 0;
+qint64 NodeCache::m_size = 0;
+QMap<QString, QPair<qint64, qint64> > NodeCache::m_entries;
+QMutex NodeCache::m_mutex;
+
+void
+NodeCache::setCacheDir(QString dir, qint64 maxSize)
+{
+  QMutexLocker lock(&m_mutex);
+
+  m_cacheDir.clear();
+  m_entries.clear();
+  m_size = 0;
+  m_maxSize = maxSize;
+
+  if (dir.isEmpty() || maxSize <= 0)
+    return;
+
+  QDir cdir(dir);
+  if (!cdir.exists() && !cdir.mkpath("."))
+    return;
+
+  m_cacheDir = cdir.absolutePath();
+
+  // pick up entries from previous sessions,
+  // modification time is updated whenever an entry is used
+  QFileInfoList flist = cdir.entryInfoList(QStringList() << "*.node",
+					   QDir::Files);
+  for(int i=0; i<flist.count(); i++)
+    {
+      QString key = flist[i].completeBaseName();
+      qint64 lastUsed = flist[i].lastModified().toMSecsSinceEpoch();
+      m_entries[key] = qMakePair(lastUsed, flist[i].size());
+      m_size += flist[i].size();
+    }
+
+  evict();
+}
+
+QString
+NodeCache::entryFile(QString key)
+{
+  return m_cacheDir + "/" + key + ".node";
+}
+
+bool
+NodeCache::contains(QString key)
+{
+  QMutexLocker lock(&m_mutex);
+  return m_entries.contains(key);
+}
+
+//--------------------------------------------
+// coord is allocated here when not already present
+//--------------------------------------------
+bool
+NodeCache::load(QString key, uchar* &coord, qint64 &npts, int bytesPerPoint)
+{
+  if (!enabled())
+    return false;
+
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_entries.contains(key))
+    return false;
+
+  QFile fl(entryFile(key));
+  if (!fl.open(QFile::ReadWrite))
+    {
+      m_size -= m_entries[key].second;
+      m_entries.remove(key);
+      return false;
+    }
+
+  qint64 fsz = fl.size();
+  uchar *mem = 0;
+  if (fsz >= NODECACHE_HEADER)
+    mem = fl.map(0, fsz);
+
+  bool ok = false;
+  if (mem)
+    {
+      int *hdr = (int*)mem;
+      qint64 n = *(qint64*)(mem + 16);
+      if (hdr[0] == NODECACHE_MAGIC &&
+	  hdr[1] == NODECACHE_VERSION &&
+	  hdr[2] == bytesPerPoint &&
+	  fsz == NODECACHE_HEADER + n*bytesPerPoint)
+	{
+	  npts = n;
+	  if (!coord)
+	    coord = new uchar[npts*bytesPerPoint];
+	  memcpy(coord, mem + NODECACHE_HEADER, npts*bytesPerPoint);
+	  ok = true;
+	}
+      fl.unmap(mem);
+    }
+
+  if (!ok) // stale or damaged entry
+    {
+      fl.close();
+      fl.remove();
+      m_size -= m_entries[key].second;
+      m_entries.remove(key);
+      return false;
+    }
+
+  // mark as recently used
+  QDateTime now = QDateTime::currentDateTime();
+  fl.setFileTime(now, QFileDevice::FileModificationTime);
+  fl.close();
+  m_entries[key].first = now.toMSecsSinceEpoch();
+
+  return true;
+}
+
+void
+NodeCache::save(QString key, uchar *coord, qint64 npts, int bytesPerPoint)
+{
+  if (!enabled() || !coord)
+    return;
+
+  QMutexLocker lock(&m_mutex);
+
+  if (m_entries.contains(key))
+    return;
+
+  // QSaveFile only replaces the entry once everything is written,
+  // a half written entry is never seen by load
+  QSaveFile fl(entryFile(key));
+  if (!fl.open(QFile::WriteOnly))
+    return;
+
+  int hdr[4];
+  hdr[0] = NODECACHE_MAGIC;
+  hdr[1] = NODECACHE_VERSION;
+  hdr[2] = bytesPerPoint;
+  hdr[3] = 0;
+  fl.write((char*)hdr, 16);
+  fl.write((char*)&npts, 8);
+  fl.write((char*)coord, npts*bytesPerPoint);
+  if (!fl.commit())
+    return;
+
+  qint64 fsz = NODECACHE_HEADER + npts*bytesPerPoint;
+  m_entries[key] = qMakePair(QDateTime::currentMSecsSinceEpoch(), fsz);
+  m_size += fsz;
+
+  evict();
+}
+
+void
+NodeCache::evict()
+{
+  while (m_size > m_maxSize && m_entries.count() > 0)
+    {
+      QString oldest;
+      qint64 oldestTime = 0;
+      QMap<QString, QPair<qint64, qint64> >::const_iterator it;
+      for(it = m_entries.constBegin(); it != m_entries.constEnd(); it++)
+	{
+	  if (oldest.isEmpty() || it.value().first < oldestTime)
+	    {
+	      oldest = it.key();
+	      oldestTime = it.value().first;
+	    }
+	}
+
+      QFile::remove(entryFile(oldest));
+      m_size -= m_entries[oldest].second;
+      m_entries.remove(oldest);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef NODECACHE_H
+#define NODECACHE_H
+
+#include <QString>
+#include <QMap>
+#include <QPair>
+#include <QMutex>
+
+//--------------------------------------------
+// Optional on-disk cache of decoded node data.
+// Entries hold the render-ready vertex array of a node and are
+// named by a key built from the node file, its modification time
+// and the transform applied while decoding.
+// Total size is bounded, least recently used entries are removed.
+//--------------------------------------------
+class NodeCache
+{
+ public :
+  static void setCacheDir(QString, qint64);
+  static bool enabled() { return !m_cacheDir.isEmpty(); }
+
+  static bool contains(QString);
+  static bool load(QString, uchar*&, qint64&, int);
+  static void save(QString, uchar*, qint64, int);
+
+ private :
+  static QString m_cacheDir;
+  static qint64 m_maxSize;
+  static qint64 m_size;
+
+  // key -> (last used, file size)
+  static QMap<QString, QPair<qint64, qint64> > m_entries;
+  static QMutex m_mutex;
+
+  static QString entryFile(QString);
+  static void evict();
+};
+
+#endif
@@ -0,0 +1,324 @@
+#include "nodereader.h"
+#include "tracer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+
+#ifdef USE_IO_URING
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#define NODEREADER_RING_ENTRIES 128
+
+
+//--------------------------------------------
+// fallback - one blocking read per pool thread
+//--------------------------------------------
+class NodeReadTask : public QRunnable
+{
+ public :
+  NodeReadTask(NodeReader *reader, int idx, QString flnm)
+    {
+      m_reader = reader;
+      m_idx = idx;
+      m_fileName = flnm;
+    }
+
+  void run()
+  {
+    TRACE_SCOPE("readNode");
+
+    QByteArray data;
+    QFile fl(m_fileName);
+    if (fl.open(QFile::ReadOnly))
+      {
+	data = fl.readAll();
+	fl.close();
+      }
+    TRACE_ARG("bytes", data.size());
+
+    m_reader->readDone(m_idx, data);
+  }
+
+ private :
+  NodeReader *m_reader;
+  int m_idx;
+  QString m_fileName;
+};
+//--------------------------------------------
+
+
+NodeReader::NodeReader()
+{
+  m_files.clear();
+  m_index.clear();
+  m_done.clear();
+  m_nextSubmit = 0;
+  m_inFlight = 0;
+  m_outstanding = 0;
+
+  setQueueDepth(32);
+
+#ifdef USE_IO_URING
+  // fall back to the thread pool if the kernel refuses the ring
+  m_ringOk = (io_uring_queue_init(NODEREADER_RING_ENTRIES, &m_ring, 0) == 0);
+#endif
+}
+
+NodeReader::~NodeReader()
+{
+  cancel();
+
+#ifdef USE_IO_URING
+  if (m_ringOk)
+    io_uring_queue_exit(&m_ring);
+#endif
+}
+
+void
+NodeReader::setQueueDepth(int qd)
+{
+  m_queueDepth = qBound(1, qd, NODEREADER_RING_ENTRIES/2);
+  m_pool.setMaxThreadCount(m_queueDepth);
+}
+
+//--------------------------------------------
+// nodes are expected in priority order - reads are issued
+// in the same order and at most m_queueDepth are read ahead
+// of the decode stage
+//--------------------------------------------
+void
+NodeReader::submit(QList<OctreeNode*> nodes)
+{
+  cancel();
+
+  QMutexLocker lock(&m_mutex);
+
+  for(int i=0; i<nodes.count(); i++)
+    {
+      OctreeNode *node = nodes[i];
+      if (node->dataLoaded() ||
+	  node->markedForDeletion() ||
+	  node->inNodeCache() ||
+	  m_index.contains(node))
+	continue;
+
+      // for LAS/LAZ nodes laszip reads the file itself,
+      // reading it here brings it into the page cache
+      m_index[node] = m_files.count();
+      m_files << node->fileName();
+    }
+
+  fill();
+}
+
+QByteArray
+NodeReader::take(OctreeNode *node)
+{
+  QMutexLocker lock(&m_mutex);
+
+  int idx = m_index.value(node, -1);
+
+  // not submitted, caller reads the file itself
+  if (idx < 0 || idx >= m_nextSubmit)
+    return QByteArray();
+
+  TRACE_SCOPE("readWait");
+  TRACE_ARG("uid", node->uid());
+
+  while (!m_done.contains(idx))
+    {
+#ifdef USE_IO_URING
+      if (m_ringOk)
+	{
+	  if (m_inFlight == 0)
+	    return QByteArray();
+	  reapRing();
+	  continue;
+	}
+#endif
+      m_readDone.wait(&m_mutex);
+    }
+
+  QByteArray data = m_done.take(idx);
+  m_index.remove(node);
+  m_outstanding--;
+
+  fill();
+
+  return data;
+}
+
+void
+NodeReader::cancel()
+{
+  m_mutex.lock();
+  // stop issuing new reads
+  m_nextSubmit = m_files.count();
+
+#ifdef USE_IO_URING
+  if (m_ringOk)
+    {
+      // buffers must stay alive till the kernel is done with them
+      while (m_inFlight > 0)
+	reapRing();
+    }
+#endif
+  m_mutex.unlock();
+
+  // drop queued reads and wait for the running ones
+  m_pool.clear();
+  m_pool.waitForDone();
+
+  m_mutex.lock();
+  m_files.clear();
+  m_index.clear();
+  m_done.clear();
+  m_nextSubmit = 0;
+  m_inFlight = 0;
+  m_outstanding = 0;
+  m_mutex.unlock();
+}
+
+void
+NodeReader::readDone(int idx, QByteArray data)
+{
+  QMutexLocker lock(&m_mutex);
+
+  m_done[idx] = data;
+  m_inFlight--;
+
+  fill();
+
+  m_readDone.wakeAll();
+}
+
+void
+NodeReader::fill()
+{
+  bool started = false;
+  while (m_outstanding < m_queueDepth &&
+	 m_nextSubmit < m_files.count())
+    {
+      startRead(m_nextSubmit);
+      m_nextSubmit++;
+      started = true;
+    }
+
+#ifdef USE_IO_URING
+  if (started && m_ringOk)
+    io_uring_submit(&m_ring);
+#endif
+}
+
+void
+NodeReader::startRead(int idx)
+{
+  m_outstanding++;
+
+#ifdef USE_IO_URING
+  if (m_ringOk)
+    {
+      qint64 fsz = QFileInfo(m_files[idx]).size();
+      int fd = -1;
+      if (fsz > 0)
+	fd = ::open(QFile::encodeName(m_files[idx]).constData(), O_RDONLY);
+
+      if (fd < 0)
+	{
+	  // nothing to read, caller falls back to reading the file
+	  m_done[idx] = QByteArray();
+	  return;
+	}
+
+      m_fds[idx] = fd;
+      m_buffers[idx] = QByteArray(fsz, Qt::Uninitialized);
+      m_offsets[idx] = 0;
+      m_inFlight++;
+
+      queueRingRead(idx);
+      return;
+    }
+#endif
+
+  m_inFlight++;
+  m_pool.start(new NodeReadTask(this, idx, m_files[idx]));
+}
+
+#ifdef USE_IO_URING
+void
+NodeReader::queueRingRead(int idx)
+{
+  struct io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+  if (!sqe)
+    {
+      // submission queue full, flush it and try again
+      io_uring_submit(&m_ring);
+      sqe = io_uring_get_sqe(&m_ring);
+    }
+
+  qint64 off = m_offsets[idx];
+  QByteArray &buf = m_buffers[idx];
+  io_uring_prep_read(sqe, m_fds[idx],
+		     buf.data() + off,
+		     buf.size() - off,
+		     off);
+  io_uring_sqe_set_data(sqe, (void*)(quintptr)idx);
+}
+
+void
+NodeReader::reapRing()
+{
+  struct io_uring_cqe *cqe;
+  int ret = io_uring_wait_cqe(&m_ring, &cqe);
+  if (ret == -EINTR)
+    return;
+
+  if (ret < 0)
+    {
+      // ring is unusable, fail all outstanding reads
+      QList<int> keys = m_fds.keys();
+      for(int i=0; i<keys.count(); i++)
+	{
+	  ::close(m_fds[keys[i]]);
+	  m_done[keys[i]] = QByteArray();
+	}
+      m_fds.clear();
+      m_buffers.clear();
+      m_offsets.clear();
+      m_inFlight = 0;
+      m_ringOk = false;
+      return;
+    }
+
+  int idx = (int)(quintptr)io_uring_cqe_get_data(cqe);
+  int res = cqe->res;
+  io_uring_cqe_seen(&m_ring, cqe);
+
+  if (res > 0)
+    {
+      m_offsets[idx] += res;
+      if (m_offsets[idx] < m_buffers[idx].size())
+	{
+	  // short read, queue the remainder
+	  queueRingRead(idx);
+	  io_uring_submit(&m_ring);
+	  return;
+	}
+    }
+
+  ::close(m_fds.take(idx));
+  qint64 nread = m_offsets.take(idx);
+  QByteArray data = m_buffers.take(idx);
+  if (res < 0 || nread < data.size())
+    data.clear();
+
+  m_done[idx] = data;
+  m_inFlight--;
+
+  fill();
+}
+#endif
@@ -0,0 +1,71 @@
+#ifndef NODEREADER_H
+#define NODEREADER_H
+
+#include "octreenode.h"
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QByteArray>
+
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif
+
+//--------------------------------------------
+// Keeps a number of node file reads in flight so that the
+// loader is not waiting on one blocking read at a time.
+// Nodes are submitted in LOD priority order and handed over
+// to the decode stage through take() in the same order.
+// Uses io_uring when built with USE_IO_URING, otherwise the
+// reads are spread over a small thread pool.
+//--------------------------------------------
+class NodeReader
+{
+ public :
+  NodeReader();
+  ~NodeReader();
+
+  void setQueueDepth(int);
+  int queueDepth() { return m_queueDepth; }
+
+  void submit(QList<OctreeNode*>);
+  QByteArray take(OctreeNode*);
+  void cancel();
+
+  // called from the pool threads
+  void readDone(int, QByteArray);
+
+ private :
+  int m_queueDepth;
+
+  QList<QString> m_files;
+  QHash<OctreeNode*, int> m_index;
+  QMap<int, QByteArray> m_done;
+  int m_nextSubmit;
+  int m_inFlight;
+  int m_outstanding; // in flight + read but not yet taken
+
+  QMutex m_mutex;
+  QWaitCondition m_readDone;
+
+  QThreadPool m_pool;
+
+#ifdef USE_IO_URING
+  struct io_uring m_ring;
+  bool m_ringOk;
+  QMap<int, QByteArray> m_buffers;
+  QMap<int, int> m_fds;
+  QMap<int, qint64> m_offsets;
+
+  void queueRingRead(int);
+  void reapRing();
+#endif
+
+  void fill();
+  void startRead(int);
+};
+
+#endif
@@ -1,11 +1,16 @@
 #include "global.h"
 #include "staticfunctions.h"
 #include "octreenode.h"
+#include "nodecache.h"
+#include "memorystats.h"
+#include "tracer.h"
 
 #include <QMessageBox>
 #include <QtMath>
 #include <QFile>
 #include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
 
 #include "laszip_dll.h"
 
@@ -25,12 +30,17 @@ OctreeNode::OctreeNode()
   m_offset = Vec(0,0,0);
   m_numpoints = 0;
   m_coord = 0;
+  m_coordBytes = 0;
   for(int i=0; i<8; i++)
     m_child[i] = 0;
   m_levelsBelow = -1;
   m_level = -1;
   m_maxVisLevel = 0;
+  m_visOffset = -1;
+  m_visDepth = 0;
+  m_visCorner = Vec(0,0,0);
   m_dataLoaded = false;
+  m_dataGen = 0;
   m_levelString.clear();
   m_dpv = 3;
 
@@ -43,6 +53,9 @@ OctreeNode::OctreeNode()
   m_pointSize = 1.0;
   m_spacing = 1.0;
 
+  m_shuffled = false;
+  m_pointLimit = -1;
+
   m_globalMin = Vec(0,0,0);
   m_globalMax = Vec(0,0,0);
 
@@ -71,6 +84,8 @@ OctreeNode::~OctreeNode()
   if (m_coord)
     delete [] m_coord;
   m_coord = 0;
+  MemoryStats::add(MemoryStats::NodeData, -m_coordBytes);
+  m_coordBytes = 0;
 
   for(int i=0; i<8; i++)
     m_child[i] = 0;
@@ -238,8 +253,12 @@ OctreeNode::childAt(int i)
   return node;
 }
 
+//--------------------------------------------
+// fileData is the node file already read by NodeReader,
+// when empty the file is read here
+//--------------------------------------------
 void
-OctreeNode::loadData()
+OctreeNode::loadData(QByteArray fileData)
 {
   if (markedForDeletion())
     {
@@ -258,11 +277,40 @@ OctreeNode::loadData()
   if (m_dataLoaded)
     return;
 
+  TRACE_SCOPE("decode");
+  TRACE_ARG("uid", m_uid);
+
   if (m_attribBytes == 0)
-    loadDataFromLASFile();
+    {
+      // decoded LAS/LAZ data may be waiting in the node cache,
+      // nodes being edited change every time so skip those
+      bool useCache = (NodeCache::enabled() && !m_editMode);
+      QString key;
+      if (useCache)
+	key = cacheKey();
+
+      int bpp = (m_dpv == 3 ? 12 : 20);
+      if (!useCache ||
+	  !NodeCache::load(key, m_coord, m_numpoints, bpp))
+	{
+	  loadDataFromLASFile();
+	  if (useCache)
+	    NodeCache::save(key, m_coord, m_numpoints, bpp);
+	}
+    }
   else
-    loadDataFromBINFile();
+    loadDataFromBINFile(fileData);
+
+  TRACE_ARG("points", m_numpoints);
 
+  // all m_coord allocations above are numpoints*bpp
+  if (m_coord && m_coordBytes == 0)
+    {
+      m_coordBytes = m_numpoints*(m_dpv == 3 ? 12 : 20);
+      MemoryStats::add(MemoryStats::NodeData, m_coordBytes);
+    }
+
+  m_dataGen++;
   m_dataLoaded = true;
 }
 
@@ -276,18 +324,66 @@ OctreeNode::reloadData()
     }
 }
 
+//--------------------------------------------
+// decoded data depends on the file contents and
+// on everything applied to the points while decoding
+//--------------------------------------------
+QString
+OctreeNode::cacheKey()
+{
+  QFileInfo finfo(m_fileName);
+
+  QByteArray desc;
+  desc += finfo.absoluteFilePath().toUtf8();
+  desc += QByteArray::number(finfo.lastModified().toMSecsSinceEpoch());
+  desc += QByteArray::number(finfo.size());
+
+  QList<double> params;
+  params << m_dpv << m_id << m_colorPresent << m_classPresent;
+  params << m_scaleCloudJs << m_scale;
+  params << m_offset.x << m_offset.y << m_offset.z;
+  params << m_shift.x << m_shift.y << m_shift.z;
+  params << m_xformCen.x << m_xformCen.y << m_xformCen.z;
+  params << m_rotation[0] << m_rotation[1] << m_rotation[2] << m_rotation[3];
+  params << m_globalMin.x << m_globalMin.y << m_globalMin.z;
+  params << m_bminZ << m_bmaxZ;
+
+  QList<Vec> colorMap = Global::getColorMap();
+  for(int i=0; i<colorMap.count(); i++)
+    params << colorMap[i].x << colorMap[i].y << colorMap[i].z;
+
+  for(int i=0; i<params.count(); i++)
+    desc += QByteArray::number(params[i], 'g', 17) + ",";
+
+  return QString(QCryptographicHash::hash(desc, QCryptographicHash::Sha1).toHex());
+}
+
+bool
+OctreeNode::inNodeCache()
+{
+  if (!NodeCache::enabled() ||
+      m_editMode ||
+      m_attribBytes != 0)
+    return false;
+
+  return NodeCache::contains(cacheKey());
+}
+
 void
 OctreeNode::unloadData()
 {
   m_dataLoaded = false;
+  m_dataGen++;
 
   if (m_coord)
     delete [] m_coord;
   m_coord = 0;
+  MemoryStats::add(MemoryStats::NodeData, -m_coordBytes);
+  m_coordBytes = 0;
 }
 
 void
-OctreeNode::loadDataFromBINFile()
+OctreeNode::loadDataFromBINFile(QByteArray fileData)
 {
   if (markedForDeletion())
     {
@@ -318,12 +414,15 @@ OctreeNode::loadDataFromBINFile()
   QList<Vec> colorMap = Global::getColorMap();
   int clim = colorMap.count()-1;
 
-  uchar *data = new uchar[fsz];
-  
-  QFile binfl(m_fileName);
-  binfl.open(QFile::ReadOnly);
-  binfl.read((char*)data, fsz);
-  binfl.close();
+  if (fileData.size() != fsz)
+    {
+      fileData = QByteArray(fsz, Qt::Uninitialized);
+      QFile binfl(m_fileName);
+      binfl.open(QFile::ReadOnly);
+      binfl.read(fileData.data(), fsz);
+      binfl.close();
+    }
+  const uchar *data = (const uchar*)fileData.constData();
 
 
   float gminZ,gmaxZ;
@@ -406,8 +505,6 @@ OctreeNode::loadDataFromBINFile()
 	  colorPtr[3] = m_id; // assuming id values are less than 65536
 	}
     }
-
-  delete [] data;
 }
 
 
@@ -609,6 +706,52 @@ OctreeNode::loadDataFromLASFile()
   laszip_close_reader(laszip_reader);
 }
 
+//--------------------------------------------
+// points within the node files are stored in random order,
+// so any leading subset of a node is a uniform sample of it
+// and a node can be drawn partially
+//--------------------------------------------
+void
+OctreeNode::setShuffled(bool b)
+{
+  // same for all nodes in the same tree
+  m_shuffled = b;
+
+  if (!isLeaf())
+    {
+      for(int k=0; k<8; k++)
+	{
+	  OctreeNode *cnode = getChild(k);
+	  if (cnode)
+	    cnode->setShuffled(b);
+	}
+    }
+}
+
+qint64
+OctreeNode::pointsToDraw()
+{
+  if (m_pointLimit < 0)
+    return m_numpoints;
+
+  return qMin(m_pointLimit, m_numpoints);
+}
+
+//--------------------------------------------
+// 0 when all points are drawn otherwise
+// fraction of points drawn scaled to 1-127
+//--------------------------------------------
+uchar
+OctreeNode::drawFill()
+{
+  if (m_pointLimit < 0 ||
+      m_pointLimit >= m_numpoints ||
+      m_numpoints == 0)
+    return 0;
+
+  return qBound(1, (int)(127.0*m_pointLimit/m_numpoints), 127);
+}
+
 void
 OctreeNode::setId(int id)
 {
@@ -705,6 +848,14 @@ OctreeNode::setPointSizeForActiveNodes(float ps)
   return (deepestVisibleLevel+1);
 }
 
+void
+OctreeNode::setVisibilityInfo(int offset, int depth, Vec corner)
+{
+  m_visOffset = offset;
+  m_visDepth = depth;
+  m_visCorner = corner;
+}
+
 uchar
 OctreeNode::setMaxVisibleLevel()
 {
@@ -5,6 +5,7 @@
 using namespace qglviewer;
 
 #include <QList>
+#include <QByteArray>
 
 class OctreeNode
 {
@@ -53,9 +54,15 @@ class OctreeNode
   void setPointSize(float ps) { m_pointSize = ps; }
   void setPointSizeFactor(float ps) { m_pointSize *= ps; }
   void setSpacing(float s) { m_spacing = s; }
+  void setShuffled(bool);
+  void setPointLimit(qint64 n) { m_pointLimit = n; }
 
+  // position in the visibility texture row of the tile,
+  // offset -1 when not part of the last visibility build
+  void setVisibilityInfo(int, int, Vec);
 
-  void loadData();
+
+  void loadData(QByteArray fileData = QByteArray());
   void unloadData();
   void reloadData();
 
@@ -71,6 +78,10 @@ class OctreeNode
   Vec bmin() { return m_bmin; }
   Vec bmax() { return m_bmax; }
   qint64 numpoints() { return m_numpoints; }
+  bool shuffled() { return m_shuffled; }
+  qint64 pointLimit() { return m_pointLimit; }
+  qint64 pointsToDraw();
+  uchar drawFill();
   uchar* coords() { return m_coord; }
   OctreeNode* getChild(int i) { return m_child[i]; }
   OctreeNode* childAt(int); // will create child if not present
@@ -81,6 +92,9 @@ class OctreeNode
   float pointSize() { return m_pointSize; }
   float spacing() { return m_spacing; }
   uchar maxVisibleLevel() { return m_maxVisLevel; }
+  int visOffset() { return m_visOffset; }
+  int visDepth() { return m_visDepth; }
+  Vec visCorner() { return m_visCorner; } // fraction of tile box
 
   Vec tightOctreeMin() { return m_tightMin; }
   Vec tightOctreeMax() { return m_tightMax; }
@@ -89,6 +103,9 @@ class OctreeNode
 
   void markForDeletion();
   bool markedForDeletion() { return m_removalFlag; }
+  bool dataLoaded() { return m_dataLoaded; }
+  int dataGeneration() { return m_dataGen; } // changes on every load/unload
+  bool inNodeCache();
 
   QList<OctreeNode*> allActiveNodes();
   int setPointSizeForActiveNodes(float);
@@ -123,15 +140,21 @@ class OctreeNode
   Vec m_tightMinO, m_tightMaxO;
   qint64 m_numpoints;
   uchar *m_coord;
+  qint64 m_coordBytes;
   OctreeNode* m_child[8];
   int m_level;
   uchar m_maxVisLevel;
+  int m_visOffset, m_visDepth;
+  Vec m_visCorner;
   int m_levelsBelow;
   int m_dpv;
   bool m_colorPresent;
   bool m_classPresent;
   float m_spacing;
 
+  bool m_shuffled;
+  qint64 m_pointLimit;
+
   QStringList m_pointAttrib;
   int m_attribBytes;
 
@@ -139,13 +162,16 @@ class OctreeNode
   Vec m_globalMax;
 
   bool m_dataLoaded;
+  int m_dataGen;
 
   bool m_removalFlag;
 
   bool m_editMode;
 
   void loadDataFromLASFile();
-  void loadDataFromBINFile();
+  void loadDataFromBINFile(QByteArray);
+
+  QString cacheKey();
 
   Vec xformPoint(Vec);
 };
@@ -45,6 +45,7 @@ PointCloud::PointCloud()
   m_dpv = 6;
 
   m_fileFormat = true; // LAS
+  m_shuffled = false;
   m_pointAttrib.clear();
   m_attribBytes = 0;
 
@@ -52,6 +53,8 @@ PointCloud::PointCloud()
   m_labels.clear();
 
   m_vData.clear();
+  m_vVersion.clear();
+  m_vVersionCount = 0;
 
   m_showMap = false;
   m_gravity = false;
@@ -97,8 +100,12 @@ PointCloud::reset()
 
   m_tiles.clear();
   m_labels.clear();
+  m_labelGrid.clear();
+  m_labelRenderer.setLabels(m_labels);
+  m_labelRenderer.release();
 
   m_vData.clear();
+  m_vVersion.clear();
 
   m_octreeMin = Vec(0,0,0);
   m_octreeMax = Vec(0,0,0);
@@ -114,6 +121,7 @@ PointCloud::reset()
 
 
   m_fileFormat = true; // LAS
+  m_shuffled = false;
   m_pointAttrib.clear();
   m_attribBytes = 0;
 
@@ -404,6 +412,7 @@ PointCloud::loadTileOctree(QString dirnameO)
   if (jsondir.exists("octree.json"))
     {
       loadOctreeNodeFromJson(dirname, oNode);
+      oNode->setShuffled(m_shuffled);
       return true;
     }  
   //-----------------------
@@ -593,6 +602,8 @@ PointCloud::loadTileOctree(QString dirnameO)
 
   setXform(m_scale, m_shift, m_rotation, m_xformCen);
 
+  oNode->setShuffled(m_shuffled);
+
   saveOctreeNodeToJson(dirname, oNode);
 
   return true;
@@ -618,6 +629,11 @@ PointCloud::loadCloudJson(QString dirname)
   m_spacing = jsonCloudData["spacing"].toDouble();
   m_scaleCloudJs = jsonCloudData["scale"].toDouble();
 
+  // points within node files are in random order
+  m_shuffled = false;
+  if (jsonCloudData.contains("shuffled"))
+    m_shuffled = jsonCloudData["shuffled"].toBool();
+
   {
     QJsonObject jsonInfo = jsonCloudData["boundingBox"].toObject();
     double lx = jsonInfo["lx"].toDouble();
@@ -1180,6 +1196,8 @@ PointCloud::loadLabelsJson(QString jsonfile)
       m_labels << lbl;
     }
 
+  m_labelGrid.build(m_labels);
+  m_labelRenderer.setLabels(m_labels);
 }
 
 void
@@ -1262,6 +1280,9 @@ PointCloud::loadLabelsCSV(QString csvfile)
 	  
       m_labels << lbl;
     }
+
+  m_labelGrid.build(m_labels);
+  m_labelRenderer.setLabels(m_labels);
 }
 
 void
@@ -1280,9 +1301,13 @@ PointCloud::stickLabelsToGround()
 {
   for(int i=0; i<m_labels.count(); i++)
     m_labels[i]->stickToGround();
+
+  m_labelGrid.build(m_labels);
+  m_labelRenderer.updatePositions();
 }
 bool
-PointCloud::findNearestLabelHit(QMatrix4x4 matR,
+PointCloud::findNearestLabelHit(QVector3D cpos,
+				QMatrix4x4 matR,
 				QMatrix4x4 finalxformInv,
 				float deadRadius,
 				QVector3D deadPoint)
@@ -1299,8 +1324,35 @@ PointCloud::findNearestLabelHit(QMatrix4x4 matR,
   if (m_labels.count() == 0)
     return false;
 
-  for(int i=0; i<m_labels.count(); i++)
+  // only labels that can be hit are tested, boxes are shown
+  // in the dead zone and icons count within unit distance
+  // of the controller. A hit further along the ray does not
+  // count but still makes a drawn label glow, so labels
+  // around the viewer are tried as well.
+  QList<int> near;
+  if (deadRadius > 0)
+    near = m_labelGrid.disk(Vec(deadPoint.x(), deadPoint.y(), deadPoint.z()),
+			    deadRadius-0.02);
+  else
+    {
+      QVector3D centerR = QVector3D(matR * QVector4D(0,0,0,1));
+      QVector3D cenR = finalxformInv.map(centerR);
+      QVector3D pinPoint = QVector3D(matR * QVector4D(0,0,-1,1));
+      QVector3D frtR = finalxformInv.map(pinPoint) - cenR;
+      frtR.normalize();
+
+      Vec a = Vec(cenR.x(), cenR.y(), cenR.z());
+      Vec b = a + Vec(frtR.x(), frtR.y(), frtR.z());
+      Vec sz = Vec(0.002,0.002,0.002);
+      near = m_labelGrid.box(Vec(qMin(a.x,b.x), qMin(a.y,b.y), qMin(a.z,b.z)) - sz,
+			     Vec(qMax(a.x,b.x), qMax(a.y,b.y), qMax(a.z,b.z)) + sz);
+      near += m_labelGrid.sphere(Vec(cpos.x(), cpos.y(), cpos.z()),
+				 qMax(m_labelGrid.maxProximity(), 1.0f));
+    }
+
+  for(int n=0; n<near.count(); n++)
     {
+      int i = near[n];
       float hit = m_labels[i]->checkHit(matR, finalxformInv,
 					deadRadius, deadPoint);
       if (hit >= 0)
@@ -1359,12 +1411,12 @@ PointCloud::drawLabels(QVector3D cpos,
   if (!m_visible)
     return;
 
-  for(int i=0; i<m_labels.count(); i++)
-    m_labels[i]->drawLabel(cpos, vDir, uDir, rDir,
-			   mat, matR,
-			   finalxform, finalxformInv,
-			   deadRadius, deadPoint,
-			   (m_nearHitLabel == i));
+  m_labelRenderer.draw(&m_labelGrid,
+		       cpos, vDir, rDir,
+		       mat, matR,
+		       finalxform, finalxformInv,
+		       deadRadius, deadPoint,
+		       m_nearHitLabel);
 }
 
 
@@ -1439,92 +1491,61 @@ PointCloud::octreeMax()
   return tm;
 }
 
-QList<uchar>
-PointCloud::maxLevelVisible()
+void
+PointCloud::updateVisibilityData()
 {
-  QList<uchar> vS;
-  for(int d=0; d<m_tiles.count(); d++)
+  if (m_vData.count() != m_tiles.count())
     {
-      int maxlevel = 0;
-
-      OctreeNode *node = m_tiles[d];
-      if (node->isActive())
-	{	  
-	  QList<OctreeNode*> vlist;
-	  vlist << node;
-
-	  int vi = 0;
-	  
-	  bool done = false;
-	  while (!done)
-	    {
-	      int oid = vi;
-	      OctreeNode *oNode = vlist[vi];
-	      vi++;
-
-	      maxlevel = qMax(maxlevel, oNode->level());	  
-	      
-	      for (int k=0; k<8; k++)
-		{
-		  OctreeNode *cnode = oNode->getChild(k);
-		  if (cnode && cnode->isActive())
-		    vlist << cnode;
-		}
-
-	      if (vi >= vlist.count())
-		done = true;
-	    }
+      m_vData.resize(m_tiles.count());
+      m_vVersion.resize(m_tiles.count());
+      for(int d=0; d<m_tiles.count(); d++)
+	{
+	  m_vData[d].clear();
+	  m_vVersion[d] = ++m_vVersionCount;
 	}
-      vS << maxlevel;
     }
 
-  return vS;
-}
-
-void
-PointCloud::updateVisibilityData()
-{
-  QList<uchar> mvl = maxLevelVisible();
-
-  m_vData.clear();
+  for(int i=0; i<m_visNodes.count(); i++)
+    m_visNodes[i]->setVisibilityInfo(-1, 0, Vec(0,0,0));
+  m_visNodes.resize(0);
 
   for(int d=0; d<m_tiles.count(); d++)
     {
       m_tiles[d]->setMaxVisibleLevel();
 
-      QList<uchar> vS;
+      // breadth first over active nodes, m_vList and m_vRow
+      // keep their capacity between calls
+      m_vList.resize(0);
+      m_vRow.resize(0);
 
       OctreeNode *node = m_tiles[d];
       if (node->isActive())
-	{	  
-	  QList<OctreeNode*> vlist;
-	  vlist << node;
-	  
-	  int vi = 0;
+	{
+	  m_vList << node;
+	  node->setVisibilityInfo(0, 0, Vec(0,0,0));
 	  
-	  bool done = false;
-	  while (!done)
+	  for(int vi=0; vi<m_vList.count(); vi++)
 	    {
-	      int oid = vi;
-	      OctreeNode *oNode = vlist[vi];
-	      vi++;
+	      OctreeNode *oNode = m_vList[vi];
 	      
 	      uchar vchildren = 0;
 	      uchar jump = 0;
 	      
-	      bool firstChild = true;
+	      // where the shader starts its walk for points of a child -
+	      // texel, level and corner within the tile box
+	      int cdepth = oNode->visDepth()+1;
+	      float csize = 1.0/(1 << cdepth);
 	      for (int k=0; k<8; k++)
 		{
 		  OctreeNode *cnode = oNode->getChild(k);
 		  if (cnode && cnode->isActive())
 		    {
-		      vchildren += qPow(2, k);
-		      vlist << cnode;
-		      if (firstChild)
-			{
-			  firstChild = false;
-			  jump = vlist.count()-oid-1;
-			}
+		      if (vchildren == 0)
+			jump = m_vList.count()-vi;
+		      vchildren |= (1 << k);
+		      Vec corner = oNode->visCorner() + csize*Vec((k>>2)&1, (k>>1)&1, k&1);
+		      cnode->setVisibilityInfo(m_vList.count(), cdepth, corner);
+		      m_vList << cnode;
 		    }
 		}
 	      
@@ -1543,24 +1564,35 @@ PointCloud::updateVisibilityData()
 		    }
 		}
 	      
-	      vS << vchildren;
-	      vS << jump;
-	      vS << maxVisLevel;	      
-	      vS << (oNode->isLeaf() ? 1 : 0);
-	      
-	      if (vi >= vlist.count())
-		done = true;
+	      m_vRow << vchildren;
+	      m_vRow << jump;
+	      m_vRow << maxVisLevel;	      
+	      // lowest bit marks leaf, rest hold fraction
+	      // of points drawn for partially drawn nodes
+	      m_vRow << ((oNode->isLeaf() ? 1 : 0) | (oNode->drawFill() << 1));
 	    }
+
+	  m_visNodes += m_vList;
 	}
 
-      m_vData << vS;
+      // only rows that differ from the previous build are copied
+      // and get a new version, so callers upload just those
+      QVector<uchar> &vS = m_vData[d];
+      if (vS.count() != m_vRow.count() ||
+	  memcmp(vS.constData(), m_vRow.constData(), m_vRow.count()) != 0)
+	{
+	  vS.resize(m_vRow.count());
+	  if (m_vRow.count() > 0)
+	    memcpy(vS.data(), m_vRow.constData(), m_vRow.count());
+	  m_vVersion[d] = ++m_vVersionCount;
+	}
     }
 
 //  QString mesg;
 //  for(int j=0; j<m_vData.count(); j++)
 //    {
 //      mesg += QString("Tile : %1\n").arg(j);
-//      QList<uchar> vS = m_vData[j];
+//      QVector<uchar> vS = m_vData[j];
 //      if (vS.count() > 0)
 //	{
 //	  for(int k=0; k<vS.count()/2; k++)
@@ -1632,6 +1664,9 @@ PointCloud::setGlobalMinMax(Vec gmin, Vec gmax)
 
   for(int i=0; i<m_labels.count(); i++)
     m_labels[i]->setGlobalMinMax(m_gmin, m_gmax);
+
+  m_labelGrid.build(m_labels);
+  m_labelRenderer.updatePositions();
 }
 
 void
@@ -9,7 +9,8 @@
 using namespace qglviewer;
 
 #include "octreenode.h"
-#include "label.h"
+#include "labelgrid.h"
+#include "labelrenderer.h"
 
 class PointCloud
 {
@@ -41,7 +42,10 @@ class PointCloud
 
   QList<OctreeNode*> tiles() { return m_tiles; }
   QList<OctreeNode*> allNodes() { return m_allNodes; }
-  QList< QList<uchar> > vData() { return m_vData; }
+  // one row per tile of 4 bytes per active node,
+  // version of a row changes whenever its content changes
+  const QVector< QVector<uchar> >& vData() { return m_vData; }
+  const QVector<uint>& vDataVersion() { return m_vVersion; }
 
   //int maxTime();
 
@@ -60,7 +64,9 @@ class PointCloud
 
   void updateVisibilityData();
 
-  QList<uchar> maxLevelVisible();
+  // also used by the dataset generator, the octree
+  // converter writes the same layout on its own
+  static void saveOctreeNodeToJson(QString, OctreeNode*);
 
   void drawLabels(Camera*);
   void drawLabels(QVector3D,
@@ -69,7 +75,7 @@ class PointCloud
 		  QMatrix4x4, QMatrix4x4,
 		  float, QVector3D);
   void stickLabelsToGround();
-  bool findNearestLabelHit(QMatrix4x4, QMatrix4x4,
+  bool findNearestLabelHit(QVector3D, QMatrix4x4, QMatrix4x4,
 			   float, QVector3D);
   GLuint labelTexture();
   QSize labelTextureSize();
@@ -179,15 +185,23 @@ class PointCloud
   bool m_loadAll;
 
   bool m_fileFormat;
+  bool m_shuffled;
   QStringList m_pointAttrib;
   int m_attribBytes;
 
-  QList< QList<uchar> > m_vData;
+  QVector< QVector<uchar> > m_vData;
+  QVector<uint> m_vVersion;
+  uint m_vVersionCount; // not reset so versions never repeat
+  QVector<OctreeNode*> m_vList;
+  QVector<OctreeNode*> m_visNodes; // nodes placed by the last build
+  QVector<uchar> m_vRow;
 
   QList<OctreeNode*> m_tiles;
   QList<OctreeNode*> m_allNodes;
 
   QList<Label*> m_labels;
+  LabelGrid m_labelGrid;
+  LabelRenderer m_labelRenderer;
 
   QList<QVector4D> m_undo;
 
@@ -198,7 +212,6 @@ class PointCloud
   qint64 getNumPointsInBINFile(QString);
 
   void loadOctreeNodeFromJson(QString, OctreeNode*);
-  void saveOctreeNodeToJson(QString, OctreeNode*);
 
   int setLevel(OctreeNode*, int);
 
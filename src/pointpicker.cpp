@@ -0,0 +1,361 @@
+#include "pointpicker.h"
+
+#include <QSet>
+#include <QMultiMap>
+#include <QtMath>
+#include <float.h>
+#include <algorithm>
+
+// points per k-d tree leaf
+#define PICKER_LEAF_SIZE 16
+
+// orders point indices on one coordinate
+struct PickerAxisLess
+{
+  const float *pos;
+  int dim;
+  bool operator()(int a, int b) const { return pos[3*a+dim] < pos[3*b+dim]; }
+};
+
+PointPicker::PointPicker()
+{
+  m_xformTileId = -1;
+  m_xformScale = 1;
+}
+
+PointPicker::~PointPicker()
+{
+  clear();
+}
+
+void
+PointPicker::clear()
+{
+  foreach(NodeTree *t, m_trees)
+    delete t;
+  m_trees.clear();
+  m_nodes.clear();
+  m_npts.clear();
+}
+
+void
+PointPicker::setNodes(QList<OctreeNode*> nodes, QList<qint64> npts)
+{
+  m_nodes = nodes;
+  m_npts = npts;
+
+  // trees of nodes no longer drawn
+  QSet<OctreeNode*> drawn;
+  drawn.reserve(nodes.count());
+  for(int i=0; i<nodes.count(); i++)
+    drawn << nodes[i];
+  QHash<OctreeNode*, NodeTree*>::iterator it = m_trees.begin();
+  while (it != m_trees.end())
+    {
+      if (!drawn.contains(it.key()))
+	{
+	  delete it.value();
+	  it = m_trees.erase(it);
+	}
+      else
+	++it;
+    }
+}
+
+void
+PointPicker::setEditXform(int tileId, Vec shift, Vec cen, float scale, Quaternion rot)
+{
+  bool changed = (tileId != m_xformTileId ||
+		  shift != m_xformShift ||
+		  cen != m_xformCen ||
+		  scale != m_xformScale);
+  for(int i=0; i<4; i++)
+    changed |= (rot[i] != m_xformRot[i]);
+
+  if (!changed)
+    return;
+
+  m_xformTileId = tileId;
+  m_xformShift = shift;
+  m_xformCen = cen;
+  m_xformScale = scale;
+  m_xformRot = rot;
+
+  // moved points are rebuilt when next needed
+  QHash<OctreeNode*, NodeTree*>::iterator it = m_trees.begin();
+  while (it != m_trees.end())
+    {
+      if (it.value()->moved)
+	{
+	  delete it.value();
+	  it = m_trees.erase(it);
+	}
+      else
+	++it;
+    }
+}
+
+//--------------------------------------------
+// tree over the leading npts points of the node,
+// 0 when the node has no data in memory
+//--------------------------------------------
+PointPicker::NodeTree*
+PointPicker::tree(OctreeNode *node, qint64 npts)
+{
+  if (!node->dataLoaded() || !node->coords())
+    return 0;
+
+  npts = qMin(npts, node->numpoints());
+  if (npts <= 0)
+    return 0;
+
+  // same test as the xform shader, which needs the node id
+  bool moved = (m_xformTileId >= 0 &&
+		node->dataPerVertex() > 3 &&
+		node->id() >= m_xformTileId);
+
+  NodeTree *t = m_trees.value(node, 0);
+  if (t &&
+      t->dataGen == node->dataGeneration() &&
+      t->npts == npts &&
+      t->moved == moved)
+    return t;
+
+  if (!t)
+    {
+      t = new NodeTree;
+      m_trees[node] = t;
+    }
+  t->dataGen = node->dataGeneration();
+  t->npts = npts;
+  t->moved = moved;
+  t->split.clear();
+  t->dim.clear();
+
+  // positions as drawn
+  QVector<float> pos(3*npts);
+  int stride = (node->dataPerVertex() == 3 ? 12 : 20);
+  for(qint64 i=0; i<npts; i++)
+    {
+      float *v = (float*)(node->coords() + stride*i);
+      Vec p(v[0], v[1], v[2]);
+      if (moved)
+	{
+	  p = m_xformRot.rotate(p - m_xformCen)*m_xformScale;
+	  p += m_xformCen + m_xformShift;
+	}
+      pos[3*i+0] = p.x;
+      pos[3*i+1] = p.y;
+      pos[3*i+2] = p.z;
+
+      if (i == 0)
+	t->bmin = t->bmax = p;
+      else
+	{
+	  t->bmin = Vec(qMin(t->bmin.x, p.x), qMin(t->bmin.y, p.y), qMin(t->bmin.z, p.z));
+	  t->bmax = Vec(qMax(t->bmax.x, p.x), qMax(t->bmax.y, p.y), qMax(t->bmax.z, p.z));
+	}
+    }
+
+  t->pos = pos;
+  QVector<int> idx(npts);
+  for(int i=0; i<npts; i++)
+    idx[i] = i;
+  build(t, idx, 0, 0, npts);
+
+  // store points in leaf order
+  for(int i=0; i<npts; i++)
+    for(int c=0; c<3; c++)
+      t->pos[3*i+c] = pos[3*idx[i]+c];
+
+  return t;
+}
+
+//--------------------------------------------
+// inner node k splits [lo,hi) at its middle on the axis
+// of largest extent, children are 2k+1 and 2k+2
+//--------------------------------------------
+void
+PointPicker::build(NodeTree *t, QVector<int> &idx, int k, int lo, int hi)
+{
+  if (hi-lo <= PICKER_LEAF_SIZE)
+    return;
+
+  const float *pos = t->pos.constData();
+
+  float bmin[3], bmax[3];
+  for(int c=0; c<3; c++)
+    bmin[c] = bmax[c] = pos[3*idx[lo]+c];
+  for(int i=lo+1; i<hi; i++)
+    for(int c=0; c<3; c++)
+      {
+	bmin[c] = qMin(bmin[c], pos[3*idx[i]+c]);
+	bmax[c] = qMax(bmax[c], pos[3*idx[i]+c]);
+      }
+
+  int d = 0;
+  for(int c=1; c<3; c++)
+    if (bmax[c]-bmin[c] > bmax[d]-bmin[d])
+      d = c;
+
+  int mid = lo + (hi-lo)/2;
+  PickerAxisLess less;
+  less.pos = pos;
+  less.dim = d;
+  std::nth_element(idx.begin()+lo, idx.begin()+mid, idx.begin()+hi, less);
+
+  if (k >= t->split.count())
+    {
+      t->split.resize(k+1);
+      t->dim.resize(k+1);
+    }
+  t->split[k] = pos[3*idx[mid]+d];
+  t->dim[k] = d;
+
+  build(t, idx, 2*k+1, lo, mid);
+  build(t, idx, 2*k+2, mid, hi);
+}
+
+//--------------------------------------------
+// where the ray enters the box grown by the hit tolerance,
+// false if it misses or enters beyond the best hit
+//--------------------------------------------
+bool
+PointPicker::enterBox(Vec bmin, Vec bmax, float &tEnter)
+{
+  // tolerance of the farthest point that can still win
+  float far = 0;
+  for(int c=0; c<8; c++)
+    {
+      Vec p((c&4)?bmin.x:bmax.x, (c&2)?bmin.y:bmax.y, (c&1)?bmin.z:bmax.z);
+      far = qMax(far, (p-m_orig).norm());
+    }
+  float r = m_tolConst + m_tolSlope*qMin(far, m_tBest);
+
+  float t0 = 0;
+  float t1 = m_tBest;
+  for(int c=0; c<3; c++)
+    {
+      float lo = bmin[c] - r;
+      float hi = bmax[c] + r;
+      if (qAbs(m_dir[c]) < 1e-8)
+	{
+	  if (m_orig[c] < lo || m_orig[c] > hi)
+	    return false;
+	  continue;
+	}
+
+      float ta = (lo - m_orig[c])/m_dir[c];
+      float tb = (hi - m_orig[c])/m_dir[c];
+      t0 = qMax(t0, qMin(ta, tb));
+      t1 = qMin(t1, qMax(ta, tb));
+      if (t0 > t1)
+	return false;
+    }
+
+  tEnter = t0;
+  return true;
+}
+
+void
+PointPicker::search(NodeTree *t, int k, int lo, int hi, Vec bmin, Vec bmax)
+{
+  float tEnter;
+  if (!enterBox(bmin, bmax, tEnter))
+    return;
+
+  if (hi-lo <= PICKER_LEAF_SIZE)
+    {
+      const float *pos = t->pos.constData();
+      for(int i=lo; i<hi; i++)
+	{
+	  Vec p(pos[3*i], pos[3*i+1], pos[3*i+2]);
+	  Vec v = p - m_orig;
+	  float d = v*m_dir;
+	  if (d <= 0 || d >= m_tBest)
+	    continue;
+
+	  float tol = m_tolConst + m_tolSlope*d;
+	  if (v.squaredNorm() - d*d <= tol*tol)
+	    {
+	      m_tBest = d;
+	      m_hit = p;
+	    }
+	}
+      return;
+    }
+
+  int d = t->dim[k];
+  float s = t->split[k];
+  int mid = lo + (hi-lo)/2;
+
+  Vec lmax = bmax;
+  Vec rmin = bmin;
+  lmax[d] = s;
+  rmin[d] = s;
+
+  // half holding the ray origin first
+  if (m_orig[d] < s)
+    {
+      search(t, 2*k+1, lo, mid, bmin, lmax);
+      search(t, 2*k+2, mid, hi, rmin, bmax);
+    }
+  else
+    {
+      search(t, 2*k+2, mid, hi, rmin, bmax);
+      search(t, 2*k+1, lo, mid, bmin, lmax);
+    }
+}
+
+bool
+PointPicker::pick(Vec orig, Vec dir, float tolConst, float tolSlope, Vec &hit)
+{
+  if (dir.norm() < 1e-8)
+    return false;
+
+  m_orig = orig;
+  m_dir = dir.unit();
+  m_tolConst = tolConst;
+  m_tolSlope = tolSlope;
+  m_tBest = FLT_MAX;
+
+  // front to back on the node boxes, points of nodes moved by
+  // the edit transform are only known once their tree is built
+  QMultiMap<float, int> order;
+  for(int i=0; i<m_nodes.count(); i++)
+    {
+      Vec bmin = m_nodes[i]->tightOctreeMin();
+      Vec bmax = m_nodes[i]->tightOctreeMax();
+      if (m_xformTileId >= 0 &&
+	  m_nodes[i]->id() >= m_xformTileId)
+	{
+	  NodeTree *t = tree(m_nodes[i], m_npts[i]);
+	  if (!t)
+	    continue;
+	  bmin = t->bmin;
+	  bmax = t->bmax;
+	}
+
+      float tEnter;
+      if (enterBox(bmin, bmax, tEnter))
+	order.insert(tEnter, i);
+    }
+
+  QMultiMap<float, int>::const_iterator it;
+  for(it = order.constBegin(); it != order.constEnd(); ++it)
+    {
+      if (it.key() > m_tBest)
+	break;
+
+      int i = it.value();
+      NodeTree *t = tree(m_nodes[i], m_npts[i]);
+      if (t)
+	search(t, 0, 0, t->npts, t->bmin, t->bmax);
+    }
+
+  if (m_tBest == FLT_MAX)
+    return false;
+
+  hit = m_hit;
+  return true;
+}
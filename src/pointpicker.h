@@ -0,0 +1,73 @@
+#ifndef POINTPICKER_H
+#define POINTPICKER_H
+
+#include "octreenode.h"
+
+#include <QList>
+#include <QHash>
+#include <QVector>
+
+//--------------------------------------------
+// Picks the front most drawn point along a ray on the cpu, in
+// place of rendering a select pass and reading back its depth.
+// Each node gets a k-d tree over its decoded points the first
+// time a ray passes through it. Trees are kept while the node is
+// drawn with the same data and edit transform.
+// Nodes are visited front to back and a node is skipped once
+// its box lies beyond the best point found so far.
+// A point is hit when it is within tolConst + tolSlope*t of the
+// ray at distance t, i.e. a few pixels on screen.
+// Does not touch GL so it can be driven by the mouse as well as
+// by VR controllers.
+//--------------------------------------------
+class PointPicker
+{
+ public :
+  PointPicker();
+  ~PointPicker();
+
+  void clear();
+
+  // nodes drawn, with the number of leading points drawn of each
+  void setNodes(QList<OctreeNode*>, QList<qint64>);
+
+  // points of nodes with id from tileId on are moved by the
+  // registration transform of the edit mode, -1 for none
+  void setEditXform(int, Vec, Vec, float, Quaternion);
+
+  bool pick(Vec, Vec, float, float, Vec&);
+
+ private :
+  struct NodeTree
+  {
+    int dataGen;    // node data the tree was built from
+    qint64 npts;
+    bool moved;
+    Vec bmin, bmax;
+    QVector<float> pos;    // xyz in tree order
+    QVector<float> split;  // per inner node
+    QVector<uchar> dim;
+  };
+
+  QList<OctreeNode*> m_nodes;
+  QList<qint64> m_npts;
+  QHash<OctreeNode*, NodeTree*> m_trees;
+
+  int m_xformTileId;
+  Vec m_xformShift, m_xformCen;
+  float m_xformScale;
+  Quaternion m_xformRot;
+
+  // best hit while picking
+  Vec m_orig, m_dir;
+  float m_tolConst, m_tolSlope;
+  float m_tBest;
+  Vec m_hit;
+
+  NodeTree* tree(OctreeNode*, qint64);
+  void build(NodeTree*, QVector<int>&, int, int, int);
+  void search(NodeTree*, int, int, int, Vec, Vec);
+  bool enterBox(Vec, Vec, float&);
+};
+
+#endif
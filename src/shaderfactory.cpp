@@ -4,6 +4,11 @@
 #include <QVBoxLayout>
 #include <QMessageBox>
 #include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QCryptographicHash>
 
 int
 ShaderFactory::loadShaderFromFile(GLhandleARB obj, QString filename)
@@ -27,11 +32,119 @@ ShaderFactory::loadShaderFromFile(GLhandleARB obj, QString filename)
 }
 
 
+//--------------------------------------------
+// defines go right after the #version line
+//--------------------------------------------
+QString
+ShaderFactory::addDefines(QString shaderString, QStringList defines)
+{
+  if (defines.count() == 0)
+    return shaderString;
+
+  QString dstr;
+  for(int i=0; i<defines.count(); i++)
+    dstr += QString("#define %1\n").arg(defines[i]);
+
+  int pos = 0;
+  if (shaderString.trimmed().startsWith("#version"))
+    pos = shaderString.indexOf("\n", shaderString.indexOf("#version")) + 1;
+
+  return shaderString.insert(pos, dstr);
+}
+
+//--------------------------------------------
+// program binaries are kept in the cache directory keyed on
+// driver and shader source, a driver update or a change
+// in the source gives a new key
+//--------------------------------------------
+QByteArray
+ShaderFactory::programCacheKey(QString vertShaderString,
+			       QString fragShaderString)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(QByteArray((const char*)glGetString(GL_VENDOR)));
+  hash.addData(QByteArray((const char*)glGetString(GL_RENDERER)));
+  hash.addData(QByteArray((const char*)glGetString(GL_VERSION)));
+  hash.addData(vertShaderString.toLatin1());
+  hash.addData(fragShaderString.toLatin1());
+
+  return hash.result().toHex();
+}
+
+QString
+ShaderFactory::programCacheFile(QByteArray key)
+{
+  QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+  return QDir(cacheDir).filePath(QString("shaders/%1.bin").arg(QString(key)));
+}
+
+bool
+ShaderFactory::loadProgramBinary(GLhandleARB progObj, QByteArray key)
+{
+  if (!GLEW_ARB_get_program_binary)
+    return false;
+
+  QFile fl(programCacheFile(key));
+  if (!fl.open(QIODevice::ReadOnly))
+    return false;
+
+  QByteArray data = fl.readAll();
+  if (data.size() <= (int)sizeof(GLenum))
+    return false;
+
+  GLenum format;
+  memcpy(&format, data.constData(), sizeof(GLenum));
+  glProgramBinary(progObj,
+		  format,
+		  data.constData() + sizeof(GLenum),
+		  data.size() - sizeof(GLenum));
+
+  // driver may refuse binaries it did not write
+  GLint linked = 0;
+  glGetProgramiv(progObj, GL_LINK_STATUS, &linked);
+  if (!linked)
+    fl.remove();
+
+  return linked;
+}
+
+void
+ShaderFactory::saveProgramBinary(GLhandleARB progObj, QByteArray key)
+{
+  if (!GLEW_ARB_get_program_binary)
+    return;
+
+  GLint len = 0;
+  glGetProgramiv(progObj, GL_PROGRAM_BINARY_LENGTH, &len);
+  if (len <= 0)
+    return;
+
+  QByteArray data(sizeof(GLenum) + len, 0);
+  GLenum format;
+  glGetProgramBinary(progObj, len, NULL, &format,
+		     data.data() + sizeof(GLenum));
+  memcpy(data.data(), &format, sizeof(GLenum));
+
+  QString flnm = programCacheFile(key);
+  QDir().mkpath(QFileInfo(flnm).absolutePath());
+  // a partly written binary is never picked up by
+  // another instance loading the same shader
+  QSaveFile fl(flnm);
+  if (!fl.open(QIODevice::WriteOnly))
+    return;
+  fl.write(data);
+  fl.commit();
+}
+
 bool
 ShaderFactory::loadShader(GLhandleARB &progObj,
 			  QString vertShaderString,
 			  QString fragShaderString)
 {
+  QByteArray cacheKey = programCacheKey(vertShaderString, fragShaderString);
+  if (loadProgramBinary(progObj, cacheKey))
+    return true;
+
   GLhandleARB fragObj = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);  
   glAttachObjectARB(progObj, fragObj);
 
@@ -141,6 +254,9 @@ ShaderFactory::loadShader(GLhandleARB &progObj,
 
   
   //----------- link program shader ----------------------
+  if (GLEW_ARB_get_program_binary)
+    glProgramParameteri(progObj, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
   GLint linked = -1;
   glLinkProgramARB(progObj);
   glGetObjectParameterivARB(progObj, GL_OBJECT_LINK_STATUS_ARB, &linked);
@@ -164,18 +280,23 @@ ShaderFactory::loadShader(GLhandleARB &progObj,
   glDeleteObjectARB(fragObj);
   glDeleteObjectARB(vertObj);
 
+  saveProgramBinary(progObj, cacheKey);
+
   return true;
 }
 
 bool
 ShaderFactory::loadShadersFromFile(GLhandleARB &progObj,
 				   QString vertShader,
-				   QString fragShader)
+				   QString fragShader,
+				   QStringList defines)
 {
   QFile vfile(vertShader);
   if (!vfile.open(QIODevice::ReadOnly | QIODevice::Text))
     return false;
   QString vertShaderString = QString::fromLatin1(vfile.readAll());
+  // octree walk is kept in one place, see getLODShaderString
+  vertShaderString.replace("//#getLOD", getLODShaderString());
 
 
   QFile ffile(fragShader);
@@ -184,8 +305,61 @@ ShaderFactory::loadShadersFromFile(GLhandleARB &progObj,
   QString fragShaderString = QString::fromLatin1(ffile.readAll());
   
   return loadShader(progObj,
-		    vertShaderString,
-		    fragShaderString);  
+		    addDefines(vertShaderString, defines),
+		    addDefines(fragShaderString, defines));  
+}
+
+//--------------------------------------------
+// octree level of a point from the GL_RGBA8UI visibility
+// texture, integer bit operations only.
+// start holds corner (fraction of tile box) and level of the
+// node to start the walk from, startOffset its texel,
+// vec4(0.0) and 0 walk from the tile root.
+// VisibilityMap::rowLOD is the cpu reference.
+//--------------------------------------------
+QString
+ShaderFactory::getLODShaderString()
+{
+  QString shader;
+
+  shader += "float getLOD(int tile, vec3 omin, vec3 omax, vec3 opos,\n";
+  shader += "             vec4 start, int startOffset)\n";
+  shader += "{\n";
+  shader += "  if (any(lessThan(opos, omin)) || any(greaterThan(opos, omax)))\n";
+  shader += "    return 10.0;\n";
+  shader += "  int level = int(start.w);\n";
+  shader += "  float depth = start.w;\n";
+  shader += "  vec3 osize = omax-omin;\n";
+  shader += "  vec3 pos = opos-omin;\n";
+  shader += "  vec3 offset = start.xyz*osize;\n";
+  shader += "  int ioffset = startOffset;\n";
+  shader += "  for(int i=level; i<20; i++)\n"; // assuming we do not have more than 20 levels
+  shader += "  {\n";
+  shader += "    vec3 nsal = osize/float(1 << i);\n"; // node size at this octree level
+  shader += "    uvec3 idx3d = uvec3(greaterThanEqual(pos-offset, 0.5*nsal));\n";
+  shader += "    uint index = (idx3d.x << 2) | (idx3d.y << 1) | idx3d.z;\n";
+  shader += "    uvec4 value = texelFetch(visTex, ivec2(ioffset, tile));\n";
+  shader += "    uint mask = value.r;\n"; // visible child nodes
+  shader += "    if ((mask & (1u << index)) != 0u)\n";
+  shader += "    {\n";
+  shader += "      ioffset += int(value.g) + bitCount(mask & ((1u << index) - 1u));\n";
+  shader += "      depth ++;\n";
+  shader += "    }\n";
+  shader += "    else\n"; // no more visible child nodes at this position
+  shader += "    {\n";
+  shader += "      if ((value.a & 1u) != 0u)\n"; // leaf node
+  shader += "        depth = max(depth, float(value.b));\n";
+  shader += "      float fill = float(value.a >> 1)/127.0;\n"; // partially drawn node
+  shader += "      if (fill > 0.0)\n";
+  shader += "        depth -= 1.0 - fill;\n";
+  shader += "      return depth;\n";
+  shader += "    }\n";
+  shader += "    offset += (nsal*0.5) * vec3(idx3d);\n";
+  shader += "  }\n";
+  shader += "  return depth;\n";
+  shader += "}\n";
+
+  return shader;
 }
 
 bool
@@ -201,7 +375,7 @@ ShaderFactory::loadPointShader(GLhandleARB &progObj,
 
   {  // vertObj
     QString qstr;
-    qstr += "#version 330 core\n";
+    qstr += "#version 420 core\n";
     qstr += "// Input vertex data, different for all executions of this shader.\n";
 
     if (dpv == 3)
@@ -236,80 +410,11 @@ ShaderFactory::loadPointShader(GLhandleARB &progObj,
     qstr += "uniform float projFactor;\n";
 
     qstr += "uniform sampler2DRect ommTex;\n";
-    qstr += "uniform sampler2DRect visTex;\n";
+    qstr += "uniform usampler2DRect visTex;\n";
 
     qstr += "uniform bool pointType;\n";
 
-    //-----------------------
-    qstr += "float numberOfOnes(float number, float index)\n";
-    qstr += "{\n";
-    qstr += "   float tmp = mod(number, pow(2.0, index + 1.0));\n";
-    qstr += "   float numOnes = 0.0;\n";
-    qstr += "   for (float i = 0.0; i < 8.0; i++)\n";
-    qstr += "   {\n";
-    qstr += "      if (mod(tmp, 2.0) != 0.0)\n";
-    qstr += "         numOnes++;\n";
-    qstr += "      tmp = floor(tmp / 2.0);\n";
-    qstr += "    }\n";
-    qstr += "    return numOnes;\n";
-    qstr += "}\n";
-    //-----------------------
-
-    //-----------------------
-    qstr += "bool isBitSet(float number, float index)\n";
-    qstr += "{\n";
-    qstr += "  return mod(floor(number / pow(2.0, index)), 2.0) != 0.0;\n";
-    qstr += "}\n";
-    //-----------------------
-
-    //-----------------------
-    qstr += "float getLOD(float tile, vec3 omin, vec3 omax, vec3 opos)\n";
-    qstr += "{\n";
-
-    qstr += "    if (any(lessThan(opos, omin)) || any(greaterThan(opos, omax)))\n";
-    qstr += "      return 10.0;";
-
-    qstr += "  float depth = 0.0;\n";
-    qstr += "  vec3 osize = omax-omin;\n";
-    qstr += "  vec3 pos = opos-omin;\n";
-    qstr += "  vec3 offset = vec3(0.0);\n";
-    qstr += "  float ioffset = 0.0;\n";
-
-    qstr += "  vec4 valueTop = texture2DRect(visTex, vec2(ioffset,tile)).rgba;";
-
-    qstr += "  for(int i=0; i<20; i++)\n"; // assuming we do not have more than 20 levels
-    qstr += "  {\n";
-    qstr += "    vec3 nsal = osize/pow(2.0, float(i));\n"; // node size at this octree level
-    qstr += "    vec3 idx3d = (pos-offset)/nsal;\n";// which of the 8 octree node children
-
-    //qstr += "    if (any(lessThan(idx3d, vec3(0.0)) ||
-    //                     greaterThan(idx3d, vec3(1.0))))\n";
-    //qstr += "      return 10.0;";    
-    //qstr += "    idx3d = clamp(idx3d, vec3(0.0), vec3(1.0));\n";
-
-    qstr += "    idx3d = floor(idx3d+vec3(0.5));\n";      // does the point lie in
-    qstr += "    float index = 4.0*idx3d.x + 2.0*idx3d.y + idx3d.z;\n"; // node position
-    qstr += "    vec4 value = texture2DRect(visTex, vec2(ioffset,tile)).rgba;";
-    qstr += "    float mask = value.r*255.0;\n";  // get visible child nodes
-    qstr += "    if (isBitSet(mask,index))\n"; // visible node at this position
-    qstr += "    {\n";
-    qstr += "      ioffset = ioffset + value.g * 255.0 + numberOfOnes(mask, index-1.0);";
-    qstr += "      depth ++;\n";
-    qstr += "    }";
-    qstr += "    else"; // no mode visible child nodes at this position
-    qstr += "    {\n";
-    qstr += "      if (value.a > 0.0)\n";
-    qstr += "        depth = max(depth, value.b*255.0);";
-    qstr += "      return depth;";
-    qstr += "    }";
-
-    qstr += "    offset = offset + (nsal*0.5) * idx3d;\n";
-
-    qstr += "  }\n";
-
-    qstr += " return depth;";
-    qstr += "}\n";
-    //-----------------------
+    qstr += getLODShaderString();
 
 
     qstr += "void main(){	\n\n";
@@ -365,7 +470,7 @@ ShaderFactory::loadPointShader(GLhandleARB &progObj,
 	qstr += "     vec3 omax = omaxs.rgb;\n";
 	//qstr += "     float lod = omaxs.a;\n";
 	//qstr += "     vec3 omax = texture2DRect(ommTex, vec2(1.0,tile)).rgb;\n";
-	qstr += "     float lod = getLOD(tile, omin, omax, pointPos);\n";
+	qstr += "     float lod = getLOD(int(tile), omin, omax, pointPos, vec4(0.0), 0);\n";
 	qstr += "     float viewZ = -(MV * vec4(pointPos,1)).z;\n";
 	qstr += "     float r = spacing*1.5;\n";
 	qstr += "     float worldSize = pointSize*r/pow(1.9, lod);\n";
@@ -4,14 +4,18 @@
 #include <GL/glew.h>
 
 #include <QString>
+#include <QStringList>
 
 class ShaderFactory
 {
  public :
 
-  static bool loadShadersFromFile(GLhandleARB&, QString, QString);
+  static bool loadShadersFromFile(GLhandleARB&, QString, QString,
+				  QStringList defines = QStringList());
+  static QString addDefines(QString, QStringList);
 
   static bool loadPointShader(GLhandleARB&, QString, int);
+  static QString getLODShaderString();
 
   static QString genPointShaderString();
   static QString genPointDepth(bool);
@@ -33,6 +37,11 @@ class ShaderFactory
   static GLint* cubemapShaderParm();
 
  private :
+  static QByteArray programCacheKey(QString, QString);
+  static QString programCacheFile(QByteArray);
+  static bool loadProgramBinary(GLhandleARB, QByteArray);
+  static void saveProgramBinary(GLhandleARB, QByteArray);
+
   static GLuint m_rcShader;
   static GLint m_rcShaderParm[10];
 
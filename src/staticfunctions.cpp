@@ -545,3 +545,32 @@ StaticFunctions::minVec(Vec a, Vec b)
   return cv;
 }
 
+
+QList<Vec>
+StaticFunctions::colorGradient()
+{
+  QList<Vec> colorGrad;
+
+  //colorGrad << Vec(47 ,173,0  )/255.0; 
+  colorGrad << Vec(47 ,100,0  )/255.0; 
+  colorGrad << Vec(80 ,183,20	)/255.0;
+  colorGrad << Vec(112,194,42	)/255.0;
+  colorGrad << Vec(143,205,67	)/255.0;
+  colorGrad << Vec(172,216,94	)/255.0;
+  colorGrad << Vec(199,227,124)/255.0;
+  colorGrad << Vec(223,238,156)/255.0;
+  colorGrad << Vec(255,230,180)/255.0;
+  //colorGrad << Vec(253,255,209)/255.0;
+  
+
+//  colorGrad << Vec(1,102, 94)/255.0f;
+//  colorGrad << Vec(53,151,143)/255.0f;
+//  colorGrad << Vec(128,205,193)/255.0f;
+//  colorGrad << Vec(199,234,229)/255.0f;
+//  colorGrad << Vec(246,232,195)/255.0f;
+//  colorGrad << Vec(223,194,125)/255.0f;
+//  colorGrad << Vec(191,129,45)/255.0f;
+//  colorGrad << Vec(140,81,10)/255.0f;
+
+  return colorGrad;
+}
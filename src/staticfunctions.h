@@ -67,6 +67,9 @@ class StaticFunctions
   static Vec clampVec(Vec, Vec, Vec);
   static Vec maxVec(Vec, Vec);
   static Vec minVec(Vec, Vec);
+
+  // colours by height for data without colour
+  static QList<Vec> colorGradient();
 };
 
 #endif
@@ -0,0 +1,167 @@
+#include "tracer.h"
+
+#include <QThread>
+#include <QCoreApplication>
+#include <QMutexLocker>
+
+bool Tracer::m_active = false;
+bool Tracer::m_firstEvent = true;
+QFile Tracer::m_file;
+QMutex Tracer::m_mutex;
+QElapsedTimer Tracer::m_timer;
+QHash<quintptr, int> Tracer::m_threads;
+
+void
+Tracer::setFile(QString flnm)
+{
+  close();
+
+  QMutexLocker lock(&m_mutex);
+
+  if (flnm.isEmpty())
+    return;
+
+  m_file.setFileName(flnm);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    return;
+
+  m_file.write("[\n");
+  m_firstEvent = true;
+  m_threads.clear();
+  m_timer.start();
+  m_active = true;
+
+  // the viewer does not always get a chance to close the file
+  qAddPostRoutine(Tracer::close);
+}
+
+//--------------------------------------------
+// the closing bracket is optional for the trace viewers,
+// so a file cut short by a crash can still be loaded
+//--------------------------------------------
+void
+Tracer::close()
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_active)
+    return;
+
+  m_active = false;
+  m_file.write("\n]\n");
+  m_file.close();
+}
+
+qint64
+Tracer::now()
+{
+  if (!m_active)
+    return 0;
+
+  return m_timer.nsecsElapsed()/1000;
+}
+
+//--------------------------------------------
+// map system thread ids to small numbers and
+// name the track after the QThread object name
+// must be called with m_mutex held
+//--------------------------------------------
+int
+Tracer::threadId()
+{
+  quintptr sysId = (quintptr)QThread::currentThreadId();
+  if (m_threads.contains(sysId))
+    return m_threads[sysId];
+
+  int tid = m_threads.count()+1;
+  m_threads[sysId] = tid;
+
+  QString name = QThread::currentThread()->objectName();
+  if (QCoreApplication::instance() &&
+      QThread::currentThread() == QCoreApplication::instance()->thread())
+    name = "GUI";
+  if (name.isEmpty())
+    name = QString("Thread %1").arg(tid);
+
+  writeEvent(QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%1,\"tid\":%2,"
+		     "\"args\":{\"name\":\"%3\",\"sys_tid\":%4}}").\
+	     arg(QCoreApplication::applicationPid()).\
+	     arg(tid).\
+	     arg(name).\
+	     arg(sysId));
+
+  return tid;
+}
+
+void
+Tracer::writeEvent(QString event)
+{
+  if (!m_firstEvent)
+    m_file.write(",\n");
+  m_firstEvent = false;
+
+  m_file.write(event.toLatin1());
+}
+
+void
+Tracer::complete(const char *name, qint64 start, qint64 dur, QString args)
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_active)
+    return;
+
+  int tid = threadId();
+  writeEvent(QString("{\"name\":\"%1\",\"ph\":\"X\",\"pid\":%2,\"tid\":%3,"
+		     "\"ts\":%4,\"dur\":%5,\"args\":{%6}}").\
+	     arg(name).\
+	     arg(QCoreApplication::applicationPid()).\
+	     arg(tid).\
+	     arg(start).\
+	     arg(dur).\
+	     arg(args));
+}
+
+void
+Tracer::instant(const char *name, QString args)
+{
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_active)
+    return;
+
+  int tid = threadId();
+  writeEvent(QString("{\"name\":\"%1\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%2,\"tid\":%3,"
+		     "\"ts\":%4,\"args\":{%5}}").\
+	     arg(name).\
+	     arg(QCoreApplication::applicationPid()).\
+	     arg(tid).\
+	     arg(m_timer.nsecsElapsed()/1000).\
+	     arg(args));
+}
+//--------------------------------------------
+
+
+//--------------------------------------------
+TraceScope::TraceScope(const char *name)
+{
+  m_name = name;
+  m_start = Tracer::now();
+}
+
+TraceScope::~TraceScope()
+{
+  if (Tracer::active())
+    Tracer::complete(m_name, m_start, Tracer::now()-m_start, m_args);
+}
+
+void
+TraceScope::addArg(const char *key, qint64 value)
+{
+  if (!Tracer::active())
+    return;
+
+  if (!m_args.isEmpty())
+    m_args += ",";
+  m_args += QString("\"%1\":%2").arg(key).arg(value);
+}
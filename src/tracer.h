@@ -0,0 +1,71 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QFile>
+#include <QMutex>
+#include <QHash>
+#include <QElapsedTimer>
+
+//--------------------------------------------
+// Writes scoped markers as trace events (JSON array format)
+// that can be opened in Perfetto or chrome://tracing.
+// Events from the GUI thread, the loader thread and the volume
+// loader thread all go into the same file, each thread on its
+// own track, so waits between them show up side by side.
+// Markers are only compiled in when built with USE_TRACE
+// (qmake CONFIG+=trace), otherwise the TRACE_ macros are empty.
+//--------------------------------------------
+class Tracer
+{
+ public :
+  static void setFile(QString);
+  static bool active() { return m_active; }
+  static void close();
+
+  static qint64 now();
+
+  static void complete(const char*, qint64, qint64, QString);
+  static void instant(const char*, QString);
+
+ private :
+  static bool m_active;
+  static bool m_firstEvent;
+  static QFile m_file;
+  static QMutex m_mutex;
+  static QElapsedTimer m_timer;
+  static QHash<quintptr, int> m_threads;
+
+  static int threadId();
+  static void writeEvent(QString);
+};
+
+//--------------------------------------------
+// emits a complete event covering the enclosing block,
+// args added along the way are attached to the event
+//--------------------------------------------
+class TraceScope
+{
+ public :
+  TraceScope(const char*);
+  ~TraceScope();
+
+  void addArg(const char*, qint64);
+
+ private :
+  const char *m_name;
+  qint64 m_start;
+  QString m_args;
+};
+
+#ifdef USE_TRACE
+#define TRACE_SCOPE(name) TraceScope traceScope(name)
+#define TRACE_ARG(key, value) traceScope.addArg(key, value)
+#define TRACE_INSTANT(name) Tracer::instant(name, QString())
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_ARG(key, value)
+#define TRACE_INSTANT(name)
+#endif
+
+#endif
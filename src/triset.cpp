@@ -2,6 +2,7 @@
 #include "staticfunctions.h"
 #include "triset.h"
 #include "ply.h"
+#include "memorystats.h"
 
 #include <QMessageBox>
 #include <QFile>
@@ -14,6 +15,9 @@ Triset::Triset()
   m_vertData = 0;
   m_indexData = 0;
 
+  m_cpuBytes = 0;
+  m_gpuBytes = 0;
+
   m_glVertBuffer = 0;
   m_glIndexBuffer = 0;
   m_glVertArray = 0;
@@ -72,6 +76,10 @@ Triset::clear()
   if (m_indexData) delete [] m_indexData;
   m_vertData = 0;
   m_indexData = 0;
+
+  MemoryStats::add(MemoryStats::TrisetVBO, -m_gpuBytes);
+  m_gpuBytes = 0;
+  updateMemoryStats();
   
   m_bmin = m_bmax = Vec(0,0,0);
   m_gmin = m_gmax = Vec(0,0,0);
@@ -109,9 +117,28 @@ Triset::load()
   else
     loaded = loadVBO(m_fileName);
 
+  updateMemoryStats();
+
   return loaded;
 }
 
+//--------------------------------------------
+// vertex data is kept on the cpu until uploaded
+//--------------------------------------------
+void
+Triset::updateMemoryStats()
+{
+  qint64 cpu = (m_vertices.count() +
+		m_normals.count() +
+		m_vcolor.count())*sizeof(Vec);
+  cpu += m_triangles.count()*sizeof(uint);
+  if (m_vertData) cpu += 9*m_nvert*sizeof(float);
+  if (m_indexData) cpu += m_ntri*sizeof(unsigned int);
+
+  MemoryStats::add(MemoryStats::TrisetData, cpu-m_cpuBytes);
+  m_cpuBytes = cpu;
+}
+
 bool
 Triset::loadPLY(QString flnm)
 {
@@ -422,6 +449,10 @@ Triset::loadVertexBufferData(GLuint glVA,
   
   m_vboLoaded = true;  
 
+  MemoryStats::add(MemoryStats::TrisetVBO, -m_gpuBytes);
+  m_gpuBytes = sizeof(float)*nv + sizeof(unsigned int)*m_ntri;
+  updateMemoryStats();
+
   return true;
 }
 
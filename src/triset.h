@@ -62,8 +62,10 @@ class Triset
   GLuint m_glIndexBuffer;
   GLuint m_glVertArray;
 
+  qint64 m_cpuBytes, m_gpuBytes;
   
   void clear();
+  void updateMemoryStats();
 
   bool loadPLY(QString);
 
@@ -2,6 +2,11 @@
 #include "viewer.h"
 #include "global.h"
 #include "shaderfactory.h"
+#include "nodecache.h"
+#include "frametimer.h"
+#include "tracer.h"
+#include "memorystats.h"
+#include "heightfield.h"
 
 #include <QMessageBox>
 #include <QtMath>
@@ -16,6 +21,7 @@ using namespace qglviewer;
 #include <QJsonObject>
 #include <QInputDialog>
 #include <QLineEdit>
+#include <QCryptographicHash>
 
 #define VECDIVIDE(a, b) Vec(a.x/b.x, a.y/b.y, a.z/b.z)
 
@@ -62,11 +68,26 @@ Viewer::Viewer(QGLFormat &glfmt, QWidget *parent) :
   m_npoints = 0;
 
   m_shadowShader = 0;
+  m_shadowParm = m_shadowParms[0];
+  for(int v=0; v<4; v++)
+    m_shadowShaders[v] = 0;
+  for(int v=0; v<3; v++)
+    m_occlusionShaders[v] = 0;
+  m_lowresBuffer = 0;
+  m_lowresTex[0] = m_lowresTex[1] = 0;
+  m_lowresWd = m_lowresHt = 0;
   m_smoothShader = 0;
+  m_depthShader = 0;
+  m_depthParm = m_depthParms[0];
+  for(int v=0; v<32; v++)
+    m_depthShaders[v] = 0;
   m_meshShader = 0;
   
   m_vbID = -1;
   m_vbPoints = 0;
+  m_mapVertexBuffer = 0;
+  m_mapVbPoints = 0;
+  m_mapVboTime = -1;
   m_vertexBuffer[0] = 0;
   m_vertexBuffer[1] = 0;
   m_vertexArrayID = 0;
@@ -80,6 +101,7 @@ Viewer::Viewer(QGLFormat &glfmt, QWidget *parent) :
 
   m_flyMode = false;
   m_showInfo = true;
+  m_showFrameTiming = false;
   m_showBox = false;
   m_showPoints = true;
 
@@ -90,6 +112,12 @@ Viewer::Viewer(QGLFormat &glfmt, QWidget *parent) :
   m_depthTex[3] = 0;
   m_rbo = 0;
 
+  m_stereoPoints = false;
+  m_stereoBuffer = 0;
+  m_stereoTex[0] = m_stereoTex[1] = m_stereoTex[2] = 0;
+  m_stereoUBO = 0;
+  m_eyeInstances = 1;
+
   m_colorTex = 0;
   m_colorMap = 0;
 
@@ -97,7 +125,7 @@ Viewer::Viewer(QGLFormat &glfmt, QWidget *parent) :
   m_minmaxMap = 0;
 
   m_visibilityTex = 0;
-  m_visibilityMap = 0;
+  m_visTexPending = false;
 
 
   m_smoothDepth = false;
@@ -163,6 +191,8 @@ Viewer::updateFramerate()
 //      emit framesPerSecond(m_frames);
 
     m_frames = 0;
+
+    MemoryStats::logIfDue();
 }
 
 void
@@ -178,6 +208,16 @@ Viewer::reset()
 
   m_headSetType = 0; // None
 
+  m_shadowScale = 1; // full resolution shadows
+  m_hiZMap.setEnabled(true); // occlusion culling
+
+  m_budgetControl.setEnabled(false); // fixed point budget
+  m_targetFrameMs = 1000.0f/60;
+
+  m_adaptiveResolution = false; // VR point passes at full resolution
+  m_minRenderScale = 0.6f;
+  m_renderScale = 1.0f;
+
   QString assetDir = qApp->applicationDirPath() + QDir::separator() + "assets";
   QString jsonfile = QDir(assetDir).absoluteFilePath("top.json");
   loadTopJson(jsonfile);
@@ -199,10 +239,14 @@ Viewer::reset()
   m_maxTime = 0;
 
   if (m_vertexBuffer[0])glDeleteBuffers(2, m_vertexBuffer);
+  if (m_mapVertexBuffer) glDeleteBuffers(1, &m_mapVertexBuffer);
   if (m_vertexArrayID) glDeleteVertexArrays(1, &m_vertexArrayID);
 
   m_vertexBuffer[0] = 0;
   m_vertexBuffer[1] = 0;
+  m_mapVertexBuffer = 0;
+  m_mapVbPoints = 0;
+  m_mapVboTime = -1;
   m_vertexArrayID = 0;
 
 
@@ -217,6 +261,16 @@ Viewer::reset()
   m_depthTex[3] = 0;
   m_rbo = 0;
 
+  if (m_stereoBuffer) glDeleteFramebuffers(1, &m_stereoBuffer);
+  if (m_stereoTex[0]) glDeleteTextures(3, m_stereoTex);
+  m_stereoBuffer = 0;
+  m_stereoTex[0] = m_stereoTex[1] = m_stereoTex[2] = 0;
+
+  if (m_lowresBuffer) glDeleteFramebuffers(1, &m_lowresBuffer);
+  if (m_lowresTex[0]) glDeleteTextures(2, m_lowresTex);
+  m_lowresBuffer = 0;
+  m_lowresTex[0] = m_lowresTex[1] = 0;
+
 
   if (m_colorTex) glDeleteTextures(1, &m_colorTex);
   m_colorTex = 0;
@@ -232,8 +286,12 @@ Viewer::reset()
 
   if (m_visibilityTex) glDeleteTextures(1, &m_visibilityTex);
   m_visibilityTex = 0;
-  if (m_visibilityMap) delete [] m_visibilityMap;
-  m_visibilityMap = 0;
+  m_visibilityMap.clear();
+
+  m_hiZMap.clear();
+  HeightField::release();
+  m_mapCache.clear();
+  m_pointPicker.clear();
 
 
   m_tiles.clear();
@@ -260,27 +318,7 @@ Viewer::genColorMap()
   if (m_colorMap)
     return;
 
-  //m_colorGrad << Vec(47 ,173,0  )/255.0; 
-  m_colorGrad << Vec(47 ,100,0  )/255.0; 
-  m_colorGrad << Vec(80 ,183,20	)/255.0;
-  m_colorGrad << Vec(112,194,42	)/255.0;
-  m_colorGrad << Vec(143,205,67	)/255.0;
-  m_colorGrad << Vec(172,216,94	)/255.0;
-  m_colorGrad << Vec(199,227,124)/255.0;
-  m_colorGrad << Vec(223,238,156)/255.0;
-  m_colorGrad << Vec(255,230,180)/255.0;
-  //m_colorGrad << Vec(253,255,209)/255.0;
-  
-
-//  m_colorGrad << Vec(1,102, 94)/255.0f;
-//  m_colorGrad << Vec(53,151,143)/255.0f;
-//  m_colorGrad << Vec(128,205,193)/255.0f;
-//  m_colorGrad << Vec(199,234,229)/255.0f;
-//  m_colorGrad << Vec(246,232,195)/255.0f;
-//  m_colorGrad << Vec(223,194,125)/255.0f;
-//  m_colorGrad << Vec(191,129,45)/255.0f;
-//  m_colorGrad << Vec(140,81,10)/255.0f;
-
+  m_colorGrad = StaticFunctions::colorGradient();
 
   Global::setColorMap(m_colorGrad);
 
@@ -330,6 +368,10 @@ Viewer::GlewInit()
   glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
   glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);  
 
+  // gl_Layer from the vertex shader lets VR draw both eyes in one pass
+  m_stereoPoints = (glewIsSupported("GL_ARB_shader_viewport_layer_array") ||
+		    glewIsSupported("GL_AMD_vertex_shader_layer"));
+
   emit message("Ready");
 
 //  m_vr.initVR();
@@ -403,6 +445,8 @@ Viewer::setVRMode(bool b)
 void
 Viewer::start()
 {
+  m_hiZMap.clear();
+
   m_tiles.clear();
   m_orderedTiles.clear();
   m_pointClouds.clear();
@@ -430,6 +474,14 @@ Viewer::start()
 	m_vr.setShowTimeseriesMenu(false);
     }
 
+  // headset refreshes at 90Hz
+  if (m_vrMode && m_vr.vrEnabled())
+    m_budgetControl.setTarget(1000.0f/90);
+  else
+    m_budgetControl.setTarget(m_targetFrameMs);
+  m_budgetControl.setScaling(m_adaptiveResolution && m_vrMode && m_vr.vrEnabled(),
+			     m_minRenderScale);
+
   if (m_pointClouds.count() > 0)
     m_pointType = m_pointClouds[0]->pointType();
   
@@ -492,6 +544,7 @@ Viewer::start()
       GLuint vb0 = m_vertexBuffer[0];
       GLuint vb1 = m_vertexBuffer[1];
       emit setVBOs(vb0, vb1);
+      emit setMapVBO(m_mapVertexBuffer);
     }
 
   if (!m_visibilityTex)
@@ -524,6 +577,16 @@ Viewer::start()
       Global::setScreenSize(m_vr.screenWidth(),
 			    m_vr.screenHeight());
       Global::setMenuCam(m_menuCam);
+
+      // ground heights are only asked for in vr
+      HeightField::setBounds(m_coordMin, m_coordMax);
+
+      m_mapCache.setSource(m_dataDir, mapCacheKey());
+    }
+  else
+    {
+      HeightField::release();
+      m_mapCache.clear();
     }
 
   if (m_volume->validCamera())
@@ -549,6 +612,7 @@ void
 Viewer::generateVBOs()
 {
   if (m_vertexBuffer[0])glDeleteBuffers(2, m_vertexBuffer);
+  if (m_mapVertexBuffer) glDeleteBuffers(1, &m_mapVertexBuffer);
   if (m_vertexArrayID) glDeleteVertexArrays(1, &m_vertexArrayID);
 
   glGenVertexArrays(1, &m_vertexArrayID);
@@ -567,6 +631,28 @@ Viewer::generateVBOs()
 	       m_dpv*m_pointBudget*sizeof(float),
 	       NULL,
 	       GL_STATIC_DRAW);
+
+  // coarse levels for the VR map, refilled by the loader
+  qint64 mapBytes = 0;
+  m_mapVertexBuffer = 0;
+  m_mapVbPoints = 0;
+  m_mapVboTime = -1;
+  if (m_vrMode)
+    {
+      mapBytes = (qint64)m_dpv*MAP_POINT_BUDGET*sizeof(float);
+      glGenBuffers(1, &m_mapVertexBuffer);
+      glBindBuffer(GL_ARRAY_BUFFER, m_mapVertexBuffer);
+      glBufferData(GL_ARRAY_BUFFER,
+		   mapBytes,
+		   NULL,
+		   GL_STATIC_DRAW);
+    }
+
+  MemoryStats::set(MemoryStats::PointVBO,
+		   2*m_dpv*m_pointBudget*sizeof(float) + mapBytes);
+
+  // adaptive budget works within the new buffers
+  m_budgetControl.setCapacity(m_pointBudget);
 }
 
 void
@@ -654,6 +740,255 @@ Viewer::createFBO()
   //glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  createStereoFBO(wd, ht);
+  createLowResFBO(wd, ht);
+
+  // 4 rgba16f textures and the depth renderbuffer,
+  // 2 layers of 2 rgba16f textures and depth for stereo,
+  // 2 reduced rgba16f textures for shadows
+  qint64 fboBytes = (qint64)wd*ht*(4*8 + 4);
+  if (m_stereoBuffer)
+    fboBytes += (qint64)wd*ht*2*(2*8 + 4);
+  if (m_lowresBuffer)
+    fboBytes += (qint64)m_lowresWd*m_lowresHt*2*8;
+  MemoryStats::set(MemoryStats::FrameBuffers, fboBytes);
+}
+
+//--------------------------------------------
+// layered targets for drawing both eyes in one pass,
+// layer 0 is the left eye and layer 1 the right eye
+//--------------------------------------------
+void
+Viewer::createStereoFBO(int wd, int ht)
+{
+  if (m_stereoBuffer) glDeleteFramebuffers(1, &m_stereoBuffer);
+  if (m_stereoTex[0]) glDeleteTextures(3, m_stereoTex);
+  m_stereoBuffer = 0;
+  m_stereoTex[0] = m_stereoTex[1] = m_stereoTex[2] = 0;
+
+  if (!m_vrMode || !m_vr.vrEnabled() || !m_stereoPoints)
+    return;
+
+  glGenFramebuffers(1, &m_stereoBuffer);
+  glGenTextures(3, m_stereoTex);
+
+  for(int dt=0; dt<3; dt++)
+    {
+      glBindTexture(GL_TEXTURE_2D_ARRAY, m_stereoTex[dt]);
+      if (dt < 2)
+	glTexImage3D(GL_TEXTURE_2D_ARRAY,
+		     0,
+		     GL_RGBA16F,
+		     wd, ht, 2,
+		     0,
+		     GL_RGBA,
+		     GL_UNSIGNED_BYTE,
+		     0);
+      else
+	glTexImage3D(GL_TEXTURE_2D_ARRAY,
+		     0,
+		     GL_DEPTH_COMPONENT24,
+		     wd, ht, 2,
+		     0,
+		     GL_DEPTH_COMPONENT,
+		     GL_FLOAT,
+		     0);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR); 
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  // attaching the whole array makes the frame buffer layered
+  glBindFramebuffer(GL_FRAMEBUFFER, m_stereoBuffer);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_stereoTex[0], 0);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, m_stereoTex[1], 0);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_stereoTex[2], 0);
+  bool complete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  if (!complete)
+    {
+      glDeleteFramebuffers(1, &m_stereoBuffer);
+      glDeleteTextures(3, m_stereoTex);
+      m_stereoBuffer = 0;
+      m_stereoTex[0] = m_stereoTex[1] = m_stereoTex[2] = 0;
+      m_stereoPoints = false;
+      emit message("Layered frame buffer not supported, drawing eyes separately");
+      return;
+    }
+
+  if (!m_stereoUBO)
+    {
+      glGenBuffers(1, &m_stereoUBO);
+      glBindBuffer(GL_UNIFORM_BUFFER, m_stereoUBO);
+      glBufferData(GL_UNIFORM_BUFFER, 4*16*sizeof(float), 0, GL_DYNAMIC_DRAW);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+}
+
+//--------------------------------------------
+// reduced depth and shadow terms for m_shadowScale > 1
+//--------------------------------------------
+void
+Viewer::createLowResFBO(int wd, int ht)
+{
+  if (m_lowresBuffer) glDeleteFramebuffers(1, &m_lowresBuffer);
+  if (m_lowresTex[0]) glDeleteTextures(2, m_lowresTex);
+  m_lowresBuffer = 0;
+  m_lowresTex[0] = m_lowresTex[1] = 0;
+
+  if (m_shadowScale <= 1)
+    return;
+
+  m_lowresWd = (wd + m_shadowScale-1)/m_shadowScale;
+  m_lowresHt = (ht + m_shadowScale-1)/m_shadowScale;
+
+  glGenFramebuffers(1, &m_lowresBuffer);
+  glGenTextures(2, m_lowresTex);
+
+  for(int dt=0; dt<2; dt++)
+    {
+      glBindTexture(GL_TEXTURE_RECTANGLE, m_lowresTex[dt]);
+      glTexImage2D(GL_TEXTURE_RECTANGLE,
+		   0,
+		   GL_RGBA16F,
+		   m_lowresWd, m_lowresHt,
+		   0,
+		   GL_RGBA,
+		   GL_UNSIGNED_BYTE,
+		   0);
+      // taps are weighted in the shader
+      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST); 
+      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+}
+
+//--------------------------------------------
+// true when the point shadow pass should upsample
+// soft shadows and edges from the reduced resolution
+//--------------------------------------------
+bool
+Viewer::lowResShadows(bool stereo, bool shadowsOn)
+{
+  if (!shadowsOn || !m_lowresBuffer)
+    return false;
+
+  int s = (stereo ? 1 : 0);
+  return (m_shadowShaders[s | 2] &&
+	  m_occlusionShaders[s] &&
+	  m_occlusionShaders[2]);
+}
+
+//--------------------------------------------
+// downsample the depth texture on unit 1 (layer for stereo)
+// and compute the soft shadow and edge terms from it,
+// leaves the reduced depth on unit 4 and the terms on unit 5
+//--------------------------------------------
+void
+Viewer::drawLowResShadows(bool stereo, int layer, int wd, int ht,
+			  bool edges, bool softShadows,
+			  float nearDist, float farDist)
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  GLint drawFbo;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFbo);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_lowresBuffer);
+
+  // only the part covered at the current render scale
+  int lwd = (qRound(wd*m_renderScale) + m_shadowScale-1)/m_shadowScale;
+  int lht = (qRound(ht*m_renderScale) + m_shadowScale-1)/m_shadowScale;
+  glViewport(0, 0, qMin(lwd, m_lowresWd), qMin(lht, m_lowresHt));
+
+  // screen quad covers the viewport
+  QMatrix4x4 mvp;
+  mvp.ortho(0.0, wd, 0.0, ht, 0.0, 1.0);
+
+  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexScreenBuffer);
+  glVertexAttribPointer(0,  // attribute 0
+			2,  // size
+			GL_FLOAT, // type
+			GL_FALSE, // normalized
+			0, // stride
+			(void*)0 ); // array buffer offset
+
+  //--------------------
+  // reduced depth
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
+			 GL_COLOR_ATTACHMENT0,
+			 GL_TEXTURE_RECTANGLE,
+			 m_lowresTex[0],
+			 0);
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+  GLint *parm = m_occlusionParms[stereo ? 1 : 0];
+  glUseProgram(m_occlusionShaders[stereo ? 1 : 0]);
+  glUniformMatrix4fv(parm[0], 1, GL_FALSE, mvp.data());
+  glUniform1i(parm[1], 1); // full resolution depth
+  glUniform1i(parm[2], layer);
+  glUniform1i(parm[3], m_shadowScale);
+  glDrawArrays(GL_QUADS, 0, 8);
+  //--------------------
+
+  //--------------------
+  // soft shadow and edge terms
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
+			 GL_COLOR_ATTACHMENT0,
+			 GL_TEXTURE_RECTANGLE,
+			 m_lowresTex[1],
+			 0);
+
+  glActiveTexture(GL_TEXTURE4);
+  glBindTexture(GL_TEXTURE_RECTANGLE, m_lowresTex[0]); // reduced depth
+
+  parm = m_occlusionParms[2];
+  glUseProgram(m_occlusionShaders[2]);
+  glUniformMatrix4fv(parm[0], 1, GL_FALSE, mvp.data());
+  glUniform1i(parm[1], 4); // reduced depth
+  glUniform1i(parm[3], m_shadowScale);
+  glUniform1i(parm[4], edges);
+  glUniform1i(parm[5], softShadows);
+  glUniform1f(parm[6], nearDist);
+  glUniform1f(parm[7], farDist);
+  glDrawArrays(GL_QUADS, 0, 8);
+  //--------------------
+
+  glActiveTexture(GL_TEXTURE5);
+  glBindTexture(GL_TEXTURE_RECTANGLE, m_lowresTex[1]); // shadow terms
+
+  glActiveTexture(GL_TEXTURE0);
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+//--------------------------------------------
+// bind the points shadow pass variant and return its uniforms
+//--------------------------------------------
+GLint*
+Viewer::useShadowShader(bool stereo, bool upsample, float renderScale)
+{
+  int v = (stereo ? 1 : 0) | (upsample ? 2 : 0);
+  glUseProgram(m_shadowShaders[v]);
+
+  GLint *parm = m_shadowParms[v];
+  glUniform1f(parm[13], renderScale);
+  if (upsample)
+    {
+      glUniform1i(parm[10], 4); // reduced depth
+      glUniform1i(parm[11], 5); // shadow terms
+      glUniform1i(parm[12], m_shadowScale);
+    }
+
+  return parm;
 }
 
 void
@@ -673,30 +1008,132 @@ Viewer::showBox(bool b)
   update();
 }
 
+//--------------------------
+// bind the drawpoints variant and point m_depthParm at its uniforms
+//--------------------------
+bool
+Viewer::useDepthShader(bool adaptive, bool shadows, bool xform, bool stereo)
+{
+  // position only data has no tile id for the octree walk
+  // or the transform, it is coloured by height instead
+  bool positionOnly = (m_dpv < 5);
+  if (positionOnly)
+    adaptive = xform = false;
+
+  int v = ((adaptive ? 1 : 0) | (shadows ? 2 : 0) |
+	   (xform ? 4 : 0) | (stereo ? 8 : 0) |
+	   (positionOnly ? 16 : 0));
+  if (!m_depthShaders[v])
+    return false;
+
+  m_depthShader = m_depthShaders[v];
+  m_depthParm = m_depthParms[v];
+  glUseProgram(m_depthShader);
+
+  if (positionOnly)
+    {
+      glUniform3f(m_depthParm[28], m_coordMin.x, m_coordMin.y, m_coordMin.z);
+      glUniform3f(m_depthParm[29], m_coordMax.x, m_coordMax.y, m_coordMax.z);
+    }
+
+  return true;
+}
+
 void
 Viewer::createShaders()
 { 
   //--------------------------
-  if (!m_shadowShader)
+  // shadow pass for a rect depth texture or an eye layer of the
+  // stereo pass, full resolution or upsampling the occlusion terms
+  for(int v=0; v<4; v++)
     {
-      m_shadowShader = glCreateProgramObjectARB();
-      if (! ShaderFactory::loadShadersFromFile(m_shadowShader,
+      bool stereo = (v & 1);
+      bool upsample = (v & 2);
+      if (m_shadowShaders[v] || (stereo && !m_stereoPoints))
+	continue;
+
+      QStringList defines;
+      if (stereo) defines << "STEREO";
+      if (upsample) defines << "UPSAMPLE";
+
+      m_shadowShaders[v] = glCreateProgramObjectARB();
+      if (! ShaderFactory::loadShadersFromFile(m_shadowShaders[v],
 					       "assets/shaders/shadow.vert",
-					       "assets/shaders/shadow.frag"))
+					       "assets/shaders/shadow.frag",
+					       defines))
 	{
-	  m_npoints = 0;
-	  return;
+	  if (v == 0)
+	    {
+	      m_npoints = 0;
+	      return;
+	    }
+	  glDeleteObjectARB(m_shadowShaders[v]);
+	  m_shadowShaders[v] = 0;
+	  continue;
+	}
+
+      GLhandleARB shader = m_shadowShaders[v];
+      GLint *parm = m_shadowParms[v];
+      parm[0] = glGetUniformLocation(shader, "MVP");
+      parm[1] = glGetUniformLocation(shader, "colorTex");
+      parm[2] = glGetUniformLocation(shader, "depthTex");
+      parm[3] = glGetUniformLocation(shader, "showedges");
+      parm[4] = glGetUniformLocation(shader, "softShadows");
+      parm[5] = glGetUniformLocation(shader, "nearDist");
+      parm[6] = glGetUniformLocation(shader, "farDist");
+      parm[7] = glGetUniformLocation(shader, "showsphere");
+      parm[8] = glGetUniformLocation(shader, "copyOnly");
+      parm[9] = glGetUniformLocation(shader, "layer");
+      parm[10] = glGetUniformLocation(shader, "lowDepthTex");
+      parm[11] = glGetUniformLocation(shader, "occlusionTex");
+      parm[12] = glGetUniformLocation(shader, "shadowScale");
+      parm[13] = glGetUniformLocation(shader, "renderScale");
+
+      glUseProgram(shader);
+      glUniform1f(parm[13], 1.0f); // full resolution
+    }
+  glUseProgram(0);
+  m_shadowShader = m_shadowShaders[0];
+  m_shadowParm = m_shadowParms[0];
+
+  // stereo points need their shadow pass
+  if (!m_shadowShaders[1])
+    m_stereoPoints = false;
+  //--------------------------
+
+
+  //--------------------------
+  // reduced resolution depth and shadow terms
+  for(int v=0; v<3; v++)
+    {
+      if (m_occlusionShaders[v] || (v == 1 && !m_stereoPoints))
+	continue;
+
+      QStringList defines;
+      if (v < 2) defines << "DOWNSAMPLE";
+      if (v == 1) defines << "STEREO";
+
+      m_occlusionShaders[v] = glCreateProgramObjectARB();
+      if (! ShaderFactory::loadShadersFromFile(m_occlusionShaders[v],
+					       "assets/shaders/shadow.vert",
+					       "assets/shaders/occlusion.frag",
+					       defines))
+	{
+	  glDeleteObjectARB(m_occlusionShaders[v]);
+	  m_occlusionShaders[v] = 0;
+	  continue;
 	}
 
-      m_shadowParm[0] = glGetUniformLocation(m_shadowShader, "MVP");
-      m_shadowParm[1] = glGetUniformLocation(m_shadowShader, "colorTex");
-      m_shadowParm[2] = glGetUniformLocation(m_shadowShader, "depthTex");
-      m_shadowParm[3] = glGetUniformLocation(m_shadowShader, "showedges");
-      m_shadowParm[4] = glGetUniformLocation(m_shadowShader, "softShadows");
-      m_shadowParm[5] = glGetUniformLocation(m_shadowShader, "nearDist");
-      m_shadowParm[6] = glGetUniformLocation(m_shadowShader, "farDist");
-      m_shadowParm[7] = glGetUniformLocation(m_shadowShader, "showsphere");
-      m_shadowParm[8] = glGetUniformLocation(m_shadowShader, "copyOnly");
+      GLhandleARB shader = m_occlusionShaders[v];
+      GLint *parm = m_occlusionParms[v];
+      parm[0] = glGetUniformLocation(shader, "MVP");
+      parm[1] = glGetUniformLocation(shader, "depthTex");
+      parm[2] = glGetUniformLocation(shader, "layer");
+      parm[3] = glGetUniformLocation(shader, "shadowScale");
+      parm[4] = glGetUniformLocation(shader, "showedges");
+      parm[5] = glGetUniformLocation(shader, "softShadows");
+      parm[6] = glGetUniformLocation(shader, "nearDist");
+      parm[7] = glGetUniformLocation(shader, "farDist");
     }
   //--------------------------
 
@@ -742,54 +1179,95 @@ Viewer::createShaders()
 
 
   //--------------------------
-  m_depthShader = glCreateProgramObjectARB();
-
-  if (! ShaderFactory::loadShadersFromFile(m_depthShader,
-					   "assets/shaders/drawpoints.vert",
-					   "assets/shaders/drawpoints.frag"))
+  // drawpoints is compiled once for every combination of
+  // adaptive point size, shadows, edit transform and vertex
+  // layout (colour and tile, or position only),
+  // program binaries are cached so later startups skip compiling
+  for(int v=0; v<32; v++)
     {
-      QMessageBox::information(0, "Error drawpoints shader", "..");
-      m_npoints = 0;
-      return;
-    }
+      // stereo pass only draws shadowed points without edit transform
+      bool stereo = (v & 8);
+      if (stereo && (!m_stereoPoints || (v & 6) != 2))
+	continue;
+
+      // position only has fixed point size and no transform
+      bool positionOnly = (v & 16);
+      if (positionOnly && (v & 5))
+	continue;
+
+      QStringList defines;
+      if (v & 1) defines << "ADAPTIVE_POINTSIZE";
+      if (v & 2) defines << "SHADOWS";
+      if (v & 4) defines << "APPLY_XFORM";
+      if (stereo) defines << "STEREO";
+      if (positionOnly) defines << "POSITION_ONLY";
+
+      if (m_depthShaders[v])
+	glDeleteObjectARB(m_depthShaders[v]);
+      m_depthShaders[v] = glCreateProgramObjectARB();
+
+      if (! ShaderFactory::loadShadersFromFile(m_depthShaders[v],
+					       "assets/shaders/drawpoints.vert",
+					       "assets/shaders/drawpoints.frag",
+					       defines))
+	{
+	  if (stereo) // draw eyes separately instead
+	    {
+	      glDeleteObjectARB(m_depthShaders[v]);
+	      m_depthShaders[v] = 0;
+	      m_stereoPoints = false;
+	      continue;
+	    }
+	  QMessageBox::information(0, "Error drawpoints shader", defines.join(" "));
+	  m_npoints = 0;
+	  return;
+	}
 
-  m_depthParm[0] = glGetUniformLocation(m_depthShader, "MV");
-  m_depthParm[1] = glGetUniformLocation(m_depthShader, "MVP");
-  m_depthParm[2] = glGetUniformLocation(m_depthShader, "pointSize");
-  m_depthParm[3] = glGetUniformLocation(m_depthShader, "eyepos");
-  m_depthParm[4] = glGetUniformLocation(m_depthShader, "viewdir");
+      GLhandleARB shader = m_depthShaders[v];
+      GLint *parm = m_depthParms[v];
 
-  m_depthParm[5] = glGetUniformLocation(m_depthShader, "scaleFactor");
+      parm[0] = glGetUniformLocation(shader, "MV");
+      parm[1] = glGetUniformLocation(shader, "MVP");
+      parm[2] = glGetUniformLocation(shader, "pointSize");
+      parm[3] = glGetUniformLocation(shader, "eyepos");
+      parm[4] = glGetUniformLocation(shader, "viewdir");
 
-  //m_depthParm[6] = glGetUniformLocation(m_depthShader, "MP");
+      parm[5] = glGetUniformLocation(shader, "scaleFactor");
 
-  m_depthParm[7] = glGetUniformLocation(m_depthShader, "colorTex");
+      parm[7] = glGetUniformLocation(shader, "colorTex");
 
-  m_depthParm[8] = glGetUniformLocation(m_depthShader, "viewDir");
-  m_depthParm[9] = glGetUniformLocation(m_depthShader, "screenWidth");
+      parm[8] = glGetUniformLocation(shader, "viewDir");
+      parm[9] = glGetUniformLocation(shader, "screenWidth");
 
-  m_depthParm[10] = glGetUniformLocation(m_depthShader, "projFactor");
+      parm[10] = glGetUniformLocation(shader, "projFactor");
 
-  m_depthParm[11] = glGetUniformLocation(m_depthShader, "ommTex");
-  m_depthParm[12] = glGetUniformLocation(m_depthShader, "visTex");
+      parm[11] = glGetUniformLocation(shader, "ommTex");
+      parm[12] = glGetUniformLocation(shader, "visTex");
 
-  m_depthParm[13] = glGetUniformLocation(m_depthShader, "pointType");
-  m_depthParm[14] = glGetUniformLocation(m_depthShader, "shadows");
+      // 13, 14 and 20 were pointType, shadows and applyXform,
+      // now selected by the variant
+      parm[13] = parm[14] = parm[20] = -1;
 
-  m_depthParm[15] = glGetUniformLocation(m_depthShader, "zFar");
+      parm[15] = glGetUniformLocation(shader, "zFar");
 
-  m_depthParm[16] = glGetUniformLocation(m_depthShader, "minPointSize");
-  m_depthParm[17] = glGetUniformLocation(m_depthShader, "maxPointSize");
+      parm[16] = glGetUniformLocation(shader, "minPointSize");
+      parm[17] = glGetUniformLocation(shader, "maxPointSize");
 
-  m_depthParm[18] = glGetUniformLocation(m_depthShader, "deadRadius");
-  m_depthParm[19] = glGetUniformLocation(m_depthShader, "deadPoint");
+      parm[18] = glGetUniformLocation(shader, "deadRadius");
+      parm[19] = glGetUniformLocation(shader, "deadPoint");
 
-  m_depthParm[20] = glGetUniformLocation(m_depthShader, "applyXform");
-  m_depthParm[21] = glGetUniformLocation(m_depthShader, "xformTileId");
-  m_depthParm[22] = glGetUniformLocation(m_depthShader, "xformShift");
-  m_depthParm[23] = glGetUniformLocation(m_depthShader, "xformCen");
-  m_depthParm[24] = glGetUniformLocation(m_depthShader, "xformScale");
-  m_depthParm[25] = glGetUniformLocation(m_depthShader, "xformRot");
+      parm[21] = glGetUniformLocation(shader, "xformTileId");
+      parm[22] = glGetUniformLocation(shader, "xformShift");
+      parm[23] = glGetUniformLocation(shader, "xformCen");
+      parm[24] = glGetUniformLocation(shader, "xformScale");
+      parm[25] = glGetUniformLocation(shader, "xformRot");
+      parm[26] = glGetUniformLocation(shader, "nodeStart");
+      parm[27] = glGetUniformLocation(shader, "nodeOffset");
+      parm[28] = glGetUniformLocation(shader, "coordMin");
+      parm[29] = glGetUniformLocation(shader, "coordMax");
+    }
+  m_depthShader = m_depthShaders[m_dpv < 5 ? 16 : 0];
+  m_depthParm = m_depthParms[m_dpv < 5 ? 16 : 0];
   //--------------------------
 
   //--------------------------
@@ -827,6 +1305,7 @@ Viewer::setPointBudget(int b)
   GLuint vb0 = m_vertexBuffer[0];
   GLuint vb1 = m_vertexBuffer[1];
   emit setVBOs(vb0, vb1);	  
+  emit setMapVBO(m_mapVertexBuffer);
 
   QString assetDir = qApp->applicationDirPath() + QDir::separator() + "assets";
   QString jsonfile = QDir(assetDir).absoluteFilePath("top.json");
@@ -846,6 +1325,12 @@ Viewer::setEditMode(bool b)
 
   m_pointPairs.clear();
 
+  // edited points move about, maps drawn before
+  // no longer match them
+  HeightField::clear();
+  m_mapCache.clear(true);
+  m_mapCache.setKey(mapCacheKey());
+
   if (m_pointClouds.count() != 2)
     return;
 
@@ -935,6 +1420,9 @@ Viewer::setTimeStep(int ct)
   m_currTime = qMin(m_maxTime, m_currTime);
   m_currTime = qMax(m_currTime, 0);
 
+  m_hiZMap.clear();
+  HeightField::clear();
+
   genDrawNodeList();
 }
 
@@ -1011,6 +1499,17 @@ Viewer::keyPressEvent(QKeyEvent *event)
       return;
     }  
 
+  if (event->key() == Qt::Key_T)
+    {
+      m_showFrameTiming = !m_showFrameTiming;
+      if (m_showFrameTiming != FrameTimer::enabled() &&
+	  !FrameTimer::logging())
+	FrameTimer::setEnabled(m_showFrameTiming);
+
+      update();
+      return;
+    }  
+
   if (event->key() == Qt::Key_Right)
     {
       if (m_maxTime > 0)
@@ -1020,6 +1519,9 @@ Viewer::keyPressEvent(QKeyEvent *event)
 	    m_currTime = 0;
 	  emit timeStepChanged(m_currTime);
 
+	  m_hiZMap.clear();
+	  HeightField::clear();
+
 	  genDrawNodeList();
 	  update();
 	}
@@ -1036,6 +1538,9 @@ Viewer::keyPressEvent(QKeyEvent *event)
 	    m_currTime = m_maxTime;
 	  emit timeStepChanged(m_currTime);
 
+	  m_hiZMap.clear();
+	  HeightField::clear();
+
 	  genDrawNodeList();
 	  update();
 	}
@@ -1072,17 +1577,81 @@ Viewer::mouseDoubleClickEvent(QMouseEvent *event)
   if (event->buttons() == Qt::LeftButton &&
       !m_flyMode)
     {
-      m_selectActive = true;
-      updateGL();
-      m_selectActive = false;
-      bool found = false;
-      Vec newp = camera()->pointUnderPixel(event->pos(), found);
-      if (found)
+      Vec newp;
+      if (pointUnderPixel(event->pos(), newp))
 	camera()->setPivotPoint(newp);
       setVisualHintsMask(1);
     }
 }
 
+bool
+Viewer::pickPoint(Vec orig, Vec dir, float tolConst, float tolSlope, Vec &pt)
+{
+  // nodes as drawn from the current point buffer
+  QList<OctreeNode*> nodes;
+  QList<qint64> npts;
+  {
+    QMutexLocker locker(&m_nodeRangeMutex);
+    if (m_vbID >= 0)
+      {
+	const QVector<NodeRange> &ranges = m_nodeRanges[m_vbID];
+	for(int i=0; i<ranges.count(); i++)
+	  {
+	    if (ranges[i].start >= m_vbPoints)
+	      break;
+	    nodes << ranges[i].node;
+	    npts << qMin(ranges[i].npts, m_vbPoints-ranges[i].start);
+	  }
+      }
+  }
+  m_pointPicker.setNodes(nodes, npts);
+
+  // same registration transform as the depth pass
+  if (m_editMode && m_pointClouds.count() == 2)
+    m_pointPicker.setEditXform(m_volume->xformTileId(),
+			       m_deltaShift - m_pointClouds[1]->globalMin(),
+			       m_pointClouds[1]->getXformCen(),
+			       m_deltaScale,
+			       m_deltaRot);
+  else
+    m_pointPicker.setEditXform(-1, Vec(0,0,0), Vec(0,0,0), 1, Quaternion());
+
+  return m_pointPicker.pick(orig, dir, tolConst, tolSlope, pt);
+}
+
+//--------------------------------------------
+// points are picked on the cpu within a few pixels of the
+// mouse, meshes still need the select pass
+//--------------------------------------------
+bool
+Viewer::pointUnderPixel(QPoint scr, Vec &pt)
+{
+  Vec orig, dir;
+  camera()->convertClickToLine(scr, orig, dir);
+
+  float tolPixels = 3;
+  float tolConst = 0;
+  float tolSlope = 0;
+  if (camera()->type() == Camera::PERSPECTIVE)
+    tolSlope = tolPixels*2*qTan(camera()->fieldOfView()/2)/camera()->screenHeight();
+  else
+    tolConst = tolPixels*camera()->pixelGLRatio(camera()->pivotPoint());
+
+  if (pickPoint(orig, dir, tolConst, tolSlope, pt))
+    return true;
+
+  if (m_trisets.count() == 0)
+    return false;
+
+  m_selectActive = true;
+  updateGL();
+  m_selectActive = false;
+
+  bool found = false;
+  pt = camera()->pointUnderPixel(scr, found);
+  return found;
+}
+
 void
 Viewer::mousePressEvent(QMouseEvent *event)
 { 
@@ -1120,10 +1689,8 @@ Viewer::mousePressEvent(QMouseEvent *event)
   if (event->modifiers() & Qt::ShiftModifier &&
       event->buttons() == Qt::LeftButton)
     {
-      m_selectActive = true;
-      updateGL();
-      bool found = false;
-      Vec newp = camera()->pointUnderPixel(event->pos(), found);
+      Vec newp;
+      bool found = pointUnderPixel(event->pos(), newp);
       if (m_editMode && found)
 	{
 	  m_pointPairs << newp;
@@ -1150,7 +1717,6 @@ Viewer::mousePressEvent(QMouseEvent *event)
 //	  if (m_savePointsToFile)
 //	    savePointsToFile(newp);
 //	}
-      m_selectActive = false;
     }
   //------------------------------------------
   // remove point
@@ -1330,6 +1896,15 @@ Viewer::dummydraw()
 void
 Viewer::paintGL()
 {
+  TRACE_SCOPE("paintGL");
+
+  if (m_visTexPending)
+    {
+      m_visibilityMap.upload(m_visibilityTex);
+      glActiveTexture(GL_TEXTURE0);
+      m_visTexPending = false;
+    }
+
   glClearColor(0,0,0,0);
 
   if (!m_vrMode ||
@@ -1337,6 +1912,8 @@ Viewer::paintGL()
       (m_pointClouds.count() == 0 &&
        m_trisets.count() == 0) )
     {
+      m_renderScale = 1.0f;
+      m_budgetControl.beginFrame();
       // Clears screen, set model view matrix...
       preDraw();
       // Used defined method. Default calls draw()
@@ -1346,6 +1923,12 @@ Viewer::paintGL()
 	draw();
       // Add visual hints: axis, camera, grid...
       postDraw();
+      m_budgetControl.endFrame();
+      FrameTimer::endFrame();
+
+      if (m_budgetControl.update() &&
+	  m_pointClouds.count() > 0)
+	QTimer::singleShot(0, this, SLOT(applyDrawBudget()));
       return;
     }
 
@@ -1355,16 +1938,30 @@ Viewer::paintGL()
       return;
     }
 
+  m_budgetControl.beginFrame();
+
+  // same scale for both eyes of a frame
+  m_renderScale = m_budgetControl.renderScale();
+
   if (m_vr.genDrawList())
     {
       if (m_vr.nextStep() != 0)
 	{
+	  int step = m_vr.nextStep();
 	  m_currTimeChanged = true;
-	  m_currTime = m_currTime + m_vr.nextStep();
+	  m_currTime = m_currTime + step;
 	  if (m_currTime > m_maxTime) m_currTime = 0;
 	  if (m_currTime < 0) m_currTime = m_maxTime;	  
 	  m_vr.resetNextStep();
 
+	  m_hiZMap.clear();
+	  HeightField::clear();
+
+	  // the buffers still hold the previous step and
+	  // the map buffer is refilled for the new one
+	  m_vboLoadedAll = false;
+	  m_mapVboTime = -1;
+
 	  m_vr.setTimeStep(QString("%1").arg(m_currTime));
 
 	  if (m_pointClouds.count() > 0)
@@ -1380,7 +1977,28 @@ Viewer::paintGL()
 	      
 	      
 	      if (m_pointClouds[0]->showMap())
-		m_firstImageDone = 0;
+		{
+		  // map drawn for this step before, no need to wait
+		  // for the points and draw it again
+		  QImage mapImage;
+		  QVector<float> mapDepth;
+		  if (m_mapCache.get(m_currTime, mapImage, mapDepth))
+		    {
+		      m_vr.setMapImage(mapImage, mapDepth);
+		      stickLabelsToGround();
+		      m_firstImageDone = 2;
+		    }
+		  else
+		    m_firstImageDone = 0;
+
+		  // the next steps in the same direction
+		  for(int i=1; i<=2; i++)
+		    {
+		      int ns = m_currTime + i*step;
+		      ns = ((ns % (m_maxTime+1)) + m_maxTime+1) % (m_maxTime+1);
+		      m_mapCache.prefetch(ns);
+		    }
+		}
 	    }
 	}
 
@@ -1421,6 +2039,29 @@ Viewer::paintGL()
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
       m_vr.postDrawRightBuffer();
     }
+  else if (m_pointClouds.count() > 0 &&
+	   m_stereoPoints && m_stereoBuffer)
+    {
+      // points for both eyes in one pass, the shadow pass
+      // clears the eye buffers so trisets come first as before
+      if (m_trisets.count() > 0)
+	{
+	  m_vr.bindLeftBuffer();
+	  drawTrisets(vr::Eye_Left);
+	  m_vr.bindRightBuffer();
+	  drawTrisets(vr::Eye_Right);
+	}
+
+      drawPointsStereo();
+
+      m_vr.bindLeftBuffer();
+      drawLabelsForVR(vr::Eye_Left);
+      m_vr.postDrawLeftBuffer();
+
+      m_vr.bindRightBuffer();
+      drawLabelsForVR(vr::Eye_Right);
+      m_vr.postDrawRightBuffer();
+    }
   else
     {
       
@@ -1453,22 +2094,52 @@ Viewer::paintGL()
       m_vr.postDrawRightBuffer();
     }
 
+  m_budgetControl.endFrame();
+
   m_vr.postDraw();
 
+  FrameTimer::endFrame();
+
+  // reselect nodes with the new budget on the next frame
+  if (m_budgetControl.update())
+    m_vr.setGenDrawList(true);
+
   m_frames++;
   
   //---------------------------
   if (m_pointClouds.count() > 0)
     {
+      // map queued on an earlier frame, kept for its time step
+      // and shown unless the step has moved on meanwhile
+      int mapStep;
+      QImage mapImage;
+      QVector<float> mapDepth;
+      if (m_vr.collectMapImage(mapStep, mapImage, mapDepth))
+	{
+	  m_mapCache.put(mapStep, mapImage, mapDepth);
+	  if (mapStep == m_currTime)
+	    {
+	      m_vr.setMapImage(mapImage, mapDepth);
+	      stickLabelsToGround();
+	    }
+	}
+
       if (m_vr.reUpdateMap())
-	m_firstImageDone = 0;
+	{
+	  // what was drawn before no longer matches
+	  m_mapCache.clear(true);
+	  m_firstImageDone = 0;
+	}
       
       
-      if (m_vboLoadedAll &&
+      // the map buffer is loaded for one step at a time, a load
+      // finishing for an earlier step must not count as this one
+      if (m_mapVboTime == m_currTime &&
+	  m_mapVbPoints > 0 &&
 	  m_pointClouds[0]->showMap()&&
 	  m_firstImageDone < 2)
 	{
-	  generateFirstImage();
+	  generateFirstImage(m_mapVboTime);
 	  m_firstImageDone++;
 	  
 	  m_vr.resetUpdateMap();
@@ -1606,6 +2277,7 @@ Viewer::drawInfo()
     return;
 
   if (!m_showInfo &&
+      !m_showFrameTiming &&
       m_volumeFactory->stackSize() == 0)
     return;
   
@@ -1629,7 +2301,9 @@ Viewer::drawInfo()
       //mesg += QString("PtSz : %1    ").arg(ptsz);
       if (m_pointClouds.count() > 0)
 	{
-	  mesg += QString("Points : %1 (%2)  ").arg(m_pointBudget).arg(m_vbPoints);
+	  mesg += QString("Points : %1 (%2)  ").arg(drawBudget()).arg(m_vbPoints);
+	  if (m_budgetControl.enabled())
+	    mesg += QString("Gpu : %1ms  ").arg(m_budgetControl.gpuTime(), 0, 'f', 1);
 	  mesg += QString("%1").arg(m_vboLoadedAll);
 	}
 	    
@@ -1638,6 +2312,25 @@ Viewer::drawInfo()
 				  Qt::black,
 				  Qt::white,
 				  true);
+
+      StaticFunctions::renderText(10, 52,
+				  MemoryStats::summary(), tfont,
+				  Qt::black,
+				  Qt::white,
+				  true);
+    }
+
+  if (m_showFrameTiming)
+    {
+      // p50 p95 p99 for each stage
+      QFont mfont = QFont("Courier", 10);
+      QStringList timing = FrameTimer::summary();
+      for(int i=0; i<timing.count(); i++)
+	StaticFunctions::renderText(10, 82+i*22,
+				    timing[i], mfont,
+				    Qt::black,
+				    Qt::white,
+				    true);
     }
 
 //  if (m_volumeFactory->stackSize() > 0)
@@ -1658,6 +2351,7 @@ Viewer::drawInfo()
 void
 Viewer::drawVAO()
 {
+  // m_eyeInstances is 2 for the stereo pass, one instance per eye
   glBindVertexArray(m_vertexArrayID);
 
 
@@ -1673,7 +2367,7 @@ Viewer::drawVAO()
 			    0, // stride
 			    (void*)0 ); // array buffer offset
 
-      glDrawArrays(GL_POINTS, 0, m_vbPoints);  
+      glDrawArraysInstanced(GL_POINTS, 0, m_vbPoints, m_eyeInstances);  
       
       glDisableVertexAttribArray(0);
     }
@@ -1696,21 +2390,99 @@ Viewer::drawVAO()
 			    20, // stride
 			    (char *)NULL+12 ); // array buffer offset
 
-      glDrawArrays(GL_POINTS, 0, m_vbPoints);  
-
-      glDisableVertexAttribArray(0);
-      glDisableVertexAttribArray(1);
+      // with adaptive pointsize each node is drawn on its own
+      // so the shader can start the octree walk at the node
+      QMutexLocker locker(&m_nodeRangeMutex);
+      if (m_pointType && m_vbID >= 0 &&
+	  m_nodeRanges[m_vbID].count() > 0)
+	{
+	  const QVector<NodeRange> &ranges = m_nodeRanges[m_vbID];
+	  for(int i=0; i<ranges.count(); i++)
+	    {
+	      if (ranges[i].start >= m_vbPoints)
+		break;
+	      qint64 npts = qMin(ranges[i].npts, m_vbPoints-ranges[i].start);
+	      glUniform4fv(m_depthParm[26], 1, ranges[i].corner);
+	      glUniform1f(m_depthParm[27], ranges[i].offset);
+	      glDrawArraysInstanced(GL_POINTS, ranges[i].start, npts, m_eyeInstances);
+	    }
+	}
+      else
+	{
+	  glUniform4f(m_depthParm[26], 0, 0, 0, 0); // walk from tile root
+	  glUniform1f(m_depthParm[27], 0);
+	  glDrawArraysInstanced(GL_POINTS, 0, m_vbPoints, m_eyeInstances);  
+	}
+
+      glDisableVertexAttribArray(0);
+      glDisableVertexAttribArray(1);
     }
 
   //glFinish();
 }
 
+//--------------------------------------------
+// map pass, the coarse levels of all tiles in their own
+// buffer, fixed point size so no octree walk is needed
+//--------------------------------------------
+void
+Viewer::drawMapVAO()
+{
+  glBindVertexArray(m_vertexArrayID);
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_mapVertexBuffer);
+
+  if (m_dpv < 5)
+    {
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0,  // attribute 0
+			    m_dpv,  // size
+			    GL_FLOAT, // type
+			    GL_FALSE, // normalized
+			    0, // stride
+			    (void*)0 ); // array buffer offset
+
+      glDrawArrays(GL_POINTS, 0, m_mapVbPoints);
+
+      glDisableVertexAttribArray(0);
+    }
+
+  if (m_dpv == 6) // explicit color
+    {
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0,  // attribute 0
+			    3,  // size
+			    GL_FLOAT, // type
+			    GL_FALSE, // normalized
+			    20, // stride
+			    (void*)0 ); // array buffer offset
+
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1,  // attribute 1
+			    4,  // size
+			    GL_UNSIGNED_SHORT, // type
+			    GL_FALSE, // normalized
+			    20, // stride
+			    (char *)NULL+12 ); // array buffer offset
+
+      glDrawArrays(GL_POINTS, 0, m_mapVbPoints);
+
+      glDisableVertexAttribArray(0);
+      glDisableVertexAttribArray(1);
+    }
+}
+
 void
 Viewer::vboLoaded(int cvp, qint64 npts)
 {
+  TRACE_SCOPE("vboLoaded");
+  TRACE_ARG("vbo", cvp);
+  TRACE_ARG("points", npts);
+
   m_vbID = cvp;
   m_vbPoints = npts;
   m_vboLoadedAll = false;
+  m_visTexPending = true;
 
   if (!m_vrMode ||
       !m_vr.vrEnabled())
@@ -1723,14 +2495,21 @@ Viewer::vboLoaded(int cvp, qint64 npts)
 void
 Viewer::vboLoadedAll(int cvp, qint64 npts)
 {
+  TRACE_SCOPE("vboLoadedAll");
+  TRACE_ARG("vbo", cvp);
+  TRACE_ARG("points", npts);
+
   if (npts > -1)
     {
       m_vbID = cvp;
       m_vbPoints = npts;
+      m_visTexPending = true;
     }
   
   m_vboLoadedAll = true;
 
+  m_budgetControl.nodesLoaded();
+
   if (!m_vrMode ||
       !m_vr.vrEnabled())
     {
@@ -1755,8 +2534,16 @@ Viewer::meshLoadedAll()
 }
 
 void
-Viewer::generateFirstImage()
+Viewer::generateFirstImage(int step)
 {
+  FrameTimerScope frameTimer(FrameTimer::Map);
+
+  // No Shadows, fixed point size - the visibility texture
+  // belongs to the view selection and would shrink points
+  // of coarse nodes that have visible children
+  if (!useDepthShader(0, 0, 0))
+    return;
+
   //-------------------
     m_vr.bindMapBuffer();
   //-------------------
@@ -1807,9 +2594,6 @@ Viewer::generateFirstImage()
   glBindTexture(GL_TEXTURE_RECTANGLE, m_visibilityTex); // octree visibility
 
 //--------------------------------------------
-  // No Shadows
-  glUseProgram(m_depthShader);
-
   // currently using fixed pointsize only
   glUniformMatrix4fv(m_depthParm[0], 1, GL_FALSE, mv);
 
@@ -1837,22 +2621,20 @@ Viewer::generateFirstImage()
   glUniform1i(m_depthParm[11], 2); // tile min max
   glUniform1i(m_depthParm[12], 3); // octree visibility
 
-  glUniform1i(m_depthParm[13], 1); // adaptive pointsize
-  
-  glUniform1i(m_depthParm[14], 0); // no shadows
-  
   glUniform1f(m_depthParm[15], camera()->zFar()); // zfar
   
-  glUniform1f(m_depthParm[16], 1); // min point size
+  // larger points close the gaps left by the missing finer levels
+  glUniform1f(m_depthParm[16], 3); // min point size
   glUniform1f(m_depthParm[17], 15); // max point size
 
   glUniform1f(m_depthParm[18], -1); // deadRadius
   glUniform3f(m_depthParm[19], -1000, -1000, -1000); // deadPoint
 
-  glUniform1i(m_depthParm[20], 0); // applyXform
 
 
-  drawVAO();
+  // coarse levels of all tiles, loaded apart from the
+  // view selection so the map is the same from anywhere
+  drawMapVAO();
   
   
   glUseProgram(0);
@@ -1870,10 +2652,9 @@ Viewer::generateFirstImage()
   glDisable(GL_TEXTURE_1D);
 
   //----------
-  m_vr.menuImageFromMapBuffer();
+  // read back asynchronously, labels follow once it arrives
+  m_vr.menuImageFromMapBuffer(step);
   //----------
-
-  stickLabelsToGround();
 }
 
 //--------------------------------------------
@@ -1885,6 +2666,10 @@ Viewer::drawPointsWithShadows(vr::Hmd_Eye eye)
   if (!m_showPoints || m_vbPoints <= 0)
     return;
 
+  // variant missing when its shader did not build
+  if (!useDepthShader(m_pointType, 1, 0))
+    return;
+
   glEnable(GL_DEPTH_TEST);
 
 
@@ -1895,6 +2680,9 @@ Viewer::drawPointsWithShadows(vr::Hmd_Eye eye)
   float slope = qTan(fov/2);
   float projFactor = (0.5*ht)/slope;
   float scaleFactor = m_vr.scaleFactor();
+
+  int swd = qMax(1, qRound(wd*m_renderScale));
+  int sht = qMax(1, qRound(ht*m_renderScale));
   //--------------------
 
   glEnable(GL_PROGRAM_POINT_SIZE );
@@ -1927,6 +2715,8 @@ Viewer::drawPointsWithShadows(vr::Hmd_Eye eye)
   glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer[m_vbID]);
 
 
+  FrameTimer::beginGpu(FrameTimer::DepthPass);
+
   glBindFramebuffer(GL_FRAMEBUFFER, m_depthBuffer);
   glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
 			 GL_COLOR_ATTACHMENT0,
@@ -1944,19 +2734,302 @@ Viewer::drawPointsWithShadows(vr::Hmd_Eye eye)
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glUseProgram(m_depthShader);
+  // point passes at the adaptive render scale,
+  // the shadow pass upscales into the eye buffer
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glViewport(0, 0, swd, sht);
 
   glUniformMatrix4fv(m_depthParm[0], 1, GL_FALSE, mv.data());
 
-  glUniformMatrix4fv(m_depthParm[1], 1, GL_FALSE, mvp.data());
+  glUniformMatrix4fv(m_depthParm[1], 1, GL_FALSE, mvp.data());
+
+
+  glUniform1f(m_depthParm[2], m_vr.pointSize()*(m_pointType ? 1.0f : m_renderScale));
+
+  Vec eyepos = Vec(m_hmdPos.x(),m_hmdPos.y(),m_hmdPos.z());
+  Vec viewDir = Vec(m_hmdVD.x(),m_hmdVD.y(),m_hmdVD.z());
+  Vec rightVec = Vec(m_hmdRV.x(),m_hmdRV.y(),m_hmdRV.z());
+
+
+  glUniform3f(m_depthParm[3], eyepos.x, eyepos.y, eyepos.z); // eyepos
+  glUniform3f(m_depthParm[4], viewDir.x, viewDir.y, viewDir.z); // viewDir
+
+  glUniform1f(m_depthParm[5], scaleFactor);
+
+  glUniform1i(m_depthParm[7], 0); // color texture
+
+  glUniform3f(m_depthParm[8], viewDir.x, viewDir.y, viewDir.z); // viewDir
+  glUniform1i(m_depthParm[9], swd); // screenWidth
+
+  glUniform1f(m_depthParm[10], projFactor*m_renderScale);
+
+  glUniform1i(m_depthParm[11], 2); // tile min max
+  glUniform1i(m_depthParm[12], 3); // octree visibility
+
+
+  
+  glUniform1f(m_depthParm[15], camera()->zFar()); // zfar
+
+  glUniform1f(m_depthParm[16], 2); // max point size
+  glUniform1f(m_depthParm[17], 20); // max point size
+
+  glUniform1f(m_depthParm[18], m_vr.deadRadius());
+  QVector3D deadPt = m_vr.deadPoint();
+  glUniform3f(m_depthParm[19], deadPt.x(), deadPt.y(), deadPt.z());
+
+
+
+
+  drawVAO();
+
+  glActiveTexture(GL_TEXTURE2);
+  glDisable(GL_TEXTURE_RECTANGLE);
+  
+  glActiveTexture(GL_TEXTURE3);
+  glDisable(GL_TEXTURE_RECTANGLE);
+  
+  glActiveTexture(GL_TEXTURE0);
+  glDisable(GL_TEXTURE_1D);
+
+  glUseProgram(0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  FrameTimer::endGpu(FrameTimer::DepthPass);
+
+//--------------------------------------------
+
+////--------------------------------------------
+//  glBindFramebuffer(GL_FRAMEBUFFER, m_depthBuffer);
+//  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
+//			 GL_COLOR_ATTACHMENT0,
+//			 GL_TEXTURE_RECTANGLE,
+//			 m_depthTex[2],
+//			 0);
+//  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
+//			 GL_COLOR_ATTACHMENT1,
+//			 GL_TEXTURE_RECTANGLE,
+//			 m_depthTex[3],
+//			 0);
+//  glDrawBuffersARB(2, buffers);
+//
+//  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+//
+//  glUseProgram(m_smoothShader);
+//
+//  glActiveTexture(GL_TEXTURE0);
+//  glEnable(GL_TEXTURE_RECTANGLE);
+//  glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[0]); // colors
+//
+//  glActiveTexture(GL_TEXTURE1);
+//  glEnable(GL_TEXTURE_RECTANGLE);
+//  glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[1]); // depth
+//
+//
+//  mvp.setToIdentity();
+//  mvp.ortho(0.0, wd, 0.0, ht, 0.0, 1.0);
+//
+//  glUniformMatrix4fv(m_smoothParm[0], 1, GL_FALSE, mvp.data());
+//
+//  glUniform1i(m_smoothParm[1], 0); // colors
+//  glUniform1i(m_smoothParm[2], 1); // depthTex1
+//
+//  glEnableVertexAttribArray(0);
+//  glBindBuffer(GL_ARRAY_BUFFER, m_vertexScreenBuffer);
+//  glVertexAttribPointer(0,  // attribute 0
+//			2,  // size
+//			GL_FLOAT, // type
+//			GL_FALSE, // normalized
+//			0, // stride
+//			(void*)0 ); // array buffer offset
+//  glDrawArrays(GL_QUADS, 0, 8);
+//
+//  glDisableVertexAttribArray(0);
+//
+//  glActiveTexture(GL_TEXTURE1);
+//  glDisable(GL_TEXTURE_RECTANGLE);
+//
+//  glActiveTexture(GL_TEXTURE0);
+//  glDisable(GL_TEXTURE_RECTANGLE);
+//
+//  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+////--------------------------------------------
+
+
+//--------------------------------------------
+//--------------------------------------------
+  // depth pyramid for culling nodes in the next selection,
+  // the left eye stands in for both
+  if (eye == vr::Eye_Left)
+    {
+      FrameTimer::beginGpu(FrameTimer::HiZ);
+      m_hiZMap.build(m_depthTex[1], false, swd, sht,
+		     mvp, eyepos, viewDir);
+      FrameTimer::endGpu(FrameTimer::HiZ);
+    }
+
+  FrameTimer::beginGpu(FrameTimer::ShadowPass);
+
+  glActiveTexture(GL_TEXTURE0);
+  glEnable(GL_TEXTURE_RECTANGLE);
+  glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[0]); // colors
+
+  glActiveTexture(GL_TEXTURE1);
+  glEnable(GL_TEXTURE_RECTANGLE);
+  glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[1]); // depth
+
+  bool upsample = lowResShadows(false, m_vr.edges() || m_vr.softShadows());
+  if (upsample)
+    drawLowResShadows(false, 0, wd, ht,
+		      m_vr.edges(), m_vr.softShadows(), 1, 0);
+
+  m_vr.bindBuffer(eye);
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+
+//--------------------------------------------
+  GLint *shadowParm = useShadowShader(false, upsample, m_renderScale);
+
+
+  mvp.setToIdentity();
+  mvp.ortho(0.0, wd, 0.0, ht, 0.0, 1.0);
+
+  glUniformMatrix4fv(shadowParm[0], 1, GL_FALSE, mvp.data());
+
+  glUniform1i(shadowParm[1], 0); // colors
+  glUniform1i(shadowParm[2], 1); // depthTex1
+
+  glUniform1i(shadowParm[3], m_vr.edges()); // showedges
+  glUniform1i(shadowParm[4], m_vr.softShadows()); // softShadows
+
+  glUniform1f(shadowParm[5], 1);
+  glUniform1f(shadowParm[6], 0);
+
+  glUniform1i(shadowParm[7], m_vr.spheres());
+
+  glUniform1i(shadowParm[8], false); // copyOnly false
+
+  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexScreenBuffer);
+  glVertexAttribPointer(0,  // attribute 0
+			2,  // size
+			GL_FLOAT, // type
+			GL_FALSE, // normalized
+			0, // stride
+			(void*)0 ); // array buffer offset
+  glDrawArrays(GL_QUADS, 0, 8);
+
+  glDisableVertexAttribArray(0);
+
+  glActiveTexture(GL_TEXTURE1);
+  glDisable(GL_TEXTURE_RECTANGLE);
+
+  glActiveTexture(GL_TEXTURE0);
+  glDisable(GL_TEXTURE_RECTANGLE);
+
+//--------------------------------------------
+//--------------------------------------------
+
+  glUseProgram(0);
+
+  FrameTimer::endGpu(FrameTimer::ShadowPass);
+
+  glDisable(GL_PROGRAM_POINT_SIZE );
+  glDisable(GL_POINT_SPRITE);
+  //glDisable(GL_TEXTURE_2D);
+}
+
+//--------------------------------------------
+// both eyes in one pass - the depth pass draws each point once per
+// eye instance into a 2 layer target, all textures and uniforms are
+// set once and the eye matrices come from a uniform block.
+// The shadow pass is then set up once and run for each eye layer
+// into that eye's (multisampled) VR buffer.
+//--------------------------------------------
+void
+Viewer::drawPointsStereo()
+{
+  if (!m_showPoints || m_vbPoints <= 0)
+    return;
+
+  if (!useDepthShader(m_pointType, 1, 0, true))
+    return;
+
+  glEnable(GL_DEPTH_TEST);
+
+  int wd = m_vr.screenWidth();
+  int ht = m_vr.screenHeight();
+
+  float fov = qDegreesToRadians(110.0); // FOV is 110 degrees for HTC Vive
+  float slope = qTan(fov/2);
+  float projFactor = (0.5*ht)/slope;
+  float scaleFactor = m_vr.scaleFactor();
+
+  int swd = qMax(1, qRound(wd*m_renderScale));
+  int sht = qMax(1, qRound(ht*m_renderScale));
+  //--------------------
+
+  glEnable(GL_PROGRAM_POINT_SIZE );
+  glEnable(GL_POINT_SPRITE);
+
+  //--------------------
+  // eyeMV[2] followed by eyeMVP[2]
+  QMatrix4x4 eyeMat[4];
+  eyeMat[0] = m_vr.modelView(vr::Eye_Left);
+  eyeMat[1] = m_vr.modelView(vr::Eye_Right);
+  eyeMat[2] = m_vr.viewProjection(vr::Eye_Left);
+  eyeMat[3] = m_vr.viewProjection(vr::Eye_Right);
+
+  glBindBuffer(GL_UNIFORM_BUFFER, m_stereoUBO);
+  for(int i=0; i<4; i++)
+    glBufferSubData(GL_UNIFORM_BUFFER,
+		    i*16*sizeof(float),
+		    16*sizeof(float),
+		    eyeMat[i].constData());
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, 1, m_stereoUBO);
+  //--------------------
+
+  glActiveTexture(GL_TEXTURE0);
+  glEnable(GL_TEXTURE_1D);
+  glBindTexture(GL_TEXTURE_1D, m_colorTex); // colors
+
+  glActiveTexture(GL_TEXTURE2);
+  glEnable(GL_TEXTURE_RECTANGLE);
+  glBindTexture(GL_TEXTURE_RECTANGLE, m_minmaxTex); // tile min max
+
+  glActiveTexture(GL_TEXTURE3);
+  glEnable(GL_TEXTURE_RECTANGLE);
+  glBindTexture(GL_TEXTURE_RECTANGLE, m_visibilityTex); // octree visibility
+  
+
+  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer[m_vbID]);
+
+
+  FrameTimer::beginGpu(FrameTimer::DepthPass);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_stereoBuffer);
+  GLenum buffers[2] = { GL_COLOR_ATTACHMENT0_EXT,
+			GL_COLOR_ATTACHMENT1_EXT };
+  glDrawBuffersARB(2, buffers);
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // both layers
 
+  // point passes at the adaptive render scale,
+  // the shadow pass upscales into the eye buffers
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glViewport(0, 0, swd, sht);
 
-  glUniform1f(m_depthParm[2], m_vr.pointSize());
+  glUniform1f(m_depthParm[2], m_vr.pointSize()*(m_pointType ? 1.0f : m_renderScale));
 
   Vec eyepos = Vec(m_hmdPos.x(),m_hmdPos.y(),m_hmdPos.z());
   Vec viewDir = Vec(m_hmdVD.x(),m_hmdVD.y(),m_hmdVD.z());
-  Vec rightVec = Vec(m_hmdRV.x(),m_hmdRV.y(),m_hmdRV.z());
-
 
   glUniform3f(m_depthParm[3], eyepos.x, eyepos.y, eyepos.z); // eyepos
   glUniform3f(m_depthParm[4], viewDir.x, viewDir.y, viewDir.z); // viewDir
@@ -1966,17 +3039,13 @@ Viewer::drawPointsWithShadows(vr::Hmd_Eye eye)
   glUniform1i(m_depthParm[7], 0); // color texture
 
   glUniform3f(m_depthParm[8], viewDir.x, viewDir.y, viewDir.z); // viewDir
-  glUniform1i(m_depthParm[9], wd); // screenWidth
+  glUniform1i(m_depthParm[9], swd); // screenWidth
 
-  glUniform1f(m_depthParm[10], projFactor);
+  glUniform1f(m_depthParm[10], projFactor*m_renderScale);
 
   glUniform1i(m_depthParm[11], 2); // tile min max
   glUniform1i(m_depthParm[12], 3); // octree visibility
 
-  glUniform1i(m_depthParm[13], m_pointType); // pointsize calculation
-
-  glUniform1i(m_depthParm[14], 1); // shadows
-  
   glUniform1f(m_depthParm[15], camera()->zFar()); // zfar
 
   glUniform1f(m_depthParm[16], 2); // max point size
@@ -1986,11 +3055,9 @@ Viewer::drawPointsWithShadows(vr::Hmd_Eye eye)
   QVector3D deadPt = m_vr.deadPoint();
   glUniform3f(m_depthParm[19], deadPt.x(), deadPt.y(), deadPt.z());
 
-
-  glUniform1i(m_depthParm[20], 0); // applyXform
-
-
+  m_eyeInstances = 2;
   drawVAO();
+  m_eyeInstances = 1;
 
   glActiveTexture(GL_TEXTURE2);
   glDisable(GL_TEXTURE_RECTANGLE);
@@ -2005,101 +3072,47 @@ Viewer::drawPointsWithShadows(vr::Hmd_Eye eye)
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-//--------------------------------------------
-
-////--------------------------------------------
-//  glBindFramebuffer(GL_FRAMEBUFFER, m_depthBuffer);
-//  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
-//			 GL_COLOR_ATTACHMENT0,
-//			 GL_TEXTURE_RECTANGLE,
-//			 m_depthTex[2],
-//			 0);
-//  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
-//			 GL_COLOR_ATTACHMENT1,
-//			 GL_TEXTURE_RECTANGLE,
-//			 m_depthTex[3],
-//			 0);
-//  glDrawBuffersARB(2, buffers);
-//
-//  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-//
-//  glUseProgram(m_smoothShader);
-//
-//  glActiveTexture(GL_TEXTURE0);
-//  glEnable(GL_TEXTURE_RECTANGLE);
-//  glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[0]); // colors
-//
-//  glActiveTexture(GL_TEXTURE1);
-//  glEnable(GL_TEXTURE_RECTANGLE);
-//  glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[1]); // depth
-//
-//
-//  mvp.setToIdentity();
-//  mvp.ortho(0.0, wd, 0.0, ht, 0.0, 1.0);
-//
-//  glUniformMatrix4fv(m_smoothParm[0], 1, GL_FALSE, mvp.data());
-//
-//  glUniform1i(m_smoothParm[1], 0); // colors
-//  glUniform1i(m_smoothParm[2], 1); // depthTex1
-//
-//  glEnableVertexAttribArray(0);
-//  glBindBuffer(GL_ARRAY_BUFFER, m_vertexScreenBuffer);
-//  glVertexAttribPointer(0,  // attribute 0
-//			2,  // size
-//			GL_FLOAT, // type
-//			GL_FALSE, // normalized
-//			0, // stride
-//			(void*)0 ); // array buffer offset
-//  glDrawArrays(GL_QUADS, 0, 8);
-//
-//  glDisableVertexAttribArray(0);
-//
-//  glActiveTexture(GL_TEXTURE1);
-//  glDisable(GL_TEXTURE_RECTANGLE);
-//
-//  glActiveTexture(GL_TEXTURE0);
-//  glDisable(GL_TEXTURE_RECTANGLE);
-//
-//  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-////--------------------------------------------
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
 
+  FrameTimer::endGpu(FrameTimer::DepthPass);
 
 //--------------------------------------------
 //--------------------------------------------
-  m_vr.bindBuffer(eye);
-
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // depth pyramid for culling nodes in the next selection,
+  // the left eye stands in for both
+  FrameTimer::beginGpu(FrameTimer::HiZ);
+  m_hiZMap.build(m_stereoTex[1], true, swd, sht,
+		 eyeMat[2], eyepos, viewDir);
+  FrameTimer::endGpu(FrameTimer::HiZ);
 
-
-//--------------------------------------------
-  glUseProgram(m_shadowShader);
+  FrameTimer::beginGpu(FrameTimer::ShadowPass);
 
   glActiveTexture(GL_TEXTURE0);
-  glEnable(GL_TEXTURE_RECTANGLE);
-  glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[0]); // colors
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_stereoTex[0]); // colors
 
   glActiveTexture(GL_TEXTURE1);
-  glEnable(GL_TEXTURE_RECTANGLE);
-  glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[1]); // depth
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_stereoTex[1]); // depth
 
+  bool upsample = lowResShadows(true, m_vr.edges() || m_vr.softShadows());
+  GLint *shadowParm = useShadowShader(true, upsample, m_renderScale);
 
-  mvp.setToIdentity();
+  QMatrix4x4 mvp;
   mvp.ortho(0.0, wd, 0.0, ht, 0.0, 1.0);
 
-  glUniformMatrix4fv(m_shadowParm[0], 1, GL_FALSE, mvp.data());
+  glUniformMatrix4fv(shadowParm[0], 1, GL_FALSE, mvp.data());
 
-  glUniform1i(m_shadowParm[1], 0); // colors
-  glUniform1i(m_shadowParm[2], 1); // depthTex1
+  glUniform1i(shadowParm[1], 0); // colors
+  glUniform1i(shadowParm[2], 1); // depthTex1
 
-  glUniform1i(m_shadowParm[3], m_vr.edges()); // showedges
-  glUniform1i(m_shadowParm[4], m_vr.softShadows()); // softShadows
+  glUniform1i(shadowParm[3], m_vr.edges()); // showedges
+  glUniform1i(shadowParm[4], m_vr.softShadows()); // softShadows
 
-  glUniform1f(m_shadowParm[5], 1);
-  glUniform1f(m_shadowParm[6], 0);
+  glUniform1f(shadowParm[5], 1);
+  glUniform1f(shadowParm[6], 0);
 
-  glUniform1i(m_shadowParm[7], m_vr.spheres());
+  glUniform1i(shadowParm[7], m_vr.spheres());
 
-  glUniform1i(m_shadowParm[8], false); // copyOnly false
+  glUniform1i(shadowParm[8], false); // copyOnly false
 
   glEnableVertexAttribArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, m_vertexScreenBuffer);
@@ -2109,24 +3122,41 @@ Viewer::drawPointsWithShadows(vr::Hmd_Eye eye)
 			GL_FALSE, // normalized
 			0, // stride
 			(void*)0 ); // array buffer offset
-  glDrawArrays(GL_QUADS, 0, 8);
+
+  for(int e=0; e<2; e++)
+    {
+      if (upsample)
+	{
+	  drawLowResShadows(true, e, wd, ht,
+			    m_vr.edges(), m_vr.softShadows(), 1, 0);
+	  useShadowShader(true, true, m_renderScale);
+	}
+
+      m_vr.bindBuffer(e == 0 ? vr::Eye_Left : vr::Eye_Right);
+
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      glUniform1i(shadowParm[9], e); // eye layer
+      glDrawArrays(GL_QUADS, 0, 8);
+    }
 
   glDisableVertexAttribArray(0);
 
   glActiveTexture(GL_TEXTURE1);
-  glDisable(GL_TEXTURE_RECTANGLE);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
   glActiveTexture(GL_TEXTURE0);
-  glDisable(GL_TEXTURE_RECTANGLE);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
 //--------------------------------------------
 //--------------------------------------------
 
   glUseProgram(0);
 
+  FrameTimer::endGpu(FrameTimer::ShadowPass);
+
   glDisable(GL_PROGRAM_POINT_SIZE );
   glDisable(GL_POINT_SPRITE);
-  //glDisable(GL_TEXTURE_2D);
 }
 
 void
@@ -2135,6 +3165,10 @@ Viewer::drawPoints(vr::Hmd_Eye eye)
   if (!m_showPoints || m_vbPoints <= 0)
     return;
 
+  // No Shadows
+  if (!useDepthShader(m_pointType, 0, 0))
+    return;
+
   glEnable(GL_DEPTH_TEST);
 
   //--------------------
@@ -2178,9 +3212,6 @@ Viewer::drawPoints(vr::Hmd_Eye eye)
   glBindTexture(GL_TEXTURE_RECTANGLE, m_visibilityTex); // octree visibility
 
 //--------------------------------------------
-  // No Shadows
-  glUseProgram(m_depthShader);
-
   // currently using fixed pointsize only
   glUniformMatrix4fv(m_depthParm[0], 1, GL_FALSE, mv.data());
 
@@ -2210,10 +3241,6 @@ Viewer::drawPoints(vr::Hmd_Eye eye)
   glUniform1i(m_depthParm[11], 2); // tile min max
   glUniform1i(m_depthParm[12], 3); // octree visibility
 
-  glUniform1i(m_depthParm[13], m_pointType); // pointsize calculation
-  
-  glUniform1i(m_depthParm[14], 0); // no shadows
-  
   glUniform1f(m_depthParm[15], camera()->zFar()); // zfar
   
   glUniform1f(m_depthParm[16], 2); // max point size
@@ -2224,7 +3251,6 @@ Viewer::drawPoints(vr::Hmd_Eye eye)
   glUniform3f(m_depthParm[19], deadPt.x(), deadPt.y(), deadPt.z());
 
 
-  glUniform1i(m_depthParm[20], 0); // applyXform
 
 
   drawVAO();
@@ -2248,6 +3274,8 @@ Viewer::drawPoints(vr::Hmd_Eye eye)
 void
 Viewer::drawTrisets(vr::Hmd_Eye eye)
 {
+  FrameTimer::beginGpu(FrameTimer::Trisets);
+
   glEnable(GL_DEPTH_TEST);
 
   // model-view-projection matrix
@@ -2321,6 +3349,7 @@ Viewer::drawTrisets(vr::Hmd_Eye eye)
 //--------------------------------------------
 //--------------------------------------------
   glUseProgram(m_shadowShader);
+  glUniform1f(m_shadowParm[13], 1.0f); // trisets are full resolution
 
   glActiveTexture(GL_TEXTURE0);
   glEnable(GL_TEXTURE_RECTANGLE);
@@ -2372,11 +3401,14 @@ Viewer::drawTrisets(vr::Hmd_Eye eye)
 //--------------------------------------------
 
   glUseProgram(0);
+
+  FrameTimer::endGpu(FrameTimer::Trisets);
 }
 
 void
 Viewer::drawTrisets()
 {
+  FrameTimer::beginGpu(FrameTimer::Trisets);
   glEnable(GL_DEPTH_TEST);
 
   // model-view-projection matrix
@@ -2448,6 +3480,8 @@ Viewer::drawTrisets()
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  FrameTimer::endGpu(FrameTimer::Trisets);
+
   if (m_selectActive)
     return;
 //--------------------------------------------
@@ -2458,6 +3492,7 @@ Viewer::drawTrisets()
 //--------------------------------------------
 //--------------------------------------------
   glUseProgram(m_shadowShader);
+  glUniform1f(m_shadowParm[13], 1.0f); // trisets are full resolution
 
   glActiveTexture(GL_TEXTURE0);
   glEnable(GL_TEXTURE_RECTANGLE);
@@ -2520,6 +3555,9 @@ Viewer::drawPointsWithReload()
   if (!m_showPoints || m_vbPoints <= 0)
     return;
 
+  if (!useDepthShader(m_pointType, !m_selectActive, m_editMode))
+    return;
+
   glEnable(GL_DEPTH_TEST);
 
 
@@ -2569,6 +3607,8 @@ Viewer::drawPointsWithReload()
   glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer[m_vbID]);
 
 
+  FrameTimer::beginGpu(FrameTimer::DepthPass);
+
   if (!m_selectActive)
     {
       glBindFramebuffer(GL_FRAMEBUFFER, m_depthBuffer);
@@ -2589,8 +3629,6 @@ Viewer::drawPointsWithReload()
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glUseProgram(m_depthShader);
-
   glUniformMatrix4fv(m_depthParm[0], 1, GL_FALSE, mv);
 
   glUniformMatrix4fv(m_depthParm[1], 1, GL_FALSE, mvp);
@@ -2616,12 +3654,7 @@ Viewer::drawPointsWithReload()
   glUniform1i(m_depthParm[11], 2); // tile min max
   glUniform1i(m_depthParm[12], 3); // octree visibility
 
-  glUniform1i(m_depthParm[13], m_pointType); // pointsize calculation
 
-  if (m_selectActive)
-    glUniform1i(m_depthParm[14], 0); // no shadows
-  else
-    glUniform1i(m_depthParm[14], 1); // shadows
   
   glUniform1f(m_depthParm[15], camera()->zFar()); // zfar
 
@@ -2632,7 +3665,6 @@ Viewer::drawPointsWithReload()
   glUniform3f(m_depthParm[19], -1000, -1000, -1000); // deadPoint
 
 
-  glUniform1i(m_depthParm[20], m_editMode); // applyXform
   if (m_editMode)
     {
       Vec shift = m_deltaShift - m_pointClouds[1]->globalMin();      
@@ -2660,6 +3692,8 @@ Viewer::drawPointsWithReload()
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  FrameTimer::endGpu(FrameTimer::DepthPass);
+
   if (m_selectActive)
     {
       glDisable(GL_PROGRAM_POINT_SIZE );
@@ -2680,11 +3714,22 @@ Viewer::drawPointsWithReload()
 
 //--------------------------------------------
 //--------------------------------------------
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // depth pyramid for culling nodes in the next selection,
+  // node boxes do not follow the edit transform
+  if (!m_editMode)
+    {
+      QMatrix4x4 viewProj;
+      memcpy(viewProj.data(), mvp, 16*sizeof(float));
 
+      FrameTimer::beginGpu(FrameTimer::HiZ);
+      m_hiZMap.build(m_depthTex[1], false, wd, ht,
+		     viewProj, eyepos, viewDir);
+      FrameTimer::endGpu(FrameTimer::HiZ);
+    }
+  else
+    m_hiZMap.clear();
 
-//--------------------------------------------
-  glUseProgram(m_shadowShader);
+  FrameTimer::beginGpu(FrameTimer::ShadowPass);
 
   glActiveTexture(GL_TEXTURE0);
   glEnable(GL_TEXTURE_RECTANGLE);
@@ -2694,25 +3739,36 @@ Viewer::drawPointsWithReload()
   glEnable(GL_TEXTURE_RECTANGLE);
   glBindTexture(GL_TEXTURE_RECTANGLE, m_depthTex[1]); // depth
 
+  bool upsample = lowResShadows(false, m_showEdges || m_softShadows);
+  if (upsample)
+    drawLowResShadows(false, 0, wd, ht,
+		      m_showEdges, m_softShadows, m_nearDist, m_farDist);
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+
+//--------------------------------------------
+  GLint *shadowParm = useShadowShader(false, upsample);
+
 
   QMatrix4x4 mvp4x4;
   mvp4x4.setToIdentity();
   mvp4x4.ortho(0.0, wd, 0.0, ht, 0.0, 1.0);
 
-  glUniformMatrix4fv(m_shadowParm[0], 1, GL_FALSE, mvp4x4.data());
+  glUniformMatrix4fv(shadowParm[0], 1, GL_FALSE, mvp4x4.data());
 
-  glUniform1i(m_shadowParm[1], 0); // colors
-  glUniform1i(m_shadowParm[2], 1); // depthTex1
+  glUniform1i(shadowParm[1], 0); // colors
+  glUniform1i(shadowParm[2], 1); // depthTex1
 
-  glUniform1i(m_shadowParm[3], m_showEdges); // showedges
-  glUniform1i(m_shadowParm[4], m_softShadows); // softShadows
+  glUniform1i(shadowParm[3], m_showEdges); // showedges
+  glUniform1i(shadowParm[4], m_softShadows); // softShadows
 
-  glUniform1f(m_shadowParm[5], m_nearDist);
-  glUniform1f(m_shadowParm[6], m_farDist);
+  glUniform1f(shadowParm[5], m_nearDist);
+  glUniform1f(shadowParm[6], m_farDist);
 
-  glUniform1i(m_shadowParm[7], m_showSphere);
+  glUniform1i(shadowParm[7], m_showSphere);
 
-  glUniform1i(m_shadowParm[8], false); // copyOnly false
+  glUniform1i(shadowParm[8], false); // copyOnly false
 
   glEnableVertexAttribArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, m_vertexScreenBuffer);
@@ -2737,6 +3793,8 @@ Viewer::drawPointsWithReload()
 
   glUseProgram(0);
 
+  FrameTimer::endGpu(FrameTimer::ShadowPass);
+
   //glDisable(GL_PROGRAM_POINT_SIZE );
   glDisable(GL_POINT_SPRITE);
   //glDisable(GL_TEXTURE_2D);
@@ -2746,6 +3804,9 @@ Viewer::drawPointsWithReload()
 void
 Viewer::drawLabels()
 {
+  FrameTimerScope frameTimer(FrameTimer::Labels);
+  FrameTimer::beginGpu(FrameTimer::LabelsGpu);
+
   QMatrix4x4 mvp;
   GLdouble m[16];
   camera()->getModelViewProjectionMatrix(m);
@@ -2780,6 +3841,8 @@ Viewer::drawLabels()
 				     QVector3D(-1,-1,-1));
     }
 
+  FrameTimer::endGpu(FrameTimer::LabelsGpu);
+
 //  glDisable(GL_DEPTH_TEST);
 //
 //  startScreenCoordinatesSystem();
@@ -2798,6 +3861,9 @@ Viewer::drawLabels()
 void
 Viewer::drawLabelsForVR(vr::Hmd_Eye eye)
 {
+  FrameTimerScope frameTimer(FrameTimer::Labels);
+  FrameTimer::beginGpu(FrameTimer::LabelsGpu);
+
 //  glDepthMask(GL_FALSE); // enable writing to depth buffer
 //  glDisable(GL_DEPTH_TEST);
 //
@@ -2825,7 +3891,8 @@ Viewer::drawLabelsForVR(vr::Hmd_Eye eye)
     {
       if (m_pointClouds[d]->visible())
 	{
-	  bool gotHit = m_pointClouds[d]->findNearestLabelHit(matR,
+	  bool gotHit = m_pointClouds[d]->findNearestLabelHit(cpos,
+							      matR,
 							      finalxformInv,
 							      m_vr.deadRadius(),
 							      m_vr.deadPoint());
@@ -2852,6 +3919,8 @@ Viewer::drawLabelsForVR(vr::Hmd_Eye eye)
 //
 //  glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  FrameTimer::endGpu(FrameTimer::LabelsGpu);
+
   return;
 
 //  //------------------------------
@@ -2912,6 +3981,36 @@ Viewer::stickLabelsToGround()
     }
 }
 
+//--------------------------------------------
+// maps on disk are only reused for the same data, placed
+// the same way and seen through the same map camera
+//--------------------------------------------
+QString
+Viewer::mapCacheKey()
+{
+  QString key = QString("%1 %2 %3 %4").arg(m_vr.screenWidth()).\
+    arg(m_vr.screenHeight()).\
+    arg(MAP_MAX_LEVEL).\
+    arg(MAP_POINT_BUDGET);
+  key += QString(" %1 %2 %3").arg(m_coordMin.x).arg(m_coordMin.y).arg(m_coordMin.z);
+  key += QString(" %1 %2 %3").arg(m_coordMax.x).arg(m_coordMax.y).arg(m_coordMax.z);
+  for(int d=0; d<m_pointClouds.count(); d++)
+    {
+      PointCloud *pc = m_pointClouds[d];
+      Vec shift = pc->getShift();
+      Vec cen = pc->getXformCen();
+      Quaternion rot = pc->getRotation();
+      key += " " + pc->name();
+      key += QString(" %1").arg(pc->getScale());
+      key += QString(" %1 %2 %3").arg(shift.x).arg(shift.y).arg(shift.z);
+      key += QString(" %1 %2 %3").arg(cen.x).arg(cen.y).arg(cen.z);
+      key += QString(" %1 %2 %3 %4").arg(rot[0]).arg(rot[1]).arg(rot[2]).arg(rot[3]);
+    }
+
+  QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5);
+  return QString(hash.toHex().left(16));
+}
+
 void
 Viewer::drawPointPairs()
 {
@@ -3217,6 +4316,8 @@ Viewer::genTrisetsList()
 void
 Viewer::genDrawNodeList()
 {
+  TRACE_SCOPE("genDrawNodeList");
+
   genTrisetsList();
 
   
@@ -3225,6 +4326,9 @@ Viewer::genDrawNodeList()
 
   QList<OctreeNode*> oldLoadNodes = m_loadNodes;
 
+  QElapsedTimer selectTimer;
+  selectTimer.start();
+
   orderTilesForCamera();
   
 
@@ -3232,12 +4336,18 @@ Viewer::genDrawNodeList()
     {
       QList<OctreeNode*> allNodes = m_pointClouds[d]->allNodes();
       for(int od=0; od<allNodes.count(); od++)
-	allNodes[od]->setActive(false);
+	{
+	  allNodes[od]->setActive(false);
+	  allNodes[od]->setPointLimit(-1);
+	}
     }
 
   m_pointsDrawn = 0;
   m_loadNodes.clear();
 
+  // nodes hidden in the last frame are not refined
+  m_occlusionTest = m_hiZMap.test();
+
 
   int nsteps = 4;
   float cfrc[4] = {1.0, 0.8, 0.6, 0.4};
@@ -3255,7 +4365,7 @@ Viewer::genDrawNodeList()
 
       // change camera frustum only if enough points have been
       // collected in this round
-      if (m_pointsDrawn > m_pointBudget*0.1*(i+1))
+      if (m_pointsDrawn > drawBudget()*0.1*(i+1))
 	fid ++;
     }  
 
@@ -3301,12 +4411,20 @@ Viewer::genDrawNodeList()
 	}
     }
   //-------------------------------
+
+  FrameTimer::addCpuTime(FrameTimer::SelectNodes,
+			 selectTimer.nsecsElapsed()*1e-6);
   
   m_volume->setLoadingNodes(m_loadNodes);
 
+  TRACE_ARG("nodes", m_loadNodes.count());
+
   // multi threaded
   if (m_showPoints)
-    emit loadPointsToVBO();
+    {
+      TRACE_INSTANT("request loadPointsToVBO");
+      emit loadPointsToVBO();
+    }
 
   createVisibilityTexture();
 
@@ -3400,12 +4518,16 @@ Viewer::genDrawNodeList(float mnfrc, float zfar)
 
 	  bool ignoreChildren = (screenProjectedSize < m_minNodePixelSize*mnfrc);
 
+	  if (!ignoreChildren)
+	    ignoreChildren = m_occlusionTest.occluded(node->tightOctreeMin(),
+						      node->tightOctreeMax());
+
 	  if (!ignoreChildren)
 	    onl0 << node;
 	  
 	  if (!node->isActive())
 	    {
-	      if (m_pointsDrawn + node->numpoints() < m_pointBudget)
+	      if (m_pointsDrawn + node->numpoints() < drawBudget())
 		{
 		  m_loadNodes << node;
 		  node->setActive(true);
@@ -3413,6 +4535,7 @@ Viewer::genDrawNodeList(float mnfrc, float zfar)
 		}
 	      else
 		{
+		  addPartialNode(node);
 		  bufferFull = true;
 		  break;
 		}
@@ -3457,6 +4580,10 @@ Viewer::genDrawNodeList(float mnfrc, float zfar)
 										  bmin, bmax,
 										  projFactor);
 		      ignoreChildren = (screenProjectedSize < m_minNodePixelSize*mnfrc);
+
+		      if (!ignoreChildren)
+			ignoreChildren = m_occlusionTest.occluded(cnode->tightOctreeMin(),
+								  cnode->tightOctreeMax());
 		      //--------------------------
 		    }
 		  
@@ -3467,7 +4594,7 @@ Viewer::genDrawNodeList(float mnfrc, float zfar)
 		      
 		      if (!cnode->isActive())
 			{
-			  if (m_pointsDrawn + cnode->numpoints() < m_pointBudget)
+			  if (m_pointsDrawn + cnode->numpoints() < drawBudget())
 			    {
 			      m_loadNodes << cnode;
 			      cnode->setActive(true);
@@ -3475,6 +4602,7 @@ Viewer::genDrawNodeList(float mnfrc, float zfar)
 			    }
 			  else
 			    {
+			      addPartialNode(cnode);
 			      bufferFull = true;
 			      done = true;
 			      break;
@@ -3494,6 +4622,23 @@ Viewer::genDrawNodeList(float mnfrc, float zfar)
   return bufferFull;
 }
 
+//--------------------------------------------
+// points in shuffled nodes are in random order,
+// so draw only as many as fit in the remaining budget
+//--------------------------------------------
+void
+Viewer::addPartialNode(OctreeNode *node)
+{
+  qint64 remaining = drawBudget() - m_pointsDrawn;
+  if (!node->shuffled() || remaining <= 0)
+    return;
+
+  node->setPointLimit(remaining);
+  node->setActive(true);
+  m_loadNodes << node;
+  m_pointsDrawn += remaining;
+}
+
 void
 Viewer::savePointsToFile(Vec newp)
 {
@@ -3507,62 +4652,6 @@ Viewer::savePointsToFile(Vec newp)
 
 }
 
-//void
-//Viewer::createMinMaxTexture()
-//{
-//  if (!m_minmaxTex) glGenTextures(1, &m_minmaxTex);
-//
-//  m_tiles.clear();
-//  for(int d=0; d<m_pointClouds.count(); d++)
-//    m_tiles += m_pointClouds[d]->tiles();
-//
-//
-//  QList<uchar> visibleLevel;
-//  for(int d=0; d<m_pointClouds.count(); d++)
-//    visibleLevel += m_pointClouds[d]->maxLevelVisible();
-//
-//
-//  int ntiles = m_tiles.count();
-//  if (m_minmaxMap) delete [] m_minmaxMap;
-//  m_minmaxMap = new float[8*ntiles];
-//
-//  memset(m_minmaxMap, 0, sizeof(float)*8*ntiles);
-//
-//  for(int i=0; i<ntiles; i++)
-//    {
-//      Vec bmin = m_tiles[i]->bmin();
-//      Vec bmax = m_tiles[i]->bmax();
-//      float spacing = m_tiles[i]->spacing();
-//      float maxLevel = visibleLevel[i];
-//
-//      m_minmaxMap[8*i+0] = bmin.x;
-//      m_minmaxMap[8*i+1] = bmin.y;
-//      m_minmaxMap[8*i+2] = bmin.z;
-//      m_minmaxMap[8*i+3] = spacing;
-//      m_minmaxMap[8*i+4] = bmax.x;
-//      m_minmaxMap[8*i+5] = bmax.y;
-//      m_minmaxMap[8*i+6] = bmax.z;
-//      m_minmaxMap[8*i+7] = maxLevel;
-//    }
-//
-//  GLuint target = GL_TEXTURE_RECTANGLE;
-//  glActiveTexture(GL_TEXTURE2);
-//    glBindTexture(target, m_minmaxTex);
-//  glTexParameterf(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); 
-//  glTexParameterf(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); 
-//  glTexParameterf(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-//  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-//  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-//  glTexImage2D(target,
-//	       0,
-//	       GL_RGBA32F,
-//	       2, ntiles, 
-//	       0,
-//	       GL_RGBA,
-//	       GL_FLOAT,
-//	       m_minmaxMap);  
-//}
-
 void
 Viewer::createMinMaxTexture()
 {
@@ -3615,6 +4704,9 @@ Viewer::createMinMaxTexture()
 void
 Viewer::createVisibilityTexture()
 {
+  TRACE_SCOPE("createVisibilityTexture");
+  FrameTimerScope frameTimer(FrameTimer::VisibilityTexture);
+
   if (!m_visibilityTex) glGenTextures(1, &m_visibilityTex);
 
 
@@ -3622,50 +4714,23 @@ Viewer::createVisibilityTexture()
   for(int d=0; d<m_pointClouds.count(); d++)
     m_pointClouds[d]->updateVisibilityData();
   
-  QList< QList<uchar> > m_vData;
-  m_vData.clear();
-
-  for(int d=0; d<m_pointClouds.count(); d++)
-    m_vData += m_pointClouds[d]->vData();
-
-
-  int ntiles = m_vData.count();
-
-  int maxwd = 0;
-  for(int i=0; i<ntiles; i++)
-    maxwd = qMax(maxwd, m_vData[i].count());
-
-
-  if (m_visibilityMap) delete [] m_visibilityMap;
-  m_visibilityMap = new uchar[maxwd*ntiles];
-  memset(m_visibilityMap, 0, maxwd*ntiles);
-    
-  for(int i=0; i<ntiles; i++)
-    {
-      QList<uchar> vS = m_vData[i];
-      
-      for(int k=0; k<vS.count(); k++)
-	m_visibilityMap[i*maxwd + k] = vS[k];
-    }
-
+  // node ranges sent with vboLoaded point into this build,
+  // so changed rows are uploaded once the points arrive
+  m_visibilityMap.update(m_pointClouds);
+}
 
-  GLuint target = GL_TEXTURE_RECTANGLE;
-  glActiveTexture(GL_TEXTURE3);
-    glBindTexture(target, m_visibilityTex);
-  glTexParameterf(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); 
-  glTexParameterf(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); 
-  glTexParameterf(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexImage2D(target,
-	       0,
-	       GL_RGBA8,
-	       maxwd/4, ntiles,
-	       0,
-	       GL_RGBA,
-	       GL_UNSIGNED_BYTE,
-	       m_visibilityMap); 
+void
+Viewer::setNodeRanges(int vbo, QVector<NodeRange> ranges)
+{
+  QMutexLocker locker(&m_nodeRangeMutex);
+  m_nodeRanges[vbo] = ranges;
+}
 
+void
+Viewer::mapVBOLoaded(int time, qint64 npts)
+{
+  m_mapVboTime = time;
+  m_mapVbPoints = npts;
 }
 
 void
@@ -3852,6 +4917,23 @@ Viewer::linkClicked(QMouseEvent *event)
 
 //-----------------------------------------------------------
 //-----------------------------------------------------------
+//--------------------------------------------
+// desktop reselection after the adaptive budget changed,
+// not while the camera is being moved
+//--------------------------------------------
+void
+Viewer::applyDrawBudget()
+{
+  if (m_vrMode && m_vr.vrEnabled())
+    return;
+
+  if (camera()->frame()->isManipulated())
+    return;
+
+  genDrawNodeList();
+  update();
+}
+
 void
 Viewer::genDrawNodeListForVR()
 {
@@ -3859,6 +4941,7 @@ Viewer::genDrawNodeListForVR()
   
   m_volume->setNewLoad(true);
 
+  TRACE_INSTANT("request updateView");
   emit updateView();
 
   emit message("viewer - update view");
@@ -3867,9 +4950,17 @@ Viewer::genDrawNodeListForVR()
 void
 Viewer::saveTopJson(QString jsonfile)
 {
+  // keep the other settings, only the budget changes here
   QJsonObject jsonMod;
+  QFile loadFile(jsonfile);
+  if (loadFile.open(QIODevice::ReadOnly))
+    {
+      QJsonDocument loadDoc(QJsonDocument::fromJson(loadFile.readAll()));
+      jsonMod = loadDoc.object();
+      loadFile.close();
+    }
 
-  QJsonObject jsonInfo;
+  QJsonObject jsonInfo = jsonMod["top"].toObject();
 
   qint64 million = 1000000; 
   int pb = m_pointBudget/million;
@@ -3915,6 +5006,66 @@ Viewer::loadTopJson(QString jsonfile)
 	  if (hs == "oculus") m_headSetType = 2;
 	}
 
+      // optional cache of decoded LAS/LAZ nodes, size in GB
+      if (jsonInfo.contains("node_cache"))
+	{
+	  qint64 cacheSize = 20;
+	  if (jsonInfo.contains("node_cache_size"))
+	    cacheSize = jsonInfo["node_cache_size"].toInt();
+	  NodeCache::setCacheDir(jsonInfo["node_cache"].toString(),
+				 cacheSize*1024*1024*1024);
+	}
+
+      // per stage timings, written every few seconds
+      if (jsonInfo.contains("frame_timing_log"))
+	{
+	  FrameTimer::setLogFile(jsonInfo["frame_timing_log"].toString());
+	  FrameTimer::setEnabled(FrameTimer::logging());
+	}
+
+      // memory counters, written every few seconds
+      if (jsonInfo.contains("memory_log"))
+	MemoryStats::setLogFile(jsonInfo["memory_log"].toString());
+
+#ifdef USE_TRACE
+      // trace events for Perfetto / chrome://tracing
+      if (jsonInfo.contains("trace_file"))
+	Tracer::setFile(jsonInfo["trace_file"].toString());
+#endif
+
+      // head poses for replaying a session in loaderbench
+      if (jsonInfo.contains("pose_log"))
+	m_vr.setPoseLog(jsonInfo["pose_log"].toString());
+
+      // 2 or 4 computes soft shadows and edges at half or
+      // quarter resolution and upsamples them
+      if (jsonInfo.contains("shadow_scale"))
+	{
+	  int ss = jsonInfo["shadow_scale"].toInt();
+	  m_shadowScale = (ss >= 4 ? 4 : (ss >= 2 ? 2 : 1));
+	}
+
+      // lower or raise the number of points drawn to hold the
+      // frame time, within the point_budget buffers
+      if (jsonInfo.contains("adaptive_budget"))
+	m_budgetControl.setEnabled(jsonInfo["adaptive_budget"].toBool());
+
+      // in VR first lower the resolution of the point passes,
+      // down to min_render_scale, before cutting the budget
+      if (jsonInfo.contains("adaptive_resolution"))
+	m_adaptiveResolution = jsonInfo["adaptive_resolution"].toBool();
+      if (jsonInfo.contains("min_render_scale"))
+	m_minRenderScale = jsonInfo["min_render_scale"].toDouble();
+
+      // desktop frame time for adaptive_budget, VR aims for 90Hz
+      if (jsonInfo.contains("target_frame_ms"))
+	m_targetFrameMs = qMax(1.0, jsonInfo["target_frame_ms"].toDouble());
+
+      // skip refining octree nodes hidden behind nearer points
+      // in the previous frame, on by default
+      if (jsonInfo.contains("occlusion_culling"))
+	m_hiZMap.setEnabled(jsonInfo["occlusion_culling"].toBool());
+
     }
 
   if (m_pointBudget < million)
@@ -3947,6 +5098,9 @@ Viewer::updateLookFrom(Vec pos, Quaternion rot, int ct)
 
   emit timeStepChanged(m_currTime);
 
+  m_hiZMap.clear();
+  HeightField::clear();
+
   m_vboLoadedAll = false;
   QMouseEvent dummyEvent(QEvent::MouseButtonRelease,
 			 QPointF(0,0),
@@ -12,13 +12,25 @@ using namespace qglviewer;
 #include <QTime>
 #include <QKeyEvent>
 #include <QMouseEvent>
+#include <QMutex>
 
 #include "volumefactory.h"
+#include "visibilitymap.h"
+#include "hizmap.h"
+#include "budgetcontroller.h"
+#include "pointpicker.h"
+#include "mapcache.h"
 
 #ifdef USE_GLMEDIA
 #include "glmedia.h"
 #endif // USE_GLMEDIA
 
+// deepest octree level drawn into the VR map, root is 0,
+// and the most points the map buffer holds, shallower
+// levels only when all of a level does not fit
+#define MAP_MAX_LEVEL 3
+#define MAP_POINT_BUDGET 4000000
+
 //-------------------------------
 // VR
 //-------------------------------
@@ -41,6 +53,9 @@ class Viewer : public QGLViewer
 
   qint64 pointBudget() { return m_pointBudget; }
 
+  // points to select, below pointBudget with adaptive_budget
+  qint64 drawBudget() { return m_budgetControl.budget(); }
+
   void draw();
   void fastDraw();
   
@@ -75,8 +90,15 @@ class Viewer : public QGLViewer
 
   void setNearFar(float n, float f) { m_nearDist = n; m_farDist = f; }
 
+  // depth pyramid of an earlier frame for node selection
+  HiZTest occlusionTest() { return m_hiZMap.test(); }
+
   Vec menuCamPos();
 
+  // front most drawn point within tolConst + tolSlope*distance
+  // of a ray, works from the decoded points without drawing
+  bool pickPoint(Vec, Vec, float, float, Vec&);
+
   bool editMode() { return m_editMode; }
 
   void setEditMode(bool);
@@ -108,12 +130,16 @@ class Viewer : public QGLViewer
 
   QList<PointCloud*> pointCloudList() { return m_pointClouds; }
 
+  // called from the loader thread before vboLoaded
+  void setNodeRanges(int, QVector<NodeRange>);
+
   public slots :
     void GlewInit();
     void showBox(bool);
 
     void vboLoaded(int, qint64);
     void vboLoadedAll(int, qint64);
+    void mapVBOLoaded(int, qint64);
 
     void meshLoadedAll();
     
@@ -123,6 +149,7 @@ class Viewer : public QGLViewer
 
     void updateFramerate();
     void setPointBudget(int);
+    void applyDrawBudget();
 
     bool setVRMode(bool);
     bool vrMode() { return m_vrMode; }
@@ -149,6 +176,7 @@ class Viewer : public QGLViewer
     void bbupdated(Vec, Vec);
     void loadPointsToVBO();
     void setVBOs(GLuint, GLuint);
+    void setMapVBO(GLuint);
     void setVisTex(GLuint);
     void stopLoading();
     void framesPerSecond(float);
@@ -186,7 +214,19 @@ class Viewer : public QGLViewer
 
 
     GLhandleARB m_shadowShader;
-    GLint m_shadowParm[10];
+    GLint *m_shadowParm;
+    // shadow pass variants, index stereo | upsample<<1, [0] is m_shadowShader
+    GLhandleARB m_shadowShaders[4];
+    GLint m_shadowParms[4][15];
+
+    // soft shadows and edges at 1/m_shadowScale resolution
+    int m_shadowScale;
+    int m_lowresWd, m_lowresHt;
+    GLuint m_lowresBuffer;
+    GLuint m_lowresTex[2]; // reduced depth, shadow terms
+    // downsample, downsample from stereo layer, occlusion
+    GLhandleARB m_occlusionShaders[3];
+    GLint m_occlusionParms[3][10];
 
     GLhandleARB m_smoothShader;
     GLint m_smoothParm[10];
@@ -197,6 +237,7 @@ class Viewer : public QGLViewer
     bool m_skybox;
     bool m_flyMode;
     bool m_showInfo;
+    bool m_showFrameTiming;
     bool m_showPoints;
     bool m_showBox;
     int m_pointSize;
@@ -223,7 +264,18 @@ class Viewer : public QGLViewer
     QList<Vec> m_colorGrad;
 
     GLhandleARB m_depthShader;
-    GLint m_depthParm[50];
+    GLint *m_depthParm;
+    // drawpoints variants, index
+    // adaptive | shadows<<1 | xform<<2 | stereo<<3 | position only<<4
+    GLhandleARB m_depthShaders[32];
+    GLint m_depthParms[32][50];
+
+    // VR points for both eyes in one pass into 2 layer textures
+    bool m_stereoPoints;
+    GLuint m_stereoBuffer;
+    GLuint m_stereoTex[3]; // color, depth info, depth attachment
+    GLuint m_stereoUBO;    // eye matrices
+    int m_eyeInstances;
 
     GLhandleARB m_blurShader;
     GLint m_blurParm[20];
@@ -257,7 +309,30 @@ class Viewer : public QGLViewer
     float *m_minmaxMap;
 
     GLuint m_visibilityTex;
-    uchar *m_visibilityMap;
+    VisibilityMap m_visibilityMap;
+    bool m_visTexPending;
+
+    HiZMap m_hiZMap;
+    MapCache m_mapCache;
+    HiZTest m_occlusionTest;
+
+    PointPicker m_pointPicker;
+
+    BudgetController m_budgetControl;
+    float m_targetFrameMs;
+
+    // VR point passes drawn at a fraction of the eye resolution
+    bool m_adaptiveResolution;
+    float m_minRenderScale;
+    float m_renderScale;
+
+    QMutex m_nodeRangeMutex;
+    QVector<NodeRange> m_nodeRanges[2];
+
+    // coarse levels of all tiles for the VR map, for one step
+    GLuint m_mapVertexBuffer;
+    qint64 m_mapVbPoints;
+    int m_mapVboTime;
 
     int m_origWidth;
     int m_origHeight;
@@ -311,6 +386,12 @@ class Viewer : public QGLViewer
     void drawPointsWithReload();
     void drawPoints(vr::Hmd_Eye);
     void drawPointsWithShadows(vr::Hmd_Eye);
+    void drawPointsStereo();
+    void createStereoFBO(int, int);
+    void createLowResFBO(int, int);
+    bool lowResShadows(bool, bool);
+    void drawLowResShadows(bool, int, int, int, bool, bool, float, float);
+    GLint* useShadowShader(bool, bool, float renderScale=1.0f);
     
     void reset();
 
@@ -319,6 +400,7 @@ class Viewer : public QGLViewer
     void drawInfo();
 
     void createShaders();
+    bool useDepthShader(bool, bool, bool, bool stereo=false);
 
     void drawGeometry();
 
@@ -327,6 +409,7 @@ class Viewer : public QGLViewer
     void loadNodeData();
 
     void drawVAO();
+    void drawMapVAO();
 
     bool isVisible(Vec, Vec);
     bool isVisible(Vec, Vec,
@@ -334,6 +417,7 @@ class Viewer : public QGLViewer
 
     void genDrawNodeList();
     bool genDrawNodeList(float, float);
+    void addPartialNode(OctreeNode*);
     void orderTilesForCamera();
 
 
@@ -355,13 +439,15 @@ class Viewer : public QGLViewer
     void dummydraw();
 
     bool linkClicked(QMouseEvent*);
+    bool pointUnderPixel(QPoint, Vec&);
 
-    void generateFirstImage();
+    void generateFirstImage(int);
 
     void loadTopJson(QString);
     void saveTopJson(QString);
 
     void stickLabelsToGround();
+    QString mapCacheKey();
 
     void rotatePointCloud(QMouseEvent*, QPoint);
     void movePointCloud(QPoint);
@@ -0,0 +1,288 @@
+#include "visibilitymap.h"
+#include "pointcloud.h"
+#include "octreenode.h"
+
+#include <QtAlgorithms>
+
+// row width is rounded up to this many bytes so that
+// small growth does not reallocate the texture
+#define VISIBILITYMAP_ROW_STEP 1024
+
+VisibilityMap::VisibilityMap()
+{
+  m_map = 0;
+  clear();
+}
+
+VisibilityMap::~VisibilityMap()
+{
+  clear();
+}
+
+void
+VisibilityMap::clear()
+{
+  if (m_map) delete [] m_map;
+  m_map = 0;
+
+  m_ntiles = m_width = 0;
+  m_texTiles = m_texWidth = 0;
+
+  m_clouds.clear();
+  m_version.clear();
+  m_rowBytes.clear();
+  m_dirtyRows.clear();
+  m_dirtyBytes.clear();
+  m_fullUpload = false;
+}
+
+bool
+VisibilityMap::update(QList<PointCloud*> pointClouds)
+{
+  int ntiles = 0;
+  int maxwd = 0;
+  for(int d=0; d<pointClouds.count(); d++)
+    {
+      const QVector< QVector<uchar> > &vData = pointClouds[d]->vData();
+      ntiles += vData.count();
+      for(int i=0; i<vData.count(); i++)
+	maxwd = qMax(maxwd, vData[i].count());
+    }
+
+  if (ntiles == 0 || maxwd == 0)
+    return false;
+
+  // a different set of tiles moves rows around, start afresh
+  bool rebuild = (pointClouds != m_clouds ||
+		  ntiles != m_ntiles ||
+		  maxwd > m_width);
+  if (rebuild)
+    {
+      int width = ((maxwd + VISIBILITYMAP_ROW_STEP-1)/VISIBILITYMAP_ROW_STEP)*
+	          VISIBILITYMAP_ROW_STEP;
+      if (!m_map || ntiles != m_ntiles || width != m_width)
+	{
+	  if (m_map) delete [] m_map;
+	  m_map = new uchar[width*ntiles];
+	  m_ntiles = ntiles;
+	  m_width = width;
+	}
+      memset(m_map, 0, m_width*m_ntiles);
+
+      m_clouds = pointClouds;
+      m_version.fill(0, ntiles);
+      m_rowBytes.fill(0, ntiles);
+      m_dirtyBytes.fill(0, ntiles);
+      m_dirtyRows.clear();
+      m_fullUpload = true;
+    }
+
+  int row = 0;
+  for(int d=0; d<pointClouds.count(); d++)
+    {
+      const QVector< QVector<uchar> > &vData = pointClouds[d]->vData();
+      const QVector<uint> &version = pointClouds[d]->vDataVersion();
+      for(int i=0; i<vData.count(); i++, row++)
+	{
+	  if (!rebuild && m_version[row] == version[i])
+	    continue;
+
+	  const QVector<uchar> &vS = vData[i];
+	  uchar *vmap = m_map + row*m_width;
+	  memcpy(vmap, vS.constData(), vS.count());
+	  // clear what is left of a longer previous row
+	  int wd = qMax(m_rowBytes[row], vS.count());
+	  if (wd > vS.count())
+	    memset(vmap + vS.count(), 0, wd - vS.count());
+
+	  m_version[row] = version[i];
+	  m_rowBytes[row] = vS.count();
+
+	  if (!m_fullUpload)
+	    {
+	      if (m_dirtyBytes[row] == 0)
+		m_dirtyRows << row;
+	      m_dirtyBytes[row] = qMax(m_dirtyBytes[row], qMax(wd, 4));
+	    }
+	}
+    }
+
+  return pending();
+}
+
+void
+VisibilityMap::upload(GLuint visibilityTex)
+{
+  if (!pending())
+    return;
+
+  GLuint target = GL_TEXTURE_RECTANGLE;
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(target, visibilityTex);
+
+  if (m_fullUpload ||
+      m_texTiles != m_ntiles ||
+      m_texWidth != m_width)
+    {
+      glTexParameterf(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); 
+      glTexParameterf(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); 
+      glTexParameterf(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+      glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexImage2D(target,
+		   0,
+		   GL_RGBA8UI,
+		   m_width/4, m_ntiles,
+		   0,
+		   GL_RGBA_INTEGER,
+		   GL_UNSIGNED_BYTE,
+		   m_map);
+      m_texTiles = m_ntiles;
+      m_texWidth = m_width;
+    }
+  else
+    {
+      // only the used part of each changed row is sent
+      for(int i=0; i<m_dirtyRows.count(); i++)
+	{
+	  int row = m_dirtyRows[i];
+	  glTexSubImage2D(target,
+			  0,
+			  0, row,
+			  m_dirtyBytes[row]/4, 1,
+			  GL_RGBA_INTEGER,
+			  GL_UNSIGNED_BYTE,
+			  m_map + row*m_width);
+	}
+    }
+
+  for(int i=0; i<m_dirtyRows.count(); i++)
+    m_dirtyBytes[m_dirtyRows[i]] = 0;
+  m_dirtyRows.clear();
+  m_fullUpload = false;
+}
+
+//--------------------------------------------
+// nodes missing from the last visibility build
+// fall back to the walk from the tile root
+//--------------------------------------------
+void
+NodeRange::setWalkStart(OctreeNode *node)
+{
+  Vec c(0,0,0);
+  int level = 0;
+  offset = 0;
+  if (node->visOffset() >= 0)
+    {
+      c = node->visCorner();
+      level = node->visDepth();
+      offset = node->visOffset();
+    }
+  corner[0] = c.x;
+  corner[1] = c.y;
+  corner[2] = c.z;
+  corner[3] = level;
+}
+
+//--------------------------------------------
+// integer walk as in the vertex shader, children are
+// numbered 4x+2y+z and stored after the jump in mask order
+//--------------------------------------------
+float
+VisibilityMap::rowLOD(const QVector<uchar> &row, Vec omin, Vec omax, Vec opos)
+{
+  if (opos.x < omin.x || opos.y < omin.y || opos.z < omin.z ||
+      opos.x > omax.x || opos.y > omax.y || opos.z > omax.z)
+    return 10.0;
+
+  Vec osize = omax-omin;
+  Vec pos = opos-omin;
+  Vec offset(0,0,0);
+  int ioffset = 0;
+  float depth = 0;
+
+  for(int i=0; i<20; i++)
+    {
+      if (4*ioffset+3 >= row.count())
+	return depth;
+
+      Vec nsal = osize/(1 << i);
+      Vec p = pos-offset;
+      uint ix = (p.x >= 0.5*nsal.x) ? 1 : 0;
+      uint iy = (p.y >= 0.5*nsal.y) ? 1 : 0;
+      uint iz = (p.z >= 0.5*nsal.z) ? 1 : 0;
+      uint index = (ix << 2) | (iy << 1) | iz;
+
+      const uchar *value = row.constData() + 4*ioffset;
+      uint mask = value[0];
+      if (mask & (1u << index))
+	{
+	  ioffset += value[1] + qPopulationCount(mask & ((1u << index) - 1u));
+	  depth ++;
+	}
+      else
+	{
+	  if (value[3] & 1) // leaf node
+	    depth = qMax(depth, (float)value[2]);
+	  float fill = (value[3] >> 1)/127.0;
+	  if (fill > 0.0)
+	    depth -= 1.0 - fill;
+	  return depth;
+	}
+
+      offset += 0.5*Vec(ix*nsal.x, iy*nsal.y, iz*nsal.z);
+    }
+
+  return depth;
+}
+
+float
+VisibilityMap::nodeLOD(OctreeNode *tile, Vec pos)
+{
+  if (!tile->inBox(pos))
+    return 10.0;
+
+  if (!tile->isActive())
+    return 0;
+
+  OctreeNode *node = tile;
+  float depth = 0;
+  while (node)
+    {
+      OctreeNode *next = 0;
+      for(int k=0; k<8 && !next; k++)
+	{
+	  OctreeNode *cnode = node->getChild(k);
+	  if (cnode && cnode->isActive() && cnode->inBox(pos))
+	    next = cnode;
+	}
+      if (next)
+	{
+	  node = next;
+	  depth ++;
+	  continue;
+	}
+
+      if (node->isLeaf())
+	{
+	  float maxVisLevel = node->maxVisibleLevel();
+	  OctreeNode *parent = node->parent();
+	  if (parent)
+	    {
+	      for (int k=0; k<8; k++)
+		{
+		  OctreeNode *cnode = parent->getChild(k);
+		  if (cnode && cnode->isActive())
+		    maxVisLevel = qMax(maxVisLevel, (float)cnode->maxVisibleLevel());
+		}
+	    }
+	  depth = qMax(depth, maxVisLevel);
+	}
+      float fill = node->drawFill()/127.0;
+      if (fill > 0.0)
+	depth -= 1.0 - fill;
+      return depth;
+    }
+
+  return depth;
+}
@@ -0,0 +1,83 @@
+#ifndef VISIBILITYMAP_H
+#define VISIBILITYMAP_H
+
+#include <GL/glew.h>
+
+#include <QGLViewer/vec.h>
+using namespace qglviewer;
+
+#include <QList>
+#include <QVector>
+
+class PointCloud;
+class OctreeNode;
+
+//--------------------------------------------
+// Points of one node in the point buffer along with where
+// the vertex shader starts its octree walk for them, so the
+// levels above the node are not walked for every point.
+//--------------------------------------------
+struct NodeRange
+{
+  qint64 start, npts;
+  OctreeNode *node;
+  float corner[4]; // node corner as fraction of tile box, w level
+  float offset;    // texel of the node in its tile row
+
+  void setWalkStart(OctreeNode*);
+};
+
+//--------------------------------------------
+// CPU copy of the visibility texture, one row per tile
+// over all point clouds, 4 bytes (one RGBA texel) per node.
+// The flat buffer and the texture are only reallocated when
+// the tiles no longer fit, otherwise just the rows whose
+// version changed since the last update are copied and then
+// uploaded with glTexSubImage2D.
+// The texture is GL_RGBA8UI, texel per node holds
+// r : visible children mask, g : jump to first child,
+// b : max visible level, a : leaf bit and fill fraction.
+//--------------------------------------------
+class VisibilityMap
+{
+ public :
+  VisibilityMap();
+  ~VisibilityMap();
+
+  void clear();
+
+  // copy changed rows from the point clouds,
+  // returns true if anything needs uploading
+  bool update(QList<PointCloud*>);
+
+  // upload pending rows to texture unit 3
+  void upload(GLuint);
+
+  bool pending() { return m_fullUpload || m_dirtyRows.count() > 0; }
+
+  int tiles() { return m_ntiles; }
+  int width() { return m_width; }
+
+  // cpu reference for getLOD in drawpoints.vert,
+  // decodes one tile row for a point in the tile box
+  static float rowLOD(const QVector<uchar>&, Vec, Vec, Vec);
+
+  // same level found by walking the active OctreeNodes
+  // of the tile, used to check the row encoding
+  static float nodeLOD(OctreeNode*, Vec);
+
+ private :
+  uchar *m_map;
+  int m_ntiles, m_width;     // allocated size, width in bytes
+  int m_texTiles, m_texWidth; // size of the texture last allocated
+
+  QList<PointCloud*> m_clouds;
+  QVector<uint> m_version;
+  QVector<int> m_rowBytes;
+
+  QVector<int> m_dirtyRows;
+  QVector<int> m_dirtyBytes; // bytes of a dirty row to send
+  bool m_fullUpload;
+};
+
+#endif
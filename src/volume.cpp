@@ -42,6 +42,7 @@ Volume::Volume() : QObject()
 
 
   m_thread = new QThread();
+  m_thread->setObjectName("VolumeLoaderThread");
   m_lt = new VolumeLoaderThread();
   m_lt->moveToThread(m_thread);
   connect(this, SIGNAL(startLoading()),
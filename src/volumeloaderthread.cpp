@@ -1,4 +1,5 @@
 #include "volumeloaderthread.h"
+#include "tracer.h"
 #include <QMessageBox>
 
 VolumeLoaderThread::VolumeLoaderThread() : QObject()
@@ -30,11 +31,17 @@ VolumeLoaderThread::startLoading()
 {
   m_loading = true;
 
+  TRACE_SCOPE("volumeLoading");
+  TRACE_ARG("trisets", m_trisets.count());
+  TRACE_ARG("pointclouds", m_pointClouds.count());
+
   for(int d=0; d<m_trisets.count(); d++)
     {
       if (m_stopLoading)
 	break;
 
+      TRACE_SCOPE("loadTriset");
+      TRACE_ARG("index", d);
       m_trisets[d]->load();
     }
 
@@ -43,6 +50,8 @@ VolumeLoaderThread::startLoading()
       if (m_stopLoading)
 	break;
 
+      TRACE_SCOPE("loadPointCloud");
+      TRACE_ARG("index", d);
       m_pointClouds[d]->loadAll();
     }
 
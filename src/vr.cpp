@@ -2,14 +2,19 @@
 #include "global.h"
 #include "staticfunctions.h"
 #include "shaderfactory.h"
+#include "memorystats.h"
+#include "heightfield.h"
 
 #include "vr.h"
 #include <QMessageBox>
+#include <QRunnable>
+#include <QMutexLocker>
 #include <QtMath>
 #include <QDir>
 
 #define NEAR_CLIP 0.1f
 #define FAR_CLIP 2.0f
+#define MAP_DEPTH_BUFFERS 4
 
 
 VR::VR() : QObject()
@@ -58,6 +63,17 @@ VR::VR() : QObject()
 
   m_depthBuffer = 0;
 
+  m_mapPbo[0] = m_mapPbo[1] = 0;
+  m_mapFence[0] = m_mapFence[1] = 0;
+  m_mapSlot = 0;
+  m_mapStep[0] = m_mapStep[1] = -1;
+  m_mapPtr[0] = m_mapPtr[1] = 0;
+  m_mapCopied[0] = m_mapCopied[1] = false;
+  m_mapCopyDone = false;
+  m_mapCopyStep = -1;
+  m_menuImageGen = 0;
+  m_mapPool.setMaxThreadCount(1);
+
   m_pinPt = QVector2D(-1,-1);
 
   m_groundHeight = 0.16;
@@ -173,10 +189,19 @@ VR::~VR()
 void
 VR::shutdown()
 {
+  // copy tasks may still read the mapped buffers
+  m_mapPool.waitForDone();
+  for(int i=0; i<2; i++)
+    if (m_mapPtr[i]) unmapMapBuffer(i);
+
   delete m_mapBuffer;
+  if (m_mapPbo[0]) glDeleteBuffers(2, m_mapPbo);
+  for(int i=0; i<2; i++)
+    if (m_mapFence[i]) glDeleteSync(m_mapFence[i]);
   delete m_leftBuffer;
   delete m_rightBuffer;
   delete m_resolveBuffer;
+  MemoryStats::set(MemoryStats::VRBuffers, 0);
   
   if (m_hmd)
     {
@@ -301,6 +326,18 @@ VR::initVR()
   mapbuffFormat.setSamples(0);  
   m_mapBuffer = new QOpenGLFramebufferObject(m_eyeWidth, m_eyeHeight, mapbuffFormat);
 
+  // map colour and depth are read back through these
+  glGenBuffers(2, m_mapPbo);
+  for(int i=0; i<2; i++)
+    {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, m_mapPbo[i]);
+      glBufferData(GL_PIXEL_PACK_BUFFER,
+		   (qint64)m_eyeWidth*m_eyeHeight*8,
+		   0,
+		   GL_STREAM_READ);
+    }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
 
   QOpenGLFramebufferObjectFormat buffFormat;
   buffFormat.setAttachment(QOpenGLFramebufferObject::Depth);
@@ -314,6 +351,11 @@ VR::initVR()
   buffFormat.setSamples(0);
   
   m_resolveBuffer = new QOpenGLFramebufferObject(m_eyeWidth*2, m_eyeHeight, resolveFormat);
+
+  // map rgba8+depth, 8 sample rgba16f+depth per eye, rgba8 resolve,
+  // two map readback buffers
+  MemoryStats::set(MemoryStats::VRBuffers,
+		   (qint64)m_eyeWidth*m_eyeHeight*(8 + 2*8*12 + 2*4 + 2*8));
   //-----------------------------
   
 
@@ -419,6 +461,52 @@ VR::updatePoses()
     {
         m_hmdPose = m_matrixDevicePose[vr::k_unTrackedDeviceIndex_Hmd].inverted();
     }
+
+    if (m_poseLog.isOpen())
+      writePoseLog();
+}
+
+void
+VR::setPoseLog(QString flnm)
+{
+  if (m_poseLog.isOpen())
+    m_poseLog.close();
+
+  if (flnm.isEmpty())
+    return;
+
+  m_poseLog.setFileName(flnm);
+  if (!m_poseLog.open(QIODevice::WriteOnly | QIODevice::Text))
+    return;
+
+  m_poseLogTimer.start();
+}
+
+//--------------------------------------------
+// one line per frame :
+// milliseconds, hmd position, modelview (row major)
+// same values GLHiddenWidget uses for the LOD selection
+//--------------------------------------------
+void
+VR::writePoseLog()
+{
+  QVector3D hp = vrHmdPosition();
+  QMatrix4x4 mv = modelView();
+
+  // 9 significant digits read back to the same float
+  QString line = QString("%1 %2 %3 %4").\
+		   arg(m_poseLogTimer.elapsed()).\
+		   arg(hp.x(), 0, 'g', 9).\
+		   arg(hp.y(), 0, 'g', 9).\
+		   arg(hp.z(), 0, 'g', 9);
+  for(int r=0; r<4; r++)
+    for(int c=0; c<4; c++)
+      line += QString(" %1").arg(mv(r,c), 0, 'g', 9);
+  line += "\n";
+
+  // handed to the OS every frame so a crash keeps the tail
+  m_poseLog.write(line.toLatin1());
+  m_poseLog.flush();
 }
 
 bool
@@ -991,42 +1079,30 @@ VR::rightTouchMove()
 
   //------------------  
   // keep head above ground
-  if (m_showMap && m_depthBuffer)
+  if (m_showMap)
     {
-      int wd = screenWidth();
-      int ht = screenHeight();
-
       QVector3D hpos = hmdPosition();
-      QVector3D hp = Global::menuCamProjectedCoordinatesOf(hpos);
-      int dx = hp.x();
-      int dy = hp.y();
-
-      if (dx > 0 && dx < wd-1 &&
-	  dy > 0 && dy < ht-1)
+      QVector3D hitP;
+      if (groundBelow(hpos, hitP))
 	{
-	  float z = m_depthBuffer[(ht-1-dy)*wd + dx];
-	  if (z > 0.0 && z < 1.0)
+	  float sf = m_teleportScale/m_scaleFactor;
+	  QVector3D pos = hitP+QVector3D(0,0,m_groundHeight*sf); // raise the height
+
+	  if (m_gravity && // stick close to ground
+	      pos.z() > hpos.z()) // push it above the ground
 	    {
-	      float sf = m_teleportScale/m_scaleFactor;
-	      QVector3D hitP = Global::menuCamUnprojectedCoordinatesOf(QVector3D(dx, dy, z));
-	      QVector3D pos = hitP+QVector3D(0,0,m_groundHeight*sf); // raise the height
-
-	      if (m_gravity && // stick close to ground
-		  pos.z() > hpos.z()) // push it above the ground
-		{
-		  float mup = (m_final_xform.map(pos)-m_final_xform.map(hpos)).y();
-
-		  // move only vertically
-		  if (pos.z() > hpos.z())
-		    mup *= 0.1; // move quickly above ground
-		  else
-		    mup*=0.05; // come down slowly
-
-		  QVector3D move(0,mup,0);
-		  m_model_xform.setToIdentity();
-		  m_model_xform.translate(-move);
-		  m_final_xform = m_model_xform * m_final_xform;
-		}
+	      float mup = (m_final_xform.map(pos)-m_final_xform.map(hpos)).y();
+
+	      // move only vertically
+	      if (pos.z() > hpos.z())
+		mup *= 0.1; // move quickly above ground
+	      else
+		mup*=0.05; // come down slowly
+
+	      QVector3D move(0,mup,0);
+	      m_model_xform.setToIdentity();
+	      m_model_xform.translate(-move);
+	      m_final_xform = m_model_xform * m_final_xform;
 	    }
 	}
     }
@@ -2314,23 +2390,10 @@ VR::updateScale(int scl)
 
   if (m_showMap)
     {
-      QVector3D hpos = hmdPosition();
-      QVector3D hp = Global::menuCamProjectedCoordinatesOf(hpos);    
-      int dx = hp.x();
-      int dy = hp.y();
-      int wd = screenWidth();
-      int ht = screenHeight();
-      if (dx > 0 && dx < wd-1 &&
-	  dy > 0 && dy < ht-1)
-	{
-	  float z = m_depthBuffer[(ht-1-dy)*wd + dx];
-	  if (z > 0.0 && z < 1.0)
-	    {
-	      // pivot point for scaling is the ground
-	      cen = Global::menuCamUnprojectedCoordinatesOf(QVector3D(dx, dy, z));
-	      cen = m_final_xform.map(cen);
-	    }
-	}
+      // pivot point for scaling is the ground
+      QVector3D ground;
+      if (groundBelow(hmdPosition(), ground))
+	cen = m_final_xform.map(ground);
     }
 
   m_model_xform.translate(cen);
@@ -2400,31 +2463,251 @@ VR::renderMenu(vr::Hmd_Eye eye)
   m_leftMenu.draw(mvp, matL, m_triggerActiveRight);
 }
 
+//--------------------------------------------
+// copies a finished readback out of its mapped pixel buffer,
+// rows come bottom up, on the map thread
+//--------------------------------------------
+class MapCopyTask : public QRunnable
+{
+ public :
+  VR *vr;
+  int slot, step, wd, ht;
+  const uchar *ptr;
+
+  void run()
+  {
+    qint64 npix = (qint64)wd*ht;
+
+    // reuse a depth buffer nobody holds on to any more, maps
+    // stay shared with the map cache until it lets them go
+    QVector<float> depth;
+    {
+      QMutexLocker lock(&vr->m_mapMutex);
+      for(int i=0; i<vr->m_mapDepthPool.count(); i++)
+	{
+	  if (vr->m_mapDepthPool[i].isDetached() &&
+	      vr->m_mapDepthPool[i].count() == npix)
+	    {
+	      depth = vr->m_mapDepthPool.takeAt(i);
+	      break;
+	    }
+	}
+    }
+    if (depth.count() != npix)
+      depth.resize(npix);
+    memcpy(depth.data(), ptr + npix*4, npix*sizeof(float));
+
+    QImage image(wd, ht, QImage::Format_RGBA8888_Premultiplied);
+    for(int y=0; y<ht; y++)
+      memcpy(image.scanLine(ht-1-y), ptr + (qint64)y*wd*4, wd*4);
+
+    QMutexLocker lock(&vr->m_mapMutex);
+    vr->m_mapCopied[slot] = true;
+    vr->m_mapCopyDone = true;
+    vr->m_mapCopyStep = step;
+    vr->m_mapCopyImage = image;
+    vr->m_mapCopyDepth = depth;
+    if (vr->m_mapDepthPool.count() < MAP_DEPTH_BUFFERS)
+      vr->m_mapDepthPool << depth;
+  }
+};
+
+//--------------------------------------------
+// menu image for the map, uploaded once done
+//--------------------------------------------
+class MapComposeTask : public QRunnable
+{
+ public :
+  VR *vr;
+  int gen;
+  QImage image;
+
+  void run()
+  {
+    QImage menuImage = Map::composeImage(image);
+
+    QMutexLocker lock(&vr->m_mapMutex);
+    // a newer map was set meanwhile
+    if (gen == vr->m_menuImageGen)
+      vr->m_menuImage = menuImage;
+  }
+};
+
+//--------------------------------------------
+// Queue the map colour and depth into a pixel buffer instead of
+// reading them back straight away. collectMapImage picks them up
+// once the copy has finished, together with the time step the map
+// was drawn for. A read still in flight when its slot comes round
+// again is dropped.
+//--------------------------------------------
 void
-VR::menuImageFromMapBuffer()
+VR::menuImageFromMapBuffer(int step)
 {
   m_mapBuffer->release();
 
-
-  if (m_depthBuffer)
-    delete [] m_depthBuffer;
- 
   int wd = screenWidth();
   int ht = screenHeight();
-  m_depthBuffer = new float[wd*ht];
+
+  int slot = m_mapSlot;
+  if (m_mapFence[slot])
+    glDeleteSync(m_mapFence[slot]);
+  m_mapFence[slot] = 0;
+
+  // still being copied out, rare as maps are far apart
+  if (m_mapPtr[slot])
+    {
+      m_mapPool.waitForDone();
+      unmapMapBuffer(slot);
+    }
 
   glBindFramebuffer(GL_READ_FRAMEBUFFER, m_mapBuffer->handle());
   glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_mapPbo[slot]);
+  glReadPixels(0, 0,
+	       wd, ht,
+	       GL_RGBA,
+	       GL_UNSIGNED_BYTE,
+	       0);
   glReadPixels(0, 0,
 	       wd, ht,
 	       GL_DEPTH_COMPONENT,
 	       GL_FLOAT,
-	       m_depthBuffer);
+	       (void*)((qint64)wd*ht*4));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 
-  QImage img = m_mapBuffer->toImage(true);
-  m_leftMenu.setImage(img);
-	
-  m_mapBuffer->release();
+  m_mapFence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  m_mapStep[slot] = step;
+  m_mapSlot = 1-slot;
+}
+
+void
+VR::unmapMapBuffer(int slot)
+{
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_mapPbo[slot]);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  QMutexLocker lock(&m_mapMutex);
+  m_mapPtr[slot] = 0;
+  m_mapCopied[slot] = false;
+}
+
+//--------------------------------------------
+// Nothing is copied here. Finished readbacks are mapped and
+// handed to the map thread, buffers it is done with are unmapped,
+// and a menu image composed since the last frame is uploaded.
+//--------------------------------------------
+bool
+VR::collectMapImage(int &step, QImage &image, QVector<float> &depth)
+{
+  int wd = screenWidth();
+  int ht = screenHeight();
+  qint64 npix = (qint64)wd*ht;
+
+  //-----------------------------------
+  // copied out, give the buffers back
+  for(int slot=0; slot<2; slot++)
+    {
+      bool copied;
+      {
+	QMutexLocker lock(&m_mapMutex);
+	copied = m_mapCopied[slot];
+      }
+      if (m_mapPtr[slot] && copied)
+	unmapMapBuffer(slot);
+    }
+  //-----------------------------------
+
+  //-----------------------------------
+  // older slot first so the newest map wins
+  for(int i=0; i<2; i++)
+    {
+      int slot = (m_mapSlot+i)%2;
+      if (!m_mapFence[slot])
+	continue;
+
+      GLenum status = glClientWaitSync(m_mapFence[slot], 0, 0);
+      if (status != GL_ALREADY_SIGNALED &&
+	  status != GL_CONDITION_SATISFIED)
+	break;
+
+      glDeleteSync(m_mapFence[slot]);
+      m_mapFence[slot] = 0;
+
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, m_mapPbo[slot]);
+      uchar *ptr = (uchar*)glMapBufferRange(GL_PIXEL_PACK_BUFFER,
+					    0, npix*8,
+					    GL_MAP_READ_BIT);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      if (!ptr)
+	continue;
+
+      m_mapPtr[slot] = ptr;
+
+      MapCopyTask *task = new MapCopyTask;
+      task->vr = this;
+      task->slot = slot;
+      task->step = m_mapStep[slot];
+      task->wd = wd;
+      task->ht = ht;
+      task->ptr = ptr;
+      m_mapPool.start(task);
+    }
+  //-----------------------------------
+
+  QMutexLocker lock(&m_mapMutex);
+
+  //-----------------------------------
+  if (!m_menuImage.isNull())
+    {
+      m_leftMenu.setMapTexture(m_menuImage);
+      m_menuImage = QImage();
+    }
+  //-----------------------------------
+
+  if (!m_mapCopyDone)
+    return false;
+
+  step = m_mapCopyStep;
+  image = m_mapCopyImage;
+  depth = m_mapCopyDepth;
+  m_mapCopyDone = false;
+  m_mapCopyImage = QImage();
+  m_mapCopyDepth.clear();
+
+  return true;
+}
+
+//--------------------------------------------
+// depth is shared with the caller, not copied, the menu
+// texture follows on a later frame
+//--------------------------------------------
+void
+VR::setMapImage(QImage image, QVector<float> depth)
+{
+  int wd = screenWidth();
+  int ht = screenHeight();
+  qint64 npix = (qint64)wd*ht;
+
+  // drawn for another eye size
+  if (image.width() != wd || image.height() != ht ||
+      depth.count() != npix)
+    return;
+
+  m_mapDepth = depth;
+  m_depthBuffer = (float*)m_mapDepth.constData();
+
+  m_mapImage = image;
+
+  MapComposeTask *task = new MapComposeTask;
+  task->vr = this;
+  task->image = image;
+  {
+    QMutexLocker lock(&m_mapMutex);
+    task->gen = ++m_menuImageGen;
+  }
+  m_mapPool.start(task);
 
   //-----------------------------------
   // also update teleports if any
@@ -2845,10 +3128,48 @@ VR::renderTeleport(vr::Hmd_Eye eye)
 }
 
 
+//--------------------------------------------
+// ground below a point, from the height field where it
+// has points and from the map depth buffer otherwise
+//--------------------------------------------
+bool
+VR::groundBelow(QVector3D pos, QVector3D &ground)
+{
+  float gz;
+  if (HeightField::height(pos.x(), pos.y(), gz))
+    {
+      ground = QVector3D(pos.x(), pos.y(), gz);
+      return true;
+    }
+
+  if (m_depthBuffer == 0) // no depth buffer found
+    return false;
+
+  int wd = screenWidth();
+  int ht = screenHeight();
+
+  QVector3D hp = Global::menuCamProjectedCoordinatesOf(pos);
+  int dx = hp.x();
+  int dy = hp.y();
+
+  if (dx > 0 && dx < wd-1 &&
+      dy > 0 && dy < ht-1)
+    {
+      float z = m_depthBuffer[(ht-1-dy)*wd + dx];
+      if (z > 0.0 && z < 1.0)
+	{
+	  ground = Global::menuCamUnprojectedCoordinatesOf(QVector3D(dx, dy, z));
+	  return true;
+	}
+    }
+
+  return false;
+}
+
 void
 VR::projectPinPoint()
 {
-  if (!m_showMap || m_depthBuffer == 0) // no depth buffer found
+  if (!m_showMap)
     return;
 
   if (m_leftMenu.pointingToMenu() &&
@@ -2867,11 +3188,19 @@ VR::projectPinPoint()
 	  int x = (1-px)*(wd-1);
 	  int y = py*(ht-1);
 	  
+	  // map is seen from straight above
+	  Vec ppt = Global::menuCamUnprojectedCoordinatesOf(Vec(x, y, 0.5));
+	  float gz;
+	  if (HeightField::height(ppt.x, ppt.y, gz))
+	    {
+	      m_projectedPinPt = QVector3D(ppt.x, ppt.y, gz);
+	      return;
+	    }
+
 	  int dx = (1-px)*(wd-1);
 	  int dy = (1-py)*(ht-1);
-	  float z = m_depthBuffer[dy*wd + dx];
+	  float z = (m_depthBuffer ? m_depthBuffer[dy*wd + dx] : 0);
 	  
-	  Vec ppt;
 	  if (z > 0.0 && z < 1.0)
 	    {
 	      ppt = Vec(x, y, z);
@@ -2892,7 +3221,7 @@ VR::projectPinPoint()
 bool
 VR::nextHit()
 {
-  if (!m_showMap || m_depthBuffer == 0) // we don't have any depth buffer
+  if (!m_showMap)
     return false;
 
   // don't find hit point if we are pointing to a menu
@@ -2910,6 +3239,25 @@ VR::nextHit()
   Vec cenW = Vec(cenV.x(), cenV.y(), cenV.z());
   Vec pinW = Vec(pinV.x(), pinV.y(), pinV.z());
 
+  //---------------------------
+  // exact hit against the ground heights when there are any
+  if (HeightField::valid())
+    {
+      Vec hitP;
+      if (!HeightField::intersect(cenW, pinW-cenW, hitP))
+	return false;
+
+      m_projectedPinPt = QVector3D(hitP.x, hitP.y, hitP.z);
+
+      Vec hitS = Global::menuCamProjectedCoordinatesOf(hitP);
+      m_pinPt = QVector2D(hitS.x/screenWidth(), hitS.y/screenHeight());
+      return true;
+    }
+  //---------------------------
+
+  if (m_depthBuffer == 0) // we don't have any depth buffer
+    return false;
+
   Vec cenP = Global::menuCamProjectedCoordinatesOf(cenW);
   Vec pinP = Global::menuCamProjectedCoordinatesOf(pinW);
 
@@ -9,8 +9,13 @@
 #include <QVector2D>
 #include <QVector3D>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QOpenGLWidget>
 #include <QOpenGLFramebufferObject>
+#include <QImage>
+#include <QVector>
+#include <QMutex>
+#include <QThreadPool>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
@@ -132,7 +137,18 @@ class VR : public QObject
 
 
   void bindMapBuffer();
-  void menuImageFromMapBuffer();
+
+  // readback of the map drawn for a time step
+  void menuImageFromMapBuffer(int);
+
+  // picks up a map copied out of its readback with the time
+  // step it was queued for, false when none is ready yet,
+  // also uploads a menu image composed since the last call
+  bool collectMapImage(int&, QImage&, QVector<float>&);
+
+  // uses the map's depth for the ground straight away and
+  // shows it on the menu once composed
+  void setMapImage(QImage, QVector<float>);
 
   float scaleFactor() { return m_scaleFactor; }
   float flightSpeed() { return m_flightSpeed; }
@@ -156,6 +172,9 @@ class VR : public QObject
 
   void teleport(QVector3D);
 
+  // record head pose every frame for replay benchmarks
+  void setPoseLog(QString);
+
  public slots:
   void resetModel();
   void updateMap();
@@ -186,6 +205,9 @@ class VR : public QObject
   QMatrix4x4 m_rightProjection, m_rightPose;
   QMatrix4x4 m_hmdPose;
 
+  QFile m_poseLog;
+  QElapsedTimer m_poseLogTimer;
+
   QMatrix4x4 m_las_xform;
   QMatrix4x4 m_model_xform;
   QMatrix4x4 m_final_xform;
@@ -277,6 +299,33 @@ class VR : public QObject
   QString m_dataDir;
   float *m_depthBuffer;
 
+  // map readback, rgba8 then float depth per slot
+  GLuint m_mapPbo[2];
+  GLsync m_mapFence[2];
+  int m_mapStep[2];
+  int m_mapSlot;
+  QImage m_mapImage;
+  QVector<float> m_mapDepth; // m_depthBuffer points into it
+
+  // copying out of the mapped pixel buffers and composing the
+  // menu image run on m_mapPool, results are picked up by
+  // collectMapImage on a later frame
+  friend class MapCopyTask;
+  friend class MapComposeTask;
+  QThreadPool m_mapPool;
+  QMutex m_mapMutex;
+  uchar *m_mapPtr[2];      // mapped while the copy task reads it
+  bool m_mapCopied[2];
+  bool m_mapCopyDone;      // newest copy below not yet collected
+  int m_mapCopyStep;
+  QImage m_mapCopyImage;
+  QVector<float> m_mapCopyDepth;
+  QList<QVector<float> > m_mapDepthPool; // free once detached
+  int m_menuImageGen;
+  QImage m_menuImage;      // composed, waiting for upload
+
+  void unmapMapBuffer(int);
+
 
   QList<QVector3D> m_teleports;
   bool m_newTeleportFound;
@@ -321,6 +370,7 @@ class VR : public QObject
 				 vr::TrackedPropertyError *error = 0);
   
   void updatePoses();
+  void writePoseLog();
   bool updateInput();
 
   void ProcessVREvent(const vr::VREvent_t & event);
@@ -428,6 +478,7 @@ class VR : public QObject
 
   QMatrix4x4 initXform(float, float, float, float);
 
+  bool groundBelow(QVector3D, QVector3D&);
   void projectPinPoint();
   bool nextHit();
 
@@ -187,6 +187,7 @@ VrMain::VrMain(QWidget *parent) :
 
   //============================
   m_thread = new QThread();
+  m_thread->setObjectName("LoaderThread");
 
   m_lt = new LoaderThread();
   m_lt->moveToThread(m_thread);
@@ -206,6 +207,9 @@ VrMain::VrMain(QWidget *parent) :
   connect(m_viewer, SIGNAL(setVBOs(GLuint, GLuint)),
 	  m_hiddenGL, SLOT(setVBOs(GLuint, GLuint)));
 
+  connect(m_viewer, SIGNAL(setMapVBO(GLuint)),
+	  m_hiddenGL, SLOT(setMapVBO(GLuint)));
+
   connect(m_viewer, SIGNAL(setVisTex(GLuint)),
 	  m_hiddenGL, SLOT(setVisTex(GLuint)));
   
@@ -222,6 +226,8 @@ VrMain::VrMain(QWidget *parent) :
 	  m_viewer, SLOT(vboLoaded(int, qint64)));
   connect(m_lt, SIGNAL(vboLoadedAll(int, qint64)),
 	  m_viewer, SLOT(vboLoadedAll(int, qint64)));
+  connect(m_lt, SIGNAL(mapVBOLoaded(int, qint64)),
+	  m_viewer, SLOT(mapVBOLoaded(int, qint64)));
   connect(m_lt, &LoaderThread::message,
 	  this, &VrMain::showMessage);
 
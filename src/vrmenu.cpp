@@ -88,6 +88,12 @@ VrMenu::setImage(QImage img)
   ((Map*)(m_menus["00"]))->setImage(img);
 }
 
+void
+VrMenu::setMapTexture(QImage img)
+{
+  ((Map*)(m_menus["00"]))->setTexture(img);
+}
+
 void
 VrMenu::draw(QMatrix4x4 mvp, QMatrix4x4 matL, bool triggerPressed)
 {
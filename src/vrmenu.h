@@ -24,6 +24,7 @@ class VrMenu : public QObject
   void draw(QMatrix4x4, QMatrix4x4, bool);
 
   void setImage(QImage);
+  void setMapTexture(QImage); // already composed by Map::composeImage
 
   void setCurrPos(QVector3D, QVector3D);
 